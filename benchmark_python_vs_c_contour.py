@@ -3,6 +3,8 @@
 Benchmark Python contour implementation vs C extension.
 
 This is the critical test - we need to match or exceed C performance.
+The benchmarks of the C extensions themselves (with json results to track
+regressions) are in src/c/benchmark_extensions.py.
 """
 
 import numpy as np
@@ -0,0 +1,413 @@
+#!/usr/bin/env python3
+"""
+Benchmarks for the CCPN C extensions (contour, peak and clibrary).
+
+Usage:
+    python setup_contour.py build_ext --inplace
+    python setup_peak.py build_ext --inplace
+    python benchmark_extensions.py --output results.json
+    python benchmark_extensions.py --compare baseline.json --tolerance 0.2
+
+Each case is timed as the median of --repeat samples, a sample being enough calls
+to take at least --minTime seconds, after one call to warm up.  The data are
+random but seeded, so the same case does the same work on each run and the times
+of releases can be compared.  --output writes the results (and the python, numpy,
+platform and git commit) as json; --compare reads such a file and exits with 1 if
+the median time of any case has grown by more than --tolerance (as a fraction).
+--filter only runs the cases with names containing any of the given strings and
+--quick only runs the smaller sizes.
+"""
+
+import argparse
+import json
+import os
+import platform
+import statistics
+import subprocess
+import sys
+import time
+import zlib
+
+import numpy as np
+
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+SCHEMA_VERSION = 1
+DEFAULT_REPEAT = 5
+DEFAULT_MIN_TIME = 0.05
+DEFAULT_TOLERANCE = 0.2
+MIN_REGRESSION_SECONDS = 1.0e-4  # ignore changes smaller than this in very fast cases
+
+
+def _importExtension(name):
+    try:
+        if name == 'contour':
+            from ccpnc.contour import Contourer2d as module
+        elif name == 'peak':
+            from ccpnc.peak import Peak as module
+        else:
+            from ccpnc.clibrary import Clibrary as module
+    except ImportError:
+        module = None
+
+    return module
+
+
+#=========================================================================================
+# timing
+#=========================================================================================
+
+def timeCall(func, repeat=DEFAULT_REPEAT, minTime=DEFAULT_MIN_TIME) -> dict:
+    """Return the timing of func() in seconds per call"""
+    func()
+
+    number = 1
+    while True:
+        start = time.perf_counter()
+        for _ in range(number):
+            func()
+        elapsed = time.perf_counter() - start
+        if elapsed >= minTime or number >= 1 << 20:
+            break
+        number *= 2 if elapsed <= 0 else max(2, min(10, int(1.2 * minTime / elapsed) + 1))
+
+    times = [elapsed / number]
+    for _ in range(repeat - 1):
+        start = time.perf_counter()
+        for _ in range(number):
+            func()
+        times.append((time.perf_counter() - start) / number)
+
+    return {'median' : statistics.median(times),
+            'min'    : min(times),
+            'mean'   : statistics.fmean(times),
+            'stdev'  : statistics.stdev(times) if len(times) > 1 else 0.0,
+            'number' : number,
+            'samples': times}
+
+
+#=========================================================================================
+# data
+#=========================================================================================
+
+def gaussianField(shape, npeaks, noise, rng) -> np.ndarray:
+    """float32 array of shape with npeaks random gaussians (heights 0.5 - 1) and noise (standard deviation)"""
+    data = np.zeros(shape, dtype=np.float32)
+    grids = np.ogrid[tuple(slice(0, n) for n in shape)]
+    for _ in range(npeaks):
+        peak = np.float32(rng.uniform(0.5, 1.0))
+        for grid, n in zip(grids, shape):
+            centre = rng.uniform(0, n - 1)
+            width = rng.uniform(1.0, max(1.5, n / 40))
+            peak = peak * np.exp(-0.5 * ((grid - centre) / width) ** 2).astype(np.float32)
+        data += peak
+    if noise:
+        data += rng.normal(0, noise, shape).astype(np.float32)
+
+    return data
+
+
+class _ApiNmrProject:
+    def __init__(self):
+        self.__dict__['resonanceGroups'] = {}
+
+
+class _ApiNmrChain:
+    def __init__(self, nmrProject):
+        self.__dict__.update(isConnected=False, serial=1, mainResonanceGroups=[])
+        self.nmrProject = nmrProject
+
+    @property
+    def mainResonanceGroups(self):
+        return tuple(self.__dict__['mainResonanceGroups'])
+
+
+class _ApiResonanceGroup:
+    def __init__(self, nmrChain, serial, seqCode, relativeOffset=None, mainResonanceGroup=None):
+        self.__dict__.update(serial=serial, seqCode=seqCode, seqInsertCode=None, relativeOffset=relativeOffset)
+        self.nmrChain = nmrChain
+        self.nmrProject = nmrChain.nmrProject
+        self.mainResonanceGroup = mainResonanceGroup or self
+
+
+class _NmrResidue:
+    def __init__(self, apiResonanceGroup):
+        self._wrappedData = apiResonanceGroup
+
+
+def nmrChain(length, rng) -> list:
+    """nmrResidues (standing in for the wrapper objects) of an unconnected nmrChain of length main
+    nmrResidues, sequential as in a typical project, with an i-1 nmrResidue for every other one"""
+    nmrProject = _ApiNmrProject()
+    apiNmrChain = _ApiNmrChain(nmrProject)
+    groups = nmrProject.__dict__['resonanceGroups']
+    nmrResidues = []
+    for seqCode in range(1, length + 1):
+        main = _ApiResonanceGroup(apiNmrChain, len(groups) + 1, seqCode)
+        groups[main.serial] = main
+        apiNmrChain.__dict__['mainResonanceGroups'].append(main)
+        nmrResidues.append(_NmrResidue(main))
+        if seqCode % 2:
+            offset = _ApiResonanceGroup(apiNmrChain, len(groups) + 1, None, -1, main)
+            groups[offset.serial] = offset
+            nmrResidues.append(_NmrResidue(offset))
+    rng.shuffle(nmrResidues)
+
+    return nmrResidues
+
+
+#=========================================================================================
+# cases, each returns a list of (name, params, make) where make(rng) returns (func, work),
+# so that the data of a case are only made if it is run
+#=========================================================================================
+
+def contourCases(quick) -> list:
+    Contourer2d = _importExtension('contour')
+    if Contourer2d is None:
+        return []
+
+    posColour = np.array([1.0, 0.0, 0.0, 1.0], dtype=np.float32)
+    negColour = np.array([0.0, 0.0, 1.0, 1.0], dtype=np.float32)
+
+    def make(rng, size, levels, noise, flatten, planes):
+        planes = tuple(gaussianField((size, size), 20, noise, rng) for _ in range(planes))
+        posLevels = np.geomspace(0.1, 0.9, levels).astype(np.float32)
+        negLevels = -posLevels[: levels // 2]
+
+        def func():
+            return Contourer2d.contourerGLList(planes, posLevels, negLevels, posColour, negColour, int(flatten))
+
+        indexCount, vertexCount = func()[:2]
+        return func, {'indices': int(indexCount), 'vertices': int(vertexCount)}
+
+    cases = []
+    for size in ((128, 512) if quick else (128, 512, 1024, 2048)):
+        for nlevels in ((10,) if quick else (5, 10, 20)):
+            for noise in (0.0, 0.05):
+                for flatten in (False, True):
+                    params = {'size': size, 'levels': nlevels, 'noise': noise, 'flatten': flatten,
+                              'planes': 3 if flatten else 1}
+                    name = f'contour/{size}x{size}/levels={nlevels}/noise={noise}/flatten={int(flatten)}'
+                    cases.append((name, params, lambda rng, params=params: make(rng, **params)))
+
+    return cases
+
+
+def findPeaksCases(quick) -> list:
+    Peak = _importExtension('peak')
+    if Peak is None:
+        return []
+
+    shapes = {2: (512, 512), 3: (64, 128, 128), 4: (16, 32, 48, 48)}
+    if quick:
+        shapes = {2: (256, 256), 3: (32, 64, 64), 4: (8, 16, 24, 24)}
+
+    def make(rng, ndim, shape, nonadjacent, excluded):
+        data = gaussianField(shape, 10 * ndim, 0.02, rng)
+        exclusions = ([], [], [])
+        if excluded:
+            # excludedRegions are (low, high) x ndim and diagonals are |a0 * x0 - a1 * x1 - b| < d, all x first
+            xShape = shape[::-1]
+            exclusions = ([np.array([[n * 0.25 for n in xShape], [n * 0.5 for n in xShape]], dtype=np.float32)],
+                          [np.array([0, 1], dtype=np.int32)],
+                          [np.array([1.0, xShape[0] / xShape[1], 0.0, 2.0], dtype=np.float32)])
+
+        def func():
+            return Peak.findPeaks(data, 1, 1, -0.1, 0.1, [1] * ndim, nonadjacent, 0.0, [0.0] * ndim, *exclusions)
+
+        return func, {'peaks': len(func())}
+
+    cases = []
+    for ndim, shape in shapes.items():
+        for nonadjacent in (0, 1):
+            for excluded in (False, True):
+                params = {'ndim': ndim, 'shape': shape, 'nonadjacent': nonadjacent, 'excluded': excluded}
+                name = f'findPeaks/{"x".join(map(str, shape))}/nonadjacent={nonadjacent}/excluded={int(excluded)}'
+                cases.append((name, params, lambda rng, params=params: make(rng, **params)))
+
+    return cases
+
+
+def fitPeaksCases(quick) -> list:
+    Peak = _importExtension('peak')
+    if Peak is None:
+        return []
+
+    def make(rng, groupSize, method):
+        # a row of overlapping peaks, fitted together in one region (x first)
+        spacing = 6.0
+        nx, ny = int(spacing * (groupSize + 3)), 24
+        positions = np.array([[spacing * (ii + 2) + rng.uniform(-0.5, 0.5), ny / 2 + rng.uniform(-0.5, 0.5)]
+                              for ii in range(groupSize)], dtype=np.float32)
+        y, x = np.ogrid[0:ny, 0:nx]
+        data = np.zeros((ny, nx), dtype=np.float32)
+        for px, py in positions:
+            data += np.exp(-0.5 * (((x - px) / 1.8) ** 2 + ((y - py) / 1.8) ** 2)).astype(np.float32)
+        data += rng.normal(0, 0.01, data.shape).astype(np.float32)
+
+        region = np.array([[0, 0], [nx, ny]], dtype=np.int32)
+        guesses = np.round(positions).astype(np.float32)
+
+        def func():
+            return Peak.fitPeaks(data, region, guesses, method)
+
+        return func, {'peaks': groupSize, 'points': nx * ny}
+
+    cases = []
+    for groupSize in ((1, 4) if quick else (1, 2, 4, 8, 16)):
+        for method, lineshape in enumerate(('gaussian', 'lorentzian')):
+            params = {'groupSize': groupSize, 'method': method}
+            cases.append((f'fitPeaks/group={groupSize}/{lineshape}', params,
+                          lambda rng, params=params: make(rng, **params)))
+
+    return cases
+
+
+def nmrResidueIndexCases(quick) -> list:
+    Clibrary = _importExtension('clibrary')
+    if Clibrary is None:
+        return []
+
+    invalidate = getattr(Clibrary, 'invalidateNmrResidueIndices', None)
+    getIndices = getattr(Clibrary, 'getNmrResidueIndices', None)
+
+    def make(rng, length, mode):
+        nmrResidues = nmrChain(length, rng)
+        getIndex = Clibrary.getNmrResidueIndex
+
+        def func():
+            if mode != 'repeated':
+                invalidate()
+            if mode == 'bulk':
+                return getIndices(nmrResidues)
+            return [getIndex(nmrRes) for nmrRes in nmrResidues]
+
+        return func, {'nmrResidues': len(nmrResidues)}
+
+    # the indices are cached by nmrChain, so also time from an empty cache
+    modes = ['repeated']
+    if invalidate is not None:
+        modes.append('cold')
+    if getIndices is not None:
+        modes.append('bulk')
+
+    cases = []
+    for length in ((100, 1000) if quick else (100, 1000, 5000)):
+        for mode in modes:
+            params = {'length': length, 'mode': mode}
+            cases.append((f'nmrResidueIndex/length={length}/{mode}', params,
+                          lambda rng, params=params: make(rng, **params)))
+
+    return cases
+
+
+CASE_GROUPS = (('contour', contourCases),
+               ('findPeaks', findPeaksCases),
+               ('fitPeaks', fitPeaksCases),
+               ('nmrResidueIndex', nmrResidueIndexCases))
+
+
+#=========================================================================================
+# results
+#=========================================================================================
+
+def _gitCommit():
+    try:
+        return subprocess.run(['git', 'rev-parse', 'HEAD'], cwd=os.path.dirname(os.path.abspath(__file__)),
+                              capture_output=True, text=True, timeout=10).stdout.strip() or None
+    except (OSError, subprocess.SubprocessError):
+        return None
+
+
+def runBenchmarks(filters=None, quick=False, repeat=DEFAULT_REPEAT, minTime=DEFAULT_MIN_TIME, seed=1,
+                  log=print) -> dict:
+    """Run the cases and return the results (as written to json)"""
+    results, skipped = [], []
+    for group, makeCases in CASE_GROUPS:
+        cases = makeCases(quick)
+        if not cases:
+            skipped.append(group)
+            log(f'{group}: extension not available, skipped')
+            continue
+
+        for name, params, make in cases:
+            if filters and not any(text in name for text in filters):
+                continue
+
+            # each case has its own generator, so its data do not depend on which cases are run
+            func, work = make(np.random.default_rng([seed, zlib.crc32(name.encode())]))
+            timing = timeCall(func, repeat, minTime)
+            results.append({'name': name, 'group': group, 'params': params, 'work': work, **timing})
+            log(f'{name:64s} {timing["median"] * 1000:10.3f} ms  (min {timing["min"] * 1000:.3f})')
+
+    return {'schema'   : SCHEMA_VERSION,
+            'timestamp': time.strftime('%Y-%m-%dT%H:%M:%S%z'),
+            'gitCommit': _gitCommit(),
+            'python'   : platform.python_version(),
+            'numpy'    : np.__version__,
+            'platform' : platform.platform(),
+            'machine'  : platform.machine(),
+            'cpuCount' : os.cpu_count(),
+            'quick'    : quick,
+            'repeat'   : repeat,
+            'minTime'  : minTime,
+            'seed'     : seed,
+            'skipped'  : skipped,
+            'results'  : results}
+
+
+def compareResults(results, baseline, tolerance=DEFAULT_TOLERANCE) -> list:
+    """Return (name, baselineMedian, median, ratio) of the cases slower than baseline by more than tolerance"""
+    baselineTimes = {result['name']: result['median'] for result in baseline.get('results', [])}
+    regressions = []
+    for result in results['results']:
+        old = baselineTimes.get(result['name'])
+        if old is None or old <= 0:
+            continue
+        new = result['median']
+        if new > old * (1.0 + tolerance) and new - old > MIN_REGRESSION_SECONDS:
+            regressions.append((result['name'], old, new, new / old))
+
+    return regressions
+
+
+def main(argv=None) -> int:
+    parser = argparse.ArgumentParser(description='Benchmark the CCPN C extensions')
+    parser.add_argument('--output', help='write the results as json to this file')
+    parser.add_argument('--compare', help='json results of an earlier run to check for regressions against')
+    parser.add_argument('--tolerance', type=float, default=DEFAULT_TOLERANCE,
+                        help='fractional slowdown of a case counted as a regression (default %(default)s)')
+    parser.add_argument('--filter', nargs='*', help='only run the cases with names containing any of these')
+    parser.add_argument('--quick', action='store_true', help='only run the smaller sizes')
+    parser.add_argument('--repeat', type=int, default=DEFAULT_REPEAT, help='samples of each case (default %(default)s)')
+    parser.add_argument('--minTime', type=float, default=DEFAULT_MIN_TIME,
+                        help='minimum seconds of each sample (default %(default)s)')
+    parser.add_argument('--seed', type=int, default=1, help='seed of the random data (default %(default)s)')
+    args = parser.parse_args(argv)
+
+    if args.repeat < 1:
+        parser.error('--repeat must be >= 1')
+
+    results = runBenchmarks(args.filter, args.quick, args.repeat, args.minTime, args.seed)
+
+    if args.output:
+        with open(args.output, 'w') as fp:
+            json.dump(results, fp, indent=2)
+        print(f'results written to {args.output}')
+
+    if args.compare:
+        with open(args.compare) as fp:
+            baseline = json.load(fp)
+        regressions = compareResults(results, baseline, args.tolerance)
+        for name, old, new, ratio in regressions:
+            print(f'REGRESSION {name}: {old * 1000:.3f} ms -> {new * 1000:.3f} ms ({ratio:.2f}x)')
+        if regressions:
+            return 1
+        print(f'no regressions against {args.compare} (tolerance {args.tolerance:.0%})')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
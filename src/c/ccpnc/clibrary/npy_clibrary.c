@@ -81,204 +81,345 @@ static void *appendFloatLong(PyObject *list, long value) {
     return NULL;
 }
 
-struct Node {
-    // Struct to contain nmrResidue information
-
-    // data
-    PyObject *object;
-    double relativeOffset;
+/* the resonanceGroups of an nmrChain are indexed by their position when sorted by */
+/* (index, seqInsertCode, relativeOffset), where an offset resonanceGroup has the index */
+/* of its main resonanceGroup, and those with the same key keep the order they are added in */
+typedef struct _Res_group_key {
+    PyObject *object; /* borrowed */
     long index;
-    CcpnBool seqCodeCompare;
-    long seqCode;
-    char *seqInsertCode;
-    CcpnBool isConnected;
-    CcpnBool seqIsReference;
-
-    // pointers
-    struct Node *prev;
-    struct Node *next;
-};
+    const char *seq_insert_code;
+    double relative_offset;
+    long order;
+} Res_group_key;
+
+#define UNASSIGNED_INDEX_OFFSET 1000000000
+
+/* id(apiNmrChain) -> (apiNmrChain, number of mainResonanceGroups, number of resonanceGroups */
+/* in the nmrProject, isConnected, {id(apiResonanceGroup): index}), until invalidated */
+static PyObject *chain_indices = NULL;
+
+/* the work of the lookups since resetStats, only counted while stats_enabled */
+typedef struct _Index_stats {
+    long nindex_calls;   /* getNmrResidueIndex */
+    long nindices_calls; /* getNmrResidueIndices */
+    long nresidues;      /* looked up by either */
+    long nnot_found;
+    long ncache_hits;    /* nmrChains whose cached indices were used */
+    long nsorts;         /* nmrChains whose indices were worked out */
+    long nsorted;        /* resonanceGroups in those sorts */
+} Index_stats;
+
+static CcpnBool stats_enabled = CCPN_FALSE;
+static Index_stats index_stats;
+
+static CcpnStatus set_id_item(PyObject *dict, PyObject *object, long value, char *error_msg) {
+    PyObject *key = PyLong_FromVoidPtr(object), *item = PyLong_FromLong(value);
+    int status = (key && item) ? PyDict_SetItem(dict, key, item) : -1;
 
-struct Node *newNode(PyObject *nmrResidue) {
-    // create a new element
-    struct Node *temp = (struct Node *)malloc(sizeof(struct Node));
+    Py_XDECREF(key);
+    Py_XDECREF(item);
 
-    // set up the data
-    temp->relativeOffset = -0.1;
-    temp->index = -1;
-    temp->object = nmrResidue;
-    temp->seqIsReference = CCPN_FALSE;
+    if (status != 0) RETURN_ERROR_MSG("allocating index memory");
 
-    //    strcpy(&(temp->seqInsertCode), "");
-    //    STRING_MALLOC_NEW(temp->seqInsertCode, "");
+    return CCPN_OK;
+}
+
+static PyObject *get_id_item(PyObject *dict, PyObject *object) {
+    PyObject *key = PyLong_FromVoidPtr(object), *item;
+
+    if (!key) return NULL;
+
+    item = PyDict_GetItem(dict, key);
+    Py_DECREF(key);
 
-    // initialise the pointers
-    temp->prev = NULL;
-    temp->next = NULL;
-    return temp;
+    return item;
 }
 
-static CcpnBool compareRes(struct Node *leftNode, struct Node *rightNode) {
-    int strCompare;
-
-    // compare whether 2 residues in connected stretch are similar
-    // need to clean this up
-
-    // compare index
-    if (leftNode->index == rightNode->index) {
-        // compare seqInsertCode
-        strCompare = strcmp(leftNode->seqInsertCode, rightNode->seqInsertCode);
-
-        if (strCompare == 0) {
-            //            printf("string identical\n");
-
-            // compare relativeOffset
-            if (leftNode->relativeOffset < rightNode->relativeOffset)
-                return CCPN_TRUE;
-            else
-                return CCPN_FALSE;
-        } else if (strCompare < 0) {
-            return CCPN_TRUE;
-            //            printf("string less\n");
-        } else {
-            return CCPN_FALSE;
-            //            printf("string greater\n");
+static CcpnStatus set_res_group_key(Res_group_key *key, PyObject *res_group, long index, CcpnBool is_connected,
+                                    CcpnBool is_main, long order, char *error_msg) {
+    PyObject *api_dict, *value;
+    const char *seq_insert_code;
+
+    api_dict = PyObject_GetAttrString(res_group, "__dict__");
+    if (!api_dict) RETURN_ERROR_MSG("error getting resonanceGroup __dict__");
+
+    key->object = res_group;
+    key->index = index;
+    key->seq_insert_code = "";
+    key->relative_offset = -0.1;
+    key->order = order;
+
+    if (!is_connected) {
+        if (is_main) {
+            value = PyDict_GetItemString(api_dict, "seqCode");
+            if (value && (value != Py_None)) {
+                key->index = PyLong_AsLong(value);
+            } else {
+                value = PyDict_GetItemString(api_dict, "serial");
+                key->index = (value ? PyLong_AsLong(value) : 0) + UNASSIGNED_INDEX_OFFSET;
+            }
         }
 
-    } else if (leftNode->index < rightNode->index)
-        return CCPN_TRUE;
-    else
-        return CCPN_FALSE;
+        /* the string is kept by the resonanceGroup, so is valid while the keys are used */
+        value = PyDict_GetItemString(api_dict, "seqInsertCode");
+        if (value && PyUnicode_Check(value)) {
+            seq_insert_code = PyUnicode_AsUTF8(value);
+            if (seq_insert_code) key->seq_insert_code = seq_insert_code;
+        }
+    }
+
+    value = PyDict_GetItemString(api_dict, "relativeOffset");
+    if (value && (value != Py_None)) key->relative_offset = PyFloat_AsDouble(value);
+
+    Py_DECREF(api_dict);
+
+    if (PyErr_Occurred()) RETURN_ERROR_MSG("error reading resonanceGroup");
+
+    return CCPN_OK;
 }
 
-struct Node *insertConnected(struct Node *node, struct Node *item) {
-    // If the tree is empty, return previously defined new node
-    if (!node) return item;
+static int compare_res_group_keys(const void *a, const void *b) {
+    const Res_group_key *key_a = (const Res_group_key *)a, *key_b = (const Res_group_key *)b;
+    int str_compare;
 
-    // Otherwise, recurse down the tree
-    if (compareRes(item, node) == CCPN_TRUE)
-        node->prev = insertConnected(node->prev, item);
-    else
-        node->next = insertConnected(node->next, item);
+    if (key_a->index != key_b->index) return (key_a->index < key_b->index) ? -1 : 1;
+
+    str_compare = strcmp(key_a->seq_insert_code, key_b->seq_insert_code);
+    if (str_compare != 0) return str_compare;
 
-    return node;
+    if (key_a->relative_offset < key_b->relative_offset) return -1;
+    if (key_a->relative_offset > key_b->relative_offset) return 1;
+
+    return (key_a->order < key_b->order) ? -1 : ((key_a->order > key_b->order) ? 1 : 0);
 }
 
-struct Node *insertConnectedNode(struct Node **headRef, PyObject *offsetItem, long index, CcpnBool isConnected,
-                                 CcpnBool isMainResonance) {
-    struct Node *temp = newNode(offsetItem);
-    struct Node *ptr = (*headRef);
-    double relOffset;
-    PyObject *offsetTest;
-    PyObject *seqInsertCode;
-    PyObject *seqCode;
-    PyObject *serial;
-    PyObject *seqString;
-    PyObject *apiDict = PyObject_GetAttrString(offsetItem, "__dict__");
-
-    temp->isConnected = isConnected;
-    if (isConnected == CCPN_TRUE) {
-        temp->index = index;
-        STRING_MALLOC_NEW(temp->seqInsertCode, "");
-    } else {
-        seqCode = PyDict_GetItemString(apiDict, "seqCode");
-        serial = PyDict_GetItemString(apiDict, "serial");
-
-        if (isMainResonance)
-            if (seqCode == Py_None)
-                temp->index = PyLong_AsLong(serial) + 1000000000;
-            else
-                temp->index = PyLong_AsLong(seqCode);
-        else
-            temp->index = index;
-
-        seqInsertCode = PyDict_GetItemString(apiDict, "seqInsertCode");
-
-        if (seqInsertCode == Py_None) {
-            STRING_MALLOC_NEW(temp->seqInsertCode, "");
-        } else {
-            // read the string from the PyObject, and put into seqInsertCode
-            seqString = PyUnicode_AsASCIIString(seqInsertCode);
-            if (seqString) {
-                temp->seqInsertCode = PyBytes_AS_STRING(seqString);
-                temp->seqIsReference = CCPN_TRUE;
-            }
+/* the offset resonanceGroups (of all those in the nmrProject) of the mainResonanceGroups, */
+/* with the position of their main resonanceGroup, returns the number found */
+static long find_offset_groups(PyObject *groups, PyObject *main_positions, long *offset_groups, long *offset_mains) {
+    long i, noffsets = 0, ngroups = PyList_GET_SIZE(groups);
+    PyObject *res_group, *main_res, *position;
+
+    for (i = 0; i < ngroups; i++) {
+        res_group = PyList_GET_ITEM(groups, i);
+        main_res = PyObject_GetAttrString(res_group, "mainResonanceGroup");
+        if (!main_res) {
+            PyErr_Clear();
+            continue;
+        }
+
+        position = (main_res != res_group) ? get_id_item(main_positions, main_res) : NULL;
+        if (position) {
+            offset_groups[noffsets] = i;
+            offset_mains[noffsets] = PyLong_AsLong(position);
+            noffsets++;
         }
+
+        Py_DECREF(main_res);
     }
 
-    offsetTest = PyDict_GetItemString(apiDict, "relativeOffset");
-    if (offsetTest != Py_None) {
-        relOffset = PyFloat_AsDouble(PyObject_GetAttrString(offsetItem, "relativeOffset"));
-        temp->relativeOffset = relOffset;
+    return noffsets;
+}
+
+/* the keys of the mainResonanceGroups in order, each followed by its offset resonanceGroups */
+static CcpnStatus set_res_group_keys(Res_group_key *keys, PyObject *mains, long nmain, PyObject *groups, long *offset_groups,
+                                     long *offset_mains, long noffsets, CcpnBool is_connected, char *error_msg) {
+    long i, slot, *next_slot;
+    CcpnStatus status = CCPN_OK;
+
+    sprintf(error_msg, "allocating index memory");
+    MALLOC(next_slot, long, nmain + 1);
+
+    for (i = 0; i <= nmain; i++) next_slot[i] = 0;
+    for (i = 0; i < noffsets; i++) next_slot[offset_mains[i] + 1]++;
+    for (i = 0; i < nmain; i++) next_slot[i + 1] += next_slot[i] + 1;
+
+    for (i = 0; (i < nmain) && (status == CCPN_OK); i++) {
+        slot = next_slot[i]++;
+        status = set_res_group_key(keys + slot, PySequence_Fast_GET_ITEM(mains, i), i, is_connected, CCPN_TRUE, slot,
+                                   error_msg);
     }
 
-    (*headRef) = insertConnected(ptr, temp);
+    /* next_slot[i] is now the slot after main resonanceGroup i, with its index in keys[slot - 1] */
+    for (i = 0; (i < noffsets) && (status == CCPN_OK); i++) {
+        slot = next_slot[offset_mains[i]]++;
+        status = set_res_group_key(keys + slot, PyList_GET_ITEM(groups, offset_groups[i]), keys[slot - 1].index,
+                                   is_connected, CCPN_FALSE, slot, error_msg);
+    }
 
-    // cleanup reference counts
-    return temp;  // CCPN_TRUE;
+    FREE(next_slot, long);
 
-    //    seqInsertCode = PyObject_GetAttrString(offsetItem, "seqInsertCode");
-    //    seqInsertCode = PyDict_GetItemString(apiDict, "seqCode");
+    return status;
+}
 
-    //    if (PyObject_RichCompareBool(seqInsertCode, Py_None, Py_NE) == 1)
-    //    {
-    //        continue;
-    //        ss = PyBytes_Size(seqInsertCode);
+/* returns {id(apiResonanceGroup): index} for all the resonanceGroups of the nmrChain, from one sort */
+static PyObject *new_chain_indices(PyObject *api_nmr_chain, PyObject *res_groups_dict, CcpnBool is_connected,
+                                   char *error_msg) {
+    long i, nmain, ngroups, nkeys = 0, *offset_groups, *offset_mains;
+    PyObject *mains_obj, *mains, *groups, *main_positions, *indices = NULL;
+    Res_group_key *keys = NULL;
+    CcpnStatus status = CCPN_OK;
+
+    mains_obj = PyObject_GetAttrString(api_nmr_chain, "mainResonanceGroups");
+    if (!mains_obj) RETURN_ERROR_MSG_NULL("error getting mainResonanceGroups");
+
+    mains = PySequence_Fast(mains_obj, "mainResonanceGroups is not a sequence");
+    Py_DECREF(mains_obj);
+    if (!mains) RETURN_ERROR_MSG_NULL("error getting mainResonanceGroups");
+
+    nmain = PySequence_Fast_GET_SIZE(mains);
+    groups = PyDict_Values(res_groups_dict);
+    ngroups = groups ? PyList_GET_SIZE(groups) : 0;
+    main_positions = PyDict_New();
+    offset_groups = (long *)malloc(MAX(1, ngroups) * sizeof(long));
+    offset_mains = (long *)malloc(MAX(1, ngroups) * sizeof(long));
+
+    sprintf(error_msg, "allocating index memory");
+    if (!groups || !main_positions || !offset_groups || !offset_mains) status = CCPN_ERROR;
+
+    for (i = 0; (i < nmain) && (status == CCPN_OK); i++)
+        status = set_id_item(main_positions, PySequence_Fast_GET_ITEM(mains, i), i, error_msg);
+
+    if (status == CCPN_OK) {
+        nkeys = nmain + find_offset_groups(groups, main_positions, offset_groups, offset_mains);
+        keys = (Res_group_key *)malloc(MAX(1, nkeys) * sizeof(Res_group_key));
+        if (!keys) status = CCPN_ERROR;
+    }
 
-    //        seqString = PyObject_Bytes(seqInsertCode);
-    //        if (seqString)
-    //        if (PyObject_IsInstance(seqInsertCode, &PyObject_Type))
-    //            printf("    array\n");
+    if (status == CCPN_OK)
+        status = set_res_group_keys(keys, mains, nmain, groups, offset_groups, offset_mains, nkeys - nmain, is_connected,
+                                    error_msg);
 
-    //    seqString = PyObject_Str(seqInsertCode);
-    //    int seqLen = PyObject_Size(seqString);
-    //
-    //    int ss = PyLong_AsLong(seqInsertCode);
-    //
-    //    printf("size %i\n", ss);
+    if (status == CCPN_OK) {
+        qsort(keys, nkeys, sizeof(Res_group_key), compare_res_group_keys);
 
-    //        PyByteArrayObject *strNone = PyByteArray_FromObject(seqInsertCode);
-    //        if (!strNone)
-    //            RETURN_OBJ_ERROR("error defining string");
+        sprintf(error_msg, "allocating index memory");
+        indices = PyDict_New();
+        if (!indices) status = CCPN_ERROR;
+    }
+
+    for (i = 0; (i < nkeys) && (status == CCPN_OK); i++) status = set_id_item(indices, keys[i].object, i, error_msg);
+
+    if (stats_enabled && (status == CCPN_OK)) {
+        index_stats.nsorts++;
+        index_stats.nsorted += nkeys;
+    }
 
-    //        seqLen = PyObject_Size(strNone);
+    FREE(keys, Res_group_key);
+    FREE(offset_groups, long);
+    FREE(offset_mains, long);
+    Py_XDECREF(main_positions);
+    Py_XDECREF(groups);
+    Py_DECREF(mains);
 
-    //        char thisString[seqLen];
+    if (status == CCPN_ERROR) {
+        Py_XDECREF(indices);
+        return NULL;
+    }
 
-    //        const char *thisString2 = PyByteArray_AsString(seqString);
-    //        strncpy(thisString, *thisString2, seqLen);
+    return indices;
+}
 
-    //        printf("%i \n", PyBytes_Size(strNone));
-    //    }
+static CcpnBool valid_chain_entry(PyObject *entry, PyObject *api_nmr_chain, long nmain, long ngroups, int is_connected) {
+    if (!entry || (nmain < 0) || (PyTuple_GET_ITEM(entry, 0) != api_nmr_chain)) return CCPN_FALSE;
 
-    //    temp->seqInsertCode = PyBytes_AsString(seqInsertCode);
-    //    printf(temp->seqInsertCode);
+    if (PyLong_AsLong(PyTuple_GET_ITEM(entry, 1)) != nmain) return CCPN_FALSE;
+    if (PyLong_AsLong(PyTuple_GET_ITEM(entry, 2)) != ngroups) return CCPN_FALSE;
+    if ((PyTuple_GET_ITEM(entry, 3) == Py_True) != is_connected) return CCPN_FALSE;
 
-    //    (*headRef) = insertConnected(ptr, temp);
-    //
-    //    return temp;            // CCPN_TRUE;
+    return CCPN_TRUE;
 }
 
-static void getIndexInList(struct Node *node, PyObject *item, long *index, long *found) {
-    if (node) {
-        getIndexInList(node->prev, item, index, found);
-        (*index)++;
-        if (node->object == item) *found = *index;
+/* returns (a borrowed reference to) the cached indices of the nmrChain, only worked out */
+/* again if invalidated or if the number of mainResonanceGroups or resonanceGroups changes */
+static PyObject *get_chain_indices(PyObject *api_nmr_chain, PyObject *api_nmr_project, char *error_msg) {
+    long nmain, ngroups;
+    int is_connected, status;
+    PyObject *chain_dict, *project_dict, *value, *res_groups_dict, *chain_id, *entry, *indices;
+
+    chain_dict = PyObject_GetAttrString(api_nmr_chain, "__dict__");
+    if (!chain_dict) RETURN_ERROR_MSG_NULL("error getting apiNmrChain __dict__");
 
-        getIndexInList(node->next, item, index, found);
+    project_dict = PyObject_GetAttrString(api_nmr_project, "__dict__");
+    if (!project_dict) {
+        Py_DECREF(chain_dict);
+        RETURN_ERROR_MSG_NULL("error getting apiNmrProjectDict");
     }
-}
 
-static void deallocateNodeList(struct Node *node) {
-    if (node) {
-        deallocateNodeList(node->prev);
-        deallocateNodeList(node->next);
+    value = PyDict_GetItemString(chain_dict, "isConnected");
+    is_connected = value ? PyObject_IsTrue(value) : -1;
+
+    /* the stored list, the mainResonanceGroups attribute makes a new tuple each time */
+    value = PyDict_GetItemString(chain_dict, "mainResonanceGroups");
+    nmain = value ? PyObject_Size(value) : -1;
+    if (nmain < 0) PyErr_Clear();
 
-        // deallocate node contents and children
-        if ((node->seqIsReference == CCPN_FALSE) && (node->seqInsertCode)) free(node->seqInsertCode);
-        if (node->prev) free(node->prev);
-        if (node->next) free(node->next);
+    res_groups_dict = PyDict_GetItemString(project_dict, "resonanceGroups");
+    if (res_groups_dict && !PyDict_Check(res_groups_dict)) res_groups_dict = NULL;
+    Py_XINCREF(res_groups_dict);
+    ngroups = res_groups_dict ? PyDict_Size(res_groups_dict) : 0;
+
+    Py_DECREF(chain_dict);
+    Py_DECREF(project_dict);
+
+    if (is_connected < 0) {
+        Py_XDECREF(res_groups_dict);
+        RETURN_ERROR_MSG_NULL("error getting isConnected");
     }
+
+    if (!res_groups_dict) RETURN_ERROR_MSG_NULL("error getting resonanceGroupDict");
+
+    if (!chain_indices) chain_indices = PyDict_New();
+    chain_id = chain_indices ? PyLong_FromVoidPtr(api_nmr_chain) : NULL;
+    if (!chain_id) {
+        Py_DECREF(res_groups_dict);
+        RETURN_ERROR_MSG_NULL("allocating index memory");
+    }
+
+    entry = PyDict_GetItem(chain_indices, chain_id);
+    if (valid_chain_entry(entry, api_nmr_chain, nmain, ngroups, is_connected)) {
+        if (stats_enabled) index_stats.ncache_hits++;
+        Py_DECREF(chain_id);
+        Py_DECREF(res_groups_dict);
+        return PyTuple_GET_ITEM(entry, 4);
+    }
+
+    indices = new_chain_indices(api_nmr_chain, res_groups_dict, is_connected ? CCPN_TRUE : CCPN_FALSE, error_msg);
+    Py_DECREF(res_groups_dict);
+    if (!indices) {
+        Py_DECREF(chain_id);
+        return NULL;
+    }
+
+    /* the cache keeps the indices (and apiNmrChain, so that its id is not reused) */
+    entry = Py_BuildValue("(OllOO)", api_nmr_chain, nmain, ngroups, is_connected ? Py_True : Py_False, indices);
+    Py_DECREF(indices);
+    status = entry ? PyDict_SetItem(chain_indices, chain_id, entry) : -1;
+    Py_XDECREF(entry);
+    Py_DECREF(chain_id);
+
+    if (status != 0) RETURN_ERROR_MSG_NULL("allocating index memory");
+
+    return indices;
+}
+
+/* returns (a borrowed reference to) the cached indices of the nmrChain containing the apiResonanceGroup */
+static PyObject *residue_chain_indices(PyObject *api_nmr_residue, char *error_msg) {
+    PyObject *api_nmr_chain, *api_nmr_project, *indices = NULL;
+
+    api_nmr_chain = PyObject_GetAttrString(api_nmr_residue, "nmrChain");
+    api_nmr_project = PyObject_GetAttrString(api_nmr_residue, "nmrProject");
+
+    if (!api_nmr_chain)
+        sprintf(error_msg, "error getting apiNmrChain");
+    else if (!api_nmr_project)
+        sprintf(error_msg, "error getting apiNmrProject");
+    else
+        indices = get_chain_indices(api_nmr_chain, api_nmr_project, error_msg);
+
+    Py_XDECREF(api_nmr_chain);
+    Py_XDECREF(api_nmr_project);
+
+    return indices;
 }
 
 static CcpnBool _flaggedForDelete(PyObject *projectDict, PyObject *apiRes) {
@@ -307,154 +448,178 @@ static CcpnBool _flaggedForDelete(PyObject *projectDict, PyObject *apiRes) {
 }
 
 static PyObject *getNmrResidueIndex(PyObject *self, PyObject *args) {
-    PyObject *apiNmrChain;
-    PyTupleObject *apiNmrResiduesTuple;
-    PyObject *nmrResidue;
-    PyObject *returnValue;
+    PyObject *nmrResidue, *apiNmrResidue, *indices, *index;
     char error_msg[1000];
-    long index = -1, numOffsets = 0, found = -1, rgSize;
-    long ii, jj;
-    PyObject *listRes, *mainRes;
-    PyObject *apiNmrResidue;
-    PyListObject *offsetList;
-    PyObject *offsetRes;
-    PyObject *resonanceGroupsList;
-    PyObject *apiNmrProjectDict;
-    PyObject *resonanceGroupDict;
-    PyObject *apiNmrProject;
-    CcpnBool isConnected;
-    PyObject *project;
-    PyDictObject *projectDict;
-
-    //    data2Obj = project._data2Obj
-    //    data2Obj[wrappedData] = self
-    //    self._flaggedForDelete
-
-    // check thart the argument is an nmrResidue
+    long found = -1;
+
+    // check that the argument is an nmrResidue
     if (!PyArg_ParseTuple(args, "O", &nmrResidue)) RETURN_OBJ_ERROR("need arguments: nmrResidue");
 
     // get the apiResonanceGroup
     apiNmrResidue = PyObject_GetAttrString(nmrResidue, "_wrappedData");
     if (!apiNmrResidue) RETURN_OBJ_ERROR("error getting _wrappedData");
 
-    // get the apiNmrChain containing the resonanceGroup
-    apiNmrChain = (PyObject *)PyObject_GetAttrString(apiNmrResidue, "nmrChain");
-    if (!apiNmrChain) RETURN_OBJ_ERROR("error getting apiNmrChain");
+    // the indices of all the resonanceGroups in the apiNmrChain, only sorted when they change
+    indices = residue_chain_indices(apiNmrResidue, error_msg);
+    if (!indices) {
+        Py_DECREF(apiNmrResidue);
+        RETURN_OBJ_ERROR(error_msg);
+    }
+
+    index = get_id_item(indices, apiNmrResidue);
+    if (index) found = PyLong_AsLong(index);
+
+    Py_DECREF(apiNmrResidue);
+
+    if (stats_enabled) {
+        index_stats.nindex_calls++;
+        index_stats.nresidues++;
+        if (found < 0) index_stats.nnot_found++;
+    }
+
+    return PyLong_FromLong(found);
+}
+
+/* the index of each nmrResidue of the sequence in its nmrChain (or -1), the indices of each */
+/* nmrChain are only looked up again when the nmrChain changes from one nmrResidue to the next */
+static CcpnStatus set_nmr_residue_indices(PyObject *nmr_residues, long *indices, char *error_msg) {
+    Py_ssize_t i, n = PySequence_Fast_GET_SIZE(nmr_residues);
+    PyObject **items = PySequence_Fast_ITEMS(nmr_residues);
+    PyObject *api_nmr_residue, *api_nmr_chain, *api_nmr_project, *index;
+    PyObject *last_chain = NULL, *chain_indices_dict = NULL;
+    CcpnStatus status = CCPN_OK;
+
+    for (i = 0; (i < n) && (status == CCPN_OK); i++) {
+        indices[i] = -1;
+
+        api_nmr_residue = PyObject_GetAttrString(items[i], "_wrappedData");
+        if (!api_nmr_residue) {
+            sprintf(error_msg, "error getting _wrappedData of nmrResidue %ld", (long)i);
+            status = CCPN_ERROR;
+            break;
+        }
+
+        api_nmr_chain = PyObject_GetAttrString(api_nmr_residue, "nmrChain");
+        if (!api_nmr_chain) {
+            sprintf(error_msg, "error getting apiNmrChain of nmrResidue %ld", (long)i);
+            status = CCPN_ERROR;
+        } else if (api_nmr_chain == Py_None) {
+            /* deleted, so not in any nmrChain */
+        } else if (api_nmr_chain != last_chain) {
+            api_nmr_project = PyObject_GetAttrString(api_nmr_residue, "nmrProject");
+            if (!api_nmr_project) {
+                sprintf(error_msg, "error getting apiNmrProject of nmrResidue %ld", (long)i);
+                status = CCPN_ERROR;
+            } else {
+                /* borrowed from the cache, which also keeps api_nmr_chain */
+                chain_indices_dict = get_chain_indices(api_nmr_chain, api_nmr_project, error_msg);
+                last_chain = chain_indices_dict ? api_nmr_chain : NULL;
+                if (!chain_indices_dict) status = CCPN_ERROR;
+                Py_DECREF(api_nmr_project);
+            }
+        }
+
+        if ((status == CCPN_OK) && (api_nmr_chain != Py_None)) {
+            index = get_id_item(chain_indices_dict, api_nmr_residue);
+            if (index) indices[i] = PyLong_AsLong(index);
+        }
+
+        Py_XDECREF(api_nmr_chain);
+        Py_DECREF(api_nmr_residue);
+    }
 
-    // get isConnected and serial for the apiNmrChain
-    PyObject *apiNmrChainDict = PyObject_GetAttrString(apiNmrChain, "__dict__");
-    PyObject *isConnectedObj = PyDict_GetItemString(apiNmrChainDict, "isConnected");
-    PyObject *apiNmrChainSerialObj = PyDict_GetItemString(apiNmrChainDict, "serial");
+    return status;
+}
 
-    // get all the resonanceGroups in the local apiNmrChain
-    apiNmrResiduesTuple = (PyTupleObject *)PyObject_GetAttrString(apiNmrChain, "mainResonanceGroups");
+static PyObject *getNmrResidueIndices(PyObject *self, PyObject *args) {
+    PyObject *nmrResidues, *sequence;
+    PyArrayObject *indices;
+    npy_intp i, n;
+    char error_msg[1000];
 
-    // error checking
-    if (!apiNmrResiduesTuple) RETURN_OBJ_ERROR("error getting apiNmrResiduesTuple");
-    if (!isConnectedObj) RETURN_OBJ_ERROR("error getting isConnected");
-    if (!apiNmrChainSerialObj) RETURN_OBJ_ERROR("error getting serial");
+    if (!PyArg_ParseTuple(args, "O", &nmrResidues)) RETURN_OBJ_ERROR("need arguments: nmrChain or nmrResidues");
 
-    if (isConnectedObj == Py_True)
-        isConnected = CCPN_TRUE;
+    // an nmrChain stands for its nmrResidues
+    if (!PyList_Check(nmrResidues) && !PyTuple_Check(nmrResidues) && PyObject_HasAttrString(nmrResidues, "nmrResidues"))
+        nmrResidues = PyObject_GetAttrString(nmrResidues, "nmrResidues");
     else
-        isConnected = CCPN_FALSE;
-
-    // put the resonanceGroups into a list
-    long numRes = PyTuple_GET_SIZE(apiNmrResiduesTuple);
-    // PyObject *mainResGroups[numRes];
-    PyObject **mainResGroups;
-    MALLOC_NEW(mainResGroups, PyObject *, numRes);
-    for (ii = 0; ii < numRes; ii++) {
-        mainResGroups[ii] = (PyObject *)PyTuple_GET_ITEM(apiNmrResiduesTuple, ii);
+        Py_INCREF(nmrResidues);
+
+    if (!nmrResidues) RETURN_OBJ_ERROR("error getting nmrResidues of nmrChain");
+
+    sequence = PySequence_Fast(nmrResidues, "nmrResidues must be a sequence");
+    Py_DECREF(nmrResidues);
+    if (!sequence) return NULL;
+
+    n = PySequence_Fast_GET_SIZE(sequence);
+    indices = (PyArrayObject *)PyArray_SimpleNew(1, &n, NPY_LONG);
+    if (!indices) {
+        Py_DECREF(sequence);
+        RETURN_OBJ_ERROR("allocating indices memory");
     }
 
-    // get the list of all resonanceGroups in the apiNmrProject
-    apiNmrProject = PyObject_GetAttrString(apiNmrResidue, "nmrProject");
-    apiNmrProjectDict = PyObject_GetAttrString(apiNmrProject, "__dict__");
-    resonanceGroupDict = PyDict_GetItemString(apiNmrProjectDict, "resonanceGroups");
-    resonanceGroupsList = PyDict_Values(resonanceGroupDict);
-
-    // error checking
-    if (!apiNmrProject) RETURN_OBJ_ERROR("error getting apiNmrProject");
-    if (!apiNmrProjectDict) RETURN_OBJ_ERROR("error getting apiNmrProjectDict");
-    if (!resonanceGroupDict) RETURN_OBJ_ERROR("error getting resonanceGroupDict");
-    if (!resonanceGroupsList) RETURN_OBJ_ERROR("error getting resonanceGroupsList");
-
-    // get the V3project
-    project = PyObject_GetAttrString(nmrResidue, "project");
-    projectDict = (PyDictObject *)PyObject_GetAttrString(project, "_data2Obj");
-
-    // error checking
-    if (!project) RETURN_OBJ_ERROR("error getting project");
-    if (!projectDict) RETURN_OBJ_ERROR("error getting projectDict");
-
-    // search all resonanceGroups in the project,
-    // to find all attached offsetResonanceGroups
-    rgSize = PyList_GET_SIZE(resonanceGroupsList);
-    //    PyObject *offsetResonanceGroups[rgSize];            //  just make it
-    //    full size, but only need some of it PyObject
-    //    *offSetMainResonances[rgSize];
-    PyObject **offsetResonanceGroups;  //  just make it full size, but only need
-                                       //  some of it
-    PyObject **offSetMainResonances;
-    MALLOC_NEW(offsetResonanceGroups, PyObject *, rgSize);
-    MALLOC_NEW(offSetMainResonances, PyObject *, rgSize);
-
-    for (ii = 0; ii < rgSize; ii++) {
-        listRes = PyList_GET_ITEM(resonanceGroupsList, ii);
-        mainRes = PyObject_GetAttrString(listRes, "mainResonanceGroup");  //  not pointing to the right place?
-
-        for (jj = 0; jj < numRes; jj++)
-            if ((mainRes == mainResGroups[jj]) && (mainRes != listRes)) {
-                // simple way of keeping res and mainRes together;
-                offsetResonanceGroups[numOffsets] = listRes;
-                offSetMainResonances[numOffsets] = mainRes;
-                numOffsets++;
-            }
+    if (set_nmr_residue_indices(sequence, (long *)PyArray_DATA(indices), error_msg) == CCPN_ERROR) {
+        Py_DECREF(sequence);
+        Py_DECREF(indices);
+        RETURN_OBJ_ERROR(error_msg);
+    }
+
+    if (stats_enabled) {
+        index_stats.nindices_calls++;
+        index_stats.nresidues += n;
+        for (i = 0; i < n; i++) {
+            if (((long *)PyArray_DATA(indices))[i] < 0) index_stats.nnot_found++;
+        }
     }
 
-    struct Node *resonanceList = NULL;
-    struct Node *thisNode = NULL;
-    struct Node *offsetNode = NULL;
-
-    // insert all resonanceGroups into a linked list for ordering
-    for (ii = 0; ii < numRes; ii++) {
-        mainRes = PyTuple_GET_ITEM(apiNmrResiduesTuple, ii);
-        thisNode = insertConnectedNode(&resonanceList, mainRes, ii, isConnected, CCPN_TRUE);
-
-        // if an offsetResonance, then uses the index of the mainResonance
-        for (jj = 0; jj < numOffsets; jj++)
-            if (offSetMainResonances[jj] == mainRes)
-                offsetNode =
-                    insertConnectedNode(&resonanceList, offsetResonanceGroups[jj], thisNode->index, isConnected, CCPN_FALSE);
-
-        //        // this is the SLOW line - and has been replaced by the quicker
-        //        accessing through apiNmrChain.__dict__['resonanceGroups']
-        //        offsetList = (PyListObject *) PyObject_GetAttrString(listRes,
-        //        "offsetResonanceGroups");
-        //
-        //        numOffsets = PyList_GET_SIZE(offsetList);
-        //        for (long jj=0; jj < numOffsets; jj++)
-        //        {
-        //            offsetRes = (PyObject *) PyList_GET_ITEM(offsetList, jj);
-        //            insertConnectedNode(&resonanceList, offsetRes, ii);
-        //        }
+    Py_DECREF(sequence);
+
+    return (PyObject *)indices;
+}
+
+static PyObject *invalidateNmrResidueIndices(PyObject *self, PyObject *args) {
+    PyObject *apiNmrChain = NULL, *chain_id;
+
+    if (!PyArg_ParseTuple(args, "|O", &apiNmrChain)) RETURN_OBJ_ERROR("need arguments: optional apiNmrChain");
+
+    if (chain_indices && apiNmrChain && (apiNmrChain != Py_None)) {
+        chain_id = PyLong_FromVoidPtr(apiNmrChain);
+        if (!chain_id) RETURN_OBJ_ERROR("allocating index memory");
+
+        if (PyDict_DelItem(chain_indices, chain_id) != 0) PyErr_Clear(); /* was not cached */
+        Py_DECREF(chain_id);
+    } else if (chain_indices) {
+        PyDict_Clear(chain_indices);
     }
 
-    // get the index of the current nmrResidue in the list
-    getIndexInList(resonanceList, apiNmrResidue, &index, &found);
+    Py_RETURN_NONE;
+}
+
+static PyObject *setStatsEnabled(PyObject *self, PyObject *args) {
+    int enabled = 1;
+
+    if (!PyArg_ParseTuple(args, "|p", &enabled)) RETURN_OBJ_ERROR("need arguments: optional enabled = True/False");
+
+    stats_enabled = enabled ? CCPN_TRUE : CCPN_FALSE;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *getStats(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, "")) RETURN_OBJ_ERROR("no arguments expected");
+
+    return Py_BuildValue("{s:O,s:l,s:l,s:l,s:l,s:l,s:l,s:l}", "enabled", stats_enabled ? Py_True : Py_False,
+                         "indexCalls", index_stats.nindex_calls, "indicesCalls", index_stats.nindices_calls,
+                         "residues", index_stats.nresidues, "notFound", index_stats.nnot_found, "cacheHits",
+                         index_stats.ncache_hits, "sorts", index_stats.nsorts, "sorted", index_stats.nsorted);
+}
 
-    // clean up allocated memory
-    deallocateNodeList(resonanceList);
-    if (resonanceList) free(resonanceList);
+static PyObject *resetStats(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, "")) RETURN_OBJ_ERROR("no arguments expected");
 
-    FREE(offsetResonanceGroups, PyObject *);
-    FREE(offSetMainResonances, PyObject *);
-    FREE(mainResGroups, PyObject *);
+    memset(&index_stats, 0, sizeof(Index_stats));
 
-    // return index
-    returnValue = PyLong_FromLong(found);
-    return returnValue;
+    Py_RETURN_NONE;
 }
 
 static PyObject *testReturnList(PyObject *self, PyObject *args) {
@@ -473,11 +638,36 @@ static PyObject *testReturnList(PyObject *self, PyObject *args) {
 }
 
 static char testReturnList_doc[] = "Return a list from a python c routine.";
-static char getNmrResidueIndex_doc[] = "Return the index of an nmrResidue in a chain";
+static char getNmrResidueIndex_doc[] =
+    "getNmrResidueIndex(nmrResidue)\n"
+    "Return the index of an nmrResidue in its nmrChain (or -1), the indices of the whole nmrChain are\n"
+    "worked out together and cached until invalidateNmrResidueIndices or the number of nmrResidues changes";
+static char getNmrResidueIndices_doc[] =
+    "getNmrResidueIndices(nmrResidues)\n"
+    "Return an integer array of the index of each nmrResidue in its nmrChain (or -1), nmrResidues is a\n"
+    "sequence of nmrResidues or an nmrChain (for its nmrResidues), as getNmrResidueIndex for each in one call";
+static char invalidateNmrResidueIndices_doc[] =
+    "invalidateNmrResidueIndices(apiNmrChain=None)\n"
+    "Forget the cached nmrResidue indices of apiNmrChain (or of all nmrChains if not given)";
+static char setStatsEnabled_doc[] =
+    "setStatsEnabled(enabled=True)\n"
+    "Count the work of the nmrResidue index lookups (see getStats), off unless enabled";
+static char getStats_doc[] =
+    "getStats()\n"
+    "Return a dict of what the lookups have done since resetStats (while setStatsEnabled): enabled, indexCalls,\n"
+    "indicesCalls, residues, notFound, cacheHits and sorts (the nmrChains whose cached indices were used or\n"
+    "worked out again) and sorted (the resonanceGroups in those sorts)";
+static char resetStats_doc[] = "resetStats()\nReset the getStats counts to zero";
 
 static struct PyMethodDef Clibrary_type_methods[] = {
     {"testReturnList", (PyCFunction)testReturnList, METH_VARARGS, testReturnList_doc},
     {"getNmrResidueIndex", (PyCFunction)getNmrResidueIndex, METH_VARARGS, getNmrResidueIndex_doc},
+    {"getNmrResidueIndices", (PyCFunction)getNmrResidueIndices, METH_VARARGS, getNmrResidueIndices_doc},
+    {"invalidateNmrResidueIndices", (PyCFunction)invalidateNmrResidueIndices, METH_VARARGS,
+     invalidateNmrResidueIndices_doc},
+    {"setStatsEnabled", (PyCFunction)setStatsEnabled, METH_VARARGS, setStatsEnabled_doc},
+    {"getStats", (PyCFunction)getStats, METH_VARARGS, getStats_doc},
+    {"resetStats", (PyCFunction)resetStats, METH_VARARGS, resetStats_doc},
     {NULL, NULL, 0, NULL}};
 
 struct module_state {
@@ -0,0 +1,82 @@
+/*
+======================COPYRIGHT/LICENSE START==========================
+
+dispatch.h: Part of the CcpNmr Analysis program
+
+Copyright (C) 2011 Wayne Boucher and Tim Stevens (University of Cambridge)
+
+=======================================================================
+
+The CCPN license can be found in ../../../license/CCPN.license.
+
+======================COPYRIGHT/LICENSE END============================
+
+for further information, please contact :
+
+- CCPN website (http://www.ccpn.ac.uk/)
+
+- email: ccpn@bioc.cam.ac.uk
+
+- contact the authors: wb104@bioc.cam.ac.uk, tjs23@cam.ac.uk
+=======================================================================
+
+If you are using this software for academic purposes, we suggest
+quoting the following references:
+
+===========================REFERENCE START=============================
+R. Fogh, J. Ionides, E. Ulrich, W. Boucher, W. Vranken, J.P. Linge, M.
+Habeck, W. Rieping, T.N. Bhat, J. Westbrook, K. Henrick, G. Gilliland,
+H. Berman, J. Thornton, M. Nilges, J. Markley and E. Laue (2002). The
+CCPN project: An interim report on a data model for the NMR community
+(Progress report). Nature Struct. Biol. 9, 416-418.
+
+Wim F. Vranken, Wayne Boucher, Tim J. Stevens, Rasmus
+H. Fogh, Anne Pajon, Miguel Llinas, Eldon L. Ulrich, John L. Markley, John
+Ionides and Ernest D. Laue (2005). The CCPN Data Model for NMR Spectroscopy:
+Development of a Software Pipeline. Proteins 59, 687 - 696.
+
+===========================REFERENCE END===============================
+
+*/
+#ifndef _incl_dispatch
+#define _incl_dispatch
+
+/* CCPN_MULTIVERSION before a (hot, vectorisable) function makes the compiler */
+/* build it for AVX-512, AVX2 and the baseline, with the version used chosen */
+/* at run time for the cpu (an ifunc), so one binary runs anywhere and still */
+/* uses the wider vectors where they are there.  This needs gcc 6 or clang 14 */
+/* on x86-64 Linux, elsewhere (and with CCPN_NO_MULTIVERSION, CCPN_NO_SIMD or */
+/* -march set, see ../../setup_options.py) it does nothing.  The versions can round */
+/* differently (e.g. fused multiply-add), so results can differ in the last */
+/* bits between cpus.  aarch64 always has NEON, so gets no versions. */
+
+#if !defined(CCPN_NO_MULTIVERSION) && !defined(CCPN_NO_SIMD) && defined(__x86_64__) && defined(__linux__) && \
+    ((defined(__clang__) && (__clang_major__ >= 14)) || (!defined(__clang__) && defined(__GNUC__) && (__GNUC__ >= 6)))
+#define CCPN_HAVE_MULTIVERSION 1
+#define CCPN_MULTIVERSION __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define CCPN_HAVE_MULTIVERSION 0
+#define CCPN_MULTIVERSION
+#endif
+
+#if defined(CCPN_OPENMP) && defined(_OPENMP)
+#define CCPN_HAVE_OPENMP 1
+#else
+#define CCPN_HAVE_OPENMP 0
+#endif
+
+/* the widest instructions the cpu has of those the versions are built for */
+static inline const char *dispatch_cpu_target(void)
+{
+#if CCPN_HAVE_MULTIVERSION
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return "avx512f";
+    if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+#endif
+
+    return "default";
+}
+
+#endif /* _incl_dispatch */
@@ -0,0 +1,498 @@
+/*
+======================COPYRIGHT/LICENSE START==========================
+
+parallel.c: Part of the CcpNmr Analysis program
+
+Copyright (C) 2011 Wayne Boucher and Tim Stevens (University of Cambridge)
+
+=======================================================================
+
+The CCPN license can be found in ../../../license/CCPN.license.
+
+======================COPYRIGHT/LICENSE END============================
+
+for further information, please contact :
+
+- CCPN website (http://www.ccpn.ac.uk/)
+
+- email: ccpn@bioc.cam.ac.uk
+
+- contact the authors: wb104@bioc.cam.ac.uk, tjs23@cam.ac.uk
+=======================================================================
+
+If you are using this software for academic purposes, we suggest
+quoting the following references:
+
+===========================REFERENCE START=============================
+R. Fogh, J. Ionides, E. Ulrich, W. Boucher, W. Vranken, J.P. Linge, M.
+Habeck, W. Rieping, T.N. Bhat, J. Westbrook, K. Henrick, G. Gilliland,
+H. Berman, J. Thornton, M. Nilges, J. Markley and E. Laue (2002). The
+CCPN project: An interim report on a data model for the NMR community
+(Progress report). Nature Struct. Biol. 9, 416-418.
+
+Wim F. Vranken, Wayne Boucher, Tim J. Stevens, Rasmus
+H. Fogh, Anne Pajon, Miguel Llinas, Eldon L. Ulrich, John L. Markley, John
+Ionides and Ernest D. Laue (2005). The CCPN Data Model for NMR Spectroscopy:
+Development of a Software Pipeline. Proteins 59, 687 - 696.
+
+===========================REFERENCE END===============================
+
+*/
+#include "parallel.h"
+#include "dispatch.h"
+
+#ifdef WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+typedef struct _Parallel_job
+{
+    int ntasks;
+    int next_task;
+    CcpnStatus status;
+    Parallel_task_func func;
+    void *user_data;
+#ifdef WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+} Parallel_job;
+
+#ifdef WIN32
+#define  JOB_LOCK(job)  EnterCriticalSection(&(job)->lock)
+#define  JOB_UNLOCK(job)  LeaveCriticalSection(&(job)->lock)
+#else
+#define  JOB_LOCK(job)  pthread_mutex_lock(&(job)->lock)
+#define  JOB_UNLOCK(job)  pthread_mutex_unlock(&(job)->lock)
+#endif
+
+/* returns the next task to run, or -1 if none left (or an earlier one failed) */
+static int next_task(Parallel_job *job)
+{
+    int task = -1;
+
+    JOB_LOCK(job);
+    if ((job->status == CCPN_OK) && (job->next_task < job->ntasks))
+        task = job->next_task++;
+    JOB_UNLOCK(job);
+
+    return task;
+}
+
+static void run_tasks(Parallel_job *job)
+{
+    int task;
+
+    while ((task = next_task(job)) >= 0)
+    {
+        if ((*job->func)(task, job->user_data) == CCPN_ERROR)
+        {
+            JOB_LOCK(job);
+            job->status = CCPN_ERROR;
+            JOB_UNLOCK(job);
+        }
+    }
+}
+
+#if !CCPN_HAVE_OPENMP
+#ifdef WIN32
+static unsigned __stdcall worker(void *arg)
+{
+    run_tasks((Parallel_job *) arg);
+
+    return 0;
+}
+#else
+static void *worker(void *arg)
+{
+    run_tasks((Parallel_job *) arg);
+
+    return NULL;
+}
+#endif
+#endif
+
+int parallel_num_cpus(void)
+{
+    int ncpus;
+#ifdef WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    ncpus = (int) info.dwNumberOfProcessors;
+#else
+    ncpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return MAX(1, ncpus);
+}
+
+/* only differences between two calls mean anything */
+double parallel_seconds(void)
+{
+#ifdef WIN32
+    LARGE_INTEGER count, frequency;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+
+    return (double) count.QuadPart / (double) frequency.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + 1.0e-9 * now.tv_nsec;
+#endif
+}
+
+/* requested <= 0 means use all cpus */
+int parallel_num_threads(int requested, int ntasks)
+{
+    int nthreads = (requested > 0) ? requested : parallel_num_cpus();
+
+    nthreads = MIN(nthreads, ntasks);
+    nthreads = MIN(nthreads, PARALLEL_MAX_THREADS);
+
+    return MAX(1, nthreads);
+}
+
+/* runs func(task, user_data) for task = 0 .. ntasks-1 on nthreads threads */
+/* (including the calling thread), returns CCPN_ERROR if any task failed */
+CcpnStatus parallel_for(int ntasks, int nthreads,
+				Parallel_task_func func, void *user_data)
+{
+    int i, nstarted;
+    Parallel_job job;
+#ifdef WIN32
+    HANDLE threads[PARALLEL_MAX_THREADS];
+#else
+    pthread_t threads[PARALLEL_MAX_THREADS];
+#endif
+
+    nthreads = MIN(nthreads, ntasks);
+    nthreads = MIN(nthreads, PARALLEL_MAX_THREADS);
+
+    if (nthreads <= 1)
+    {
+        for (i = 0; i < ntasks; i++)
+            CHECK_STATUS((*func)(i, user_data));
+
+        return CCPN_OK;
+    }
+
+    job.ntasks = ntasks;
+    job.next_task = 0;
+    job.status = CCPN_OK;
+    job.func = func;
+    job.user_data = user_data;
+
+#ifdef WIN32
+    InitializeCriticalSection(&job.lock);
+#else
+    pthread_mutex_init(&job.lock, NULL);
+#endif
+
+#if CCPN_HAVE_OPENMP
+    /* the OpenMP runtime keeps its threads between calls, the tasks are handed out as below */
+    nstarted = 0;
+#pragma omp parallel num_threads(nthreads)
+    run_tasks(&job);
+#else
+    /* if a thread cannot be started the remaining ones just do more work */
+    for (nstarted = 0; nstarted < nthreads-1; nstarted++)
+    {
+#ifdef WIN32
+        threads[nstarted] = (HANDLE) _beginthreadex(NULL, 0, worker, &job, 0, NULL);
+        if (!threads[nstarted])
+            break;
+#else
+        if (pthread_create(&threads[nstarted], NULL, worker, &job) != 0)
+            break;
+#endif
+    }
+
+    run_tasks(&job);
+#endif
+
+    for (i = 0; i < nstarted; i++)
+    {
+#ifdef WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+
+#ifdef WIN32
+    DeleteCriticalSection(&job.lock);
+#else
+    pthread_mutex_destroy(&job.lock);
+#endif
+
+    return job.status;
+}
+
+struct _Parallel_lock
+{
+#ifdef WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+/* the background pool: PARALLEL_BACKGROUND_THREADS threads, started with the first work */
+/* queued and kept from then on, taking the work from a queue oldest first */
+
+#define  WORK_QUEUED   0
+#define  WORK_RUNNING  1
+#define  WORK_DONE     2
+
+struct _Parallel_work
+{
+    Parallel_task_func func;
+    void *user_data;
+    CcpnStatus status;
+    int state;  /* under pool_lock */
+    struct _Parallel_work *next;  /* in the queue */
+};
+
+static Parallel_work queue_head = NULL, queue_tail = NULL;
+static CcpnBool queue_paused = CCPN_FALSE;
+static int npool_threads = 0;
+
+#ifdef WIN32
+static INIT_ONCE pool_once = INIT_ONCE_STATIC_INIT;
+static CRITICAL_SECTION pool_lock;
+static CONDITION_VARIABLE pool_work_cond;  /* work queued or the queue unpaused */
+static CONDITION_VARIABLE pool_done_cond;  /* work done */
+
+#define  POOL_LOCK()  EnterCriticalSection(&pool_lock)
+#define  POOL_UNLOCK()  LeaveCriticalSection(&pool_lock)
+#define  POOL_WAIT(cond)  SleepConditionVariableCS(&(cond), &pool_lock, INFINITE)
+#define  POOL_WAKE(cond)  WakeAllConditionVariable(&(cond))
+#else
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done_cond = PTHREAD_COND_INITIALIZER;
+
+#define  POOL_LOCK()  pthread_mutex_lock(&pool_lock)
+#define  POOL_UNLOCK()  pthread_mutex_unlock(&pool_lock)
+#define  POOL_WAIT(cond)  pthread_cond_wait(&(cond), &pool_lock)
+#define  POOL_WAKE(cond)  pthread_cond_broadcast(&(cond))
+#endif
+
+#ifdef WIN32
+static unsigned __stdcall pool_main(void *arg)
+#else
+static void *pool_main(void *arg)
+#endif
+{
+    Parallel_work work;
+
+    POOL_LOCK();
+
+    for (;;)
+    {
+        while (!queue_head || queue_paused)
+            POOL_WAIT(pool_work_cond);
+
+        work = queue_head;
+        queue_head = work->next;
+        if (!queue_head)
+            queue_tail = NULL;
+        work->state = WORK_RUNNING;
+
+        POOL_UNLOCK();
+        work->status = (*work->func)(0, work->user_data);
+        POOL_LOCK();
+
+        work->state = WORK_DONE;
+        POOL_WAKE(pool_done_cond);
+    }
+
+#ifdef WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+/* the threads are never joined, they wait for work until the process exits */
+#ifdef WIN32
+static BOOL CALLBACK start_pool(PINIT_ONCE once, void *param, void **context)
+{
+    int i;
+    HANDLE handle;
+
+    InitializeCriticalSection(&pool_lock);
+    InitializeConditionVariable(&pool_work_cond);
+    InitializeConditionVariable(&pool_done_cond);
+
+    for (i = 0; i < PARALLEL_BACKGROUND_THREADS; i++)
+    {
+        handle = (HANDLE) _beginthreadex(NULL, 0, pool_main, NULL, 0, NULL);
+        if (!handle)
+            break;
+        CloseHandle(handle);
+        npool_threads++;
+    }
+
+    return TRUE;
+}
+#else
+static void start_pool(void)
+{
+    int i;
+    pthread_t handle;
+
+    for (i = 0; i < PARALLEL_BACKGROUND_THREADS; i++)
+    {
+        if (pthread_create(&handle, NULL, pool_main, NULL) != 0)
+            break;
+        pthread_detach(handle);
+        npool_threads++;
+    }
+}
+#endif
+
+Parallel_lock new_parallel_lock(void)
+{
+    Parallel_lock lock;
+
+    MALLOC_NEW(lock, struct _Parallel_lock, 1);
+
+#ifdef WIN32
+    InitializeCriticalSection(&lock->lock);
+#else
+    pthread_mutex_init(&lock->lock, NULL);
+#endif
+
+    return lock;
+}
+
+void delete_parallel_lock(Parallel_lock lock)
+{
+    if (!lock)
+        return;
+
+#ifdef WIN32
+    DeleteCriticalSection(&lock->lock);
+#else
+    pthread_mutex_destroy(&lock->lock);
+#endif
+
+    FREE(lock, struct _Parallel_lock);
+}
+
+void parallel_lock(Parallel_lock lock)
+{
+    JOB_LOCK(lock);
+}
+
+void parallel_unlock(Parallel_lock lock)
+{
+    JOB_UNLOCK(lock);
+}
+
+static void ensure_pool(void)
+{
+#ifdef WIN32
+    InitOnceExecuteOnce(&pool_once, start_pool, NULL, NULL);
+#else
+    pthread_once(&pool_once, start_pool);
+#endif
+}
+
+Parallel_work parallel_queue(Parallel_task_func func, void *user_data)
+{
+    Parallel_work work;
+
+    ensure_pool();
+
+    if (npool_threads == 0)
+        return NULL;
+
+    MALLOC_NEW(work, struct _Parallel_work, 1);
+
+    work->func = func;
+    work->user_data = user_data;
+    work->status = CCPN_OK;
+    work->state = WORK_QUEUED;
+    work->next = NULL;
+
+    POOL_LOCK();
+    if (queue_tail)
+        queue_tail->next = work;
+    else
+        queue_head = work;
+    queue_tail = work;
+    POOL_WAKE(pool_work_cond);
+    POOL_UNLOCK();
+
+    return work;
+}
+
+CcpnBool parallel_unqueue(Parallel_work work)
+{
+    Parallel_work prev = NULL, w;
+    CcpnBool unqueued = CCPN_FALSE;
+
+    POOL_LOCK();
+
+    if (work->state == WORK_QUEUED)
+    {
+        for (w = queue_head; w != work; w = w->next)
+            prev = w;
+
+        if (prev)
+            prev->next = work->next;
+        else
+            queue_head = work->next;
+
+        if (queue_tail == work)
+            queue_tail = prev;
+
+        work->state = WORK_DONE;
+        work->status = CCPN_ERROR;
+        unqueued = CCPN_TRUE;
+    }
+
+    POOL_UNLOCK();
+
+    return unqueued;
+}
+
+CcpnStatus parallel_wait(Parallel_work work)
+{
+    CcpnStatus status;
+
+    POOL_LOCK();
+    while (work->state != WORK_DONE)
+        POOL_WAIT(pool_done_cond);
+    POOL_UNLOCK();
+
+    status = work->status;
+    FREE(work, struct _Parallel_work);
+
+    return status;
+}
+
+void parallel_pause_queue(CcpnBool paused)
+{
+    ensure_pool();
+
+    POOL_LOCK();
+    queue_paused = paused;
+    POOL_WAKE(pool_work_cond);
+    POOL_UNLOCK();
+}
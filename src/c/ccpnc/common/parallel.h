@@ -0,0 +1,95 @@
+/*
+======================COPYRIGHT/LICENSE START==========================
+
+parallel.h: Part of the CcpNmr Analysis program
+
+Copyright (C) 2011 Wayne Boucher and Tim Stevens (University of Cambridge)
+
+=======================================================================
+
+The CCPN license can be found in ../../../license/CCPN.license.
+
+======================COPYRIGHT/LICENSE END============================
+
+for further information, please contact :
+
+- CCPN website (http://www.ccpn.ac.uk/)
+
+- email: ccpn@bioc.cam.ac.uk
+
+- contact the authors: wb104@bioc.cam.ac.uk, tjs23@cam.ac.uk
+=======================================================================
+
+If you are using this software for academic purposes, we suggest
+quoting the following references:
+
+===========================REFERENCE START=============================
+R. Fogh, J. Ionides, E. Ulrich, W. Boucher, W. Vranken, J.P. Linge, M.
+Habeck, W. Rieping, T.N. Bhat, J. Westbrook, K. Henrick, G. Gilliland,
+H. Berman, J. Thornton, M. Nilges, J. Markley and E. Laue (2002). The
+CCPN project: An interim report on a data model for the NMR community
+(Progress report). Nature Struct. Biol. 9, 416-418.
+
+Wim F. Vranken, Wayne Boucher, Tim J. Stevens, Rasmus
+H. Fogh, Anne Pajon, Miguel Llinas, Eldon L. Ulrich, John L. Markley, John
+Ionides and Ernest D. Laue (2005). The CCPN Data Model for NMR Spectroscopy:
+Development of a Software Pipeline. Proteins 59, 687 - 696.
+
+===========================REFERENCE END===============================
+
+*/
+#ifndef _incl_parallel
+#define _incl_parallel
+
+#include "defns.h"
+
+/* Minimal worker pool for running independent tasks on several threads. */
+/* Tasks are numbered 0 .. ntasks-1 and handed out in increasing order, */
+/* so a thread never sees a task until all lower numbered ones have started. */
+/* Task functions must not call into Python (the GIL is normally released). */
+
+#define  PARALLEL_MAX_THREADS  64
+
+typedef CcpnStatus (*Parallel_task_func)(int task, void *user_data);
+
+extern int parallel_num_cpus(void);
+
+extern int parallel_num_threads(int requested, int ntasks);
+
+/* seconds from a monotonic clock, for timing the work (e.g. the statistics) */
+extern double parallel_seconds(void);
+
+extern CcpnStatus parallel_for(int ntasks, int nthreads,
+				Parallel_task_func func, void *user_data);
+
+/* a mutex, and single functions run in the background on a fixed pool of threads */
+
+#define  PARALLEL_BACKGROUND_THREADS  2
+
+typedef struct _Parallel_lock *Parallel_lock;
+
+typedef struct _Parallel_work *Parallel_work;
+
+extern Parallel_lock new_parallel_lock(void);
+
+extern void delete_parallel_lock(Parallel_lock lock);
+
+extern void parallel_lock(Parallel_lock lock);
+
+extern void parallel_unlock(Parallel_lock lock);
+
+/* queues func(0, user_data) to run on a background thread, oldest first, */
+/* returns NULL if it cannot be queued (or no background thread could be started) */
+extern Parallel_work parallel_queue(Parallel_task_func func, void *user_data);
+
+/* takes work off the queue if it has not started, returns CCPN_TRUE if so, */
+/* and then func is never run and parallel_wait returns CCPN_ERROR at once */
+extern CcpnBool parallel_unqueue(Parallel_work work);
+
+/* waits for work to finish (or be unqueued), and frees it, returns what func returned */
+extern CcpnStatus parallel_wait(Parallel_work work);
+
+/* while paused no queued work is started, e.g. so that tests can cancel work before it runs */
+extern void parallel_pause_queue(CcpnBool paused);
+
+#endif /* _incl_parallel */
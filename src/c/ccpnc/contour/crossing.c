@@ -0,0 +1,208 @@
+/*
+======================COPYRIGHT/LICENSE START==========================
+
+crossing.c: Part of the CcpNmr Analysis program
+
+Copyright (C) 2011 Wayne Boucher and Tim Stevens (University of Cambridge)
+
+=======================================================================
+
+The CCPN license can be found in ../../../license/CCPN.license.
+
+======================COPYRIGHT/LICENSE END============================
+
+for further information, please contact :
+
+- CCPN website (http://www.ccpn.ac.uk/)
+
+- email: ccpn@bioc.cam.ac.uk
+
+- contact the authors: wb104@bioc.cam.ac.uk, tjs23@cam.ac.uk
+=======================================================================
+
+If you are using this software for academic purposes, we suggest
+quoting the following references:
+
+===========================REFERENCE START=============================
+R. Fogh, J. Ionides, E. Ulrich, W. Boucher, W. Vranken, J.P. Linge, M.
+Habeck, W. Rieping, T.N. Bhat, J. Westbrook, K. Henrick, G. Gilliland,
+H. Berman, J. Thornton, M. Nilges, J. Markley and E. Laue (2002). The
+CCPN project: An interim report on a data model for the NMR community
+(Progress report). Nature Struct. Biol. 9, 416-418.
+
+Wim F. Vranken, Wayne Boucher, Tim J. Stevens, Rasmus
+H. Fogh, Anne Pajon, Miguel Llinas, Eldon L. Ulrich, John L. Markley, John
+Ionides and Ernest D. Laue (2005). The CCPN Data Model for NMR Spectroscopy:
+Development of a Software Pipeline. Proteins 59, 687 - 696.
+
+===========================REFERENCE END===============================
+
+*/
+#include "crossing.h"
+
+#if !defined(CCPN_NO_SIMD) && !defined(CONTOUR_NO_SIMD)
+#if defined(__x86_64__) || defined(_M_X64)
+#define CROSSING_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define CROSSING_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CROSSING_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#define  ABOVE_LEVEL(d)  ((d) > level)
+
+static int find_crossing_scalar(const float32 *row0, const float32 *row1, int start, int end,
+				float level, CcpnBool above)
+{
+    int j;
+
+    if (above)
+    {
+        for (j = start; j < end; j++)
+        {
+            if (!ABOVE_LEVEL(row0[j]) || !ABOVE_LEVEL(row1[j]))
+                break;
+        }
+    }
+    else
+    {
+        for (j = start; j < end; j++)
+        {
+            if (ABOVE_LEVEL(row0[j]) || ABOVE_LEVEL(row1[j]))
+                break;
+        }
+    }
+
+    return j;
+}
+
+/* index of lowest set bit of non-zero mask */
+static int lowest_bit(unsigned int mask)
+{
+    int n = 0;
+
+    while (!(mask & 1))
+    {
+        mask >>= 1;
+        n++;
+    }
+
+    return n;
+}
+
+#ifdef CROSSING_SSE2
+static int find_crossing_sse2(const float32 *row0, const float32 *row1, int start, int end,
+				float level, CcpnBool above)
+{
+    int j, mask;
+    __m128 lev = _mm_set1_ps(level), a0, a1;
+
+    for (j = start; j + 4 <= end; j += 4)
+    {
+        a0 = _mm_cmpgt_ps(_mm_loadu_ps(row0 + j), lev);
+        a1 = _mm_cmpgt_ps(_mm_loadu_ps(row1 + j), lev);
+
+        if (above)
+            mask = ~_mm_movemask_ps(_mm_and_ps(a0, a1)) & 0xF;
+        else
+            mask = _mm_movemask_ps(_mm_or_ps(a0, a1));
+
+        if (mask)
+            return j + lowest_bit(mask);
+    }
+
+    return find_crossing_scalar(row0, row1, j, end, level, above);
+}
+#endif
+
+#ifdef CROSSING_AVX2
+__attribute__((target("avx2")))
+static int find_crossing_avx2(const float32 *row0, const float32 *row1, int start, int end,
+				float level, CcpnBool above)
+{
+    int j, mask;
+    __m256 lev = _mm256_set1_ps(level), a0, a1;
+
+    for (j = start; j + 8 <= end; j += 8)
+    {
+        a0 = _mm256_cmp_ps(_mm256_loadu_ps(row0 + j), lev, _CMP_GT_OQ);
+        a1 = _mm256_cmp_ps(_mm256_loadu_ps(row1 + j), lev, _CMP_GT_OQ);
+
+        if (above)
+            mask = ~_mm256_movemask_ps(_mm256_and_ps(a0, a1)) & 0xFF;
+        else
+            mask = _mm256_movemask_ps(_mm256_or_ps(a0, a1));
+
+        if (mask)
+            return j + lowest_bit(mask);
+    }
+
+    return find_crossing_sse2(row0, row1, j, end, level, above);
+}
+#endif
+
+#ifdef CROSSING_NEON
+static int find_crossing_neon(const float32 *row0, const float32 *row1, int start, int end,
+				float level, CcpnBool above)
+{
+    int j;
+    uint32x4_t a0, a1, m;
+    float32x4_t lev = vdupq_n_f32(level);
+
+    for (j = start; j + 4 <= end; j += 4)
+    {
+        a0 = vcgtq_f32(vld1q_f32(row0 + j), lev);
+        a1 = vcgtq_f32(vld1q_f32(row1 + j), lev);
+
+        if (above)
+            m = vmvnq_u32(vandq_u32(a0, a1));
+        else
+            m = vorrq_u32(a0, a1);
+
+        /* something in these 4, so find exactly where */
+        if (vmaxvq_u32(m))
+            return find_crossing_scalar(row0, row1, j, j+4, level, above);
+    }
+
+    return find_crossing_scalar(row0, row1, j, end, level, above);
+}
+#endif
+
+static Find_crossing_func find_crossing_func = find_crossing_scalar;
+static const char *find_crossing_name = "scalar";
+
+/* called once when the module is loaded */
+void init_find_crossing(void)
+{
+#if defined(CROSSING_SSE2)
+    find_crossing_func = find_crossing_sse2;
+    find_crossing_name = "sse2";
+#if defined(CROSSING_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        find_crossing_func = find_crossing_avx2;
+        find_crossing_name = "avx2";
+    }
+#endif
+#elif defined(CROSSING_NEON)
+    find_crossing_func = find_crossing_neon;
+    find_crossing_name = "neon";
+#endif
+}
+
+int find_crossing(const float32 *row0, const float32 *row1, int start, int end,
+				float level, CcpnBool above)
+{
+    return (*find_crossing_func)(row0, row1, start, end, level, above);
+}
+
+const char *find_crossing_kernel(void)
+{
+    return find_crossing_name;
+}
@@ -0,0 +1,64 @@
+/*
+======================COPYRIGHT/LICENSE START==========================
+
+crossing.h: Part of the CcpNmr Analysis program
+
+Copyright (C) 2011 Wayne Boucher and Tim Stevens (University of Cambridge)
+
+=======================================================================
+
+The CCPN license can be found in ../../../license/CCPN.license.
+
+======================COPYRIGHT/LICENSE END============================
+
+for further information, please contact :
+
+- CCPN website (http://www.ccpn.ac.uk/)
+
+- email: ccpn@bioc.cam.ac.uk
+
+- contact the authors: wb104@bioc.cam.ac.uk, tjs23@cam.ac.uk
+=======================================================================
+
+If you are using this software for academic purposes, we suggest
+quoting the following references:
+
+===========================REFERENCE START=============================
+R. Fogh, J. Ionides, E. Ulrich, W. Boucher, W. Vranken, J.P. Linge, M.
+Habeck, W. Rieping, T.N. Bhat, J. Westbrook, K. Henrick, G. Gilliland,
+H. Berman, J. Thornton, M. Nilges, J. Markley and E. Laue (2002). The
+CCPN project: An interim report on a data model for the NMR community
+(Progress report). Nature Struct. Biol. 9, 416-418.
+
+Wim F. Vranken, Wayne Boucher, Tim J. Stevens, Rasmus
+H. Fogh, Anne Pajon, Miguel Llinas, Eldon L. Ulrich, John L. Markley, John
+Ionides and Ernest D. Laue (2005). The CCPN Data Model for NMR Spectroscopy:
+Development of a Software Pipeline. Proteins 59, 687 - 696.
+
+===========================REFERENCE END===============================
+
+*/
+#ifndef _incl_crossing
+#define _incl_crossing
+
+#include "defns.h"
+
+/* Kernel used by find_vertices to skip over runs of cells that cannot */
+/* contain a contour, i.e. all four corners are below (or all above) the level. */
+/* Returns the first j in [start, end) where row0[j] or row1[j] is not on the */
+/* same side of level as given by above (above means data > level), or end. */
+/* Vectorised (AVX2 chosen at run time, else SSE2 / NEON), unless compiled */
+/* with CCPN_NO_SIMD (or the older CONTOUR_NO_SIMD). */
+
+typedef int (*Find_crossing_func)(const float32 *row0, const float32 *row1, int start, int end,
+				float level, CcpnBool above);
+
+extern void init_find_crossing(void);
+
+extern int find_crossing(const float32 *row0, const float32 *row1, int start, int end,
+				float level, CcpnBool above);
+
+/* name of the kernel being used, e.g. "avx2" */
+extern const char *find_crossing_kernel(void);
+
+#endif /* _incl_crossing */
@@ -44,6 +44,10 @@ Development of a Software Pipeline. Proteins 59, 687 - 696.
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION    // so that warnings avoided
 #include "arrayobject.h"
 #include "npy_defns.h"
+#include "parallel.h"
+#include "dispatch.h"
+#include "crossing.h"
+#include "pool.h"
 
 /*
   Module: Contourer2d
@@ -63,27 +67,59 @@ Development of a Software Pipeline. Proteins 59, 687 - 696.
       the second index is 0 for x and 1 for y
 */
 
-// define a global object(cheating for the minute)
-static PyObject *gl_object_list;
-static int numIndices = 0;
-static int numVertices = 0;
-static int numColours = 0;
-static int indexCount = 0;
-static int vertexCount = 0;
-static int colourCount = 0;
-static int lastIndex = 0;
-static int lastVertex = 0;
-static PyArrayObject *indexing;
-static PyArrayObject *vertices;
-static PyArrayObject *colours;
-static unsigned int *indexPTR;
-static float32 *vertexPTR;
-static float32 *colourPTR;
-
-#define CONTOUR_NALLOC 50 /* allocate vertices in this size bunch */
+// per-call state for contourerGLList (so that the module is re-entrant)
+typedef struct _Contour_gl_state {
+    int numIndices;
+    int numVertices;
+    int indexCount;
+    int vertexCount;
+    int colourCount;
+    int lastIndex;
+    unsigned int *indexPTR;
+    float32 *vertexPTR;
+    float32 *colourPTR;
+} Contour_gl_state;
+
+#define CONTOUR_NALLOC 64 /* allocate vertices in this size bunch (doubling for each block) */
 
 static PyObject *ErrorObject; /* locally-raised exception */
 
+#define CONTOUR_STATS_NLEVELS 32 /* levels counted separately, any after are added to the last */
+
+/* what the contouring has done since resetStats, only counted while setStatsEnabled(True), */
+/* only updated (and read) with the GIL held, the threads keep their own counts until then */
+typedef struct _Contour_stats {
+    long ncalls;
+    long nplanes;
+    long nlevels;                  /* levels contoured, over all the planes */
+    long nvertices;
+    long nchains;
+    double find_vertices_seconds;  /* summed over the threads */
+    double process_chains_seconds;
+    int nlevel_counts;             /* level_vertices and level_chains used */
+    long level_vertices[CONTOUR_STATS_NLEVELS]; /* by index of the level in posLevels (or negLevels) */
+    long level_chains[CONTOUR_STATS_NLEVELS];
+} Contour_stats;
+
+static CcpnBool stats_enabled = CCPN_FALSE;
+static Contour_stats contour_stats;
+
+static void add_level_stats(int l, long nvertices, long nchains) {
+    l = MIN(l, CONTOUR_STATS_NLEVELS - 1);
+
+    contour_stats.nlevels++;
+    contour_stats.nvertices += nvertices;
+    contour_stats.nchains += nchains;
+    contour_stats.level_vertices[l] += nvertices;
+    contour_stats.level_chains[l] += nchains;
+    contour_stats.nlevel_counts = MAX(contour_stats.nlevel_counts, l + 1);
+}
+
+static void add_call_stats(int nplanes) {
+    contour_stats.ncalls++;
+    contour_stats.nplanes += nplanes;
+}
+
 typedef struct _Contour_vertex {
     float x[2];
     struct _Contour_vertex *v1; /* previous vertex (NULL if none) */
@@ -91,14 +127,30 @@ typedef struct _Contour_vertex {
     CcpnBool visited;           /* = CCPN_FALSE if not visited, CCPN_TRUE if visited */
 } * Contour_vertex;
 
+#define CONTOUR_SUMMARY_BLOCK 16 /* cells along each side of the blocks of a plane summary */
+
+/* a summary costs a pass over the plane, so it is only made for enough levels to pay for it */
+#define CONTOUR_SUMMARY_MIN_LEVELS        4 /* levels of a plane (both signs) when it is split into bands */
+#define CONTOUR_SUMMARY_MIN_SERIAL_LEVELS 8 /* the same when it is contoured in one band */
+
+/* the smallest and largest data of each block of cells of a plane (corners included), */
+/* so that find_vertices can jump over blocks that a level cannot go through */
+typedef struct _Contour_summary {
+    PyArrayObject *data;
+    int nblocks0;       /* blocks along a row */
+    int nblocks1;       /* rows of blocks */
+    float32 *block_min; /* of block (c, r) at r * nblocks0 + c, NaN if it has any NaN */
+    float32 *block_max;
+} Contour_summary;
+
 typedef struct _Contour_vertices {
     int nvertices;                /* number of vertices */
-    int nalloc;                   /* size of each block of vertices allocated */
+    int nalloc;                   /* size of the first block of vertices allocated */
     int nblocks;                  /* number of blocks allocated */
-    Contour_vertex *vertex_store; /* vertex store, ceil(nvertices/nalloc) long */
+    Contour_vertex *vertex_store; /* vertex store, block b holds nalloc << b vertices */
     /* above used to speed up allocation of vertices */
     /* allocate lots in one go and then use one after the other */
-    /* so access via vertex i = vertex_store[i/nalloc] + (i%nalloc) */
+    /* so access via vertex i = get_vertex(vertex_store, nalloc, i) */
 
     /* below are things added to make contouring faster if more than one level */
     CcpnBool are_levels_increasing;
@@ -118,17 +170,62 @@ typedef struct _Contour_vertices {
     int *ncol_ranges_new; /* the number of column ranges in a given row */
     int **col_start_new;  /* the start column for a given range */
     int **col_end_new;    /* the end column for a given range */
+
+    /* the band of rows being contoured, row_start <= y < row_end for the cell rows */
+    /* (the whole array is row_start = 0, row_end = npoints1-1) */
+    int row_start;
+    int row_end;
+    int nrows_alloc; /* size of the row tables above */
+    char *range_tables; /* one block holding all the row/column range tables */
+
+    Contour_vertex *v_row; /* vertex on the bottom edge of each cell in current row, length npoints0-1 */
+
+    /* if not NULL then these record the vertices found on the first and */
+    /* last rows of the band so that bands can be stitched together afterwards */
+    Contour_vertex *seam_bottom; /* length npoints0-1 */
+    Contour_vertex *seam_top;    /* length npoints0-1 */
+
+    volatile int *cancelled; /* checked before each row, NULL if the contouring cannot be cancelled */
+
+    const Contour_summary *summary; /* of the data, NULL if none */
 } * Contour_vertices;
 
-static Contour_vertices new_contour_vertices(PyArrayObject *data, int nlevels, CcpnBool are_levels_increasing) {
+/* vertex blocks grow geometrically, block b holds nalloc << b vertices, */
+/* so the first vertex in block b is number nalloc * (2^b - 1) */
+static int vertex_block(int nalloc, int i, int *p_offset) {
+    int b;
+    unsigned int q = i / nalloc + 1;
+
+#if defined(__GNUC__)
+    b = 31 - __builtin_clz(q);
+#else
+    for (b = 0; q >>= 1; b++)
+        ;
+#endif
+
+    *p_offset = i - nalloc * ((1 << b) - 1);
+
+    return b;
+}
+
+static Contour_vertex get_vertex(Contour_vertex *vertex_store, int nalloc, int i) {
+    int offset, b = vertex_block(nalloc, i, &offset);
+
+    return vertex_store[b] + offset;
+}
+
+static Contour_vertices new_contour_vertices(PyArrayObject *data, int nlevels, CcpnBool are_levels_increasing, int row_start,
+                                             int row_end) {
     int i;
     Contour_vertices contour_vertices;
     int npoints0 = PyArray_DIM(data, 1);
-    int npoints1 = PyArray_DIM(data, 0);
+    int nrows = row_end - row_start + 1;
     int ncols = MAX(1, npoints0 / 2);
     // int ncols = npoints0;
+    int *ints, **ptrs;
 
-    MALLOC_NEW(contour_vertices, struct _Contour_vertices, 1);
+    /* everything comes from the pool, so repeated calls for the same sized plane do not use the heap */
+    POOL_MALLOC_NEW(contour_vertices, struct _Contour_vertices, 1);
 
     contour_vertices->nvertices = 0;
     contour_vertices->nalloc = CONTOUR_NALLOC;
@@ -137,61 +234,78 @@ static Contour_vertices new_contour_vertices(PyArrayObject *data, int nlevels, C
 
     contour_vertices->are_levels_increasing = are_levels_increasing;
 
-    contour_vertices->nrows_old = npoints1 - 1;
-    MALLOC_NEW(contour_vertices->row_old, int, npoints1);
-    MALLOC_NEW(contour_vertices->ncol_ranges_old, int, npoints1);
-    MALLOC_NEW(contour_vertices->col_start_old, int *, npoints1);
-    MALLOC_NEW(contour_vertices->col_end_old, int *, npoints1);
-    for (i = 0; i < npoints1; i++) {
-        contour_vertices->row_old[i] = i;
+    contour_vertices->row_start = row_start;
+    contour_vertices->row_end = row_end;
+    contour_vertices->nrows_alloc = nrows;
+    contour_vertices->seam_bottom = NULL;
+    contour_vertices->seam_top = NULL;
+    contour_vertices->cancelled = NULL;
+    contour_vertices->summary = NULL;
+    contour_vertices->range_tables = NULL;
+    contour_vertices->v_row = NULL;
+
+    /* not POOL_MALLOC_NEW, which would return without freeing contour_vertices */
+    contour_vertices->v_row = (Contour_vertex *)pool_malloc(MAX(1, npoints0 - 1) * sizeof(Contour_vertex));
+    if (!contour_vertices->v_row) {
+        pool_free(contour_vertices);
+        return NULL;
+    }
+
+    /* the row/column range tables (both old and new): 4 arrays of row pointers, */
+    /* then 4 int arrays of length nrows and 4 of length nrows * ncols */
+    contour_vertices->range_tables =
+        (char *)pool_malloc(4 * nrows * sizeof(int *) + (4 * (size_t)nrows + 4 * (size_t)nrows * ncols) * sizeof(int));
+    if (!contour_vertices->range_tables) {
+        pool_free(contour_vertices->v_row);
+        pool_free(contour_vertices);
+        return NULL;
+    }
+
+    ptrs = (int **)contour_vertices->range_tables;
+    contour_vertices->col_start_old = ptrs;
+    contour_vertices->col_end_old = ptrs + nrows;
+    contour_vertices->col_start_new = ptrs + 2 * nrows;
+    contour_vertices->col_end_new = ptrs + 3 * nrows;
+
+    ints = (int *)(ptrs + 4 * nrows);
+    contour_vertices->row_old = ints;
+    contour_vertices->ncol_ranges_old = ints + nrows;
+    contour_vertices->row_new = ints + 2 * nrows;
+    contour_vertices->ncol_ranges_new = ints + 3 * nrows;
+
+    ints += 4 * nrows;
+    for (i = 0; i < nrows; i++) {
+        contour_vertices->col_start_old[i] = ints + (4 * i) * ncols;
+        contour_vertices->col_end_old[i] = ints + (4 * i + 1) * ncols;
+        contour_vertices->col_start_new[i] = ints + (4 * i + 2) * ncols;
+        contour_vertices->col_end_new[i] = ints + (4 * i + 3) * ncols;
+    }
+
+    contour_vertices->nrows_old = row_end - row_start;
+    for (i = 0; i < nrows; i++) {
+        contour_vertices->row_old[i] = row_start + i;
         contour_vertices->ncol_ranges_old[i] = 1;
-        MALLOC_NEW(contour_vertices->col_start_old[i], int, ncols);
-        MALLOC_NEW(contour_vertices->col_end_old[i], int, ncols);
         contour_vertices->col_start_old[i][0] = 0;
         contour_vertices->col_end_old[i][0] = npoints0;
     }
 
-    // TBD: should not need _new variables if nlevels = 1 but crashes if do not have them
-    // if (nlevels > 1)
-    {
-        contour_vertices->nrows_new = 0;
-        MALLOC_NEW(contour_vertices->row_new, int, npoints1);
-        MALLOC_NEW(contour_vertices->ncol_ranges_new, int, npoints1);
-        MALLOC_NEW(contour_vertices->col_start_new, int *, npoints1);
-        MALLOC_NEW(contour_vertices->col_end_new, int *, npoints1);
-        for (i = 0; i < npoints1; i++) {
-            MALLOC_NEW(contour_vertices->col_start_new[i], int, ncols);
-            MALLOC_NEW(contour_vertices->col_end_new[i], int, ncols);
-        }
-    }
+    contour_vertices->nrows_new = 0;
 
     return contour_vertices;
 }
 
-static void delete_contour_vertices(Contour_vertices vertices, int nlevels, int npoints1) {
+static void delete_contour_vertices(Contour_vertices vertices, int nlevels) {
     int i;
 
     if (!vertices) return;
 
-    for (i = 0; i < vertices->nblocks; i++) FREE(vertices->vertex_store[i], struct _Contour_vertex);
-
-    FREE(vertices->vertex_store, Contour_vertex);
+    for (i = 0; i < vertices->nblocks; i++) POOL_FREE(vertices->vertex_store[i], struct _Contour_vertex);
 
-    FREE(vertices->row_old, int);
-    FREE(vertices->ncol_ranges_old, int);
-    FREE2(vertices->col_start_old, int, npoints1);
-    FREE2(vertices->col_end_old, int, npoints1);
-
-    // TBD: should not need _new variables if nlevels = 1 but crashes if do not have them
-    // if (nlevels > 1)
-    {
-        FREE(vertices->row_new, int);
-        FREE(vertices->ncol_ranges_new, int);
-        FREE2(vertices->col_start_new, int, npoints1);
-        FREE2(vertices->col_end_new, int, npoints1);
-    }
+    POOL_FREE(vertices->vertex_store, Contour_vertex);
+    POOL_FREE(vertices->v_row, Contour_vertex);
+    POOL_FREE(vertices->range_tables, char);
 
-    FREE(vertices, struct _Contour_vertices);
+    POOL_FREE(vertices, struct _Contour_vertices);
 }
 
 #define NEITHER     0
@@ -257,23 +371,18 @@ static void swap_old_new(Contour_vertices contour_vertices) {
 static Contour_vertex new_vertex(Contour_vertices contour_vertices) {
     int nvertices = contour_vertices->nvertices;
     int nalloc = contour_vertices->nalloc;
-    int nblocks = contour_vertices->nblocks, block;
+    int nblocks = contour_vertices->nblocks, block, offset;
     Contour_vertex v;
 
-    block = nvertices / nalloc;
-    if (block >= nblocks) /* time for a new block of storage */
+    block = vertex_block(nalloc, nvertices, &offset);
+    if (block >= nblocks) /* time for a new block of storage, twice the size of the last one */
     {
-        if (nblocks == 0) {
-            MALLOC_NEW(contour_vertices->vertex_store, Contour_vertex, 1);
-        } else {
-            REALLOC_NEW(contour_vertices->vertex_store, Contour_vertex, nblocks + 1);
-        }
-
-        MALLOC_NEW(contour_vertices->vertex_store[nblocks], struct _Contour_vertex, nalloc);
+        POOL_REALLOC_NEW(contour_vertices->vertex_store, Contour_vertex, nblocks + 1);
+        POOL_MALLOC_NEW(contour_vertices->vertex_store[nblocks], struct _Contour_vertex, nalloc << nblocks);
         contour_vertices->nblocks++;
     }
 
-    v = contour_vertices->vertex_store[block] + (nvertices % nalloc);
+    v = contour_vertices->vertex_store[block] + offset;
     contour_vertices->nvertices++;
 
     v->v1 = v->v2 = NULL;
@@ -647,62 +756,161 @@ static CcpnStatus no_edge33(Contour_vertices contour_vertices, float level, Ccpn
 #define N 4
 
 #define GET_DATA(j0, j1)     (*((float32 *)PyArray_GETPTR2(data, (j1), (j0))))
-#define GET_DATA0(j0, j1)    (*((float32 *)PyArray_GETPTR2(data0, j0, j1)))
-#define GET_DATA1(j0, j1)    (*((float32 *)PyArray_GETPTR2(data1, j0, j1)))
 #define DATA_ABOVE_LEVEL(d)  (((d) > level) ? 1 : 0)
 #define DATA_ABOVE_LEVEL2(d) (((d) > level) ? 2 : 0)
 
-static CcpnStatus update_bounds(PyArrayObject *data0, PyArrayObject *data1) {
-    // get the dimensions
-    int npointsi = PyArray_DIM(data0, 0);
-    int npointsj = PyArray_DIM(data0, 1);
-    int npointsi1 = PyArray_DIM(data1, 0);
-    int npointsj1 = PyArray_DIM(data1, 1);
-    int size = npointsi * npointsj;
-    npy_float32 v0, v1, v0min, v0max, v1min, v1max, sum;
-
-    // check that the arrays are the same size
-    if ((npointsi != npointsi1) || (npointsj != npointsj1)) return CCPN_OK;
-
-    // generate pointers to the numpy c data
-    npy_float32 *p0 = (npy_float32 *)PyArray_DATA(data0);
-    npy_float32 *p1 = (npy_float32 *)PyArray_DATA(data1);
-
-    // NOTE:ED - use c indexing to access the array, MUST be an npy_float32 array
-    for (int ii = 0; ii < size; ii++) {
-        v0 = p0[ii];
-        v1 = p1[ii];
-        v0max = MAX(v0, 0.0);
-        v0min = MIN(v0, 0.0);
-        v1max = MAX(v1, 0.0);
-        v1min = MIN(v1, 0.0);
-        p0[ii] = MAX(v0max, v1max) + MIN(v0min, v1min);
-    }
-
-    //    // iterate through the array in pyArray method
-    //    for (int ii=0; ii < npointsi; ii++)
-    //        for (int jj=0; jj < npointsj; jj++)
-    //        {
-    //            v0 = GET_DATA0(ii, jj);
-    //            v1 = GET_DATA1(ii, jj);
-    //            v0max = MAX(v0, 0.0);
-    //            v0min = MIN(v0, 0.0);
-    //            v1max = MAX(v1, 0.0);
-    //            v1min = MIN(v1, 0.0);
-    //            PyArray_SETITEM(data0, PyArray_GETPTR2(data0, ii, jj), PyFloat_FromDouble(MAX(v0max, v1max) + MIN(v0min,
-    //            v1min)));
-    //        }
+#define PROJECT_BLOCK     2048 /* points of a row projected at a time, so the partial result stays in cache */
+#define PROJECT_TASK_ROWS 16   /* rows of the output in each task */
+
+typedef struct _Project_job {
+    int nplanes;
+    PyArrayObject **planes; /* the planes with the same shape as the first */
+    float32 *output;        /* C-contiguous, same shape as the planes */
+    int nrows;
+    int ncols;
+} Project_job;
+
+/* acc = max of the positive parts + min of the negative parts of acc and the plane row */
+/* (each plane folded into the result in turn, as the original pairwise version) */
+CCPN_MULTIVERSION static void project_row(float32 *acc, char *row, npy_intp stride, int n) {
+    int j;
+    float32 a, b, *v;
+
+    if (stride == sizeof(float32)) {
+        v = (float32 *)row;
+        for (j = 0; j < n; j++) {
+            a = acc[j];
+            b = v[j];
+            acc[j] = MAX(MAX(a, 0.0f), MAX(b, 0.0f)) + MIN(MIN(a, 0.0f), MIN(b, 0.0f));
+        }
+    } else {
+        for (j = 0; j < n; j++) {
+            a = acc[j];
+            b = *((float32 *)(row + j * stride));
+            acc[j] = MAX(MAX(a, 0.0f), MAX(b, 0.0f)) + MIN(MIN(a, 0.0f), MIN(b, 0.0f));
+        }
+    }
+}
+
+static CcpnStatus project_task(int task, void *user_data) {
+    Project_job *job = (Project_job *)user_data;
+    int i, j, c, n, p;
+    int row_start = task * PROJECT_TASK_ROWS, row_end = MIN(row_start + PROJECT_TASK_ROWS, job->nrows);
+    npy_intp stride;
+    char *row;
+    float32 *acc;
+
+    for (i = row_start; i < row_end; i++) {
+        for (c = 0; c < job->ncols; c += PROJECT_BLOCK) {
+            n = MIN(PROJECT_BLOCK, job->ncols - c);
+            acc = job->output + (npy_intp)i * job->ncols + c;
+
+            /* a block of the first plane, then all the others, before moving on along the row */
+            stride = PyArray_STRIDE(job->planes[0], 1);
+            row = (char *)PyArray_GETPTR2(job->planes[0], i, c);
+            for (j = 0; j < n; j++) acc[j] = *((float32 *)(row + j * stride));
+
+            for (p = 1; p < job->nplanes; p++)
+                project_row(acc, (char *)PyArray_GETPTR2(job->planes[p], i, c), PyArray_STRIDE(job->planes[p], 1), n);
+        }
+    }
+
+    return CCPN_OK;
+}
+
+/* overlay the planes of dataArrays into a new array, leaving them unchanged */
+/* planes with a different shape to the first are ignored, the arrays must all be 2D float32 */
+static PyArrayObject *project_planes(PyObject *dataArrays, int numThreads) {
+    int arr, nthreads, ntasks, numArrays = PyTuple_GET_SIZE(dataArrays);
+    npy_intp dims[2];
+    CcpnStatus status;
+    Project_job job;
+    PyArrayObject *data0, *dataArray, *output;
+
+    data0 = (PyArrayObject *)PyTuple_GET_ITEM(dataArrays, 0);
+    dims[0] = PyArray_DIM(data0, 0);
+    dims[1] = PyArray_DIM(data0, 1);
+
+    output = (PyArrayObject *)PyArray_SimpleNew(2, dims, NPY_FLOAT32);
+    if (!output) RETURN_OBJ_ERROR("Cannot create projection array");
+
+    job.planes = (PyArrayObject **)pool_malloc(numArrays * sizeof(PyArrayObject *));
+    if (!job.planes) {
+        Py_DECREF(output);
+        RETURN_OBJ_ERROR("allocating projection memory");
+    }
+
+    for (arr = job.nplanes = 0; arr < numArrays; arr++) {
+        dataArray = (PyArrayObject *)PyTuple_GET_ITEM(dataArrays, arr);
+
+        if ((PyArray_DIM(dataArray, 0) == dims[0]) && (PyArray_DIM(dataArray, 1) == dims[1]))
+            job.planes[job.nplanes++] = dataArray;
+    }
+
+    job.output = (float32 *)PyArray_DATA(output);
+    job.nrows = dims[0];
+    job.ncols = dims[1];
+
+    ntasks = (job.nrows + PROJECT_TASK_ROWS - 1) / PROJECT_TASK_ROWS;
+    nthreads = parallel_num_threads(numThreads, ntasks);
+
+    Py_BEGIN_ALLOW_THREADS
+    status = parallel_for(ntasks, nthreads, project_task, &job);
+    Py_END_ALLOW_THREADS
+
+    POOL_FREE(job.planes, PyArrayObject *);
+
+    if (status == CCPN_ERROR) {
+        Py_DECREF(output);
+        RETURN_OBJ_ERROR("projecting planes");
+    }
+
+    return output;
+}
+
+static CcpnStatus check_data_arrays(PyObject *dataArrays, char *error_msg) {
+    int arr;
+    PyArrayObject *dataArray;
+
+    for (arr = 0; arr < PyTuple_GET_SIZE(dataArrays); arr++) {
+        dataArray = (PyArrayObject *)PyTuple_GET_ITEM(dataArrays, arr);
+
+        if (!PyArray_Check(dataArray)) RETURN_ERROR_MSG("dataArrays needs to be tuple of NumPy arrays");
+
+        if (PyArray_TYPE(dataArray) != NPY_FLOAT) RETURN_ERROR_MSG("dataArrays needs to be tuple of arrays of floats");
+
+        if (PyArray_NDIM(dataArray) != 2) RETURN_ERROR_MSG("dataArrays needs to be tuple of NumPy arrays with ndim 2");
+    }
+
     return CCPN_OK;
 }
 
+/* the first point from i0 (at most end) not in a block of cells all on one side of level, for the cells of row i1, */
+/* block c covers the points c * CONTOUR_SUMMARY_BLOCK to (c + 1) * CONTOUR_SUMMARY_BLOCK inclusive */
+static int skip_summary_blocks(const Contour_summary *summary, int i0, int i1, int end, float level, CcpnBool above) {
+    int c = i0 / CONTOUR_SUMMARY_BLOCK;
+    int offset = (i1 / CONTOUR_SUMMARY_BLOCK) * summary->nblocks0;
+    const float32 *block_min = summary->block_min + offset, *block_max = summary->block_max + offset;
+
+    while ((c < summary->nblocks0) && (above ? (block_min[c] > level) : !(block_max[c] > level))) {
+        c++;
+        i0 = c * CONTOUR_SUMMARY_BLOCK + 1;
+    }
+
+    return MIN(i0, end);
+}
+
 static CcpnStatus find_vertices(Contour_vertices contour_vertices, float level, PyArrayObject *data, CcpnBool more_levels) {
     int npoints0 = PyArray_DIM(data, 1);
     int npoints1 = PyArray_DIM(data, 0);
     int i0, i1, r, c;
     CcpnBool b_old, b_new;
     float d_old, d_old0, d_old1, d_new, d_new0, d_new1;
-    Contour_vertex *v_row, v_col;
-    static New_edge_func *new_edge, edge_func;
+    Contour_vertex *v_row = contour_vertices->v_row, v_col;
+    Contour_vertex *seam_bottom = contour_vertices->seam_bottom;
+    Contour_vertex *seam_top = contour_vertices->seam_top;
+    const Contour_summary *summary = contour_vertices->summary;
+    New_edge_func *new_edge, edge_func;
     static New_edge_func new_edge_func[N][N] = {{no_edge00, new_edge01, new_edge02, new_edge03},
                                                 {new_edge10, new_edge11, new_edge12, new_edge13},
                                                 {new_edge20, new_edge21, new_edge22, new_edge23},
@@ -713,16 +921,20 @@ static CcpnStatus find_vertices(Contour_vertices contour_vertices, float level,
     int **col_start_old = contour_vertices->col_start_old;
     int **col_end_old = contour_vertices->col_end_old;
     int *col_start, *col_end;
+    int j;
+    CcpnBool rows_contiguous = (PyArray_STRIDE(data, 1) == sizeof(float32));
+    float32 *row_old_data, *row_new_data;
 
     if ((nrows_old < 1) || (npoints0 < 2) || (npoints1 < 2)) return CCPN_OK;
 
-    MALLOC(v_row, Contour_vertex, npoints0 - 1);
+    /* so that stale vertices from an earlier level can never be picked up */
+    for (i0 = 0; i0 < npoints0 - 1; i0++) v_row[i0] = NULL;
 
-    /* first do vertices along bottom row, but this only needed if first row is i1=0 */
+    /* first do vertices along bottom row, but this only needed if first row is the first row of the band */
 
     r = 0;
     i1 = row_old[r];
-    if (i1 == 0) {
+    if (i1 == contour_vertices->row_start) {
         col_start = col_start_old[r];
         col_end = col_end_old[r];
 
@@ -738,6 +950,7 @@ static CcpnStatus find_vertices(Contour_vertices contour_vertices, float level,
                 if (b_old ^ b_new) /* i.e. b_old != b_new */
                 {
                     NEW_VERTEX0(v_row[i0], d_old, d_new, i0, i1);
+                    if (seam_bottom) seam_bottom[i0] = v_row[i0];
                     b_old = b_new;
                 }
 
@@ -747,9 +960,13 @@ static CcpnStatus find_vertices(Contour_vertices contour_vertices, float level,
     }
 
     for (r = 0; r < nrows_old; r++) {
+        if (contour_vertices->cancelled && *contour_vertices->cancelled) return CCPN_ERROR;
+
         i1 = row_old[r];
         col_start = col_start_old[r];
         col_end = col_end_old[r];
+        row_old_data = (float32 *)PyArray_GETPTR2(data, i1, 0);
+        row_new_data = (float32 *)PyArray_GETPTR2(data, i1 + 1, 0);
 
         for (c = 0; c < ncol_ranges_old[r]; c++) {
             i0 = col_start[c];
@@ -761,6 +978,24 @@ static CcpnStatus find_vertices(Contour_vertices contour_vertices, float level,
 
             new_edge = new_edge_func[b_old];
             for (i0 = col_start[c] + 1; i0 < col_end[c]; i0++) {
+                /* skip cells with all four corners below (or above) the level, for those */
+                /* the edge function does nothing except when x = i0 - 1 = 0, */
+                /* first whole blocks of them from the summary, then point by point */
+                if ((i0 > 1) && ((b_old == 0) || (b_old == 3))) {
+                    j = summary ? skip_summary_blocks(summary, i0, i1, col_end[c], level, b_old == 3) : i0;
+
+                    if (rows_contiguous && (j < col_end[c]))
+                        j = find_crossing(row_old_data, row_new_data, j, col_end[c], level, b_old == 3);
+
+                    if (j == col_end[c]) break;
+
+                    if (j > i0) {
+                        i0 = j;
+                        d_old0 = GET_DATA(j - 1, i1);
+                        d_new0 = GET_DATA(j - 1, i1 + 1);
+                    }
+                }
+
                 d_old1 = GET_DATA(i0, i1);
                 d_new1 = GET_DATA(i0, i1 + 1);
                 b_new = DATA_ABOVE_LEVEL(d_old1) | DATA_ABOVE_LEVEL2(d_new1);
@@ -787,12 +1022,23 @@ static CcpnStatus find_vertices(Contour_vertices contour_vertices, float level,
         check_end_range(contour_vertices, npoints0);
     }
 
-    FREE(v_row, Contour_vertex);
+    /* the vertices on the top edge of the band are left behind in v_row */
+    if (seam_top) {
+        i1 = contour_vertices->row_end;
+        d_old = GET_DATA(0, i1);
+        b_old = DATA_ABOVE_LEVEL(d_old);
+        for (i0 = 0; i0 < npoints0 - 1; i0++) {
+            d_new = GET_DATA(i0 + 1, i1);
+            b_new = DATA_ABOVE_LEVEL(d_new);
+            seam_top[i0] = (b_old ^ b_new) ? v_row[i0] : NULL;
+            b_old = b_new;
+        }
+    }
 
     return CCPN_OK;
 }
 
-static CcpnStatus process_chain(PyObject *contours, Contour_vertex v) {
+static CcpnStatus process_chain(PyObject *contours, Contour_vertex v, Contour_gl_state *gl_state) {
     int i, k, nvertices, typenum = NPY_FLOAT;
     npy_intp dims[2];
     Contour_vertex vv;
@@ -834,13 +1080,15 @@ static CcpnStatus process_chain(PyObject *contours, Contour_vertex v) {
     }
 
     // ejb - keep a count of the number of indices/vertices
-    numIndices += 2 * nvertices;
-    numVertices += nvertices;
+    if (gl_state) {
+        gl_state->numIndices += 2 * nvertices;
+        gl_state->numVertices += nvertices;
+    }
 
     return CCPN_OK;
 }
 
-static CcpnStatus process_chains(PyObject *contours, Contour_vertices contour_vertices) {
+static CcpnStatus process_chains(PyObject *contours, Contour_vertices contour_vertices, Contour_gl_state *gl_state) {
     int i;
     int nvertices = contour_vertices->nvertices;
     int nalloc = contour_vertices->nalloc;
@@ -848,24 +1096,24 @@ static CcpnStatus process_chains(PyObject *contours, Contour_vertices contour_ve
     Contour_vertex *vertex_store = contour_vertices->vertex_store;
 
     for (i = 0; i < nvertices; i++) {
-        v = vertex_store[i / nalloc] + i % nalloc;
+        v = get_vertex(vertex_store, nalloc, i);
         v->visited = CCPN_FALSE;
     }
 
     for (i = 0; i < nvertices; i++) {
-        v = vertex_store[i / nalloc] + i % nalloc;
+        v = get_vertex(vertex_store, nalloc, i);
 
         if (v->visited) continue;
 
-        CHECK_STATUS(process_chain(contours, v));
+        CHECK_STATUS(process_chain(contours, v, gl_state));
     }
 
     return CCPN_OK;
 }
 
-static void fillContours(PyArrayObject *contours, PyArrayObject *lineColour) {
+static void fillContours(Contour_gl_state *gl_state, PyObject *contours, PyArrayObject *lineColour) {
     int i, col, z, k, l, contCount = PyList_GET_SIZE(contours);
-    int lineCount, fromSize, endIndex, contourCount;
+    int lineCount, endIndex, contourCount;
     PyObject *this_contour_list;
     PyArrayObject *thisLine;
     float32 *fromArray;
@@ -884,31 +1132,29 @@ static void fillContours(PyArrayObject *contours, PyArrayObject *lineColour) {
             //            // duh - used lineCount in wrong place
             //            indexPTR[indexCount++] = lineCount;
 
-            endIndex = lastIndex;
+            endIndex = gl_state->lastIndex;
             for (i = 0, z = 0; i < (int)(lineCount / 2); i++) {
-                indexPTR[indexCount++] = lastIndex++;
-                indexPTR[indexCount++] = lastIndex;
-                vertexPTR[vertexCount++] = fromArray[z++];
-                vertexPTR[vertexCount++] = fromArray[z++];
+                gl_state->indexPTR[gl_state->indexCount++] = gl_state->lastIndex++;
+                gl_state->indexPTR[gl_state->indexCount++] = gl_state->lastIndex;
+                gl_state->vertexPTR[gl_state->vertexCount++] = fromArray[z++];
+                gl_state->vertexPTR[gl_state->vertexCount++] = fromArray[z++];
 
                 // copy the colour across
                 for (col = 0; col < 4; col++) {
-                    colourPTR[colourCount + col] = fromColour[col];
+                    gl_state->colourPTR[gl_state->colourCount + col] = fromColour[col];
                 }
-                colourCount += 4;
+                gl_state->colourCount += 4;
             }
-            indexPTR[indexCount - 1] = endIndex;
+            gl_state->indexPTR[gl_state->indexCount - 1] = endIndex;
         }
         fromColour += 4;
     }
 }
 
-static PyObject *calculate_contours(PyArrayObject *data, PyArrayObject *levels) {
-    int l, nlevels = PyArray_DIM(levels, 0), npoints1 = PyArray_DIM(data, 0);
+static CcpnStatus check_levels(PyArrayObject *levels, CcpnBool *p_are_levels_increasing, char *error_msg) {
+    int l, nlevels = PyArray_DIM(levels, 0);
     float level, prev_level;
-    CcpnBool more_levels, are_levels_increasing;
-    PyObject *contours_list, *contourlevel_list;
-    Contour_vertices contour_vertices;
+    CcpnBool are_levels_increasing;
 
     if (nlevels > 1) {
         prev_level = *((float32 *)PyArray_GETPTR1(levels, 0));
@@ -919,21 +1165,39 @@ static PyObject *calculate_contours(PyArrayObject *data, PyArrayObject *levels)
             prev_level = level;
             level = *((float32 *)PyArray_GETPTR1(levels, l));
             if (are_levels_increasing) {
-                if (prev_level > level) RETURN_OBJ_ERROR("levels initially increasing but later decrease");
+                if (prev_level > level) RETURN_ERROR_MSG("levels initially increasing but later decrease");
             } else {
-                if (prev_level < level) RETURN_OBJ_ERROR("levels initially decreasing but later increase");
+                if (prev_level < level) RETURN_ERROR_MSG("levels initially decreasing but later increase");
             }
         }
     } else {
         are_levels_increasing = CCPN_TRUE; /* arbitrary and irrelevant */
     }
 
-    contour_vertices = new_contour_vertices(data, nlevels, are_levels_increasing);
+    *p_are_levels_increasing = are_levels_increasing;
+
+    return CCPN_OK;
+}
+
+// gl_state (if not NULL) accumulates the number of indices/vertices for contourerGLList
+static PyObject *calculate_contours(PyArrayObject *data, PyArrayObject *levels, Contour_gl_state *gl_state) {
+    int l, nlevels = PyArray_DIM(levels, 0), npoints1 = PyArray_DIM(data, 0);
+    float level;
+    double start = 0;
+    CcpnBool more_levels, are_levels_increasing, stats = stats_enabled;
+    CcpnStatus status;
+    PyObject *contours_list, *contourlevel_list;
+    Contour_vertices contour_vertices;
+    char error_msg[1000];
+
+    if (check_levels(levels, &are_levels_increasing, error_msg) == CCPN_ERROR) RETURN_OBJ_ERROR(error_msg);
+
+    contour_vertices = new_contour_vertices(data, nlevels, are_levels_increasing, 0, npoints1 - 1);
     if (!contour_vertices) RETURN_OBJ_ERROR("allocating vertex memory");
 
     contours_list = PyList_New(0);
     if (!contours_list) {
-        delete_contour_vertices(contour_vertices, nlevels, npoints1);
+        delete_contour_vertices(contour_vertices, nlevels);
         RETURN_OBJ_ERROR("allocating contours_list memory");
     }
 
@@ -941,13 +1205,13 @@ static PyObject *calculate_contours(PyArrayObject *data, PyArrayObject *levels)
         contourlevel_list = PyList_New(0);
         if (!contourlevel_list) {
             Py_DECREF(contours_list);
-            delete_contour_vertices(contour_vertices, nlevels, npoints1);
+            delete_contour_vertices(contour_vertices, nlevels);
             RETURN_OBJ_ERROR("allocating contourlevel_list memory");
         }
 
         if (PyList_Append(contours_list, contourlevel_list) != 0) {
             Py_DECREF(contours_list);
-            delete_contour_vertices(contour_vertices, nlevels, npoints1);
+            delete_contour_vertices(contour_vertices, nlevels);
             RETURN_OBJ_ERROR("appending contourlevel_list to contours_list");
         }
         Py_DECREF(contourlevel_list);
@@ -956,24 +1220,40 @@ static PyObject *calculate_contours(PyArrayObject *data, PyArrayObject *levels)
         level = *((float32 *)PyArray_GETPTR1(levels, l));
         contour_vertices->nvertices = 0;
 
-        if (find_vertices(contour_vertices, level, data, more_levels) == CCPN_ERROR) {
+        // find_vertices only touches the data and contour_vertices, so other threads can run meanwhile
+        Py_BEGIN_ALLOW_THREADS
+        if (stats) start = parallel_seconds();
+        status = find_vertices(contour_vertices, level, data, more_levels);
+        if (stats) start = parallel_seconds() - start;
+        Py_END_ALLOW_THREADS
+
+        if (stats) contour_stats.find_vertices_seconds += start;
+
+        if (status == CCPN_ERROR) {
             Py_DECREF(contours_list);
-            delete_contour_vertices(contour_vertices, nlevels, npoints1);
+            delete_contour_vertices(contour_vertices, nlevels);
             RETURN_OBJ_ERROR("allocating vertex memory");
         }
 
         if (contour_vertices->nvertices == 0) break;
 
-        if (process_chains(contourlevel_list, contour_vertices) == CCPN_ERROR) {
+        if (stats) start = parallel_seconds();
+
+        if (process_chains(contourlevel_list, contour_vertices, gl_state) == CCPN_ERROR) {
             Py_DECREF(contours_list);
-            delete_contour_vertices(contour_vertices, nlevels, npoints1);
+            delete_contour_vertices(contour_vertices, nlevels);
             RETURN_OBJ_ERROR("processing contourlevel_list");
         }
 
+        if (stats) {
+            contour_stats.process_chains_seconds += parallel_seconds() - start;
+            add_level_stats(l, contour_vertices->nvertices, (long)PyList_GET_SIZE(contourlevel_list));
+        }
+
         if (more_levels) swap_old_new(contour_vertices);
     }
 
-    delete_contour_vertices(contour_vertices, nlevels, npoints1);
+    delete_contour_vertices(contour_vertices, nlevels);
 
     return contours_list;
 }
@@ -993,7 +1273,9 @@ static PyObject *contourer(PyObject *self, PyObject *args) {
 
     if (PyArray_NDIM(levels_obj) != 1) RETURN_OBJ_ERROR("levelsArray needs to be NumPy array with ndim 1");
 
-    contours = calculate_contours(data_obj, levels_obj);
+    contours = calculate_contours(data_obj, levels_obj, NULL);
+
+    if (contours && stats_enabled) add_call_stats(1);
 
     return contours;
 }
@@ -1006,194 +1288,1818 @@ static PyObject *newList(int size) {
     return list;
 }
 
-/* not used
-static PyArrayObject *newArrayList(size) {
-    PyListObject *list;
-    list = PyList_New(size);
-    if (!list) {
-        RETURN_OBJ_ERROR("allocating list memory");
+/*
+  Native (band-parallel) contouring, used by contourerGLList unless useLists is set
+
+  The chains are written straight into growable native buffers, rather than
+  one NumPy array per polyline in nested Python lists, and the final
+  index/vertex/colour arrays are filled in a single pass at the end.
+
+  With numThreads != 1 each plane is split into bands of rows and every band is contoured for all
+  the levels on a worker thread, with the GIL released.  Each level keeps its
+  own vertex store, and the vertices found on the first and last row of a band
+  are recorded so that afterwards the bands can be stitched together along the
+  shared rows.  The chains for each level are then written straight into native
+  buffers (also in parallel) and finally copied into the index/vertex/colour
+  arrays in the same order as the serial version.
+*/
+
+#define CONTOUR_BAND_NALLOC      1024 /* allocate band vertices in this size bunch */
+#define CONTOUR_MIN_BAND_ROWS    32   /* do not make bands with fewer cell rows than this */
+#define CONTOUR_BANDS_PER_THREAD 4    /* more bands than threads so that the load balances */
+#define CONTOUR_CHAINS_NALLOC    256  /* minimum allocation for chain buffers */
+
+#define CONTOUR_JOB_CANCELLED "contour job cancelled"
+
+#define GROW_ARRAY(ptr, type, nalloc, nneeded)                     \
+    {                                                              \
+        if ((nneeded) > (nalloc)) {                                \
+            int Nalloc = MAX(2 * (nalloc), (nneeded));             \
+            Nalloc = MAX(Nalloc, CONTOUR_CHAINS_NALLOC);           \
+            POOL_REALLOC(ptr, type, Nalloc);                       \
+            nalloc = Nalloc;                                       \
+        }                                                          \
     }
-    return list;
-}*/
 
-static PyObject *appendFloatList(PyObject *list, double value) {
-    if (PyList_Append(list, PyFloat_FromDouble((double)value)) != 0) {
-        RETURN_OBJ_ERROR("appending item to list");
+typedef struct _Contour_level_store {
+    int nvertices;               /* vertices found in the band for this level */
+    int nalloc;
+    int nblocks;
+    Contour_vertex *vertex_store;
+    Contour_vertex *seam_bottom; /* NULL for the first band */
+    Contour_vertex *seam_top;    /* NULL for the last band */
+} Contour_level_store;
+
+typedef struct _Contour_chains {
+    int nvertices;      /* total vertices over all chains */
+    int nvertices_alloc;
+    float32 *vertices;  /* x, y of each vertex, one chain after another */
+    int nchains;
+    int nchains_alloc;
+    int *chain_length;  /* number of vertices in each chain */
+    double seconds;     /* taken to stitch and write the chains, for the statistics */
+} Contour_chains;
+
+typedef struct _Contour_band {
+    struct _Contour_group *group;
+    int row_start;
+    int row_end;
+    Contour_level_store *stores; /* one per level */
+    double seconds;              /* taken to find the vertices, for the statistics */
+} Contour_band;
+
+typedef struct _Contour_group {
+    PyArrayObject *data;
+    int nlevels;
+    float *levels;
+    CcpnBool are_levels_increasing;
+    float32 *colour;         /* RGBA for each level */
+    const Contour_summary *summary; /* of data, set by run_contour_job */
+    int nbands;
+    Contour_band *bands;
+    CcpnBool all_levels;     /* carry on past a level with no vertices */
+    int nlevels_used;        /* levels before the first one with no vertices (unless all_levels) */
+    Contour_chains *chains;  /* one per level */
+    CcpnBool *level_done;    /* whether the chains of each level are finished, set under the job lock */
+    volatile int *cancelled; /* the job's flag */
+    CcpnBool stats;          /* time the bands and chains (stats_enabled when the group was made) */
+} Contour_group;
+
+typedef struct _Contour_job {
+    int ngroups;
+    Contour_group *groups;
+    int nbands;                /* over all groups */
+    Contour_band **bands;
+    int nlevel_tasks;          /* over all groups */
+    Contour_group **task_group;
+    int *task_level;
+    int nsummaries;            /* one per plane, shared by the groups of that plane */
+    Contour_summary *summaries;
+    int nsummary_tasks;        /* a task per row of blocks over all summaries */
+    volatile int cancelled;    /* only ever set (by contourJobCancel), so read without the lock */
+    Parallel_lock lock;        /* for the progress below, NULL unless run in the background */
+    CcpnBool levels_started;   /* the bands are done, so nlevels_used is known */
+} Contour_job;
+
+static Contour_vertex *new_seam(int n) {
+    int i;
+    Contour_vertex *seam = (Contour_vertex *)pool_malloc((size_t)n * sizeof(Contour_vertex));
+
+    if (seam) {
+        for (i = 0; i < n; i++) seam[i] = NULL;
     }
-    return NULL;
+
+    return seam;
 }
 
-static PyObject *contourerGLList(PyObject *self, PyObject *args) {
-    PyObject *dataArrays;
-    PyArrayObject *dataArray, *posLevels, *posColour;
-    PyArrayObject *negLevels, *negColour;
-    PyObject *contours_list;
-    //    PyObject *pos_cont_list, *neg_cont_list;
-    int arr, flatten = 0;
+static CcpnStatus contour_band(Contour_band *band) {
+    Contour_group *group = band->group;
+    PyArrayObject *data = group->data;
+    int l, npoints0 = PyArray_DIM(data, 1), npoints1 = PyArray_DIM(data, 0);
+    double start = 0;
+    CcpnBool more_levels;
+    CcpnStatus status = CCPN_OK;
+    Contour_vertices contour_vertices;
+    Contour_level_store *store;
 
-    //    PyArrayObject *colours;
+    contour_vertices =
+        new_contour_vertices(data, group->nlevels, group->are_levels_increasing, band->row_start, band->row_end);
+    if (!contour_vertices) return CCPN_ERROR;
 
-    // define an empty array to pass out
-    contours_list = newList(1);
+    contour_vertices->nalloc = CONTOUR_BAND_NALLOC;
 
-    // assumes that the parameters are all numpy arrays
-    if (!PyArg_ParseTuple(args, "O!O!O!O!O!|i", &PyTuple_Type, &dataArrays, &PyArray_Type, &posLevels, &PyArray_Type,
-                          &negLevels, &PyArray_Type, &posColour, &PyArray_Type, &negColour, &flatten))
+    contour_vertices->cancelled = group->cancelled;
+    contour_vertices->summary = group->summary;
 
-        RETURN_OBJ_ERROR(
-            "need arguments: dataArrays, posLevels, negLevels, posColour, negColour, optional flatten = True/False");
+    for (l = 0; l < group->nlevels; l++) {
+        if (*group->cancelled) {
+            status = CCPN_ERROR;
+            break;
+        }
 
-    //    if (PyArray_TYPE(dataArray) != NPY_FLOAT)
-    //        RETURN_OBJ_ERROR("dataArray needs to be array of floats");
-    //
-    //    if (PyArray_NDIM(dataArray) != 2)
-    //        RETURN_OBJ_ERROR("dataArray needs to be NumPy array with ndim 2");
+        more_levels = (l < group->nlevels - 1);
+        store = band->stores + l;
 
-    if (PyArray_TYPE(posLevels) != NPY_FLOAT) RETURN_OBJ_ERROR("posLevels needs to be array of floats");
+        /* not POOL_MALLOC_ZERO, which would return without deleting contour_vertices */
+        if ((band->row_start > 0) && !(store->seam_bottom = new_seam(npoints0 - 1))) {
+            status = CCPN_ERROR;
+            break;
+        }
 
-    if (PyArray_NDIM(posLevels) != 1) RETURN_OBJ_ERROR("posLevels needs to be NumPy array with ndim 1");
+        if ((band->row_end < npoints1 - 1) && !(store->seam_top = new_seam(npoints0 - 1))) {
+            status = CCPN_ERROR;
+            break;
+        }
 
-    if (PyArray_TYPE(negLevels) != NPY_FLOAT) RETURN_OBJ_ERROR("negLevels needs to be array of floats");
+        contour_vertices->seam_bottom = store->seam_bottom;
+        contour_vertices->seam_top = store->seam_top;
+        contour_vertices->nvertices = 0;
 
-    if (PyArray_NDIM(negLevels) != 1) RETURN_OBJ_ERROR("negLevels needs to be NumPy array with ndim 1");
+        if (group->stats) start = parallel_seconds();
+        status = find_vertices(contour_vertices, group->levels[l], data, more_levels);
+        if (group->stats) band->seconds += parallel_seconds() - start;
 
-    if (PyArray_TYPE(posColour) != NPY_FLOAT32) RETURN_OBJ_ERROR("posColour needs to be array of floats");
+        /* the level keeps the vertices, so new storage gets allocated for the next level */
+        store->nvertices = contour_vertices->nvertices;
+        store->nalloc = contour_vertices->nalloc;
+        store->nblocks = contour_vertices->nblocks;
+        store->vertex_store = contour_vertices->vertex_store;
+        contour_vertices->nvertices = 0;
+        contour_vertices->nblocks = 0;
+        contour_vertices->vertex_store = NULL;
 
-    if (PyArray_NDIM(posColour) != 1) RETURN_OBJ_ERROR("posColour needs to be NumPy array with ndim 1");
+        if (status == CCPN_ERROR) break;
 
-    if (PyArray_TYPE(negColour) != NPY_FLOAT32) RETURN_OBJ_ERROR("negColour needs to be array of floats");
+        /* with a single band no later level would be used (see find_levels_used) */
+        if ((group->nbands == 1) && (store->nvertices == 0) && !group->all_levels) break;
 
-    if (PyArray_NDIM(negColour) != 1) RETURN_OBJ_ERROR("negColour needs to be NumPy array with ndim 1");
+        if (more_levels) swap_old_new(contour_vertices);
+    }
 
-    if (flatten != 0 && flatten != 1) RETURN_OBJ_ERROR("flatten must be True/False");
+    delete_contour_vertices(contour_vertices, group->nlevels);
 
-    //    npy_intp dims[1] = {24};
-    //    colours = (PyArrayObject *) PyArray_SimpleNew(1, dims, NPY_FLOAT32);
-    //    if (!colours)
-    //    	return CCPN_ERROR;
+    return status;
+}
 
-    // initialise the index/vertex count
-    numIndices = 0;
-    numVertices = 0;
-    numColours = 0;
+/* va is on the top row of one band and vb the same point on the bottom row of the next */
+/* band, each has only the link to its own band, so make va take over the link of vb */
+static void stitch_vertices(Contour_vertex va, Contour_vertex vb) {
+    if (vb->v1 && !va->v1) {
+        va->v1 = vb->v1;
+        vb->v1->v2 = va;
+    }
 
-    indexCount = 0;
-    vertexCount = 0;
-    colourCount = 0;
+    if (vb->v2 && !va->v2) {
+        va->v2 = vb->v2;
+        vb->v2->v1 = va;
+    }
 
-    int numArrays = PyTuple_GET_SIZE(dataArrays);
-    // PyObject *pos_cont_list[numArrays], *neg_cont_list[numArrays];
+    /* vb is no longer in any chain */
+    vb->v1 = vb->v2 = NULL;
+    vb->visited = CCPN_TRUE;
+}
 
-    PyObject *pos_cont_list, *neg_cont_list;
-    PyArrayObject *posCont, *negCont;
-    pos_cont_list = newList(0);
-    neg_cont_list = newList(0);
+static CcpnStatus append_chain(Contour_chains *chains, Contour_vertex v) {
+    int i, nvertices;
+    float32 *vertices;
+    Contour_vertex vv;
 
-    if ((numArrays > 1) && (flatten)) {
-        for (int ii = 1; ii < numArrays; ii++)
-            update_bounds((PyArrayObject *)PyTuple_GET_ITEM(dataArrays, 0), (PyArrayObject *)PyTuple_GET_ITEM(dataArrays, ii));
-        numArrays = 1;
+    /* same traversal as process_chain */
+    nvertices = 1;
+    for (vv = v; vv->v1 && (vv->v1 != v); vv = vv->v1) {
+        nvertices++;
+        vv->visited = CCPN_TRUE;
     }
 
-    for (arr = 0; arr < numArrays; arr++) {
-        dataArray = (PyArrayObject *)PyTuple_GET_ITEM(dataArrays, arr);
+    vv->visited = CCPN_TRUE;
+
+    for (v = v->v2; v && (v != vv); v = v->v2) {
+        nvertices++;
+        v->visited = CCPN_TRUE;
+    }
 
-        // get the positive contours_list
-        // pos_cont_list[arr] = calculate_contours(dataArray, posLevels);
-        // neg_cont_list[arr] = calculate_contours(dataArray, negLevels);
+    GROW_ARRAY(chains->vertices, float32, chains->nvertices_alloc, 2 * (chains->nvertices + nvertices));
+    GROW_ARRAY(chains->chain_length, int, chains->nchains_alloc, chains->nchains + 1);
 
-        PyList_Append(pos_cont_list, calculate_contours(dataArray, posLevels));
-        PyList_Append(neg_cont_list, calculate_contours(dataArray, negLevels));
+    vertices = chains->vertices + 2 * chains->nvertices;
+    for (i = 0, v = vv; i < nvertices; i++, v = v->v2) {
+        *vertices++ = v->x[0];
+        *vertices++ = v->x[1];
     }
 
-    npy_intp dims[1] = {numIndices};
-    indexing = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_UINT32);
-    if (!indexing) RETURN_OBJ_ERROR("Cannot create index array");
+    chains->nvertices += nvertices;
+    chains->chain_length[chains->nchains++] = nvertices;
 
-    dims[0] = 2 * numVertices;
-    vertices = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_FLOAT32);
-    if (!vertices) RETURN_OBJ_ERROR("Cannot create vertex array");
+    return CCPN_OK;
+}
 
-    dims[0] = 4 * numVertices;
-    colours = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_FLOAT32);
-    if (!colours) RETURN_OBJ_ERROR("Cannot create colour array");
+static CcpnStatus contour_level_chains(Contour_group *group, int l) {
+    int b, i, x, nalloc, npoints0 = PyArray_DIM(group->data, 1);
+    double start = group->stats ? parallel_seconds() : 0;
+    Contour_level_store *store, *store_below;
+    Contour_vertex v;
+    Contour_chains *chains = group->chains + l;
 
-    indexPTR = PyArray_GETPTR1(indexing, 0);
-    vertexPTR = PyArray_GETPTR1(vertices, 0);
-    colourPTR = PyArray_GETPTR1(colours, 0);
-    lastIndex = 0;
-    lastVertex = 0;
+    /* stitch each band to the one below along their shared row */
+    for (b = 1; b < group->nbands; b++) {
+        store_below = group->bands[b - 1].stores + l;
+        store = group->bands[b].stores + l;
 
-    for (arr = 0; arr < numArrays; arr++) {
-        // fill the new arrays
-        // fillContours(pos_cont_list[arr], posColour);
-        // fillContours(neg_cont_list[arr], negColour);
+        for (x = 0; x < npoints0 - 1; x++) {
+            if (store_below->seam_top[x] && store->seam_bottom[x])
+                stitch_vertices(store_below->seam_top[x], store->seam_bottom[x]);
+        }
+    }
+
+    for (b = 0; b < group->nbands; b++) {
+        store = group->bands[b].stores + l;
+        nalloc = store->nalloc;
+
+        for (i = 0; i < store->nvertices; i++) {
+            v = get_vertex(store->vertex_store, nalloc, i);
 
-        posCont = (PyArrayObject *)PyList_GET_ITEM(pos_cont_list, arr);
-        negCont = (PyArrayObject *)PyList_GET_ITEM(neg_cont_list, arr);
+            if (v->visited) continue;
 
-        fillContours(posCont, posColour);
-        fillContours(negCont, negColour);
+            CHECK_STATUS(append_chain(chains, v));
+        }
     }
 
-    PyObject *ind = PyLong_FromDouble(numIndices);
-    PyObject *vect = PyLong_FromDouble(numVertices);
+    if (group->stats) chains->seconds = parallel_seconds() - start;
 
-    gl_object_list = newList(5);
-    PyList_SET_ITEM(gl_object_list, 0, ind);
-    PyList_SET_ITEM(gl_object_list, 1, vect);
-    PyList_SET_ITEM(gl_object_list, 2, (PyObject *)indexing);
-    PyList_SET_ITEM(gl_object_list, 3, (PyObject *)vertices);
-    PyList_SET_ITEM(gl_object_list, 4, (PyObject *)colours);
+    return CCPN_OK;
+}
 
-    return gl_object_list;
+/* the smallest and largest data of block row r, a NaN is never above a level so for the smallest */
+/* it sticks (the block is never all above) and for the largest it is ignored unless all are NaN */
+CCPN_MULTIVERSION static void summarise_block_row(Contour_summary *summary, int r) {
+    PyArrayObject *data = summary->data;
+    int npoints0 = PyArray_DIM(data, 1), npoints1 = PyArray_DIM(data, 0);
+    int c, i0, i1, i0_end, i1_end = MIN((r + 1) * CONTOUR_SUMMARY_BLOCK, npoints1 - 1);
+    float32 d, d_min, d_max;
+    float32 *block_min = summary->block_min + r * summary->nblocks0;
+    float32 *block_max = summary->block_max + r * summary->nblocks0;
+
+    for (c = 0; c < summary->nblocks0; c++) {
+        i0_end = MIN((c + 1) * CONTOUR_SUMMARY_BLOCK, npoints0 - 1);
+        d_min = d_max = GET_DATA(c * CONTOUR_SUMMARY_BLOCK, r * CONTOUR_SUMMARY_BLOCK);
+
+        for (i1 = r * CONTOUR_SUMMARY_BLOCK; i1 <= i1_end; i1++) {
+            for (i0 = c * CONTOUR_SUMMARY_BLOCK; i0 <= i0_end; i0++) {
+                d = GET_DATA(i0, i1);
+                if ((d > d_max) || (d_max != d_max)) d_max = d;
+                if ((d_min == d_min) && !(d >= d_min)) d_min = d;
+            }
+        }
 
-    //    // get the start/size of the numpy array
-    //    float32 *levelPTR = PyArray_GETPTR1(colours,0);
-    //    int sizeColours = (float32 *) PyArray_SIZE(colours);
-    //
-    ////    for (int i=0; i < sizeColours; i++, levelPTR++)
-    ////    {
-    ////        // fast memory accessing :)
-    ////        *levelPTR = i+32;
-    ////    }
-    //
-    //    for (int i=0; i < sizeColours; i++)
-    //    {
-    //        // fast memory accessing :)
-    //        levelPTR[i] = i+15.765;
-    //    }
-    //
-    //    PyList_SET_ITEM(contours_list, 0, colours);
-    //
-    //    return contours_list;
+        block_min[c] = d_min;
+        block_max[c] = d_max;
+    }
 }
 
-static char contourer_doc[] = "Create 2D contours for spectral data";
-static char contourerGLList_doc[] = "Convert 2D contours to glList";
+static CcpnStatus summary_task(int task, void *user_data) {
+    Contour_job *job = (Contour_job *)user_data;
+    int s;
 
-static struct PyMethodDef Contourer_type_methods[] = {
-    {"contourer2d", (PyCFunction)contourer, METH_VARARGS, contourer_doc},
-    {"contourerGLList", (PyCFunction)contourerGLList, METH_VARARGS, contourerGLList_doc},
-    {NULL, NULL, 0, NULL}};
+    if (job->cancelled) return CCPN_ERROR;
 
-struct module_state {
-    PyObject *error;
-};
+    for (s = 0; task >= job->summaries[s].nblocks1; s++) task -= job->summaries[s].nblocks1;
 
-static struct PyModuleDef moduledef = {
-    PyModuleDef_HEAD_INIT, "Contourer2d", NULL, sizeof(struct module_state), Contourer_type_methods, NULL, NULL, NULL, NULL};
+    summarise_block_row(job->summaries + s, task);
 
-PyMODINIT_FUNC PyInit_Contourer2d(void) {
-    PyObject *module;
+    return CCPN_OK;
+}
 
-#ifdef WIN32
-    Contourer.ob_type = &PyType_Type;
-#endif
-    /* create the module and add the functions */
-    module = PyModule_Create(&moduledef);
+/* whether the plane of group has enough levels over all its groups for a summary to pay for itself */
+static CcpnBool summary_pays(Contour_job *job, Contour_group *group) {
+    int g, nlevels = 0, nbands = 0;
 
-    import_array(); /* needed for numpy, otherwise it crashes */
+    for (g = 0; g < job->ngroups; g++) {
+        if ((job->groups[g].data != group->data) || (job->groups[g].nbands == 0)) continue;
+
+        nlevels += job->groups[g].nlevels;
+        nbands = MAX(nbands, job->groups[g].nbands);
+    }
+
+    return nlevels >= ((nbands > 1) ? CONTOUR_SUMMARY_MIN_LEVELS : CONTOUR_SUMMARY_MIN_SERIAL_LEVELS);
+}
+
+/* one summary for each plane with enough levels to contour, shared by all its groups */
+static CcpnStatus new_contour_summaries(Contour_job *job) {
+    int g, h, npoints0, npoints1;
+    Contour_group *group;
+    Contour_summary *summary;
+
+    POOL_MALLOC(job->summaries, Contour_summary, MAX(1, job->ngroups));
+
+    for (g = 0; g < job->ngroups; g++) {
+        group = job->groups + g;
+        group->summary = NULL;
+        if (group->nbands == 0) continue;
+
+        for (h = 0; h < job->nsummaries; h++) {
+            if (job->summaries[h].data == group->data) group->summary = job->summaries + h;
+        }
+
+        if (group->summary || !summary_pays(job, group)) continue;
+
+        npoints0 = PyArray_DIM(group->data, 1);
+        npoints1 = PyArray_DIM(group->data, 0);
+
+        summary = job->summaries + job->nsummaries++;
+        summary->data = group->data;
+        summary->nblocks0 = (npoints0 - 2) / CONTOUR_SUMMARY_BLOCK + 1;
+        summary->nblocks1 = (npoints1 - 2) / CONTOUR_SUMMARY_BLOCK + 1;
+        summary->block_min = NULL;
+        summary->block_max = NULL;
+        POOL_MALLOC(summary->block_min, float32, summary->nblocks0 * summary->nblocks1);
+        POOL_MALLOC(summary->block_max, float32, summary->nblocks0 * summary->nblocks1);
+
+        job->nsummary_tasks += summary->nblocks1;
+        group->summary = summary;
+    }
+
+    return CCPN_OK;
+}
+
+static CcpnStatus band_task(int task, void *user_data) {
+    Contour_job *job = (Contour_job *)user_data;
+
+    return contour_band(job->bands[task]);
+}
+
+static CcpnStatus level_task(int task, void *user_data) {
+    Contour_job *job = (Contour_job *)user_data;
+    Contour_group *group = job->task_group[task];
+
+    if (job->cancelled) return CCPN_ERROR;
+
+    CHECK_STATUS(contour_level_chains(group, job->task_level[task]));
+
+    if (job->lock) parallel_lock(job->lock);
+    group->level_done[job->task_level[task]] = CCPN_TRUE;
+    if (job->lock) parallel_unlock(job->lock);
+
+    return CCPN_OK;
+}
+
+static void delete_contour_job(Contour_job *job) {
+    int g, b, l, i;
+    Contour_group *group;
+    Contour_level_store *store;
+
+    if (job->groups) {
+        for (g = 0; g < job->ngroups; g++) {
+            group = job->groups + g;
+
+            if (group->bands) {
+                for (b = 0; b < group->nbands; b++) {
+                    if (!group->bands[b].stores) continue;
+
+                    for (l = 0; l < group->nlevels; l++) {
+                        store = group->bands[b].stores + l;
+                        for (i = 0; i < store->nblocks; i++) POOL_FREE(store->vertex_store[i], struct _Contour_vertex);
+                        POOL_FREE(store->vertex_store, Contour_vertex);
+                        POOL_FREE(store->seam_bottom, Contour_vertex);
+                        POOL_FREE(store->seam_top, Contour_vertex);
+                    }
+
+                    POOL_FREE(group->bands[b].stores, Contour_level_store);
+                }
+
+                POOL_FREE(group->bands, Contour_band);
+            }
+
+            if (group->chains) {
+                for (l = 0; l < group->nlevels; l++) {
+                    POOL_FREE(group->chains[l].vertices, float32);
+                    POOL_FREE(group->chains[l].chain_length, int);
+                }
+
+                POOL_FREE(group->chains, Contour_chains);
+            }
+
+            POOL_FREE(group->level_done, CcpnBool);
+            POOL_FREE(group->levels, float);
+        }
+
+        POOL_FREE(job->groups, Contour_group);
+    }
+
+    if (job->summaries) {
+        for (i = 0; i < job->nsummaries; i++) {
+            POOL_FREE(job->summaries[i].block_min, float32);
+            POOL_FREE(job->summaries[i].block_max, float32);
+        }
+
+        POOL_FREE(job->summaries, Contour_summary);
+    }
+
+    POOL_FREE(job->bands, Contour_band *);
+    POOL_FREE(job->task_group, Contour_group *);
+    POOL_FREE(job->task_level, int);
+}
+
+static CcpnStatus new_contour_group(Contour_group *group, PyArrayObject *data, PyArrayObject *levels,
+                                    PyArrayObject *colour, int nthreads, char *error_msg) {
+    int b, l, nbands, ncell_rows;
+    int npoints0 = PyArray_DIM(data, 1), npoints1 = PyArray_DIM(data, 0);
+
+    group->data = data;
+    group->nlevels = PyArray_DIM(levels, 0);
+    group->colour = colour ? (float32 *)PyArray_DATA(colour) : NULL;
+    group->all_levels = CCPN_FALSE;
+    group->stats = stats_enabled;
+
+    CHECK_STATUS(check_levels(levels, &group->are_levels_increasing, error_msg));
+
+    sprintf(error_msg, "allocating band memory");
+
+    POOL_MALLOC(group->levels, float, MAX(1, group->nlevels));
+    for (l = 0; l < group->nlevels; l++) group->levels[l] = *((float32 *)PyArray_GETPTR1(levels, l));
+
+    POOL_MALLOC(group->level_done, CcpnBool, MAX(1, group->nlevels));
+    for (l = 0; l < group->nlevels; l++) group->level_done[l] = CCPN_FALSE;
+
+    POOL_MALLOC(group->chains, Contour_chains, MAX(1, group->nlevels));
+    for (l = 0; l < group->nlevels; l++) {
+        group->chains[l].nvertices = group->chains[l].nvertices_alloc = 0;
+        group->chains[l].nchains = group->chains[l].nchains_alloc = 0;
+        group->chains[l].vertices = NULL;
+        group->chains[l].chain_length = NULL;
+        group->chains[l].seconds = 0;
+    }
+
+    /* nothing to contour (as in find_vertices) */
+    if ((group->nlevels == 0) || (npoints0 < 2) || (npoints1 < 2)) return CCPN_OK;
+
+    /* a single band needs no stitching, and gives the chains in the same order as the list version */
+    ncell_rows = npoints1 - 1;
+    nbands = (nthreads > 1) ? MIN(nthreads * CONTOUR_BANDS_PER_THREAD, ncell_rows / CONTOUR_MIN_BAND_ROWS) : 1;
+    nbands = MAX(1, nbands);
+
+    POOL_MALLOC(group->bands, Contour_band, nbands);
+    for (b = 0; b < nbands; b++) group->bands[b].stores = NULL;
+    group->nbands = nbands;
+
+    for (b = 0; b < nbands; b++) {
+        group->bands[b].group = group;
+        group->bands[b].row_start = (int)(((long)b * ncell_rows) / nbands);
+        group->bands[b].row_end = (int)(((long)(b + 1) * ncell_rows) / nbands);
+        group->bands[b].seconds = 0;
+
+        POOL_MALLOC(group->bands[b].stores, Contour_level_store, group->nlevels);
+        for (l = 0; l < group->nlevels; l++) {
+            group->bands[b].stores[l].nvertices = 0;
+            group->bands[b].stores[l].nalloc = CONTOUR_BAND_NALLOC;
+            group->bands[b].stores[l].nblocks = 0;
+            group->bands[b].stores[l].vertex_store = NULL;
+            group->bands[b].stores[l].seam_bottom = NULL;
+            group->bands[b].stores[l].seam_top = NULL;
+        }
+    }
+
+    return CCPN_OK;
+}
+
+/* the first level with no vertices anywhere stops the contouring, as in calculate_contours */
+static void find_levels_used(Contour_group *group) {
+    int b, l, nvertices;
+
+    for (l = 0; l < group->nlevels; l++) {
+        nvertices = 0;
+        for (b = 0; b < group->nbands; b++) nvertices += group->bands[b].stores[l].nvertices;
+
+        if (nvertices == 0) break;
+    }
+
+    group->nlevels_used = l;
+}
+
+static CcpnStatus run_contour_job(Contour_job *job, int nthreads, char *error_msg) {
+    int g, b, l, t;
+    Contour_group *group;
+
+    sprintf(error_msg, "allocating task memory");
+
+    job->nbands = 0;
+    for (g = 0; g < job->ngroups; g++) {
+        job->groups[g].cancelled = &job->cancelled;
+        job->nbands += job->groups[g].nbands;
+    }
+
+    POOL_MALLOC(job->bands, Contour_band *, MAX(1, job->nbands));
+    for (g = t = 0; g < job->ngroups; g++) {
+        for (b = 0; b < job->groups[g].nbands; b++) job->bands[t++] = job->groups[g].bands + b;
+    }
+
+    /* each plane is summarised at most once, however many levels (of either sign) and bands it has */
+    CHECK_STATUS(new_contour_summaries(job));
+
+    if (parallel_for(job->nsummary_tasks, nthreads, summary_task, (void *)job) == CCPN_ERROR)
+        RETURN_ERROR_MSG(CONTOUR_JOB_CANCELLED);
+
+    if (parallel_for(job->nbands, nthreads, band_task, (void *)job) == CCPN_ERROR)
+        RETURN_ERROR_MSG(job->cancelled ? CONTOUR_JOB_CANCELLED : "allocating vertex memory");
+
+    job->nlevel_tasks = 0;
+    for (g = 0; g < job->ngroups; g++) {
+        group = job->groups + g;
+        if (group->nbands == 0)
+            group->nlevels_used = 0;
+        else if (group->all_levels)
+            group->nlevels_used = group->nlevels;
+        else
+            find_levels_used(group);
+
+        job->nlevel_tasks += group->nlevels_used;
+    }
+
+    POOL_MALLOC(job->task_group, Contour_group *, MAX(1, job->nlevel_tasks));
+    POOL_MALLOC(job->task_level, int, MAX(1, job->nlevel_tasks));
+    for (g = t = 0; g < job->ngroups; g++) {
+        for (l = 0; l < job->groups[g].nlevels_used; l++, t++) {
+            job->task_group[t] = job->groups + g;
+            job->task_level[t] = l;
+        }
+    }
+
+    if (job->lock) parallel_lock(job->lock);
+    job->levels_started = CCPN_TRUE;
+    if (job->lock) parallel_unlock(job->lock);
+
+    if (parallel_for(job->nlevel_tasks, nthreads, level_task, (void *)job) == CCPN_ERROR)
+        RETURN_ERROR_MSG(job->cancelled ? CONTOUR_JOB_CANCELLED : "processing contour chains");
+
+    return CCPN_OK;
+}
+
+static CcpnStatus new_contour_job(Contour_job *job, int ngroups) {
+    int g;
+
+    job->ngroups = ngroups;
+    job->bands = NULL;
+    job->task_group = NULL;
+    job->task_level = NULL;
+    job->nsummaries = 0;
+    job->summaries = NULL;
+    job->nsummary_tasks = 0;
+    job->cancelled = 0;
+    job->lock = NULL;
+    job->levels_started = CCPN_FALSE;
+
+    POOL_MALLOC(job->groups, Contour_group, MAX(1, ngroups));
+
+    for (g = 0; g < ngroups; g++) {
+        job->groups[g].nlevels = 0;
+        job->groups[g].nbands = 0;
+        job->groups[g].bands = NULL;
+        job->groups[g].chains = NULL;
+        job->groups[g].levels = NULL;
+        job->groups[g].level_done = NULL;
+        job->groups[g].summary = NULL;
+        job->groups[g].cancelled = &job->cancelled;
+        job->groups[g].stats = CCPN_FALSE;
+    }
+
+    return CCPN_OK;
+}
+
+/* with the GIL held, after run_contour_job */
+static void add_job_stats(Contour_job *job) {
+    int g, b, l;
+    Contour_group *group;
+
+    for (g = 0; g < job->ngroups; g++) {
+        group = job->groups + g;
+        if (!group->stats) continue;
+
+        for (b = 0; b < group->nbands; b++) contour_stats.find_vertices_seconds += group->bands[b].seconds;
+
+        for (l = 0; l < group->nlevels_used; l++) {
+            contour_stats.process_chains_seconds += group->chains[l].seconds;
+            add_level_stats(l, group->chains[l].nvertices, group->chains[l].nchains);
+        }
+    }
+}
+
+#define GROUP_NLEVELS(g) (nlevels ? nlevels[g] : job->groups[g].nlevels_used)
+
+/* nlevels is the number of levels of each group to include, NULL means nlevels_used */
+static PyObject *contour_job_gl_list(Contour_job *job, int *nlevels) {
+    int g, l, c, i, col, nvertices, numVertices = 0, numIndices;
+    unsigned int *index_ptr, index, end_index;
+    float32 *vertex_ptr, *colour_ptr, *from_vertex, *from_colour;
+    npy_intp dims[1];
+    Contour_group *group;
+    Contour_chains *chains;
+    PyArrayObject *indexing_obj, *vertices_obj, *colours_obj;
+    PyObject *gl_list;
+
+    for (g = 0; g < job->ngroups; g++) {
+        for (l = 0; l < GROUP_NLEVELS(g); l++) numVertices += job->groups[g].chains[l].nvertices;
+    }
+
+    numIndices = 2 * numVertices;
+
+    dims[0] = numIndices;
+    indexing_obj = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_UINT32);
+    if (!indexing_obj) RETURN_OBJ_ERROR("Cannot create index array");
+
+    dims[0] = 2 * numVertices;
+    vertices_obj = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_FLOAT32);
+    if (!vertices_obj) {
+        Py_DECREF(indexing_obj);
+        RETURN_OBJ_ERROR("Cannot create vertex array");
+    }
+
+    dims[0] = 4 * numVertices;
+    colours_obj = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_FLOAT32);
+    if (!colours_obj) {
+        Py_DECREF(indexing_obj);
+        Py_DECREF(vertices_obj);
+        RETURN_OBJ_ERROR("Cannot create colour array");
+    }
+
+    index_ptr = (unsigned int *)PyArray_DATA(indexing_obj);
+    vertex_ptr = (float32 *)PyArray_DATA(vertices_obj);
+    colour_ptr = (float32 *)PyArray_DATA(colours_obj);
+    index = 0;
+
+    /* same layout as fillContours */
+    for (g = 0; g < job->ngroups; g++) {
+        group = job->groups + g;
+
+        for (l = 0; l < GROUP_NLEVELS(g); l++) {
+            chains = group->chains + l;
+            from_vertex = chains->vertices;
+            from_colour = group->colour + 4 * l;
+
+            memcpy(vertex_ptr, from_vertex, 2 * chains->nvertices * sizeof(float32));
+            vertex_ptr += 2 * chains->nvertices;
+
+            for (c = 0; c < chains->nchains; c++) {
+                nvertices = chains->chain_length[c];
+                end_index = index;
+
+                for (i = 0; i < nvertices; i++) {
+                    *index_ptr++ = index++;
+                    *index_ptr++ = index;
+
+                    for (col = 0; col < 4; col++) *colour_ptr++ = from_colour[col];
+                }
+
+                index_ptr[-1] = end_index;
+            }
+        }
+    }
+
+    gl_list = newList(5);
+    if (!gl_list) {
+        Py_DECREF(indexing_obj);
+        Py_DECREF(vertices_obj);
+        Py_DECREF(colours_obj);
+        return NULL;
+    }
+
+    PyList_SET_ITEM(gl_list, 0, PyLong_FromLong(numIndices));
+    PyList_SET_ITEM(gl_list, 1, PyLong_FromLong(numVertices));
+    PyList_SET_ITEM(gl_list, 2, (PyObject *)indexing_obj);
+    PyList_SET_ITEM(gl_list, 3, (PyObject *)vertices_obj);
+    PyList_SET_ITEM(gl_list, 4, (PyObject *)colours_obj);
+
+    return gl_list;
+}
+
+#undef GROUP_NLEVELS
+
+#define CONTOUR_GL_FULL          0 /* contourerGLList */
+#define CONTOUR_GL_COMPACT       1 /* contourerGLListCompact with float32 vertices */
+#define CONTOUR_GL_COMPACT_INT16 2 /* contourerGLListCompact with fixed point int16 vertices */
+
+#define CONTOUR_INT16_MAX 32767
+
+/* the largest power of 2 that keeps every vertex of the job within int16 */
+static float fixed_point_scale(Contour_job *job) {
+    int g, npoints = 2;
+    float scale = 1;
+
+    for (g = 0; g < job->ngroups; g++) {
+        npoints = MAX(npoints, PyArray_DIM(job->groups[g].data, 0));
+        npoints = MAX(npoints, PyArray_DIM(job->groups[g].data, 1));
+    }
+
+    while (2 * scale * (npoints - 1) <= CONTOUR_INT16_MAX) scale *= 2;
+    while (scale * (npoints - 1) > CONTOUR_INT16_MAX) scale /= 2;
+
+    return scale;
+}
+
+/* the indices of each chain as in contour_job_gl_list, as index_type */
+#define FILL_CHAIN_INDICES(index_type)                                   \
+    {                                                                    \
+        index_type *index_ptr = (index_type *)PyArray_DATA(indexing_obj); \
+        for (g = 0, index = 0; g < job->ngroups; g++) {                  \
+            for (l = 0; l < job->groups[g].nlevels_used; l++) {          \
+                chains = job->groups[g].chains + l;                      \
+                for (c = 0; c < chains->nchains; c++) {                  \
+                    end_index = index;                                   \
+                    for (i = 0; i < chains->chain_length[c]; i++) {      \
+                        *index_ptr++ = (index_type)index++;              \
+                        *index_ptr++ = (index_type)index;                \
+                    }                                                    \
+                    index_ptr[-1] = (index_type)end_index;               \
+                }                                                        \
+            }                                                            \
+        }                                                                \
+    }
+
+/* as contour_job_gl_list but with uint16 indices if they fit, the vertices as int16 (value = vertex * scale) */
+/* if format is CONTOUR_GL_COMPACT_INT16 and scale >= 1, and one colour for each range of indices of a level (not each vertex) */
+static PyObject *contour_job_compact_gl_list(Contour_job *job, int format) {
+    int g, l, c, i, col, numVertices = 0, numIndices, nranges = 0;
+    unsigned int index, end_index;
+    float scale = 1;
+    float32 *vertex_ptr, *colour_ptr;
+    short *fixed_ptr;
+    npy_int32 *range_ptr;
+    npy_intp dims[1];
+    Contour_group *group;
+    Contour_chains *chains;
+    PyArrayObject *indexing_obj = NULL, *vertices_obj = NULL, *ranges_obj = NULL, *colours_obj = NULL;
+    PyObject *gl_list;
+
+    for (g = 0; g < job->ngroups; g++) {
+        for (l = 0; l < job->groups[g].nlevels_used; l++) {
+            numVertices += job->groups[g].chains[l].nvertices;
+            if (job->groups[g].chains[l].nvertices > 0) nranges++;
+        }
+    }
+
+    numIndices = 2 * numVertices;
+    if (format == CONTOUR_GL_COMPACT_INT16) {
+        scale = fixed_point_scale(job);
+        /* planes wider than 32768 points would lose precision, so stay with float32 */
+        if (scale < 1) {
+            format = CONTOUR_GL_COMPACT;
+            scale = 1;
+        }
+    }
+
+    dims[0] = numIndices;
+    indexing_obj = (PyArrayObject *)PyArray_SimpleNew(1, dims, (numVertices <= 65536) ? NPY_UINT16 : NPY_UINT32);
+    dims[0] = 2 * numVertices;
+    vertices_obj = (PyArrayObject *)PyArray_SimpleNew(1, dims, (format == CONTOUR_GL_COMPACT_INT16) ? NPY_INT16 : NPY_FLOAT32);
+    dims[0] = 2 * nranges;
+    ranges_obj = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_INT32);
+    dims[0] = 4 * nranges;
+    colours_obj = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_FLOAT32);
+
+    if (!indexing_obj || !vertices_obj || !ranges_obj || !colours_obj) {
+        Py_XDECREF(indexing_obj);
+        Py_XDECREF(vertices_obj);
+        Py_XDECREF(ranges_obj);
+        Py_XDECREF(colours_obj);
+        RETURN_OBJ_ERROR("Cannot create gl list arrays");
+    }
+
+    if (numVertices <= 65536)
+        FILL_CHAIN_INDICES(npy_uint16)
+    else
+        FILL_CHAIN_INDICES(npy_uint32)
+
+    vertex_ptr = (float32 *)PyArray_DATA(vertices_obj);
+    fixed_ptr = (short *)PyArray_DATA(vertices_obj);
+    range_ptr = (npy_int32 *)PyArray_DATA(ranges_obj);
+    colour_ptr = (float32 *)PyArray_DATA(colours_obj);
+    index = 0;
+
+    for (g = 0; g < job->ngroups; g++) {
+        group = job->groups + g;
+
+        for (l = 0; l < group->nlevels_used; l++) {
+            chains = group->chains + l;
+            if (chains->nvertices == 0) continue;
+
+            if (format == CONTOUR_GL_COMPACT_INT16) {
+                /* the vertices are never negative, so rounding is adding a half */
+                for (i = 0; i < 2 * chains->nvertices; i++) *fixed_ptr++ = (short)(chains->vertices[i] * scale + 0.5f);
+            } else {
+                memcpy(vertex_ptr, chains->vertices, 2 * chains->nvertices * sizeof(float32));
+                vertex_ptr += 2 * chains->nvertices;
+            }
+
+            /* the first index and the number of indices of the level */
+            *range_ptr++ = 2 * index;
+            *range_ptr++ = 2 * chains->nvertices;
+            index += chains->nvertices;
+
+            for (col = 0; col < 4; col++) *colour_ptr++ = group->colour[4 * l + col];
+        }
+    }
+
+    gl_list = newList(7);
+    if (!gl_list) {
+        Py_DECREF(indexing_obj);
+        Py_DECREF(vertices_obj);
+        Py_DECREF(ranges_obj);
+        Py_DECREF(colours_obj);
+        return NULL;
+    }
+
+    PyList_SET_ITEM(gl_list, 0, PyLong_FromLong(numIndices));
+    PyList_SET_ITEM(gl_list, 1, PyLong_FromLong(numVertices));
+    PyList_SET_ITEM(gl_list, 2, (PyObject *)indexing_obj);
+    PyList_SET_ITEM(gl_list, 3, (PyObject *)vertices_obj);
+    PyList_SET_ITEM(gl_list, 4, PyFloat_FromDouble(scale));
+    PyList_SET_ITEM(gl_list, 5, (PyObject *)ranges_obj);
+    PyList_SET_ITEM(gl_list, 6, (PyObject *)colours_obj);
+
+    return gl_list;
+}
+
+#undef FILL_CHAIN_INDICES
+
+static PyObject *contourerGLListNative(PyObject *dataArrays, PyArrayObject *posLevels, PyArrayObject *negLevels,
+                                      PyArrayObject *posColour, PyArrayObject *negColour, int numThreads, int format) {
+    int arr, nthreads, numArrays = PyTuple_GET_SIZE(dataArrays);
+    CcpnStatus status;
+    Contour_job job;
+    PyArrayObject *dataArray;
+    PyObject *gl_list;
+    char error_msg[1000];
+
+    nthreads = parallel_num_threads(numThreads, PARALLEL_MAX_THREADS);
+
+    /* group 2*arr is the positive levels of array arr and 2*arr+1 the negative */
+    if (new_contour_job(&job, 2 * numArrays) == CCPN_ERROR) RETURN_OBJ_ERROR("allocating band memory");
+
+    for (arr = 0, status = CCPN_OK; (arr < numArrays) && (status == CCPN_OK); arr++) {
+        dataArray = (PyArrayObject *)PyTuple_GET_ITEM(dataArrays, arr);
+
+        status = new_contour_group(job.groups + 2 * arr, dataArray, posLevels, posColour, nthreads, error_msg);
+        if (status == CCPN_OK)
+            status = new_contour_group(job.groups + 2 * arr + 1, dataArray, negLevels, negColour, nthreads, error_msg);
+    }
+
+    if (status == CCPN_OK) {
+        Py_BEGIN_ALLOW_THREADS
+        status = run_contour_job(&job, nthreads, error_msg);
+        Py_END_ALLOW_THREADS
+    }
+
+    if (status == CCPN_OK) {
+        add_job_stats(&job);
+        if (format == CONTOUR_GL_FULL)
+            gl_list = contour_job_gl_list(&job, NULL);
+        else
+            gl_list = contour_job_compact_gl_list(&job, format);
+    } else {
+        gl_list = NULL;
+    }
+
+    delete_contour_job(&job);
+
+    if (status == CCPN_ERROR) RETURN_OBJ_ERROR(error_msg);
+
+    return gl_list;
+}
+
+/* one (vertices, chainLengths) tuple per level, as used by the Python ContourCache */
+static PyObject *contour_group_level_chains(Contour_group *group) {
+    int l;
+    npy_intp dims[1];
+    Contour_chains *chains;
+    PyArrayObject *vertices_obj, *lengths_obj;
+    PyObject *levels_list, *level_tuple;
+
+    levels_list = newList(group->nlevels);
+    if (!levels_list) return NULL;
+
+    for (l = 0; l < group->nlevels; l++) {
+        chains = group->chains + l;
+
+        dims[0] = 2 * chains->nvertices;
+        vertices_obj = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_FLOAT32);
+        dims[0] = chains->nchains;
+        lengths_obj = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_INT32);
+
+        if (!vertices_obj || !lengths_obj) {
+            Py_XDECREF(vertices_obj);
+            Py_XDECREF(lengths_obj);
+            Py_DECREF(levels_list);
+            RETURN_OBJ_ERROR("Cannot create chain arrays");
+        }
+
+        if (chains->nvertices > 0)
+            memcpy(PyArray_DATA(vertices_obj), chains->vertices, 2 * chains->nvertices * sizeof(float32));
+        if (chains->nchains > 0)
+            memcpy(PyArray_DATA(lengths_obj), chains->chain_length, chains->nchains * sizeof(int));
+
+        level_tuple = PyTuple_Pack(2, (PyObject *)vertices_obj, (PyObject *)lengths_obj);
+        Py_DECREF(vertices_obj);
+        Py_DECREF(lengths_obj);
+
+        if (!level_tuple) {
+            Py_DECREF(levels_list);
+            return NULL;
+        }
+
+        PyList_SET_ITEM(levels_list, l, level_tuple);
+    }
+
+    return levels_list;
+}
+
+static PyObject *contourerLevelChains(PyObject *self, PyObject *args) {
+    int nthreads, numThreads = 1;
+    CcpnStatus status;
+    Contour_job job;
+    PyArrayObject *dataArray, *levels;
+    PyObject *levels_list;
+    char error_msg[1000];
+
+    if (!PyArg_ParseTuple(args, "O!O!|i", &PyArray_Type, &dataArray, &PyArray_Type, &levels, &numThreads))
+        RETURN_OBJ_ERROR("need arguments: dataArray, levels, optional numThreads");
+
+    if (PyArray_TYPE(dataArray) != NPY_FLOAT) RETURN_OBJ_ERROR("dataArray needs to be array of floats");
+
+    if (PyArray_NDIM(dataArray) != 2) RETURN_OBJ_ERROR("dataArray needs to be NumPy array with ndim 2");
+
+    if (PyArray_TYPE(levels) != NPY_FLOAT) RETURN_OBJ_ERROR("levels needs to be array of floats");
+
+    if (PyArray_NDIM(levels) != 1) RETURN_OBJ_ERROR("levels needs to be NumPy array with ndim 1");
+
+    if (numThreads < 0) RETURN_OBJ_ERROR("numThreads must be >= 0 (0 = use all cpus)");
+
+    nthreads = parallel_num_threads(numThreads, PARALLEL_MAX_THREADS);
+
+    if (new_contour_job(&job, 1) == CCPN_ERROR) RETURN_OBJ_ERROR("allocating band memory");
+
+    status = new_contour_group(job.groups, dataArray, levels, NULL, nthreads, error_msg);
+
+    if (status == CCPN_OK) {
+        /* every level is wanted, the caller decides what to do with empty ones */
+        job.groups[0].all_levels = CCPN_TRUE;
+
+        Py_BEGIN_ALLOW_THREADS
+        status = run_contour_job(&job, nthreads, error_msg);
+        Py_END_ALLOW_THREADS
+    }
+
+    if (status == CCPN_OK) {
+        add_job_stats(&job);
+        if (job.groups[0].stats) add_call_stats(1);
+        levels_list = contour_group_level_chains(job.groups);
+    } else {
+        levels_list = NULL;
+    }
+
+    delete_contour_job(&job);
+
+    if (status == CCPN_ERROR) RETURN_OBJ_ERROR(error_msg);
+
+    return levels_list;
+}
+
+/* the checks on the arguments shared by contourerGLList and startContourJob */
+static CcpnStatus check_gl_list_args(PyObject *dataArrays, PyArrayObject *posLevels, PyArrayObject *negLevels,
+                                     PyArrayObject *posColour, PyArrayObject *negColour, int flatten, int numThreads,
+                                     char *error_msg) {
+    if (PyArray_TYPE(posLevels) != NPY_FLOAT) RETURN_ERROR_MSG("posLevels needs to be array of floats");
+
+    if (PyArray_NDIM(posLevels) != 1) RETURN_ERROR_MSG("posLevels needs to be NumPy array with ndim 1");
+
+    if (PyArray_TYPE(negLevels) != NPY_FLOAT) RETURN_ERROR_MSG("negLevels needs to be array of floats");
+
+    if (PyArray_NDIM(negLevels) != 1) RETURN_ERROR_MSG("negLevels needs to be NumPy array with ndim 1");
+
+    if (PyArray_TYPE(posColour) != NPY_FLOAT32) RETURN_ERROR_MSG("posColour needs to be array of floats");
+
+    if (PyArray_NDIM(posColour) != 1) RETURN_ERROR_MSG("posColour needs to be NumPy array with ndim 1");
+
+    if (PyArray_TYPE(negColour) != NPY_FLOAT32) RETURN_ERROR_MSG("negColour needs to be array of floats");
+
+    if (PyArray_NDIM(negColour) != 1) RETURN_ERROR_MSG("negColour needs to be NumPy array with ndim 1");
+
+    if (flatten != 0 && flatten != 1) RETURN_ERROR_MSG("flatten must be True/False");
+
+    if (numThreads < 0) RETURN_ERROR_MSG("numThreads must be >= 0 (0 = use all cpus)");
+
+    return check_data_arrays(dataArrays, error_msg);
+}
+
+/* a new tuple holding the overlaid planes (see projectPlanes) */
+static PyObject *flatten_data_arrays(PyObject *dataArrays, int numThreads) {
+    PyArrayObject *flat;
+    PyObject *flat_arrays;
+
+    flat = project_planes(dataArrays, numThreads);
+    if (!flat) return NULL;
+
+    flat_arrays = PyTuple_Pack(1, flat);
+    Py_DECREF(flat);
+    if (!flat_arrays) RETURN_OBJ_ERROR("allocating tuple memory");
+
+    return flat_arrays;
+}
+
+/* a contourerGLList run on the background pool, the job handle given to Python is a capsule of this */
+typedef struct _Contour_async {
+    Contour_job job;
+    CcpnBool have_job;          /* job still has its memory, freed once the result is made */
+    PyObject *data_arrays;      /* the planes contoured (flattened if asked), and the colours the */
+    PyArrayObject *pos_colour;  /* groups point into, kept until the thread has finished */
+    PyArrayObject *neg_colour;
+    int nthreads;
+    Parallel_work work;         /* NULL once waited for */
+    Parallel_lock join_lock;    /* so only one caller waits for the work */
+    CcpnBool finished;          /* under job.lock */
+    CcpnStatus status;
+    PyObject *result;           /* the gl list, once the thread has been joined */
+    char error_msg[1000];
+} Contour_async;
+
+#define CONTOUR_JOB_CAPSULE "Contourer2d.contourJob"
+
+static void finish_contour_async(Contour_async *contour_async, CcpnStatus status) {
+    parallel_lock(contour_async->job.lock);
+    contour_async->status = status;
+    contour_async->finished = CCPN_TRUE;
+    parallel_unlock(contour_async->job.lock);
+}
+
+static CcpnStatus contour_async_task(int task, void *user_data) {
+    Contour_async *contour_async = (Contour_async *)user_data;
+    CcpnStatus status;
+
+    status = run_contour_job(&contour_async->job, contour_async->nthreads, contour_async->error_msg);
+    finish_contour_async(contour_async, status);
+
+    return status;
+}
+
+/* a job cancelled (or dropped) before the pool starts it is taken off the queue, so it never waits its turn */
+static void unqueue_contour_async(Contour_async *contour_async) {
+    CcpnBool unqueued = CCPN_FALSE;
+
+    if (!contour_async->join_lock) return;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    parallel_lock(contour_async->join_lock);
+    if (contour_async->work) unqueued = parallel_unqueue(contour_async->work);
+    parallel_unlock(contour_async->join_lock);
+
+    Py_END_ALLOW_THREADS
+
+    if (unqueued) {
+        sprintf(contour_async->error_msg, CONTOUR_JOB_CANCELLED);
+        finish_contour_async(contour_async, CCPN_ERROR);
+    }
+}
+
+/* waits for the work, with the GIL released, then (with the GIL) makes the result if wanted and frees the job */
+static void join_contour_async(Contour_async *contour_async, CcpnBool make_result) {
+    /* without the lock the work was never queued */
+    if (contour_async->join_lock) {
+        Py_BEGIN_ALLOW_THREADS
+
+        parallel_lock(contour_async->join_lock);
+        if (contour_async->work) {
+            parallel_wait(contour_async->work);
+            contour_async->work = NULL;
+        }
+        parallel_unlock(contour_async->join_lock);
+
+        Py_END_ALLOW_THREADS
+    }
+
+    if (!contour_async->have_job) return;
+
+    if (make_result && contour_async->finished && (contour_async->status == CCPN_OK)) {
+        add_job_stats(&contour_async->job);
+        if (stats_enabled) add_call_stats((int)PyTuple_GET_SIZE(contour_async->data_arrays));
+
+        contour_async->result = contour_job_gl_list(&contour_async->job, NULL);
+        if (!contour_async->result) {
+            PyErr_Clear();
+            contour_async->status = CCPN_ERROR;
+            sprintf(contour_async->error_msg, "Cannot create gl list arrays");
+        }
+    }
+
+    delete_contour_job(&contour_async->job);
+    contour_async->have_job = CCPN_FALSE;
+
+    Py_CLEAR(contour_async->data_arrays);
+    Py_CLEAR(contour_async->pos_colour);
+    Py_CLEAR(contour_async->neg_colour);
+}
+
+static void delete_contour_async(PyObject *capsule) {
+    Contour_async *contour_async = (Contour_async *)PyCapsule_GetPointer(capsule, CONTOUR_JOB_CAPSULE);
+
+    if (!contour_async) return;
+
+    /* nobody wants the result any more */
+    contour_async->job.cancelled = 1;
+    unqueue_contour_async(contour_async);
+    join_contour_async(contour_async, CCPN_FALSE);
+
+    delete_parallel_lock(contour_async->job.lock);
+    delete_parallel_lock(contour_async->join_lock);
+    Py_XDECREF(contour_async->result);
+    Py_XDECREF(contour_async->data_arrays);
+    Py_XDECREF(contour_async->pos_colour);
+    Py_XDECREF(contour_async->neg_colour);
+    FREE(contour_async, Contour_async);
+}
+
+static Contour_async *get_contour_async(PyObject *args) {
+    PyObject *capsule;
+
+    if (!PyArg_ParseTuple(args, "O", &capsule)) RETURN_OBJ_ERROR("need argument: job");
+
+    return (Contour_async *)PyCapsule_GetPointer(capsule, CONTOUR_JOB_CAPSULE);
+}
+
+static PyObject *startContourJob(PyObject *self, PyObject *args) {
+    int arr, numArrays, flatten = 0, numThreads = 1;
+    CcpnStatus status = CCPN_OK;
+    PyObject *dataArrays, *capsule;
+    PyArrayObject *posLevels, *negLevels, *posColour, *negColour, *dataArray;
+    Contour_async *contour_async;
+    char error_msg[1000];
+
+    if (!PyArg_ParseTuple(args, "O!O!O!O!O!|ii", &PyTuple_Type, &dataArrays, &PyArray_Type, &posLevels, &PyArray_Type,
+                          &negLevels, &PyArray_Type, &posColour, &PyArray_Type, &negColour, &flatten, &numThreads))
+        RETURN_OBJ_ERROR(
+            "need arguments: dataArrays, posLevels, negLevels, posColour, negColour, optional flatten = True/False, "
+            "optional numThreads");
+
+    if (check_gl_list_args(dataArrays, posLevels, negLevels, posColour, negColour, flatten, numThreads, error_msg) ==
+        CCPN_ERROR)
+        RETURN_OBJ_ERROR(error_msg);
+
+    contour_async = (Contour_async *)calloc(1, sizeof(Contour_async));
+    if (!contour_async) RETURN_OBJ_ERROR("allocating job memory");
+
+    /* the capsule owns everything from here on, delete_contour_async copes with a job not yet started */
+    capsule = PyCapsule_New(contour_async, CONTOUR_JOB_CAPSULE, delete_contour_async);
+    if (!capsule) {
+        free(contour_async);
+        return NULL;
+    }
+
+    if ((PyTuple_GET_SIZE(dataArrays) > 1) && (flatten)) {
+        contour_async->data_arrays = flatten_data_arrays(dataArrays, numThreads);
+        if (!contour_async->data_arrays) {
+            Py_DECREF(capsule);
+            return NULL;
+        }
+    } else {
+        Py_INCREF(dataArrays);
+        contour_async->data_arrays = dataArrays;
+    }
+
+    Py_INCREF(posColour);
+    Py_INCREF(negColour);
+    contour_async->pos_colour = posColour;
+    contour_async->neg_colour = negColour;
+    contour_async->nthreads = parallel_num_threads(numThreads, PARALLEL_MAX_THREADS);
+
+    numArrays = PyTuple_GET_SIZE(contour_async->data_arrays);
+    if (new_contour_job(&contour_async->job, 2 * numArrays) == CCPN_ERROR) {
+        Py_DECREF(capsule);
+        RETURN_OBJ_ERROR("allocating band memory");
+    }
+    contour_async->have_job = CCPN_TRUE;
+
+    /* as contourerGLListNative, group 2*arr is the positive levels of array arr and 2*arr+1 the negative */
+    for (arr = 0; (arr < numArrays) && (status == CCPN_OK); arr++) {
+        dataArray = (PyArrayObject *)PyTuple_GET_ITEM(contour_async->data_arrays, arr);
+
+        status = new_contour_group(contour_async->job.groups + 2 * arr, dataArray, posLevels, posColour,
+                                   contour_async->nthreads, error_msg);
+        if (status == CCPN_OK)
+            status = new_contour_group(contour_async->job.groups + 2 * arr + 1, dataArray, negLevels, negColour,
+                                       contour_async->nthreads, error_msg);
+    }
+
+    if (status == CCPN_ERROR) {
+        Py_DECREF(capsule);
+        RETURN_OBJ_ERROR(error_msg);
+    }
+
+    contour_async->job.lock = new_parallel_lock();
+    contour_async->join_lock = new_parallel_lock();
+    if (!contour_async->job.lock || !contour_async->join_lock) {
+        Py_DECREF(capsule);
+        RETURN_OBJ_ERROR("allocating lock memory");
+    }
+
+    contour_async->work = parallel_queue(contour_async_task, contour_async);
+    if (!contour_async->work) {
+        Py_DECREF(capsule);
+        RETURN_OBJ_ERROR("queueing contour job");
+    }
+
+    return capsule;
+}
+
+static PyObject *contourJobCancel(PyObject *self, PyObject *args) {
+    Contour_async *contour_async = get_contour_async(args);
+
+    if (!contour_async) return NULL;
+
+    contour_async->job.cancelled = 1;
+    unqueue_contour_async(contour_async);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *pauseContourJobs(PyObject *self, PyObject *args) {
+    int paused;
+
+    if (!PyArg_ParseTuple(args, "p", &paused)) RETURN_OBJ_ERROR("need argument: paused = True/False");
+
+    parallel_pause_queue(paused ? CCPN_TRUE : CCPN_FALSE);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *contourJobDone(PyObject *self, PyObject *args) {
+    CcpnBool finished;
+    Contour_async *contour_async = get_contour_async(args);
+
+    if (!contour_async) return NULL;
+
+    parallel_lock(contour_async->job.lock);
+    finished = contour_async->finished;
+    parallel_unlock(contour_async->job.lock);
+
+    return PyBool_FromLong(finished);
+}
+
+/* the levels of each group finished so far, up to the first one not finished (so in order) */
+static PyObject *contourJobPartial(PyObject *self, PyObject *args) {
+    int g, l, *nlevels;
+    Contour_group *group;
+    PyObject *gl_list;
+    Contour_async *contour_async = get_contour_async(args);
+
+    if (!contour_async) return NULL;
+
+    if (contour_async->result) {
+        Py_INCREF(contour_async->result);
+        return contour_async->result;
+    }
+
+    if (!contour_async->have_job) RETURN_OBJ_ERROR(contour_async->error_msg);
+
+    nlevels = (int *)malloc(MAX(1, contour_async->job.ngroups) * sizeof(int));
+    if (!nlevels) RETURN_OBJ_ERROR("allocating level memory");
+
+    parallel_lock(contour_async->job.lock);
+    for (g = 0; g < contour_async->job.ngroups; g++) {
+        group = contour_async->job.groups + g;
+        l = 0;
+        if (contour_async->job.levels_started) {
+            while ((l < group->nlevels_used) && group->level_done[l]) l++;
+        }
+        nlevels[g] = l;
+    }
+    parallel_unlock(contour_async->job.lock);
+
+    /* the chains of the levels done are not touched again by the thread */
+    gl_list = contour_job_gl_list(&contour_async->job, nlevels);
+    FREE(nlevels, int);
+
+    return gl_list;
+}
+
+static PyObject *contourJobWait(PyObject *self, PyObject *args) {
+    Contour_async *contour_async = get_contour_async(args);
+
+    if (!contour_async) return NULL;
+
+    join_contour_async(contour_async, CCPN_TRUE);
+
+    if (!contour_async->result) RETURN_OBJ_ERROR(contour_async->error_msg);
+
+    Py_INCREF(contour_async->result);
+    return contour_async->result;
+}
+
+/* max and min of each decimation x decimation block of data[row_start:row_end, col_start:col_end] */
+static void decimate_plane(PyArrayObject *data, int decimation, int row_start, int row_end, int col_start, int col_end,
+                           float32 *max_data, float32 *min_data) {
+    int i, j, r, c, c_end;
+    int nrows = (row_end - row_start + decimation - 1) / decimation;
+    int ncols = (col_end - col_start + decimation - 1) / decimation;
+    npy_intp stride1 = PyArray_STRIDE(data, 1);
+    char *row;
+    float32 v, *max_row, *min_row;
+
+    for (i = 0; i < nrows; i++) {
+        max_row = max_data + i * ncols;
+        min_row = min_data + i * ncols;
+
+        for (r = row_start + i * decimation; r < MIN(row_start + (i + 1) * decimation, row_end); r++) {
+            row = (char *)PyArray_GETPTR2(data, r, 0);
+
+            for (j = 0, c = col_start; j < ncols; j++) {
+                c_end = MIN(c + decimation, col_end);
+
+                /* first row of the block sets the values */
+                if (r == row_start + i * decimation) {
+                    max_row[j] = min_row[j] = *((float32 *)(row + c * stride1));
+                }
+
+                for (; c < c_end; c++) {
+                    v = *((float32 *)(row + c * stride1));
+                    max_row[j] = MAX(max_row[j], v);
+                    min_row[j] = MIN(min_row[j], v);
+                }
+            }
+        }
+    }
+}
+
+static PyObject *decimatePlane(PyObject *self, PyObject *args) {
+    int decimation, row_start, row_end, col_start, col_end;
+    npy_intp dims[2];
+    PyArrayObject *data, *max_obj, *min_obj;
+
+    if (!PyArg_ParseTuple(args, "O!iiiii", &PyArray_Type, &data, &decimation, &row_start, &row_end, &col_start,
+                          &col_end))
+        RETURN_OBJ_ERROR("need arguments: dataArray, decimation, rowStart, rowEnd, colStart, colEnd");
+
+    if (PyArray_TYPE(data) != NPY_FLOAT) RETURN_OBJ_ERROR("dataArray needs to be array of floats");
+
+    if (PyArray_NDIM(data) != 2) RETURN_OBJ_ERROR("dataArray needs to be NumPy array with ndim 2");
+
+    if (decimation < 1) RETURN_OBJ_ERROR("decimation must be >= 1");
+
+    row_start = MAX(row_start, 0);
+    row_end = MIN(row_end, PyArray_DIM(data, 0));
+    col_start = MAX(col_start, 0);
+    col_end = MIN(col_end, PyArray_DIM(data, 1));
+
+    if ((row_start >= row_end) || (col_start >= col_end)) RETURN_OBJ_ERROR("region is empty");
+
+    dims[0] = (row_end - row_start + decimation - 1) / decimation;
+    dims[1] = (col_end - col_start + decimation - 1) / decimation;
+
+    max_obj = (PyArrayObject *)PyArray_SimpleNew(2, dims, NPY_FLOAT32);
+    if (!max_obj) RETURN_OBJ_ERROR("Cannot create decimated array");
+
+    min_obj = (PyArrayObject *)PyArray_SimpleNew(2, dims, NPY_FLOAT32);
+    if (!min_obj) {
+        Py_DECREF(max_obj);
+        RETURN_OBJ_ERROR("Cannot create decimated array");
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    decimate_plane(data, decimation, row_start, row_end, col_start, col_end, (float32 *)PyArray_DATA(max_obj),
+                   (float32 *)PyArray_DATA(min_obj));
+    Py_END_ALLOW_THREADS
+
+    return Py_BuildValue("(NN)", max_obj, min_obj);
+}
+
+/* not used
+static PyArrayObject *newArrayList(size) {
+    PyListObject *list;
+    list = PyList_New(size);
+    if (!list) {
+        RETURN_OBJ_ERROR("allocating list memory");
+    }
+    return list;
+}*/
+
+static PyObject *appendFloatList(PyObject *list, double value) {
+    if (PyList_Append(list, PyFloat_FromDouble((double)value)) != 0) {
+        RETURN_OBJ_ERROR("appending item to list");
+    }
+    return NULL;
+}
+
+// the original two-pass version, building Python lists of polylines before filling the arrays
+static PyObject *contourerGLListLists(PyObject *dataArrays, PyArrayObject *posLevels, PyArrayObject *negLevels,
+                                      PyArrayObject *posColour, PyArrayObject *negColour) {
+    PyArrayObject *dataArray;
+    PyArrayObject *indexing, *vertices, *colours;
+    PyObject *pos_cont_list, *neg_cont_list, *pos_cont, *neg_cont, *gl_object_list;
+    int arr;
+    Contour_gl_state gl_state;
+
+    // initialise the index/vertex count
+    memset(&gl_state, 0, sizeof(Contour_gl_state));
+
+    int numArrays = PyTuple_GET_SIZE(dataArrays);
+
+    pos_cont_list = PyList_New(numArrays);
+    if (!pos_cont_list) RETURN_OBJ_ERROR("allocating list memory");
+
+    neg_cont_list = PyList_New(numArrays);
+    if (!neg_cont_list) {
+        Py_DECREF(pos_cont_list);
+        RETURN_OBJ_ERROR("allocating list memory");
+    }
+
+    for (arr = 0; arr < numArrays; arr++) {
+        dataArray = (PyArrayObject *)PyTuple_GET_ITEM(dataArrays, arr);
+
+        // get the positive/negative contours, the lists take over the references
+        pos_cont = calculate_contours(dataArray, posLevels, &gl_state);
+        neg_cont = pos_cont ? calculate_contours(dataArray, negLevels, &gl_state) : NULL;
+
+        if (!pos_cont || !neg_cont) {
+            Py_XDECREF(pos_cont);
+            Py_DECREF(pos_cont_list);
+            Py_DECREF(neg_cont_list);
+            return NULL;
+        }
+
+        PyList_SET_ITEM(pos_cont_list, arr, pos_cont);
+        PyList_SET_ITEM(neg_cont_list, arr, neg_cont);
+    }
+
+    npy_intp dims[1] = {gl_state.numIndices};
+    indexing = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_UINT32);
+
+    dims[0] = 2 * gl_state.numVertices;
+    vertices = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_FLOAT32);
+
+    dims[0] = 4 * gl_state.numVertices;
+    colours = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_FLOAT32);
+
+    gl_object_list = (indexing && vertices && colours) ? newList(5) : NULL;
+
+    if (!gl_object_list) {
+        Py_XDECREF(indexing);
+        Py_XDECREF(vertices);
+        Py_XDECREF(colours);
+        Py_DECREF(pos_cont_list);
+        Py_DECREF(neg_cont_list);
+        if (!indexing) RETURN_OBJ_ERROR("Cannot create index array");
+        if (!vertices) RETURN_OBJ_ERROR("Cannot create vertex array");
+        if (!colours) RETURN_OBJ_ERROR("Cannot create colour array");
+        return NULL;
+    }
+
+    gl_state.indexPTR = PyArray_GETPTR1(indexing, 0);
+    gl_state.vertexPTR = PyArray_GETPTR1(vertices, 0);
+    gl_state.colourPTR = PyArray_GETPTR1(colours, 0);
+    gl_state.lastIndex = 0;
+
+    for (arr = 0; arr < numArrays; arr++) {
+        // fill the new arrays
+        fillContours(&gl_state, PyList_GET_ITEM(pos_cont_list, arr), posColour);
+        fillContours(&gl_state, PyList_GET_ITEM(neg_cont_list, arr), negColour);
+    }
+
+    Py_DECREF(pos_cont_list);
+    Py_DECREF(neg_cont_list);
+
+    PyList_SET_ITEM(gl_object_list, 0, PyLong_FromLong(gl_state.numIndices));
+    PyList_SET_ITEM(gl_object_list, 1, PyLong_FromLong(gl_state.numVertices));
+    PyList_SET_ITEM(gl_object_list, 2, (PyObject *)indexing);
+    PyList_SET_ITEM(gl_object_list, 3, (PyObject *)vertices);
+    PyList_SET_ITEM(gl_object_list, 4, (PyObject *)colours);
+
+    return gl_object_list;
+}
+
+static PyObject *contourerGLList(PyObject *self, PyObject *args) {
+    PyObject *dataArrays, *flat_arrays = NULL, *gl_object_list;
+    PyArrayObject *posLevels, *posColour;
+    PyArrayObject *negLevels, *negColour;
+    int flatten = 0, numThreads = 1, useLists = 0;
+    char error_msg[1000];
+
+    // assumes that the parameters are all numpy arrays
+    if (!PyArg_ParseTuple(args, "O!O!O!O!O!|iii", &PyTuple_Type, &dataArrays, &PyArray_Type, &posLevels, &PyArray_Type,
+                          &negLevels, &PyArray_Type, &posColour, &PyArray_Type, &negColour, &flatten, &numThreads,
+                          &useLists))
+
+        RETURN_OBJ_ERROR(
+            "need arguments: dataArrays, posLevels, negLevels, posColour, negColour, optional flatten = True/False, "
+            "optional numThreads, optional useLists = True/False");
+
+    //    if (PyArray_TYPE(dataArray) != NPY_FLOAT)
+    //        RETURN_OBJ_ERROR("dataArray needs to be array of floats");
+    //
+    //    if (PyArray_NDIM(dataArray) != 2)
+    //        RETURN_OBJ_ERROR("dataArray needs to be NumPy array with ndim 2");
+
+    if (check_gl_list_args(dataArrays, posLevels, negLevels, posColour, negColour, flatten, numThreads, error_msg) ==
+        CCPN_ERROR)
+        RETURN_OBJ_ERROR(error_msg);
+
+    if (useLists != 0 && useLists != 1) RETURN_OBJ_ERROR("useLists must be True/False");
+
+    if (useLists && numThreads != 1) RETURN_OBJ_ERROR("useLists needs numThreads = 1");
+
+    // overlay the planes in one pass into a new array, the caller's arrays are left unchanged
+    if ((PyTuple_GET_SIZE(dataArrays) > 1) && (flatten)) {
+        flat_arrays = flatten_data_arrays(dataArrays, numThreads);
+        if (!flat_arrays) return NULL;
+
+        dataArrays = flat_arrays;
+    }
+
+    // chains go straight into native buffers, otherwise the original version via Python lists
+    if (!useLists)
+        gl_object_list =
+            contourerGLListNative(dataArrays, posLevels, negLevels, posColour, negColour, numThreads, CONTOUR_GL_FULL);
+    else
+        gl_object_list = contourerGLListLists(dataArrays, posLevels, negLevels, posColour, negColour);
+
+    if (gl_object_list && stats_enabled) add_call_stats((int)PyTuple_GET_SIZE(dataArrays));
+
+    Py_XDECREF(flat_arrays);
+
+    return gl_object_list;
+}
+
+static PyObject *contourerGLListCompact(PyObject *self, PyObject *args) {
+    PyObject *dataArrays, *flat_arrays = NULL, *gl_object_list;
+    PyArrayObject *posLevels, *posColour;
+    PyArrayObject *negLevels, *negColour;
+    int flatten = 0, numThreads = 1, fixedPoint = 1;
+    char error_msg[1000];
+
+    if (!PyArg_ParseTuple(args, "O!O!O!O!O!|iii", &PyTuple_Type, &dataArrays, &PyArray_Type, &posLevels, &PyArray_Type,
+                          &negLevels, &PyArray_Type, &posColour, &PyArray_Type, &negColour, &flatten, &numThreads,
+                          &fixedPoint))
+        RETURN_OBJ_ERROR(
+            "need arguments: dataArrays, posLevels, negLevels, posColour, negColour, optional flatten = True/False, "
+            "optional numThreads, optional fixedPoint = True/False");
+
+    if (check_gl_list_args(dataArrays, posLevels, negLevels, posColour, negColour, flatten, numThreads, error_msg) ==
+        CCPN_ERROR)
+        RETURN_OBJ_ERROR(error_msg);
+
+    if (fixedPoint != 0 && fixedPoint != 1) RETURN_OBJ_ERROR("fixedPoint must be True/False");
+
+    if ((PyTuple_GET_SIZE(dataArrays) > 1) && (flatten)) {
+        flat_arrays = flatten_data_arrays(dataArrays, numThreads);
+        if (!flat_arrays) return NULL;
+
+        dataArrays = flat_arrays;
+    }
+
+    gl_object_list = contourerGLListNative(dataArrays, posLevels, negLevels, posColour, negColour, numThreads,
+                                           fixedPoint ? CONTOUR_GL_COMPACT_INT16 : CONTOUR_GL_COMPACT);
+
+    if (gl_object_list && stats_enabled) add_call_stats((int)PyTuple_GET_SIZE(dataArrays));
+
+    Py_XDECREF(flat_arrays);
+
+    return gl_object_list;
+}
+
+static PyObject *projectPlanes(PyObject *self, PyObject *args) {
+    PyObject *dataArrays;
+    int numThreads = 1;
+    char error_msg[1000];
+
+    if (!PyArg_ParseTuple(args, "O!|i", &PyTuple_Type, &dataArrays, &numThreads))
+        RETURN_OBJ_ERROR("need arguments: dataArrays, optional numThreads");
+
+    if (PyTuple_GET_SIZE(dataArrays) < 1) RETURN_OBJ_ERROR("dataArrays needs at least one array");
+
+    if (numThreads < 0) RETURN_OBJ_ERROR("numThreads must be >= 0 (0 = use all cpus)");
+
+    if (check_data_arrays(dataArrays, error_msg) == CCPN_ERROR) RETURN_OBJ_ERROR(error_msg);
+
+    return (PyObject *)project_planes(dataArrays, numThreads);
+}
+
+static PyObject *poolStats(PyObject *self, PyObject *args) {
+    Pool_stats stats;
+
+    if (!PyArg_ParseTuple(args, "")) RETURN_OBJ_ERROR("no arguments expected");
+
+    pool_get_stats(&stats);
+
+    return Py_BuildValue("{s:l,s:l,s:n}", "heapAllocs", stats.nheap_allocs, "reuses", stats.nreuses, "cachedBytes",
+                         (Py_ssize_t)stats.cached_bytes);
+}
+
+static PyObject *clearPool(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, "")) RETURN_OBJ_ERROR("no arguments expected");
+
+    pool_clear();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *setStatsEnabled(PyObject *self, PyObject *args) {
+    int enabled = 1;
+
+    if (!PyArg_ParseTuple(args, "|p", &enabled)) RETURN_OBJ_ERROR("need arguments: optional enabled = True/False");
+
+    stats_enabled = enabled ? CCPN_TRUE : CCPN_FALSE;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *getStats(PyObject *self, PyObject *args) {
+    int l;
+    PyObject *level_vertices, *level_chains;
+
+    if (!PyArg_ParseTuple(args, "")) RETURN_OBJ_ERROR("no arguments expected");
+
+    level_vertices = PyList_New(contour_stats.nlevel_counts);
+    level_chains = PyList_New(contour_stats.nlevel_counts);
+    if (!level_vertices || !level_chains) {
+        Py_XDECREF(level_vertices);
+        Py_XDECREF(level_chains);
+        RETURN_OBJ_ERROR("allocating list memory");
+    }
+
+    for (l = 0; l < contour_stats.nlevel_counts; l++) {
+        PyList_SET_ITEM(level_vertices, l, PyLong_FromLong(contour_stats.level_vertices[l]));
+        PyList_SET_ITEM(level_chains, l, PyLong_FromLong(contour_stats.level_chains[l]));
+    }
+
+    return Py_BuildValue("{s:O,s:l,s:l,s:l,s:l,s:l,s:d,s:d,s:N,s:N}", "enabled", stats_enabled ? Py_True : Py_False,
+                         "calls", contour_stats.ncalls, "planes", contour_stats.nplanes, "levels", contour_stats.nlevels,
+                         "vertices", contour_stats.nvertices, "chains", contour_stats.nchains, "findVerticesSeconds",
+                         contour_stats.find_vertices_seconds, "processChainsSeconds",
+                         contour_stats.process_chains_seconds, "levelVertices", level_vertices, "levelChains",
+                         level_chains);
+}
+
+static PyObject *buildInfo(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, "")) RETURN_OBJ_ERROR("no arguments expected");
+
+    return Py_BuildValue("{s:s,s:O,s:s,s:O}", "simd", find_crossing_kernel(), "multiversion",
+                         CCPN_HAVE_MULTIVERSION ? Py_True : Py_False, "cpuTarget", dispatch_cpu_target(), "openmp",
+                         CCPN_HAVE_OPENMP ? Py_True : Py_False);
+}
+
+static PyObject *resetStats(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, "")) RETURN_OBJ_ERROR("no arguments expected");
+
+    memset(&contour_stats, 0, sizeof(Contour_stats));
+
+    Py_RETURN_NONE;
+}
+
+static char contourer_doc[] = "Create 2D contours for spectral data";
+
+static char contourerLevelChains_doc[] =
+    "Create 2D contours for each level as native buffers\n"
+    "contourerLevelChains(dataArray, levels, numThreads=1)\n"
+    "returns a list, one (vertices, chainLengths) tuple for each level (even after an empty level),\n"
+    "vertices is float32 [x0, y0, x1, y1, ...] of all the chains and chainLengths is int32";
+
+static char decimatePlane_doc[] =
+    "Downsample a region of a 2D plane, keeping the peaks\n"
+    "decimatePlane(dataArray, decimation, rowStart, rowEnd, colStart, colEnd)\n"
+    "returns (maxArray, minArray), the max and min of each decimation x decimation block\n"
+    "of dataArray[rowStart:rowEnd, colStart:colEnd] (blocks at the end may be smaller)";
+
+static char projectPlanes_doc[] =
+    "Overlay 2D planes, as contourerGLList does with flatten = True\n"
+    "projectPlanes(dataArrays, numThreads=1)\n"
+    "returns a new array, at each point the largest positive value plus the most negative value\n"
+    "of the arrays folded in turn (arrays with a different shape to the first are ignored)";
+
+static char poolStats_doc[] =
+    "Return the use of the memory cache for the contouring\n"
+    "poolStats()\n"
+    "returns a dict with heapAllocs (blocks from the heap), reuses (blocks from the cache) and cachedBytes";
+
+static char clearPool_doc[] = "Free the memory cached for the contouring (and reset the poolStats counts)";
+
+static char setStatsEnabled_doc[] =
+    "Count the work of the contouring (see getStats), off unless enabled\n"
+    "setStatsEnabled(enabled=True)";
+
+static char getStats_doc[] =
+    "Return what the contouring has done since resetStats (while setStatsEnabled)\n"
+    "getStats()\n"
+    "returns a dict with enabled, calls, planes, levels, vertices, chains, findVerticesSeconds and\n"
+    "processChainsSeconds (summed over the threads), and levelVertices and levelChains, lists of the\n"
+    "vertices and chains by index of the level in posLevels or negLevels";
+
+static char resetStats_doc[] = "Reset the getStats counts to zero";
+
+static char buildInfo_doc[] =
+    "Return how the module was built and what it uses on this cpu:\n"
+    "simd = the find_crossing kernel (e.g. 'avx2'), multiversion = whether the hot loops have versions\n"
+    "for AVX2 and AVX-512 chosen at run time, cpuTarget = the version used here, openmp = whether\n"
+    "numThreads uses OpenMP rather than threads of its own";
+
+static char startContourJob_doc[] =
+    "Start contouring in the background, returns a job\n"
+    "startContourJob(dataArrays, posLevels, negLevels, posColour, negColour, flatten=False, numThreads=1)\n"
+    "the arguments are as for contourerGLList, dataArrays must not be changed until the job has finished\n"
+    "the jobs are queued, oldest first, on a fixed pool of background threads";
+
+static char contourJobCancel_doc[] =
+    "Ask a job to stop, it stops between rows and levels (or is taken off the queue if not started),\n"
+    "and then contourJobWait raises an error";
+
+static char pauseContourJobs_doc[] =
+    "pauseContourJobs(paused), while paused no queued job is started (for tests)";
+
+static char contourJobDone_doc[] = "True once a job has finished (or stopped after contourJobCancel)";
+
+static char contourJobPartial_doc[] =
+    "Return the glList of the levels a job has finished so far, for each plane the positive and negative\n"
+    "levels up to the first one not finished, in the same layout as contourerGLList";
+
+static char contourJobWait_doc[] =
+    "Wait (with the GIL released) for a job to finish, returns the same glList as contourerGLList";
+
+static char contourerGLList_doc[] =
+    "Convert 2D contours to glList\n"
+    "contourerGLList(dataArrays, posLevels, negLevels, posColour, negColour, flatten=False, numThreads=1, "
+    "useLists=False)\n"
+    "flatten = True overlays the planes (see projectPlanes) into a new array, dataArrays are not changed\n"
+    "numThreads = 1 contours serially, otherwise the planes are split into bands of rows contoured\n"
+    "on numThreads threads (0 = all the cpus) with the GIL released\n"
+    "useLists = True uses the original version that goes via Python lists of polylines (serial only)";
+
+static char contourerGLListCompact_doc[] =
+    "Convert 2D contours to a compact glList, for less memory and upload bandwidth\n"
+    "contourerGLListCompact(dataArrays, posLevels, negLevels, posColour, negColour, flatten=False, numThreads=1, "
+    "fixedPoint=True)\n"
+    "the contours are as contourerGLList, but returned as\n"
+    "[numIndices, numVertices, indices, vertices, scale, levelRanges, levelColours]\n"
+    "indices are uint16 if there are at most 65536 vertices, otherwise uint32\n"
+    "fixedPoint = True gives int16 vertices, the point (relative to the plane origin) times scale\n"
+    "(a power of 2, so the points are exact to 0.5/scale), otherwise float32 vertices and scale = 1\n"
+    "planes of more than 32768 points along an axis always give float32 vertices and scale = 1\n"
+    "levelRanges is (first index, number of indices) of each level with contours, drawn in\n"
+    "the colour in levelColours (RGBA for each range)";
+
+static struct PyMethodDef Contourer_type_methods[] = {
+    {"contourer2d", (PyCFunction)contourer, METH_VARARGS, contourer_doc},
+    {"contourerGLList", (PyCFunction)contourerGLList, METH_VARARGS, contourerGLList_doc},
+    {"contourerGLListCompact", (PyCFunction)contourerGLListCompact, METH_VARARGS, contourerGLListCompact_doc},
+    {"contourerLevelChains", (PyCFunction)contourerLevelChains, METH_VARARGS, contourerLevelChains_doc},
+    {"startContourJob", (PyCFunction)startContourJob, METH_VARARGS, startContourJob_doc},
+    {"contourJobCancel", (PyCFunction)contourJobCancel, METH_VARARGS, contourJobCancel_doc},
+    {"contourJobDone", (PyCFunction)contourJobDone, METH_VARARGS, contourJobDone_doc},
+    {"contourJobPartial", (PyCFunction)contourJobPartial, METH_VARARGS, contourJobPartial_doc},
+    {"contourJobWait", (PyCFunction)contourJobWait, METH_VARARGS, contourJobWait_doc},
+    {"pauseContourJobs", (PyCFunction)pauseContourJobs, METH_VARARGS, pauseContourJobs_doc},
+    {"decimatePlane", (PyCFunction)decimatePlane, METH_VARARGS, decimatePlane_doc},
+    {"projectPlanes", (PyCFunction)projectPlanes, METH_VARARGS, projectPlanes_doc},
+    {"poolStats", (PyCFunction)poolStats, METH_VARARGS, poolStats_doc},
+    {"clearPool", (PyCFunction)clearPool, METH_VARARGS, clearPool_doc},
+    {"setStatsEnabled", (PyCFunction)setStatsEnabled, METH_VARARGS, setStatsEnabled_doc},
+    {"getStats", (PyCFunction)getStats, METH_VARARGS, getStats_doc},
+    {"resetStats", (PyCFunction)resetStats, METH_VARARGS, resetStats_doc},
+    {"buildInfo", (PyCFunction)buildInfo, METH_VARARGS, buildInfo_doc},
+    {NULL, NULL, 0, NULL}};
+
+struct module_state {
+    PyObject *error;
+};
+
+static struct PyModuleDef moduledef = {
+    PyModuleDef_HEAD_INIT, "Contourer2d", NULL, sizeof(struct module_state), Contourer_type_methods, NULL, NULL, NULL, NULL};
+
+PyMODINIT_FUNC PyInit_Contourer2d(void) {
+    PyObject *module;
+
+#ifdef WIN32
+    Contourer.ob_type = &PyType_Type;
+#endif
+    /* create the module and add the functions */
+    module = PyModule_Create(&moduledef);
+
+    import_array(); /* needed for numpy, otherwise it crashes */
+
+    init_find_crossing();
 
     /* create exception object and add to module */
     ErrorObject = PyErr_NewException("Contourer2d.error", NULL, NULL);
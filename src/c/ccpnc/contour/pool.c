@@ -0,0 +1,207 @@
+/*
+======================COPYRIGHT/LICENSE START==========================
+
+pool.c: Part of the CcpNmr Analysis program
+
+Copyright (C) 2011 Wayne Boucher and Tim Stevens (University of Cambridge)
+
+=======================================================================
+
+The CCPN license can be found in ../../../license/CCPN.license.
+
+======================COPYRIGHT/LICENSE END============================
+
+for further information, please contact :
+    
+- CCPN website (http://www.ccpn.ac.uk/)
+
+- email: ccpn@bioc.cam.ac.uk
+
+- contact the authors: wb104@bioc.cam.ac.uk, tjs23@cam.ac.uk
+=======================================================================
+
+If you are using this software for academic purposes, we suggest
+quoting the following references:
+
+===========================REFERENCE START=============================
+R. Fogh, J. Ionides, E. Ulrich, W. Boucher, W. Vranken, J.P. Linge, M.
+Habeck, W. Rieping, T.N. Bhat, J. Westbrook, K. Henrick, G. Gilliland,
+H. Berman, J. Thornton, M. Nilges, J. Markley and E. Laue (2002). The
+CCPN project: An interim report on a data model for the NMR community
+(Progress report). Nature Struct. Biol. 9, 416-418.
+
+Wim F. Vranken, Wayne Boucher, Tim J. Stevens, Rasmus
+H. Fogh, Anne Pajon, Miguel Llinas, Eldon L. Ulrich, John L. Markley, John
+Ionides and Ernest D. Laue (2005). The CCPN Data Model for NMR Spectroscopy:
+Development of a Software Pipeline. Proteins 59, 687 - 696.
+
+===========================REFERENCE END===============================
+
+*/
+#include "pool.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define  POOL_MIN_SHIFT  6   /* smallest class is 64 bytes */
+#define  POOL_NCLASSES   48
+
+/* in front of every block, 16 bytes so that the memory handed out stays aligned */
+typedef union _Pool_header
+{
+    int size_class;
+    double align[2];
+} Pool_header;
+
+/* what a block on a free list holds */
+typedef struct _Pool_block
+{
+    struct _Pool_block *next;
+} Pool_block;
+
+static Pool_block *free_lists[POOL_NCLASSES];
+static Pool_stats pool_stats;
+
+#ifdef WIN32
+static SRWLOCK pool_lock = SRWLOCK_INIT;
+#define  POOL_LOCK  AcquireSRWLockExclusive(&pool_lock)
+#define  POOL_UNLOCK  ReleaseSRWLockExclusive(&pool_lock)
+#else
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+#define  POOL_LOCK  pthread_mutex_lock(&pool_lock)
+#define  POOL_UNLOCK  pthread_mutex_unlock(&pool_lock)
+#endif
+
+#define  CLASS_SIZE(k)  (((size_t) 1) << (k))
+
+#define  BLOCK_HEADER(ptr)  (((Pool_header *) (ptr)) - 1)
+
+static int size_class(size_t size)
+{
+    int k = POOL_MIN_SHIFT;
+
+    while ((k < POOL_NCLASSES-1) && (CLASS_SIZE(k) < size))
+        k++;
+
+    return k;
+}
+
+void *pool_malloc(size_t size)
+{
+    int k = size_class(size);
+    Pool_header *header = NULL;
+
+    if (CLASS_SIZE(k) < size)
+        return NULL;
+
+    POOL_LOCK;
+    if (free_lists[k])
+    {
+        header = (Pool_header *) free_lists[k];
+        free_lists[k] = free_lists[k]->next;
+        pool_stats.cached_bytes -= CLASS_SIZE(k);
+        pool_stats.nreuses++;
+    }
+    else
+    {
+        pool_stats.nheap_allocs++;
+    }
+    POOL_UNLOCK;
+
+    if (!header)
+    {
+        header = (Pool_header *) malloc(sizeof(Pool_header) + CLASS_SIZE(k));
+        if (!header)
+            return NULL;
+    }
+
+    header->size_class = k;
+
+    return (void *) (header + 1);
+}
+
+void *pool_realloc(void *ptr, size_t size)
+{
+    int k;
+    void *new_ptr;
+
+    if (!ptr)
+        return pool_malloc(size);
+
+    /* still fits in the block it already has */
+    k = BLOCK_HEADER(ptr)->size_class;
+    if (size <= CLASS_SIZE(k))
+        return ptr;
+
+    new_ptr = pool_malloc(size);
+    if (!new_ptr)
+        return NULL;
+
+    memcpy(new_ptr, ptr, CLASS_SIZE(k));
+    pool_free(ptr);
+
+    return new_ptr;
+}
+
+void pool_free(void *ptr)
+{
+    int k;
+    Pool_header *header;
+    CcpnBool cached = CCPN_FALSE;
+
+    if (!ptr)
+        return;
+
+    header = BLOCK_HEADER(ptr);
+    k = header->size_class;
+
+    POOL_LOCK;
+    if (pool_stats.cached_bytes + CLASS_SIZE(k) <= POOL_MAX_CACHED_BYTES)
+    {
+        ((Pool_block *) header)->next = free_lists[k];
+        free_lists[k] = (Pool_block *) header;
+        pool_stats.cached_bytes += CLASS_SIZE(k);
+        cached = CCPN_TRUE;
+    }
+    POOL_UNLOCK;
+
+    if (!cached)
+        free(header);
+}
+
+void pool_clear(void)
+{
+    int k;
+    Pool_block *block, *lists[POOL_NCLASSES];
+
+    POOL_LOCK;
+    for (k = 0; k < POOL_NCLASSES; k++)
+    {
+        lists[k] = free_lists[k];
+        free_lists[k] = NULL;
+    }
+
+    pool_stats.nheap_allocs = 0;
+    pool_stats.nreuses = 0;
+    pool_stats.cached_bytes = 0;
+    POOL_UNLOCK;
+
+    for (k = 0; k < POOL_NCLASSES; k++)
+    {
+        while ((block = lists[k]))
+        {
+            lists[k] = block->next;
+            free(block);
+        }
+    }
+}
+
+void pool_get_stats(Pool_stats *stats)
+{
+    POOL_LOCK;
+    *stats = pool_stats;
+    POOL_UNLOCK;
+}
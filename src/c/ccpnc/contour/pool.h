@@ -0,0 +1,101 @@
+/*
+======================COPYRIGHT/LICENSE START==========================
+
+pool.h: Part of the CcpNmr Analysis program
+
+Copyright (C) 2011 Wayne Boucher and Tim Stevens (University of Cambridge)
+
+=======================================================================
+
+The CCPN license can be found in ../../../license/CCPN.license.
+
+======================COPYRIGHT/LICENSE END============================
+
+for further information, please contact :
+
+- CCPN website (http://www.ccpn.ac.uk/)
+
+- email: ccpn@bioc.cam.ac.uk
+
+- contact the authors: wb104@bioc.cam.ac.uk, tjs23@cam.ac.uk
+=======================================================================
+
+If you are using this software for academic purposes, we suggest
+quoting the following references:
+
+===========================REFERENCE START=============================
+R. Fogh, J. Ionides, E. Ulrich, W. Boucher, W. Vranken, J.P. Linge, M.
+Habeck, W. Rieping, T.N. Bhat, J. Westbrook, K. Henrick, G. Gilliland,
+H. Berman, J. Thornton, M. Nilges, J. Markley and E. Laue (2002). The
+CCPN project: An interim report on a data model for the NMR community
+(Progress report). Nature Struct. Biol. 9, 416-418.
+
+Wim F. Vranken, Wayne Boucher, Tim J. Stevens, Rasmus
+H. Fogh, Anne Pajon, Miguel Llinas, Eldon L. Ulrich, John L. Markley, John
+Ionides and Ernest D. Laue (2005). The CCPN Data Model for NMR Spectroscopy:
+Development of a Software Pipeline. Proteins 59, 687 - 696.
+
+===========================REFERENCE END===============================
+
+*/
+#ifndef _incl_pool
+#define _incl_pool
+
+#include "defns.h"
+
+/* Thread-safe cache of memory blocks for the contourer, so that repeated */
+/* contouring (e.g. redraws of same sized planes) does not go back to the */
+/* heap.  Blocks are rounded up to a power of 2 size class and freed blocks */
+/* are kept on a list for their class, up to POOL_MAX_CACHED_BYTES in total. */
+/* Memory from pool_malloc/pool_realloc must only be freed by pool_free. */
+
+#define  POOL_MAX_CACHED_BYTES  (256 * 1024 * 1024)
+
+typedef struct _Pool_stats
+{
+    long nheap_allocs;    /* number of blocks that came from the heap */
+    long nreuses;         /* number of blocks that came from the cache */
+    size_t cached_bytes;  /* bytes currently in the cache */
+} Pool_stats;
+
+extern void *pool_malloc(size_t size);
+
+extern void *pool_realloc(void *ptr, size_t size);
+
+extern void pool_free(void *ptr);
+
+/* frees all the cached blocks and resets the counts */
+extern void pool_clear(void);
+
+extern void pool_get_stats(Pool_stats *stats);
+
+/* as the MALLOC etc. macros in defns.h */
+
+#define  POOL_MALLOC(ptr, type, num) \
+	 {   if ( ((ptr)=(type *) pool_malloc((size_t) (num)*sizeof(type))) \
+	           == NULL )  return  CCPN_ERROR;   }
+
+#define  POOL_MALLOC_NEW(ptr, type, num) \
+	 {   if ( ((ptr)=(type *) pool_malloc((size_t) (num)*sizeof(type))) \
+	           == NULL )  return  NULL;   }
+
+#define  POOL_MALLOC_ZERO(ptr, type, num) \
+	 {   int I; \
+	     POOL_MALLOC(ptr, type, num); \
+	     for (I = 0; I < (num); I++)  (ptr)[I] = (type) NULL;   }
+
+#define  POOL_REALLOC(ptr, type, num) \
+	 {   type *Ptr; \
+	     if ( ((Ptr)=(type *) pool_realloc((ptr), (size_t) (num)*sizeof(type))) \
+	               == NULL )  return  CCPN_ERROR;  else  ptr = Ptr;   }
+
+#define  POOL_REALLOC_NEW(ptr, type, num) \
+	 {   type *Ptr; \
+	     if ( ((Ptr)=(type *) pool_realloc((ptr), (size_t) (num)*sizeof(type))) \
+	               == NULL )  return  NULL;  else  ptr = Ptr;   }
+
+#define  POOL_FREE(ptr, type) \
+	 {   if ((ptr) != (type *) NULL) \
+	     {   pool_free((void *) (ptr));  (ptr) = (type *) NULL;   }   }
+
+#endif /* _incl_pool */
@@ -41,6 +41,7 @@ Development of a Software Pipeline. Proteins 59, 687 - 696.
 #include "nonlinear_model.h"
 
 #include "gauss_jordan.h"
+#include "dispatch.h"
 
 #define  CHECK_NONLINEAR_MODEL(stage) \
          CHECK_STATUS(nonlinear_model(x, y, w, npts, params, covar, alpha, beta, da, ap, dy_da, piv, row, col, nparams, chisq, &lambda, func, stage, user_data, error_msg));
@@ -303,3 +304,471 @@ CcpnStatus nonlinear_fit(int npts, float *x, float *y, float *w, float *y_fit,
     return status;
 }
 
+
+/* nonlinear_fit_blocks does the same fit as nonlinear_fit, but with all */
+/* the storage in a workspace that can be reused from one fit to the next. */
+/* The params come in nblocks blocks of block_size (e.g. one for each peak), */
+/* so a sample only adds to the normal matrix for the blocks where its */
+/* derivatives are not zero, and as the normal matrix is symmetric it is */
+/* kept packed (lower triangle, row by row) and solved by Cholesky. */
+/* The sums over the samples are done in float (as nonlinear_fit) or in */
+/* double, as set by the workspace precision, the solve is always in double. */
+
+/* x[n] in nonlinear_fit is replaced by the index of the sample, 0 to npts-1, */
+/* and func is called for each sample in turn, after prepare (if not NULL) */
+/* has been called with the params, so the model can work out anything that */
+/* only depends on the params once rather than for every sample. */
+
+#define  PACKED_ROW(a, i)  ((a) + (i)*((i)+1)/2)
+
+void init_nonlinear_workspace(Nonlinear_workspace *workspace, int precision)
+{
+    workspace->precision = precision;
+    workspace->nparams_alloc = 0;
+    workspace->nblocks_alloc = 0;
+    workspace->alpha = NULL;
+    workspace->alpha_trial = NULL;
+    workspace->chol = NULL;
+    workspace->beta = NULL;
+    workspace->beta_trial = NULL;
+    workspace->da = NULL;
+    workspace->alpha_float = NULL;
+    workspace->beta_float = NULL;
+    workspace->a_trial = NULL;
+    workspace->dy_da = NULL;
+    workspace->block_active = NULL;
+    workspace->active = NULL;
+    workspace->counts.nfits = 0;
+    workspace->counts.niterations = 0;
+    workspace->counts.nnot_converged = 0;
+}
+
+void clear_nonlinear_workspace(Nonlinear_workspace *workspace)
+{
+    FREE(workspace->alpha, double);
+    FREE(workspace->alpha_trial, double);
+    FREE(workspace->chol, double);
+    FREE(workspace->beta, double);
+    FREE(workspace->beta_trial, double);
+    FREE(workspace->da, double);
+    FREE(workspace->alpha_float, float);
+    FREE(workspace->beta_float, float);
+    FREE(workspace->a_trial, float);
+    FREE(workspace->dy_da, float);
+    FREE(workspace->block_active, CcpnBool);
+    FREE(workspace->active, int);
+
+    init_nonlinear_workspace(workspace, workspace->precision);
+}
+
+static CcpnStatus grow_nonlinear_workspace(Nonlinear_workspace *workspace,
+                                           int nparams, int nblocks)
+{
+    int npacked = nparams * (nparams+1) / 2;
+
+    if (nparams > workspace->nparams_alloc)
+    {
+        REALLOC(workspace->alpha, double, npacked);
+        REALLOC(workspace->alpha_trial, double, npacked);
+        REALLOC(workspace->chol, double, npacked);
+        REALLOC(workspace->beta, double, nparams);
+        REALLOC(workspace->beta_trial, double, nparams);
+        REALLOC(workspace->da, double, nparams);
+        REALLOC(workspace->alpha_float, float, npacked);
+        REALLOC(workspace->beta_float, float, nparams);
+        REALLOC(workspace->a_trial, float, nparams);
+        REALLOC(workspace->dy_da, float, nparams);
+        workspace->nparams_alloc = nparams;
+    }
+
+    if (nblocks > workspace->nblocks_alloc)
+    {
+        REALLOC(workspace->block_active, CcpnBool, nblocks);
+        REALLOC(workspace->active, int, nblocks);
+        workspace->nblocks_alloc = nblocks;
+    }
+
+    return CCPN_OK;
+}
+
+/* adds the contribution of one sample to the packed alpha and beta, */
+/* for the nactive blocks in active (in increasing order, so k <= j), */
+/* the float and double versions only differ in the type of the sums */
+CCPN_MULTIVERSION static void add_sample_float(float *alpha, float *beta, float *dy_da,
+                             float wgt_i, float dy, int *active, int nactive,
+                             int nblocks, int block_size)
+{
+    int b, bb, j, k, k_end, m = nblocks * block_size;
+    float wgt, *alpha_row;
+
+    if (nactive == nblocks) /* whole triangle */
+    {
+        for (j = 0; j < m; j++)
+        {
+            wgt = wgt_i * dy_da[j];
+            alpha_row = PACKED_ROW(alpha, j);
+
+            for (k = 0; k <= j; k++)
+                alpha_row[k] += wgt * dy_da[k];
+
+            beta[j] += wgt * dy;
+        }
+
+        return;
+    }
+
+    for (b = 0; b < nactive; b++)
+    {
+        for (j = active[b]*block_size; j < (active[b]+1)*block_size; j++)
+        {
+            wgt = wgt_i * dy_da[j];
+            alpha_row = PACKED_ROW(alpha, j);
+
+            for (bb = 0; bb <= b; bb++)
+            {
+                k_end = (bb == b) ? j+1 : (active[bb]+1)*block_size;
+
+                for (k = active[bb]*block_size; k < k_end; k++)
+                    alpha_row[k] += wgt * dy_da[k];
+            }
+
+            beta[j] += wgt * dy;
+        }
+    }
+}
+
+CCPN_MULTIVERSION static void add_sample_double(double *alpha, double *beta, float *dy_da,
+                              float wgt_i, float dy, int *active, int nactive,
+                              int nblocks, int block_size)
+{
+    int b, bb, j, k, k_end, m = nblocks * block_size;
+    double wgt, *alpha_row;
+
+    if (nactive == nblocks) /* whole triangle */
+    {
+        for (j = 0; j < m; j++)
+        {
+            wgt = wgt_i * (double) dy_da[j];
+            alpha_row = PACKED_ROW(alpha, j);
+
+            for (k = 0; k <= j; k++)
+                alpha_row[k] += wgt * dy_da[k];
+
+            beta[j] += wgt * dy;
+        }
+
+        return;
+    }
+
+    for (b = 0; b < nactive; b++)
+    {
+        for (j = active[b]*block_size; j < (active[b]+1)*block_size; j++)
+        {
+            wgt = wgt_i * (double) dy_da[j];
+            alpha_row = PACKED_ROW(alpha, j);
+
+            for (bb = 0; bb <= b; bb++)
+            {
+                k_end = (bb == b) ? j+1 : (active[bb]+1)*block_size;
+
+                for (k = active[bb]*block_size; k < k_end; k++)
+                    alpha_row[k] += wgt * dy_da[k];
+            }
+
+            beta[j] += wgt * dy;
+        }
+    }
+}
+
+/* as find_linearised, into packed alpha, returns chisq */
+static double find_linearised_blocks(Nonlinear_workspace *workspace,
+                                     float *y, float *w, int n, float *a,
+                                     int nblocks, int block_size,
+                                     double *alpha, double *beta,
+                                     Nonlinear_prepare_func prepare,
+                                     Nonlinear_block_func func, void *user_data)
+{
+    int i, b, nactive, m = nblocks * block_size, npacked = m*(m+1)/2;
+    int *active = workspace->active;
+    float dy, y_fit, wgt_i, c_float = 0, *dy_da = workspace->dy_da;
+    float *alpha_float = workspace->alpha_float, *beta_float = workspace->beta_float;
+    double c_double = 0;
+    CcpnBool *block_active = workspace->block_active;
+
+    if (workspace->precision == NONLINEAR_FLOAT)
+    {
+        ZERO_VECTOR(alpha_float, npacked);
+        ZERO_VECTOR(beta_float, m);
+    }
+    else
+    {
+        ZERO_VECTOR(alpha, npacked);
+        ZERO_VECTOR(beta, m);
+    }
+
+    if (prepare)
+        (*prepare)(a, user_data);
+
+    for (i = 0; i < n; i++)
+    {
+        for (b = 0; b < nblocks; b++)
+            block_active[b] = CCPN_TRUE;
+
+        (*func)(i, a, &y_fit, dy_da, block_active, user_data);
+
+        dy = y[i] - y_fit;
+        wgt_i = w ? w[i] : 1;
+
+        nactive = 0;
+        for (b = 0; b < nblocks; b++)
+        {
+            if (block_active[b])
+                active[nactive++] = b;
+        }
+
+        if (workspace->precision == NONLINEAR_FLOAT)
+        {
+            add_sample_float(alpha_float, beta_float, dy_da, wgt_i, dy,
+                             active, nactive, nblocks, block_size);
+            c_float += wgt_i * dy * dy;
+        }
+        else
+        {
+            add_sample_double(alpha, beta, dy_da, wgt_i, dy,
+                              active, nactive, nblocks, block_size);
+            c_double += wgt_i * (double) dy * dy;
+        }
+    }
+
+    if (workspace->precision == NONLINEAR_FLOAT)
+    {
+        COPY_VECTOR(alpha, alpha_float, npacked);
+        COPY_VECTOR(beta, beta_float, m);
+        return c_float;
+    }
+
+    return c_double;
+}
+
+/* factorises packed a[n][n] in place into lower triangular l, with a = l l^T */
+static CcpnBool cholesky_packed(double *a, int n)
+{
+    int i, j, k;
+    double s, *row_i, *row_j;
+
+    for (i = 0; i < n; i++)
+    {
+        row_i = PACKED_ROW(a, i);
+
+        for (j = 0; j <= i; j++)
+        {
+            row_j = PACKED_ROW(a, j);
+
+            s = row_i[j];
+            for (k = 0; k < j; k++)
+                s -= row_i[k] * row_j[k];
+
+            if (i == j)
+            {
+                if (!(s > 0)) /* also catches NaN */
+                    return CCPN_FALSE;
+
+                row_i[i] = sqrt(s);
+            }
+            else
+            {
+                row_i[j] = s / row_j[j];
+            }
+        }
+    }
+
+    return CCPN_TRUE;
+}
+
+/* solves l l^T x = b, with b replaced by x */
+static void cholesky_solve_packed(double *l, int n, double *b)
+{
+    int i, k;
+    double s, *row_i;
+
+    for (i = 0; i < n; i++)
+    {
+        row_i = PACKED_ROW(l, i);
+
+        s = b[i];
+        for (k = 0; k < i; k++)
+            s -= row_i[k] * b[k];
+
+        b[i] = s / row_i[i];
+    }
+
+    for (i = n-1; i >= 0; i--)
+    {
+        s = b[i];
+        for (k = i+1; k < n; k++)
+            s -= PACKED_ROW(l, k)[i] * b[k];
+
+        b[i] = s / PACKED_ROW(l, i)[i];
+    }
+}
+
+/* chol = alpha with the diagonal scaled by 1 + lambda, factorised */
+static CcpnStatus factorise_curvature(Nonlinear_workspace *workspace, int m,
+                                      float lambda, char *error_msg)
+{
+    int i;
+
+    COPY_VECTOR(workspace->chol, workspace->alpha, m*(m+1)/2);
+
+    for (i = 0; i < m; i++)
+        PACKED_ROW(workspace->chol, i)[i] *= 1 + lambda;
+
+    if (!cholesky_packed(workspace->chol, m))
+        RETURN_ERROR_MSG("singular nonlinear model");
+
+    return CCPN_OK;
+}
+
+/* one Levenberg-Marquardt step, as for the GENERAL_STAGE of nonlinear_model */
+static CcpnStatus nonlinear_step(Nonlinear_workspace *workspace, float *y,
+                                 float *w, int n, float *a,
+                                 int nblocks, int block_size,
+                                 double *chisq, float *lambda,
+                                 Nonlinear_prepare_func prepare,
+                                 Nonlinear_block_func func, void *user_data,
+                                 char *error_msg)
+{
+    int i, m = nblocks * block_size;
+    float lam = *lambda;
+    double csq = *chisq, trial_chisq, *swap;
+
+    CHECK_STATUS(factorise_curvature(workspace, m, lam, error_msg));
+
+    COPY_VECTOR(workspace->da, workspace->beta, m);
+    cholesky_solve_packed(workspace->chol, m, workspace->da);
+
+    for (i = 0; i < m; i++)
+        workspace->a_trial[i] = a[i] + workspace->da[i];
+
+    trial_chisq = find_linearised_blocks(workspace, y, w, n, workspace->a_trial,
+                                         nblocks, block_size,
+                                         workspace->alpha_trial,
+                                         workspace->beta_trial,
+                                         prepare, func, user_data);
+
+    if (trial_chisq < csq)
+    {
+        *lambda = 0.1 * lam;
+        *chisq = trial_chisq;
+
+        swap = workspace->alpha;
+        workspace->alpha = workspace->alpha_trial;
+        workspace->alpha_trial = swap;
+
+        swap = workspace->beta;
+        workspace->beta = workspace->beta_trial;
+        workspace->beta_trial = swap;
+
+        COPY_VECTOR(a, workspace->a_trial, m);
+    }
+    else
+    {
+        *lambda = 10.0 * lam;
+    }
+
+    return CCPN_OK;
+}
+
+CcpnStatus nonlinear_fit_blocks(Nonlinear_workspace *workspace, int npts,
+                                float *y, float *w, float *y_fit,
+                                int nblocks, int block_size,
+                                float *params, float *params_dev,
+                                int max_iter, float noise, float *chisq,
+                                Nonlinear_prepare_func prepare,
+                                Nonlinear_block_func func, void *user_data,
+                                char *error_msg)
+{
+    int i, iter, cond, nparams = nblocks * block_size;
+    float lambda, chisq_stop_criterion;
+    double csq, old_chisq;
+
+    sprintf(error_msg, "allocating memory");
+    CHECK_STATUS(grow_nonlinear_workspace(workspace, nparams, nblocks));
+
+    if (noise == 0)
+    {
+        for (i = 0; i < npts; i++)
+            noise = MAX(noise, ABS(y[i]));
+        noise *= 0.05; /* arbitrary */
+    }
+
+    if (max_iter == 0)
+        max_iter = MAX_MODEL_ITER;
+
+    chisq_stop_criterion = CHISQ_STOP_CRITERION * noise * noise;
+
+    /* INITIAL_STAGE */
+    lambda = 0.001;
+    csq = find_linearised_blocks(workspace, y, w, npts, params, nblocks, block_size,
+                                 workspace->alpha, workspace->beta,
+                                 prepare, func, user_data);
+    CHECK_STATUS(nonlinear_step(workspace, y, w, npts, params, nblocks, block_size,
+                                &csq, &lambda, prepare, func, user_data, error_msg));
+
+    for (iter = cond = 0; (iter < max_iter) && (cond < MAX_CONDITION); iter++)
+    {
+        old_chisq = csq;
+
+        CHECK_STATUS(nonlinear_step(workspace, y, w, npts, params, nblocks, block_size,
+                                    &csq, &lambda, prepare, func, user_data, error_msg));
+
+        if (csq > old_chisq)
+            cond = 0;
+        else if ((old_chisq - csq) < chisq_stop_criterion)
+            cond++;
+    }
+
+    workspace->counts.nfits++;
+    workspace->counts.niterations += iter;
+
+    if (iter == max_iter)
+    {
+        workspace->counts.nnot_converged++;
+        RETURN_ERROR_MSG("fit did not converge");
+    }
+
+    if (params_dev)
+        CHECK_STATUS(factorise_curvature(workspace, nparams, lambda, error_msg));
+
+    if (y_fit)
+    {
+        if (prepare)
+            (*prepare)(params, user_data);
+
+        for (i = 0; i < npts; i++)
+            (*func)(i, params, &y_fit[i], workspace->dy_da, workspace->block_active, user_data);
+    }
+
+    if (npts > nparams)
+        csq /= (npts - nparams);
+    else
+        csq = 0;
+
+    csq /= noise * noise;
+    *chisq = csq;
+
+    if (params_dev)
+    {
+        /* diagonal of the covariance matrix, the inverse of the curvature matrix */
+        for (i = 0; i < nparams; i++)
+        {
+            ZERO_VECTOR(workspace->da, nparams);
+            workspace->da[i] = 1;
+            cholesky_solve_packed(workspace->chol, nparams, workspace->da);
+
+            params_dev[i] = (float) sqrt(csq*MAX(workspace->da[i], 0));
+        }
+    }
+
+    return CCPN_OK;
+}
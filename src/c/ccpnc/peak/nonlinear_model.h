@@ -64,4 +64,61 @@ extern CcpnStatus nonlinear_fit
 	int max_iter, float noise, float *chisq,
 	Nonlinear_model_func func, void *user_data, char *error_msg);
 
+/* precision of the sums over the samples in nonlinear_fit_blocks */
+#define  NONLINEAR_FLOAT	0
+#define  NONLINEAR_DOUBLE	1
+
+/* y (and if dy_da is not NULL the derivatives) of the model at sample x, */
+/* with block_active[b] set to CCPN_FALSE if dy_da is zero for all the */
+/* params in block b (and then those dy_da do not need to be set) */
+typedef void (*Nonlinear_block_func)(int x, float *a, float *y, float *dy_da,
+				CcpnBool *block_active, void *user_data);
+
+/* called with each new set of params, before the Nonlinear_block_func calls for them */
+typedef void (*Nonlinear_prepare_func)(float *a, void *user_data);
+
+/* what nonlinear_fit_blocks has done with a workspace, since it was initialised */
+typedef struct _Nonlinear_counts
+{
+    long nfits;
+    long niterations;		/* of the Levenberg-Marquardt loop, over all the fits */
+    long nnot_converged;	/* fits stopped by max_iter */
+} Nonlinear_counts;
+
+/* storage for nonlinear_fit_blocks, which grows as needed and can be */
+/* used for any number of fits (but only by one thread at a time) */
+typedef struct _Nonlinear_workspace
+{
+    int precision;
+    int nparams_alloc;
+    int nblocks_alloc;
+    double *alpha;		/* normal matrices, packed lower triangle */
+    double *alpha_trial;
+    double *chol;
+    double *beta;
+    double *beta_trial;
+    double *da;
+    float *alpha_float;		/* for the sums with NONLINEAR_FLOAT */
+    float *beta_float;
+    float *a_trial;
+    float *dy_da;
+    CcpnBool *block_active;
+    int *active;
+    Nonlinear_counts counts;
+} Nonlinear_workspace;
+
+extern void init_nonlinear_workspace
+	(Nonlinear_workspace *workspace, int precision);
+
+extern void clear_nonlinear_workspace
+	(Nonlinear_workspace *workspace);
+
+extern CcpnStatus nonlinear_fit_blocks
+	(Nonlinear_workspace *workspace, int npts, float *y, float *w,
+	float *y_fit, int nblocks, int block_size,
+	float *params, float *params_dev,
+	int max_iter, float noise, float *chisq,
+	Nonlinear_prepare_func prepare, Nonlinear_block_func func,
+	void *user_data, char *error_msg);
+
 #endif /* _incl_nonlinear_model */
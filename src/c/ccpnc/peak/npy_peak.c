@@ -46,48 +46,220 @@ Development of a Software Pipeline. Proteins 59, 687 - 696.
 #include "arrayobject.h"
 #include "nonlinear_model.h"
 #include "npy_defns.h"
+#include "parallel.h"
+#include "dispatch.h"
+#include "peak_grid.h"
 
 #define MAX_NDIM 10
 
+/* the search and fit loops are written once, with ndim a parameter of a forced inline */
+/* function, and then called with ndim 1 to 4 as constants so that the compiler unrolls */
+/* the loops over the dims, and with the runtime ndim for the rest */
+#define PEAK_NDIM_SPECIALISED 4
+
+#if defined(_MSC_VER)
+#define PEAK_INLINE static __forceinline
+#elif defined(__GNUC__)
+#define PEAK_INLINE static inline __attribute__((always_inline))
+#else
+#define PEAK_INLINE static inline
+#endif
+
+/* the method for fitPeaks is the index into lineshapes */
 #define GAUSSIAN_METHOD 0
 #define LORENTZIAN_METHOD 1
-//#define PARABOLIC_METHOD  2
+#define PSEUDO_VOIGT_METHOD 2
+
+#define PSEUDO_VOIGT_FRACTION 0.5 /* starting fraction of Lorentzian, the rest Gaussian with the same linewidth */
 
 #define LARGE_NUMBER 1.0e20
 
+/* status of each fit in the fit arrays, and of each group in fitPeaksBatch */
+#define FIT_STATUS_OK         0
+#define FIT_STATUS_FAILED     1 /* the fit did not converge or was singular */
+#define FIT_STATUS_BAD_REGION 2 /* the region is empty or not inside the data */
+
+#define PEAK_CANDIDATES_NALLOC 256
+#define PEAK_TASKS_PER_THREAD  4 /* more tasks than threads, so that uneven blocks are shared out */
+
+/* returns the 1D lineshape at dx from the peak position, and the derivatives of its log, */
+/* fraction is the shape param of the peak (if the lineshape has one, otherwise ignored) */
+typedef float (*Lineshape_func)(float dx, float lw, float fraction, float *dlog_dp, float *dlog_dl, float *dlog_df);
+
 typedef struct _FitPeak {
     int ndim;
     int npeaks;
     int *region_offset;
     int *region_end;
+    int *region_size;
     int *cumul_region;
-    int method;
+    Lineshape_func lineshape;
+    int nshape;                /* shape params of each peak, after its linewidths */
+    int table_size;            /* sum of region_size, the 1D table entries for each peak */
+    int table_start[MAX_NDIM]; /* where each dim starts in the table of a peak */
+    float *factor;             /* npeaks x table_size, the lineshape in each dim */
+    float *dlog_dp;            /* and the derivatives of its log */
+    float *dlog_dl;
+    float *dlog_df;
+    CcpnBool outside;          /* first peak position is outside the region, or a fraction outside 0 to 1 */
+    int x[MAX_NDIM];           /* point in the region for sample next_ind */
+    int next_ind;
 } FitPeak;
 
+/* excluded regions and diagonals, read from the Python lists once for find_peaks */
+typedef struct _Peak_exclusions {
+    int nregions;
+    float *regions; /* nregions x 2 x ndim, low then high value in each dim */
+    int ndiagonals;
+    int *diagonal_dims;         /* ndiagonals x 2, dim1 and dim2 */
+    float *diagonal_transforms; /* ndiagonals x 4, a1, a2, b12 and d */
+} Peak_exclusions;
+
+/* the findPeaks arguments other than the data, checked and read once by new_peak_picker, */
+/* either for one findPeaks call or kept by newPeakPicker for many peakPickerPick calls */
+typedef struct _Peak_picker {
+    int ndim;
+    CcpnBool have_low;
+    CcpnBool have_high;
+    float low;
+    float high;
+    long buffer[MAX_NDIM];
+    CcpnBool nonadjacent;
+    float drop_factor;
+    float min_linewidth[MAX_NDIM];
+    Peak_exclusions exclusions;
+} Peak_picker;
+
+#define PEAK_PICKER_CAPSULE "Peak.peakPicker"
+
 static PyObject *ErrorObject; /* locally-raised exception */
 
+/* what findPeaks and the fits have done since resetStats, only counted while stats_enabled */
+typedef struct _Peak_stats {
+    long nfind_calls;
+    long npoints;
+    long nexcluded;           /* points in the excluded regions or diagonals */
+    long nthreshold;          /* points beyond low or high */
+    long nrejected_extreme;   /* of those, not a maximum (minimum) of their neighbours */
+    long nrejected_drop;      /* or not dropping by dropFactor */
+    long nrejected_linewidth; /* or narrower than minLinewidth */
+    long ncandidates;
+    long nrejected_buffer;
+    long npeaks;
+    double search_seconds; /* summed over the threads */
+    double buffer_seconds;
+    long nfit_calls;
+    long ngroups;
+    long nfailed;
+    long nbad_region;
+    Nonlinear_counts fit_counts;
+    double fit_seconds;
+} Peak_stats;
+
+static CcpnBool stats_enabled = CCPN_FALSE;
+static Peak_stats peak_stats;
+
+static void add_fit_counts(Nonlinear_counts *counts) {
+    peak_stats.fit_counts.nfits += counts->nfits;
+    peak_stats.fit_counts.niterations += counts->niterations;
+    peak_stats.fit_counts.nnot_converged += counts->nnot_converged;
+}
+
 static float get_value_at_point(PyArrayObject *data_array, npy_intp *point) {
     int i, ndim = PyArray_NDIM(data_array);
-    npy_intp reversed_point[MAX_NDIM];
-    for (i = 0; i < ndim; i++) reversed_point[i] = point[ndim - 1 - i];
+    npy_intp *strides = PyArray_STRIDES(data_array);
+    char *ptr = PyArray_BYTES(data_array);
+
+    /* point is in reverse order to the array dims */
+    for (i = 0; i < ndim; i++) ptr += point[i] * strides[ndim - 1 - i];
 
-    // return *((float *) PyArray_GetPtr(data_array, point));
-    return *((float *)PyArray_GetPtr(data_array, reversed_point));
+    return *((float *)ptr);
 }
 
-static CcpnBool point_within_peak_buffer(int ndim, npy_intp *point, PyObject *peak_obj, long *buffer) {
-    int i, d, p;
-    double posn;
+/* the data layout, so that the search can go straight to the values without the numpy API */
+typedef struct _Peak_data {
+    int ndim;
+    char *data;
+    npy_intp strides[MAX_NDIM]; /* in bytes, in point order (the reverse of the array dims) */
+    int points[MAX_NDIM];
+    CcpnBool contiguous;        /* first (point) dim is contiguous float32 */
+} Peak_data;
+
+#define VALUE_AT(ptr, offset) (*((float *)((ptr) + (offset))))
+
+static void init_peak_data(Peak_data *peak_data, PyArrayObject *data_array) {
+    int i, ndim = PyArray_NDIM(data_array);
+
+    peak_data->ndim = ndim;
+    peak_data->data = PyArray_BYTES(data_array);
 
     for (i = 0; i < ndim; i++) {
-        posn = PyFloat_AsDouble(PyTuple_GetItem(peak_obj, i));
-        p = NEAREST_INTEGER(posn);
+        peak_data->strides[i] = PyArray_STRIDE(data_array, ndim - 1 - i);
+        peak_data->points[i] = PyArray_DIM(data_array, ndim - 1 - i);
+    }
+
+    peak_data->contiguous = (ndim > 0) && (peak_data->strides[0] == sizeof(float));
+}
 
-        d = ABS(point[i] - p);
-        if (d > buffer[i]) return CCPN_FALSE;
+/* the usual numbers of dims are written out so that the compiler can unroll them */
+static inline char *point_ptr(Peak_data *peak_data, npy_intp *point) {
+    npy_intp *s = peak_data->strides;
+    char *ptr = peak_data->data;
+    int i;
+
+    switch (peak_data->ndim) {
+        case 1:
+            return ptr + point[0] * s[0];
+        case 2:
+            return ptr + point[0] * s[0] + point[1] * s[1];
+        case 3:
+            return ptr + point[0] * s[0] + point[1] * s[1] + point[2] * s[2];
+        case 4:
+            return ptr + point[0] * s[0] + point[1] * s[1] + point[2] * s[2] + point[3] * s[3];
+        default:
+            for (i = 0; i < peak_data->ndim; i++) ptr += point[i] * s[i];
+            return ptr;
     }
+}
 
-    return CCPN_TRUE;
+/* byte offsets from a point to the 3^ndim - 1 points around it, the 2 * ndim along the */
+/* axes first (as they are the most likely to reject a point) and then in index order, */
+/* so neighbour_offsets needs at least that many entries */
+static int neighbour_offsets(Peak_data *peak_data, npy_intp *neighbour_offsets) {
+    int i, n, pass, naxes, npoints, nneighbours, zero_index, ndim = peak_data->ndim;
+    int cumulative[MAX_NDIM];
+    npy_intp p[MAX_NDIM], offset;
+
+    npoints = 1;
+    for (i = 0; i < ndim; i++) {
+        cumulative[i] = npoints;
+        npoints *= 3;
+    }
+
+    zero_index = (npoints - 1) / 2;
+
+    nneighbours = 0;
+    for (pass = 0; pass < 2; pass++) {
+        for (n = 0; n < npoints; n++) {
+            if (n == zero_index) /* this is the central point */
+                continue;
+
+            ARRAY_OF_INDEX(p, n, cumulative, ndim);
+
+            /* p goes 0, 1, 2 so -1 makes it -1, 0, 1 */
+            offset = 0;
+            naxes = 0;
+            for (i = 0; i < ndim; i++) {
+                offset += (p[i] - 1) * peak_data->strides[i];
+                if (p[i] != 1) naxes++;
+            }
+
+            /* along an axis on the first pass, otherwise on the second */
+            if ((naxes == 1) == (pass == 0)) neighbour_offsets[nneighbours++] = offset;
+        }
+    }
+
+    return nneighbours;
 }
 
 static float fit_position_parabolic(float vm, float v, float vp) {
@@ -152,19 +324,14 @@ static CcpnBool fit_position_x(float vm, float v, float vp, float *peakPos, floa
     return CCPN_OK;
 }
 
-static CcpnBool check_buffer(PyArrayObject *data_array, PyObject *peak_list, long *buffer, float value, npy_intp *point) {
+static CcpnBool check_buffer(PyArrayObject *data_array, Peak_grid peak_grid, float value, npy_intp *point) {
     int i, ndim = PyArray_NDIM(data_array);
-    PyObject *point_obj;
-
-    /* check that not within buffer */
-    /* could do this first if implement efficient way of doing so */
+    long pnt[MAX_NDIM];
 
-    for (i = 0; i < PyList_Size(peak_list); i++) {
-        point_obj = PyTuple_GetItem(PyList_GetItem(peak_list, i), 0);
-        if (point_within_peak_buffer(ndim, point, point_obj, buffer)) return CCPN_FALSE;
-    }
+    /* check that not within buffer of the peaks found so far (only those in nearby grid cells are looked at) */
+    for (i = 0; i < ndim; i++) pnt[i] = (long)point[i];
 
-    return CCPN_TRUE;
+    return point_near_peak_grid(peak_grid, pnt) ? CCPN_FALSE : CCPN_TRUE;
 }
 
 static PyObject *peak_volume(PyArrayObject *data_array, float value, npy_intp *point) {
@@ -173,69 +340,172 @@ static PyObject *peak_volume(PyArrayObject *data_array, float value, npy_intp *p
     return PyFloat_FromDouble(volume);
 }
 
-static CcpnStatus new_peak(PyArrayObject *data_array, PyObject *peak_list, float value, npy_intp *point, int *points,
-                           char *error_msg) {
-    long i, ndim = PyArray_NDIM(data_array);
-    npy_intp pnt[MAX_NDIM];
-    float posn, vm, vp;
-    PyObject *peak_obj, *point_obj;
+static CcpnStatus new_peak(PyArrayObject *data_array, Peak_grid peak_grid, float value, npy_intp *point, char *error_msg) {
+    int i, ndim = PyArray_NDIM(data_array);
+    long pnt[MAX_NDIM];
 
-    peak_obj = PyTuple_New(2); /* point, height */
-    if (!peak_obj) RETURN_ERROR_MSG("allocating peak memory");
+    for (i = 0; i < ndim; i++) pnt[i] = (long)point[i];
 
-    point_obj = PyTuple_New(ndim);
-    if (!point_obj) RETURN_ERROR_MSG("allocating peak point memory");
+    if (add_peak_grid(peak_grid, pnt, value) == CCPN_ERROR) RETURN_ERROR_MSG("allocating peak memory");
+
+    return CCPN_OK;
+}
 
-    PyTuple_SetItem(peak_obj, 0, point_obj);
-    PyTuple_SetItem(peak_obj, 1, PyFloat_FromDouble((double)value));
+/* the Python list of (point, height) for the peaks, in the order they were found */
+static PyObject *peak_list_from_grid(Peak_grid peak_grid) {
+    int i, j, ndim = peak_grid->ndim;
+    long *pnt;
+    PyObject *peak_list, *peak_obj, *point_obj;
 
-    for (i = 0; i < ndim; i++) PyTuple_SetItem(point_obj, i, PyLong_FromLong((long)point[i]));
+    peak_list = PyList_New(peak_grid->npeaks);
+    if (!peak_list) RETURN_OBJ_ERROR("allocating memory for peak list");
 
-    if (PyList_Append(peak_list, peak_obj)) RETURN_ERROR_MSG("appending peak data to peak list");
-    Py_DECREF(peak_obj);
+    for (i = 0; i < peak_grid->npeaks; i++) {
+        peak_obj = PyTuple_New(2); /* point, height */
+        point_obj = PyTuple_New(ndim);
+        if (!peak_obj || !point_obj) {
+            Py_XDECREF(peak_obj);
+            Py_XDECREF(point_obj);
+            Py_DECREF(peak_list);
+            RETURN_OBJ_ERROR("allocating peak memory");
+        }
 
-    return CCPN_OK;
+        pnt = peak_grid->points + i * ndim;
+        for (j = 0; j < ndim; j++) PyTuple_SET_ITEM(point_obj, j, PyLong_FromLong(pnt[j]));
+
+        PyTuple_SET_ITEM(peak_obj, 0, point_obj);
+        PyTuple_SET_ITEM(peak_obj, 1, PyFloat_FromDouble((double)peak_grid->values[i]));
+
+        PyList_SET_ITEM(peak_list, i, peak_obj);
+    }
+
+    return peak_list;
 }
 
-/* TBD: ignores aliasing so does not work correctly on boundaries */
-static CcpnBool check_nonadjacent_points(PyArrayObject *data_array, CcpnBool find_maximum, long *buffer, float v,
-                                         npy_intp *point, int *points, int npoints, int *cumulative) {
-    int i, n, zero_index, ndim = PyArray_NDIM(data_array);
-    npy_intp p[MAX_NDIM];
-    CcpnBool do_point;
-    float v2;
+/* a structured array of n records, with the fields in spec (a list of (name, format[, shape])), */
+/* the fields used here are all 4 bytes so the records are filled through int32 and float32 pointers */
+static PyArrayObject *new_record_array(PyObject *spec, npy_intp n) {
+    PyArray_Descr *descr;
 
-    zero_index = 1;
-    for (i = 0; i < ndim; i++) zero_index *= 3;
-    zero_index = (zero_index - 1) / 2;
+    if (!spec) return NULL;
 
-    /* check that local extremum */
+    if (!PyArray_DescrConverter(spec, &descr)) {
+        Py_DECREF(spec);
+        return NULL;
+    }
 
-    // npoints is now the number of adjacent points to any in the array
-    // i.e. 3d is 27, so will only check these elements offset from the current, ignoring the middle
-    // this is all the elements in the encompassing cube
+    Py_DECREF(spec);
 
-    do_point = CCPN_TRUE;
-    for (n = 0; n < npoints; n++) {
-        if (n == zero_index) /* this is the central point */
-            continue;
+    return (PyArrayObject *)PyArray_NewFromDescr(&PyArray_Type, descr, 1, &n, NULL, NULL, 0, NULL);
+}
 
-        ARRAY_OF_INDEX(p, n, cumulative, ndim);
+#define RECORD(array, i) (PyArray_BYTES(array) + (i) * PyArray_STRIDE(array, 0))
 
-        for (i = 0; i < ndim; i++) {
-            // can't test points on the border
-            if ((point[i] == 0) || (point[i] == points[i] - 1)) return CCPN_FALSE;
+/* as peak_list_from_grid, but a structured array with fields position (int32 x ndim) and height (float32) */
+static PyObject *peak_array_from_grid(Peak_grid peak_grid) {
+    int i, j, ndim = peak_grid->ndim;
+    long *pnt;
+    char *record;
+    PyArrayObject *peak_array;
+
+    peak_array = new_record_array(Py_BuildValue("[(ss(i))(ss)]", "position", "<i4", ndim, "height", "<f4"),
+                                  peak_grid->npeaks);
+    if (!peak_array) RETURN_OBJ_ERROR("allocating memory for peak array");
+
+    for (i = 0; i < peak_grid->npeaks; i++) {
+        record = RECORD(peak_array, i);
+        pnt = peak_grid->points + i * ndim;
+
+        for (j = 0; j < ndim; j++) ((npy_int32 *)record)[j] = (npy_int32)pnt[j];
+        ((npy_float32 *)record)[ndim] = peak_grid->values[i];
+    }
 
-            /* would have been more efficient to do this before this function called... */
-            p[i] += point[i] - 1;
-            /* p initially goes 0, 1, 2 so extra -1 makes it -1, 0, 1 */
+    return (PyObject *)peak_array;
+}
+
+/* the Python list of (height, position, linewidth) for npeaks fits of (1 + 2 * ndim + nshape) params, */
+/* without the shape params */
+static PyObject *fit_list_from_params(float *params, int npeaks, int ndim, int nshape) {
+    int i, j, k;
+    PyObject *fit_list, *fit_obj, *posn_obj, *lw_obj;
+
+    fit_list = PyList_New(npeaks);
+    if (!fit_list) RETURN_OBJ_ERROR("allocating memory for fit list");
 
-            if ((p[i] < 0) || (p[i] >= points[i])) return CCPN_FALSE;
+    for (j = k = 0; j < npeaks; j++) {
+        fit_obj = PyTuple_New(3);  // height, position, linewidth
+        posn_obj = PyTuple_New(ndim);
+        lw_obj = PyTuple_New(ndim);
+        if (!fit_obj || !posn_obj || !lw_obj) {
+            Py_XDECREF(fit_obj);
+            Py_XDECREF(posn_obj);
+            Py_XDECREF(lw_obj);
+            Py_DECREF(fit_list);
+            RETURN_OBJ_ERROR("allocating fit data");
         }
 
-        // printf("              against: %i => %i, %i, %i\n", n, p[0], p[1], p[2]);
+        PyTuple_SET_ITEM(fit_obj, 0, PyFloat_FromDouble((double)params[k++]));
+        PyTuple_SET_ITEM(fit_obj, 1, posn_obj);
+        PyTuple_SET_ITEM(fit_obj, 2, lw_obj);
+
+        for (i = 0; i < ndim; i++) PyTuple_SET_ITEM(posn_obj, i, PyFloat_FromDouble((double)params[k++]));
+
+        for (i = 0; i < ndim; i++) PyTuple_SET_ITEM(lw_obj, i, PyFloat_FromDouble((double)params[k++]));
+
+        k += nshape;
+
+        PyList_SET_ITEM(fit_list, j, fit_obj);
+    }
+
+    return fit_list;
+}
+
+/* as fit_list_from_params, but a structured array with fields height (float32), position and linewidth */
+/* (float32 x ndim), fraction (float32) if nshape, and status (int32), from peak_status if not NULL, */
+/* otherwise status for every fit */
+static PyObject *fit_array_from_params(float *params, int *peak_status, int status, int npeaks, int ndim, int nshape) {
+    int j, nparams = 1 + 2 * ndim + nshape;
+    char *record;
+    PyObject *descr;
+    PyArrayObject *fit_array;
+
+    if (nshape)
+        descr = Py_BuildValue("[(ss)(ss(i))(ss(i))(ss)(ss)]", "height", "<f4", "position", "<f4", ndim, "linewidth",
+                              "<f4", ndim, "fraction", "<f4", "status", "<i4");
+    else
+        descr = Py_BuildValue("[(ss)(ss(i))(ss(i))(ss)]", "height", "<f4", "position", "<f4", ndim, "linewidth", "<f4",
+                              ndim, "status", "<i4");
+
+    fit_array = new_record_array(descr, npeaks);
+    if (!fit_array) RETURN_OBJ_ERROR("allocating memory for fit array");
+
+    for (j = 0; j < npeaks; j++) {
+        record = RECORD(fit_array, j);
+
+        COPY_VECTOR((npy_float32 *)record, params + j * nparams, nparams);
+        ((npy_int32 *)record)[nparams] = peak_status ? peak_status[j] : status;
+    }
+
+    return (PyObject *)fit_array;
+}
+
+/* TBD: ignores aliasing so does not work correctly on boundaries */
+/* ptr is where point is in the data, neighbour_offsets from neighbour_offsets() */
+PEAK_INLINE CcpnBool check_nonadjacent_points(Peak_data *peak_data, CcpnBool find_maximum, float v, npy_intp *point,
+                                              char *ptr, int nneighbours, npy_intp *neighbour_offsets, const int ndim) {
+    int i, n;
+    float v2;
+
+    /* check that local extremum */
+
+    // can't test points on the border
+    for (i = 0; i < ndim; i++) {
+        if ((point[i] == 0) || (point[i] == peak_data->points[i] - 1)) return CCPN_FALSE;
+    }
 
-        v2 = get_value_at_point(data_array, p);
+    // only check the elements in the encompassing cube (i.e. 26 in 3d)
+    for (n = 0; n < nneighbours; n++) {
+        v2 = VALUE_AT(ptr, neighbour_offsets[n]);
 
         if (find_maximum) {
             if (v2 > v) return CCPN_FALSE;
@@ -248,20 +518,17 @@ static CcpnBool check_nonadjacent_points(PyArrayObject *data_array, CcpnBool fin
 }
 
 /* TBD: ignores aliasing so does not work correctly on boundaries */
-static CcpnBool check_adjacent_points(PyArrayObject *data_array, CcpnBool find_maximum, long *buffer, float v, npy_intp *point,
-                                      int *points) {
-    int i, ndim = PyArray_NDIM(data_array);
-    npy_intp pnt[MAX_NDIM];
+PEAK_INLINE CcpnBool check_adjacent_points(Peak_data *peak_data, CcpnBool find_maximum, float v, npy_intp *point,
+                                           char *ptr, const int ndim) {
+    int i;
     float v2;
 
     /* check that local extremum */
 
     // only check the adjacent elements in the directions of the axes
-    COPY_VECTOR(pnt, point, ndim);
     for (i = 0; i < ndim; i++) {
         if (point[i] > 0) {
-            pnt[i] = point[i] - 1;
-            v2 = get_value_at_point(data_array, pnt);
+            v2 = VALUE_AT(ptr, -peak_data->strides[i]);
 
             if (find_maximum) {
                 if (v2 > v) return CCPN_FALSE;
@@ -270,9 +537,8 @@ static CcpnBool check_adjacent_points(PyArrayObject *data_array, CcpnBool find_m
             }
         }
 
-        if (point[i] < (points[i] - 1)) {
-            pnt[i] = point[i] + 1;
-            v2 = get_value_at_point(data_array, pnt);
+        if (point[i] < (peak_data->points[i] - 1)) {
+            v2 = VALUE_AT(ptr, peak_data->strides[i]);
 
             if (find_maximum) {
                 if (v2 > v) return CCPN_FALSE;
@@ -280,78 +546,21 @@ static CcpnBool check_adjacent_points(PyArrayObject *data_array, CcpnBool find_m
                 if (v2 < v) return CCPN_FALSE;
             }
         }
-
-        pnt[i] = point[i];
-    }
-
-    return CCPN_TRUE;
-}
-
-static CcpnBool drops_in_direction(PyArrayObject *data_array, CcpnBool find_maximum, float drop, float v, npy_intp *point,
-                                   int *points, int dim, int dirn) {
-    int i, i_start, i_end, i_step, ndim = PyArray_NDIM(data_array);
-    float v_prev = v, v_this;
-    npy_intp q[MAX_NDIM];
-
-    if (dirn == 1) {
-        i_start = point[dim] + 1;
-        i_end = points[dim];
-        i_step = 1;
-    } else {
-        i_start = point[dim] - 1;
-        i_end = -1;
-        i_step = -1;
-    }
-
-    COPY_VECTOR(q, point, ndim);
-
-    for (i = i_start; i != i_end; i += i_step) {
-        q[dim] = i;
-        v_this = get_value_at_point(data_array, q);
-
-        if (find_maximum) {
-            if (v_this > v_prev)
-                return CCPN_FALSE;
-            else if ((v - v_this) >= drop)
-                return CCPN_TRUE;
-        } else {
-            if (v_this < v_prev)
-                return CCPN_FALSE;
-            else if ((v_this - v) >= drop)
-                return CCPN_TRUE;
-        }
-
-        v_prev = v_this;
-    }
-
-    return CCPN_TRUE;
-}
-
-static CcpnBool check_drop(PyArrayObject *data_array, CcpnBool find_maximum, float drop_factor, float v, npy_intp *point,
-                           int *points) {
-    int i, ndim = PyArray_NDIM(data_array);
-    float dropV = drop_factor * ABS(v);
-
-    if (drop_factor <= 0) return CCPN_TRUE;
-
-    for (i = 0; i < ndim; i++) {
-        if (!drops_in_direction(data_array, find_maximum, dropV, v, point, points, i, 1)) return CCPN_FALSE;
-
-        if (!drops_in_direction(data_array, find_maximum, dropV, v, point, points, i, -1)) return CCPN_FALSE;
     }
 
     return CCPN_TRUE;
 }
 
-static float half_max_position(PyArrayObject *data_array, CcpnBool find_maximum, float v, npy_intp *point, int *points, int dim,
+/* point must be inside the data, so the walk never needs to wrap round */
+static float half_max_position(Peak_data *peak_data, CcpnBool find_maximum, float v, npy_intp *point, char *ptr, int dim,
                                int dirn) {
-    int i, i_start, i_end, i_step, ndim = PyArray_NDIM(data_array);
+    int i, i_start, i_end, i_step, npoints = peak_data->points[dim];
     float v_half = 0.5 * v, v_prev = v, v_this, half_max;
-    npy_intp q[MAX_NDIM];
+    npy_intp step = dirn * peak_data->strides[dim];
 
     if (dirn == 1) {
         i_start = point[dim] + 1;
-        i_end = points[dim];
+        i_end = npoints;
         i_step = 1;
     } else {
         i_start = point[dim] - 1;
@@ -359,11 +568,9 @@ static float half_max_position(PyArrayObject *data_array, CcpnBool find_maximum,
         i_step = -1;
     }
 
-    COPY_VECTOR(q, point, ndim);
-
     for (i = i_start; i != i_end; i += i_step) {
-        q[dim] = (i + points[dim]) % points[dim];
-        v_this = get_value_at_point(data_array, q);
+        ptr += step;
+        v_this = VALUE_AT(ptr, 0);
 
         if (find_maximum) {
             if (v_this < v_half) return i - i_step * (v_half - v_this) / (v_prev - v_this);
@@ -375,17 +582,16 @@ static float half_max_position(PyArrayObject *data_array, CcpnBool find_maximum,
     }
 
     if (dirn == 1)
-        return points[dim] - 1.0;
+        return npoints - 1.0;
     else
         return 1.0;
 }
 
-static float half_max_linewidth(PyArrayObject *data_array, CcpnBool have_maximum, float v, npy_intp *point, int *points,
-                                int dim) {
+static float half_max_linewidth(Peak_data *peak_data, CcpnBool have_maximum, float v, npy_intp *point, char *ptr, int dim) {
     float linewidth, a, b;
 
-    a = half_max_position(data_array, have_maximum, v, point, points, dim, 1);
-    b = half_max_position(data_array, have_maximum, v, point, points, dim, -1);
+    a = half_max_position(peak_data, have_maximum, v, point, ptr, dim, 1);
+    b = half_max_position(peak_data, have_maximum, v, point, ptr, dim, -1);
 
     linewidth = a - b;
 
@@ -434,379 +640,835 @@ static CcpnBool fitParabolicToNDim(PyArrayObject *data_array, float *v, npy_intp
     return CCPN_ERROR;
 }
 
-static CcpnBool check_dim_linewidth(PyArrayObject *data_array, CcpnBool have_maximum, float min_linewidth, float v,
-                                    npy_intp *point, int *points, int dim) {
-    float linewidth = half_max_linewidth(data_array, have_maximum, v, point, points, dim);
+/* what the walk outwards from a point found in one direction of one dim */
+typedef struct _Peak_walk {
+    CcpnBool drops;  /* by dropV before rising, or before the edge */
+    float half_max;  /* position where it crosses half of v, as from half_max_position() */
+} Peak_walk;
 
-    if (linewidth < min_linewidth) return CCPN_FALSE;
+/* the drop and half-max checks in one walk, which stops as soon as both are known, */
+/* or as soon as the drop check fails, check_drop says whether dropV is needed */
+static void walk_in_direction(Peak_data *peak_data, CcpnBool find_maximum, CcpnBool check_drop, float dropV,
+                              CcpnBool check_half, float v, npy_intp *point, char *ptr, int dim, int dirn,
+                              Peak_walk *walk) {
+    int i, i_start, i_end, i_step, npoints = peak_data->points[dim];
+    float v_half = 0.5 * v, v_prev = v, v_this;
+    npy_intp step = dirn * peak_data->strides[dim];
 
-    return CCPN_TRUE;
-}
-
-static CcpnBool check_linewidth(PyArrayObject *data_array, CcpnBool find_maximum, float *min_linewidth, float v,
-                                npy_intp *point, int *points) {
-    int i, ndim = PyArray_NDIM(data_array);
+    walk->drops = CCPN_TRUE;
+    walk->half_max = 0.0;
 
-    for (i = 0; i < ndim; i++) {
-        if (min_linewidth[i] <= 0) continue;
-
-        if (!check_dim_linewidth(data_array, find_maximum, min_linewidth[i], v, point, points, i)) return CCPN_FALSE;
+    if (dirn == 1) {
+        i_start = point[dim] + 1;
+        i_end = npoints;
+        i_step = 1;
+    } else {
+        i_start = point[dim] - 1;
+        i_end = -1;
+        i_step = -1;
     }
 
-    return CCPN_TRUE;
-}
-
-static CcpnStatus find_peaks(PyArrayObject *data_array, CcpnBool have_low, CcpnBool have_high, float low, float high,
-                             long *buffer, CcpnBool nonadjacent, float drop_factor, float *min_linewidth, PyObject *peak_list,
-                             PyObject *excluded_regions_obj, PyObject *diagonal_exclusion_dims_obj,
-                             PyObject *diagonal_exclusion_transform_obj, char *error_msg) {
-    int i, j, k, npoints, nadj_points, ndim, dim1, dim2;
-    int cum_points[MAX_NDIM], cumulative[MAX_NDIM], points[MAX_NDIM];
-    npy_intp point[MAX_NDIM];
-    float v, a1, a2, b12, d, delta;
-    CcpnBool find_maximum, ok_extreme, ok_drop, ok_linewidth, ok_buffer;
-    PyArrayObject *excluded_regions_array, *diagonal_exclusion_dims_array, *diagonal_exclusion_transform_array;
-
-    ndim = PyArray_NDIM(data_array);
+    for (i = i_start; (i != i_end) && (check_drop || check_half); i += i_step) {
+        ptr += step;
+        v_this = VALUE_AT(ptr, 0);
 
-    if (!have_low && !have_high) return CCPN_OK;
+        if (check_drop) {
+            if (find_maximum ? (v_this > v_prev) : (v_this < v_prev)) {
+                walk->drops = CCPN_FALSE;
+                return;
+            }
 
-    if (nonadjacent) {
-        nadj_points = 1;
-        for (i = 0; i < ndim; i++) {
-            cumulative[i] = nadj_points;
-            nadj_points *= 3;
+            if ((find_maximum ? (v - v_this) : (v_this - v)) >= dropV) check_drop = CCPN_FALSE;
         }
-        // printf("nadj_points %i\n"nadj_points);
-    }
 
-    npoints = 1;
-    for (i = 0; i < ndim; i++) {
-        cum_points[i] = npoints;
-        points[i] = PyArray_DIM(data_array, ndim - 1 - i);
-        npoints *= points[i];
-
-        // printf("%i, %i, %i\n", i, points[i], cum_points[i]);
-    }
-
-    // iterate over all points in the dataArray
-    // printf("num of points: %i\n", npoints);
-    for (i = 0; i < npoints; i++) {
-        // get the index of the point in the array
-        ARRAY_OF_INDEX(point, i, cum_points, ndim);
-
-        for (j = 0; j < PyList_Size(diagonal_exclusion_dims_obj); j++) {
-            diagonal_exclusion_dims_array = (PyArrayObject *)PyList_GetItem(diagonal_exclusion_dims_obj, j);
-            diagonal_exclusion_transform_array = (PyArrayObject *)PyList_GetItem(diagonal_exclusion_transform_obj, j);
-            dim1 = *((int *)PyArray_GETPTR1(diagonal_exclusion_dims_array, 0));
-            dim2 = *((int *)PyArray_GETPTR1(diagonal_exclusion_dims_array, 1));
-            a1 = *((float *)PyArray_GETPTR1(diagonal_exclusion_transform_array, 0));
-            a2 = *((float *)PyArray_GETPTR1(diagonal_exclusion_transform_array, 1));
-            b12 = *((float *)PyArray_GETPTR1(diagonal_exclusion_transform_array, 2));
-            d = *((float *)PyArray_GETPTR1(diagonal_exclusion_transform_array, 3));
-
-            delta = a1 * point[dim1] - a2 * point[dim2] + b12;
-            if (ABS(delta) < d) break;
+        if (check_half && (find_maximum ? (v_this < v_half) : (v_this > v_half))) {
+            walk->half_max = i - i_step * (v_half - v_this) / (v_prev - v_this);
+            check_half = CCPN_FALSE;
         }
 
-        if (j < PyList_Size(diagonal_exclusion_dims_obj)) continue; /* point is in some excluded diagonal */
+        v_prev = v_this;
+    }
 
-        for (j = 0; j < PyList_Size(excluded_regions_obj); j++) {
-            excluded_regions_array = (PyArrayObject *)PyList_GetItem(excluded_regions_obj, j);
+    if (check_half) walk->half_max = (dirn == 1) ? npoints - 1.0 : 1.0;
+}
 
-            for (k = 0; k < ndim; k++) {
-                a1 = *((float *)PyArray_GETPTR2(excluded_regions_array, 0, k));
-                a2 = *((float *)PyArray_GETPTR2(excluded_regions_array, 1, k));
-                if ((point[k] < a1) || (point[k] > a2)) break; /* point is not in excluded region in this dim */
-            }
+/* the result of check_drop_linewidth(), the first check that fails */
+#define PEAK_CHECK_OK               0
+#define PEAK_CHECK_FAILED_DROP      1
+#define PEAK_CHECK_FAILED_LINEWIDTH 2
+
+/* on noisy data most points beyond the thresholds fail the extremum check, most of the */
+/* rest fail the drop check, and few get as far as the linewidth check, so that is the */
+/* order of the checks, and here the drop and linewidth are found together in one walk */
+/* each way along each dim, so the same points are only read once, stopping at the first */
+/* failure; the order is fixed so that which check fails does not depend on the threads */
+PEAK_INLINE int check_drop_linewidth(Peak_data *peak_data, CcpnBool find_maximum, float drop_factor, float *min_linewidth,
+                                    float v, npy_intp *point, char *ptr, const int ndim) {
+    int i;
+    float dropV = drop_factor * ABS(v);
+    CcpnBool check_drop = (drop_factor > 0), check_half;
+    Peak_walk up, down;
 
-            if (k == ndim) break; /* point is in this excluded region */
-        }
+    for (i = 0; i < ndim; i++) {
+        check_half = (min_linewidth[i] > 0);
 
-        if (j < PyList_Size(excluded_regions_obj)) continue; /* point is in some excluded region */
+        if (!check_drop && !check_half) continue;
 
-        v = get_value_at_point(data_array, point);
-        // printf("i = %d, v = %f, high = %f\n", i, v, high);
+        walk_in_direction(peak_data, find_maximum, check_drop, dropV, check_half, v, point, ptr, i, 1, &up);
+        if (!up.drops) return PEAK_CHECK_FAILED_DROP;
 
-        if (have_high && (v >= high))
-            find_maximum = CCPN_TRUE;
-        else if (have_low && (v <= low))
-            find_maximum = CCPN_FALSE;
-        else
-            continue;
+        walk_in_direction(peak_data, find_maximum, check_drop, dropV, check_half, v, point, ptr, i, -1, &down);
+        if (!down.drops) return PEAK_CHECK_FAILED_DROP;
 
-        // printf("i = %d, nonadjacent = %d\n", i, nonadjacent);
-        if (nonadjacent)
-            ok_extreme = check_nonadjacent_points(data_array, find_maximum, buffer, v, point, points, nadj_points, cumulative);
-        else
-            ok_extreme = check_adjacent_points(data_array, find_maximum, buffer, v, point, points);
+        if (check_half && ((up.half_max - down.half_max) < min_linewidth[i])) return PEAK_CHECK_FAILED_LINEWIDTH;
+    }
 
-        if (!ok_extreme) continue;
+    return PEAK_CHECK_OK;
+}
 
-        ok_drop = check_drop(data_array, find_maximum, drop_factor, v, point, points);
+static void delete_peak_exclusions(Peak_exclusions *exclusions) {
+    FREE(exclusions->regions, float);
+    FREE(exclusions->diagonal_dims, int);
+    FREE(exclusions->diagonal_transforms, float);
+}
 
-        if (!ok_drop) continue;
+/* the arguments have already been checked by new_peak_picker */
+static CcpnStatus new_peak_exclusions(Peak_exclusions *exclusions, int ndim, PyObject *excluded_regions_obj,
+                                      PyObject *diagonal_exclusion_dims_obj, PyObject *diagonal_exclusion_transform_obj,
+                                      char *error_msg) {
+    int i, k;
+    PyArrayObject *excluded_regions_array, *diagonal_exclusion_dims_array, *diagonal_exclusion_transform_array;
 
-        ok_linewidth = check_linewidth(data_array, find_maximum, min_linewidth, v, point, points);
+    exclusions->nregions = PyList_Size(excluded_regions_obj);
+    exclusions->ndiagonals = PyList_Size(diagonal_exclusion_dims_obj);
+    exclusions->regions = NULL;
+    exclusions->diagonal_dims = NULL;
+    exclusions->diagonal_transforms = NULL;
 
-        if (!ok_linewidth) continue;
+    sprintf(error_msg, "allocating exclusion memory");
 
-        ok_buffer = check_buffer(data_array, peak_list, buffer, v, point);
+    MALLOC(exclusions->regions, float, MAX(1, 2 * ndim * exclusions->nregions));
+    MALLOC(exclusions->diagonal_dims, int, MAX(1, 2 * exclusions->ndiagonals));
+    MALLOC(exclusions->diagonal_transforms, float, MAX(1, 4 * exclusions->ndiagonals));
 
-        if (!ok_buffer) continue;
+    for (i = 0; i < exclusions->nregions; i++) {
+        excluded_regions_array = (PyArrayObject *)PyList_GetItem(excluded_regions_obj, i);
 
-        CHECK_STATUS(new_peak(data_array, peak_list, v, point, points, error_msg));
-        // printf(">>>>> new point...");
-        // printf("     array_of_index: %i - %i, %i, %i\n", i, point[0], point[1], point[2]);
+        for (k = 0; k < ndim; k++) {
+            exclusions->regions[(2 * i) * ndim + k] = *((float *)PyArray_GETPTR2(excluded_regions_array, 0, k));
+            exclusions->regions[(2 * i + 1) * ndim + k] = *((float *)PyArray_GETPTR2(excluded_regions_array, 1, k));
+        }
     }
 
-    return CCPN_OK;
-}
+    for (i = 0; i < exclusions->ndiagonals; i++) {
+        diagonal_exclusion_dims_array = (PyArrayObject *)PyList_GetItem(diagonal_exclusion_dims_obj, i);
+        diagonal_exclusion_transform_array = (PyArrayObject *)PyList_GetItem(diagonal_exclusion_transform_obj, i);
 
-static float gaussian(int ndim, int *x, float *a, float *dy_da) {
-    float h = a[0], *position = a + 1, *linewidth = a + 1 + ndim;
-    float *dy_dh, *dy_dp, *dy_dl;
-    float lw, dx, y = h;
-    int i;
+        for (k = 0; k < 2; k++)
+            exclusions->diagonal_dims[2 * i + k] = *((int *)PyArray_GETPTR1(diagonal_exclusion_dims_array, k));
 
-    if (dy_da) {
-        dy_dh = dy_da;
-        dy_dp = dy_da + 1;
-        dy_dl = dy_da + 1 + ndim;
+        for (k = 0; k < 4; k++)
+            exclusions->diagonal_transforms[4 * i + k] = *((float *)PyArray_GETPTR1(diagonal_exclusion_transform_array, k));
     }
 
-    for (i = 0; i < ndim; i++) {
-        dx = x[i] - position[i];
-        lw = linewidth[i];
-        y *= exp(-4 * log(2) * dx * dx / (lw * lw));
-        if (dy_da) {
-            dy_dp[i] = 8 * log(2) * dx / (lw * lw);
-            dy_dl[i] = 8 * log(2) * dx * dx / (lw * lw * lw);
-        }
-    }
+    return CCPN_OK;
+}
 
-    if (dy_da) {
-        *dy_dh = y / h;
-        SCALE_VECTOR(dy_dp, dy_dp, y, ndim);
-        SCALE_VECTOR(dy_dl, dy_dl, y, ndim);
-    }
+/* set row_mask for the points along the row through point (point[0] is ignored) that are */
+/* in some excluded diagonal or region, returns CCPN_TRUE if the whole row is excluded */
+static CcpnBool exclusion_row_mask(Peak_exclusions *exclusions, int ndim, npy_intp *point, int npoints0, char *row_mask) {
+    int j, k, dim1, dim2;
+    npy_intp pnt[MAX_NDIM];
+    float a1, a2, b12, d, delta, *region_low, *region_high;
 
-    return y;
-}
+    memset(row_mask, 0, npoints0);
 
-static float lorentzian(int ndim, int *x, float *a, float *dy_da) {
-    float h = a[0], *position = a + 1, *linewidth = a + 1 + ndim;
-    float *dy_dh, *dy_dp, *dy_dl;
-    float lw, dx, d, y = h;
-    int i;
+    for (k = 1; k < ndim; k++) pnt[k] = point[k];
 
-    if (dy_da) {
-        dy_dh = dy_da;
-        dy_dp = dy_da + 1;
-        dy_dl = dy_da + 1 + ndim;
-    }
+    for (j = 0; j < exclusions->ndiagonals; j++) {
+        dim1 = exclusions->diagonal_dims[2 * j];
+        dim2 = exclusions->diagonal_dims[2 * j + 1];
+        a1 = exclusions->diagonal_transforms[4 * j];
+        a2 = exclusions->diagonal_transforms[4 * j + 1];
+        b12 = exclusions->diagonal_transforms[4 * j + 2];
+        d = exclusions->diagonal_transforms[4 * j + 3];
 
-    for (i = 0; i < ndim; i++) {
-        dx = x[i] - position[i];
-        lw = linewidth[i];
-        d = lw * lw + 4 * dx * dx;
-        y *= lw * lw / d;
-        dy_dp[i] = 8 * dx / d;
-        dy_dl[i] = 8 * dx * dx / (lw * d);
+        if ((dim1 != 0) && (dim2 != 0)) {
+            /* the same for the whole row */
+            delta = a1 * pnt[dim1] - a2 * pnt[dim2] + b12;
+            if (ABS(delta) < d) return CCPN_TRUE;
+        } else {
+            for (pnt[0] = 0; pnt[0] < npoints0; pnt[0]++) {
+                delta = a1 * pnt[dim1] - a2 * pnt[dim2] + b12;
+                if (ABS(delta) < d) row_mask[pnt[0]] = 1;
+            }
+        }
     }
 
-    if (dy_da) {
-        *dy_dh = y / h;
-        SCALE_VECTOR(dy_dp, dy_dp, y, ndim);
-        SCALE_VECTOR(dy_dl, dy_dl, y, ndim);
-    }
+    for (j = 0; j < exclusions->nregions; j++) {
+        region_low = exclusions->regions + (2 * j) * ndim;
+        region_high = region_low + ndim;
 
-    return y;
-}
+        for (k = 1; k < ndim; k++) {
+            if ((pnt[k] < region_low[k]) || (pnt[k] > region_high[k])) break; /* row is not in excluded region in this dim */
+        }
 
-static void _fitting_func(float xind, float *a, float *y_fit, float *dy_da, void *user_data) {
-    FitPeak *fitPeak = (FitPeak *)user_data;
-    int ndim = fitPeak->ndim;
-    int npeaks = fitPeak->npeaks;
-    int *region_offset = fitPeak->region_offset;
-    int *region_end = fitPeak->region_end;
-    int *cumul_region = fitPeak->cumul_region;
-    int method = fitPeak->method;
-    int ind = NEAREST_INTEGER(xind);
-    int nparams_per_peak = 1 + 2 * ndim;
-    int i, j, x[MAX_NDIM];
-    float *position = a + 1;
-
-    ARRAY_OF_INDEX(x, ind, cumul_region, ndim);
-    ADD_VECTORS(x, x, region_offset, ndim);
+        if (k < ndim) continue;
 
-    // check whether position is outside the intended fitting region
-    for (i = 0; i < ndim; i++) {
-        if ((position[i] < region_offset[i]) || (position[i] >= region_end[i])) {
-            *y_fit = LARGE_NUMBER;
-            ZERO_VECTOR(dy_da, npeaks * nparams_per_peak);  // arbitrary, hopefully ok
-            return;
+        for (pnt[0] = 0; pnt[0] < npoints0; pnt[0]++) {
+            if (!((pnt[0] < region_low[0]) || (pnt[0] > region_high[0]))) row_mask[pnt[0]] = 1;
         }
     }
 
-    *y_fit = 0;
-    for (j = 0; j < npeaks; j++) {
-        if (method == GAUSSIAN_METHOD)
-            *y_fit += gaussian(ndim, x, a, dy_da);
-        else
-            *y_fit += lorentzian(ndim, x, a, dy_da);
+    return CCPN_FALSE;
+}
 
-        a += nparams_per_peak;
-        if (dy_da) dy_da += nparams_per_peak;
+/* points that pass all the tests except the buffer, for one task (a range of rows) */
+typedef struct _Peak_candidates {
+    int ncandidates;
+    int nalloc;
+    int *index;     /* linear index of the point, first dim fastest */
+    float *value;
+    char *row_mask; /* points along the current row that are excluded */
+    long nexcluded; /* the counts for the statistics, as in Peak_stats */
+    long nthreshold;
+    long nrejected_extreme;
+    long nrejected_drop;
+    long nrejected_linewidth;
+    double seconds;
+} Peak_candidates;
+
+/* what the tasks need to test the points, only read by them */
+typedef struct _Peak_search {
+    Peak_data data;
+    CcpnBool have_low;
+    CcpnBool have_high;
+    float low;
+    float high;
+    long *buffer;
+    CcpnBool nonadjacent;
+    float drop_factor;
+    float *min_linewidth;
+    CcpnBool check_walks; /* dropFactor or some minLinewidth is positive */
+    int ndim;
+    int nneighbours;
+    npy_intp *neighbour_offsets; /* for the nonadjacent check */
+    int cum_points[MAX_NDIM];
+    int points[MAX_NDIM];
+    int nrows;         /* number of rows along the first dim */
+    int rows_per_task;
+    Peak_exclusions *exclusions;
+    Peak_candidates *candidates; /* one for each task */
+    CcpnBool stats;              /* time the tasks */
+} Peak_search;
+
+static CcpnStatus add_candidate(Peak_candidates *candidates, int index, float value) {
+    int n = candidates->ncandidates;
+
+    if (n >= candidates->nalloc) {
+        candidates->nalloc = MAX(2 * candidates->nalloc, PEAK_CANDIDATES_NALLOC);
+        REALLOC(candidates->index, int, candidates->nalloc);
+        REALLOC(candidates->value, float, candidates->nalloc);
     }
+
+    candidates->index[n] = index;
+    candidates->value[n] = value;
+    candidates->ncandidates++;
+
+    return CCPN_OK;
 }
 
-static CcpnStatus fit_parabolic(PyArrayObject *data_array, PyArrayObject *region_array, PyArrayObject *peak_array,
-                                PyObject *fit_list, char *error_msg) {
-    int i, j, k, ndim, total_region_size, first, last, nparams, npeaks, npts;
-    int region_offset[MAX_NDIM], region_size[MAX_NDIM], cumul_region[MAX_NDIM], points[MAX_NDIM], region_end[MAX_NDIM];
-    npy_intp array[MAX_NDIM], grid_posn[MAX_NDIM], posn;
-    float *x, *y, *params, *params_dev, *w = NULL, *y_fit = NULL;
-    float peak_posn[MAX_NDIM], height, chisq, max_iter = 0, noise = 0;
-    float peakFit[MAX_NDIM], lineWidths[MAX_NDIM];
-    float peakHeight;
-    PyObject *fit_obj, *posn_obj, *lw_obj;
-    FitPeak fitPeak;
-    CcpnBool have_maximum;
-    CcpnStatus status;
+/* find the candidate peaks in rows [row_start, row_end), nneighbours is 3^ndim - 1 */
+PEAK_INLINE CcpnStatus search_rows(Peak_search *search, Peak_candidates *candidates, int row_start, int row_end,
+                                   const int ndim, const int nneighbours) {
+    Peak_data *peak_data = &search->data;
+    int i, row, x, check, npoints0 = search->points[0];
+    npy_intp point[MAX_NDIM], stride0 = peak_data->strides[0];
+    char *row_ptr, *ptr;
+    float v;
+    long nexcluded = 0, nthreshold = 0, nrejected_extreme = 0, nrejected_drop = 0, nrejected_linewidth = 0;
+    CcpnBool find_maximum, ok_extreme, have_exclusions;
+
+    have_exclusions = (search->exclusions->nregions > 0) || (search->exclusions->ndiagonals > 0);
+
+    for (row = row_start; row < row_end; row++) {
+        ARRAY_OF_INDEX(point, row * npoints0, search->cum_points, ndim);
+
+        /* the exclusions only need working out once for each row */
+        if (have_exclusions && exclusion_row_mask(search->exclusions, ndim, point, npoints0, candidates->row_mask)) {
+            nexcluded += npoints0;
+            continue; /* whole row is excluded */
+        }
 
-    ndim = PyArray_DIM(region_array, 1);
-    for (i = 0; i < ndim; i++) {
-        first = *((int *)PyArray_GETPTR2(region_array, 0, i));
-        last = *((int *)PyArray_GETPTR2(region_array, 1, i));
-        region_offset[i] = first;
-        region_end[i] = last;
-        region_size[i] = last - first;
-    }
+        row_ptr = peak_data->data;
+        for (i = 1; i < ndim; i++) row_ptr += point[i] * peak_data->strides[i];
 
-    CUMULATIVE(cumul_region, region_size, total_region_size, ndim);
+        for (x = 0; x < npoints0; x++) {
+            if (have_exclusions && candidates->row_mask[x]) {
+                nexcluded++;
+                continue;
+            }
 
-    npeaks = PyArray_DIM(peak_array, 0);
-    nparams = (1 + 2 * ndim) * npeaks;
+            point[0] = x;
+            if (peak_data->contiguous) {
+                ptr = row_ptr + x * sizeof(float);
+                v = ((float *)row_ptr)[x];
+            } else {
+                ptr = row_ptr + x * stride0;
+                v = VALUE_AT(ptr, 0);
+            }
 
-    //    printf(">>> parabolic - npeaks: %i\n", npeaks);
+            if (search->have_high && (v >= search->high))
+                find_maximum = CCPN_TRUE;
+            else if (search->have_low && (v <= search->low))
+                find_maximum = CCPN_FALSE;
+            else
+                continue;
 
-    sprintf(error_msg, "allocating memory for params, params_dev");
-    MALLOC(params, float, nparams);
+            nthreshold++;
 
-    for (i = 0; i < ndim; i++) points[i] = PyArray_DIM(data_array, ndim - 1 - i);
+            if (search->nonadjacent)
+                ok_extreme = check_nonadjacent_points(peak_data, find_maximum, v, point, ptr, nneighbours,
+                                                      search->neighbour_offsets, ndim);
+            else
+                ok_extreme = check_adjacent_points(peak_data, find_maximum, v, point, ptr, ndim);
 
-    k = 0;
+            if (!ok_extreme) {
+                nrejected_extreme++;
+                continue;
+            }
 
-    // iterate over all the peaks passed in
-    for (j = 0; j < npeaks; j++) {
-        // find the index point nearest to the peak position (floats)
-        // relative to the dataArray, clipped to the dataArray bounds
-        for (i = 0; i < ndim; i++) {
-            peak_posn[i] = *((float *)PyArray_GETPTR2(peak_array, j, i));
-            posn = NEAREST_INTEGER(peak_posn[i]);
-            npts = PyArray_DIM(data_array, ndim - 1 - i);
-            posn = MAX(0, posn);
-            posn = MIN(npts - 1, posn);
-            grid_posn[i] = posn;
+            if (search->check_walks) {
+                check = check_drop_linewidth(peak_data, find_maximum, search->drop_factor, search->min_linewidth, v,
+                                             point, ptr, ndim);
+
+                if (check == PEAK_CHECK_FAILED_DROP) {
+                    nrejected_drop++;
+                    continue;
+                } else if (check == PEAK_CHECK_FAILED_LINEWIDTH) {
+                    nrejected_linewidth++;
+                    continue;
+                }
+            }
 
-            //            printf(">>> parabolic - npeak %i, %i -> [%i]\n", j, i, grid_posn[i]);
+            CHECK_STATUS(add_candidate(candidates, row * npoints0 + x, v));
         }
+    }
 
-        height = get_value_at_point(data_array, grid_posn);
-        have_maximum = height > 0;  // TBD: possibly wrong
-
-        //        printf(">>> parabolic - height %i, %f\n", j, height);
+    candidates->nexcluded = nexcluded;
+    candidates->nthreshold = nthreshold;
+    candidates->nrejected_extreme = nrejected_extreme;
+    candidates->nrejected_drop = nrejected_drop;
+    candidates->nrejected_linewidth = nrejected_linewidth;
 
-        for (i = 0; i < ndim; i++)
-            status = fitParabolicToNDim(data_array, &peakHeight, grid_posn, points, &peakFit[i], &lineWidths[i], i);
+    return CCPN_OK;
+}
 
-        params[k++] = peakHeight;
-        for (i = 0; i < ndim; i++) params[k++] = peakFit[i];
+/* find the candidate peaks in a range of rows, does not use any Python objects so can run without the GIL */
+static CcpnStatus candidates_task(int task, void *user_data) {
+    Peak_search *search = (Peak_search *)user_data;
+    Peak_candidates *candidates = search->candidates + task;
+    int row_start = task * search->rows_per_task, row_end = MIN(row_start + search->rows_per_task, search->nrows);
+    double start = search->stats ? parallel_seconds() : 0;
+    CcpnStatus status;
 
-        for (i = 0; i < ndim; i++) params[k++] = lineWidths[i];
+    switch (search->ndim) {
+        case 1:
+            status = search_rows(search, candidates, row_start, row_end, 1, 2);
+            break;
+        case 2:
+            status = search_rows(search, candidates, row_start, row_end, 2, 8);
+            break;
+        case 3:
+            status = search_rows(search, candidates, row_start, row_end, 3, 26);
+            break;
+        case 4:
+            status = search_rows(search, candidates, row_start, row_end, 4, 80);
+            break;
+        default:
+            status = search_rows(search, candidates, row_start, row_end, search->ndim, search->nneighbours);
+            break;
     }
 
-    status = CCPN_OK;
+    if (search->stats) candidates->seconds = parallel_seconds() - start;
 
-    if (status == CCPN_ERROR) {
-        FREE(params, float);
+    return status;
+}
+
+/* with the GIL held, after the candidates have been checked against the buffer */
+static void add_find_stats(Peak_candidates *candidates, int ntasks, long npoints, long npeaks, double buffer_seconds) {
+    int i;
+
+    peak_stats.npoints += npoints;
+    peak_stats.npeaks += npeaks;
+    peak_stats.buffer_seconds += buffer_seconds;
+
+    for (i = 0; i < ntasks; i++) {
+        peak_stats.nexcluded += candidates[i].nexcluded;
+        peak_stats.nthreshold += candidates[i].nthreshold;
+        peak_stats.nrejected_extreme += candidates[i].nrejected_extreme;
+        peak_stats.nrejected_drop += candidates[i].nrejected_drop;
+        peak_stats.nrejected_linewidth += candidates[i].nrejected_linewidth;
+        peak_stats.ncandidates += candidates[i].ncandidates;
+        peak_stats.search_seconds += candidates[i].seconds;
+    }
+
+    peak_stats.nrejected_buffer = peak_stats.ncandidates - peak_stats.npeaks;
+}
+
+static void delete_peak_picker(Peak_picker *picker) {
+    delete_peak_exclusions(&picker->exclusions);
+}
+
+/* check the findPeaks arguments other than the data (of ndim dims) and read them into picker */
+static CcpnStatus new_peak_picker(Peak_picker *picker, int ndim, CcpnBool have_low, CcpnBool have_high, float low,
+                                  float high, PyObject *buffer_obj, CcpnBool nonadjacent, float drop_factor,
+                                  PyObject *min_linewidth_obj, PyObject *excluded_regions_obj,
+                                  PyObject *diagonal_exclusion_dims_obj, PyObject *diagonal_exclusion_transform_obj,
+                                  char *error_msg) {
+    long i;
+    int j, dim;
+    PyObject *z;
+    PyArrayObject *excluded_regions_array, *diagonal_exclusion_dims_array, *diagonal_exclusion_transform_array;
+
+    /* so that delete_peak_picker is safe whatever happens */
+    memset(picker, 0, sizeof(Peak_picker));
+
+    if (ndim > MAX_NDIM) {
+        sprintf(error_msg, "maximum ndim is %d", MAX_NDIM);
         return CCPN_ERROR;
     }
 
-    k = 0;
-    for (j = 0; j < npeaks; j++) {
-        fit_obj = PyTuple_New(3);  // height, position, linewidth
-        if (!fit_obj) RETURN_ERROR_MSG("allocating fit data");
+    picker->ndim = ndim;
+    picker->have_low = have_low;
+    picker->have_high = have_high;
+    picker->low = low;
+    picker->high = high;
+    picker->nonadjacent = nonadjacent;
+    picker->drop_factor = drop_factor;
 
-        posn_obj = PyTuple_New(ndim);
-        if (!posn_obj) RETURN_ERROR_MSG("allocating position");
+    if (PyList_Size(buffer_obj) != ndim) {
+        sprintf(error_msg, "buffer is a list of size %ld, should be %d", (long)PyList_Size(buffer_obj), ndim);
+        return CCPN_ERROR;
+    }
 
-        lw_obj = PyTuple_New(ndim);
-        if (!lw_obj) RETURN_ERROR_MSG("allocating linewidth");
+    for (i = 0; i < ndim; i++) {
+        z = PyList_GetItem(buffer_obj, i);
+        if (!PyLong_Check(z)) {
+            sprintf(error_msg, "buffer element %ld is not an int", i);
+            return CCPN_ERROR;
+        }
+
+        picker->buffer[i] = (long)PyLong_AsLong(z);
+    }
+
+    if (PyList_Size(min_linewidth_obj) != ndim) {
+        sprintf(error_msg, "minLinewidth is a list of size %ld, should be %d\n", (long)PyList_Size(buffer_obj), ndim);
+        return CCPN_ERROR;
+    }
+
+    for (i = 0; i < ndim; i++) {
+        z = PyList_GetItem(min_linewidth_obj, i);
+        if (!PyFloat_Check(z)) {
+            sprintf(error_msg, "minLinewidth element %ld is not a float", i);
+            return CCPN_ERROR;
+        }
+
+        picker->min_linewidth[i] = (float)PyFloat_AsDouble(z);
+    }
+
+    for (i = 0; i < PyList_Size(excluded_regions_obj); i++) {
+        excluded_regions_array = (PyArrayObject *)PyList_GetItem(excluded_regions_obj, i);
 
-        height = params[k++];
-        PyTuple_SetItem(fit_obj, 0, PyFloat_FromDouble((double)height));
-        PyTuple_SetItem(fit_obj, 1, posn_obj);
-        PyTuple_SetItem(fit_obj, 2, lw_obj);
+        if (!PyArray_Check(excluded_regions_array)) RETURN_ERROR_MSG("excludedRegions needs to be list of NumPy arrays");
 
-        for (i = 0; i < ndim; i++) PyTuple_SetItem(posn_obj, i, PyFloat_FromDouble((double)params[k++]));
+        if (PyArray_TYPE(excluded_regions_array) != NPY_FLOAT)
+            RETURN_ERROR_MSG("excludedRegions needs to be list of NumPy float arrays");
 
-        for (i = 0; i < ndim; i++) PyTuple_SetItem(lw_obj, i, PyFloat_FromDouble((double)params[k++]));
+        if (PyArray_NDIM(excluded_regions_array) != 2)
+            RETURN_ERROR_MSG("excludedRegions must be list of 2 dimensional NumPy arrays");
 
-        if (PyList_Append(fit_list, fit_obj)) RETURN_ERROR_MSG("appending fit data to fit list");
+        if ((PyArray_DIM(excluded_regions_array, 0) != 2) || (PyArray_DIM(excluded_regions_array, 1) != ndim)) {
+            sprintf(error_msg, "excludedRegions must be list of 2 x %d NumPy arrays", ndim);
+            return CCPN_ERROR;
+        }
+    }
 
-        Py_DECREF(fit_obj);
+    if (PyList_Size(diagonal_exclusion_dims_obj) != PyList_Size(diagonal_exclusion_transform_obj)) {
+        sprintf(error_msg,
+                "diagonalExclusionDims is a list of size %ld, diagonalExclusionTransform is of size %ld, should be the same",
+                (long)PyList_Size(diagonal_exclusion_dims_obj), (long)PyList_Size(diagonal_exclusion_transform_obj));
+        return CCPN_ERROR;
     }
 
-    FREE(params, float);
+    for (i = 0; i < PyList_Size(diagonal_exclusion_dims_obj); i++) {
+        diagonal_exclusion_dims_array = (PyArrayObject *)PyList_GetItem(diagonal_exclusion_dims_obj, i);
+
+        if (!PyArray_Check(diagonal_exclusion_dims_array))
+            RETURN_ERROR_MSG("diagonalExclusionDims needs to be list of NumPy arrays");
+
+        if (PyArray_TYPE(diagonal_exclusion_dims_array) != NPY_INT)
+            RETURN_ERROR_MSG("diagonalExclusionDims needs to be list of NumPy int arrays");
+
+        if (PyArray_NDIM(diagonal_exclusion_dims_array) != 1)
+            RETURN_ERROR_MSG("diagonalExclusionDims must be list of 1 dimensional NumPy arrays");
+
+        if (PyArray_DIM(diagonal_exclusion_dims_array, 0) != 2)
+            RETURN_ERROR_MSG("diagonalExclusionDims must be list of size 2 NumPy arrays");
+
+        for (j = 0; j < 2; j++) {
+            dim = *((int *)PyArray_GETPTR1(diagonal_exclusion_dims_array, j));
+            if ((dim < 0) || (dim >= ndim)) {
+                sprintf(error_msg, "diagonalExclusionDims element %d is %d, should be >= 0 and < %d", j, dim, ndim);
+                return CCPN_ERROR;
+            }
+        }
+    }
+
+    for (i = 0; i < PyList_Size(diagonal_exclusion_transform_obj); i++) {
+        diagonal_exclusion_transform_array = (PyArrayObject *)PyList_GetItem(diagonal_exclusion_transform_obj, i);
+
+        if (!PyArray_Check(diagonal_exclusion_transform_array))
+            RETURN_ERROR_MSG("diagonalExclusionTransform needs to be list of NumPy arrays");
+
+        if (PyArray_TYPE(diagonal_exclusion_transform_array) != NPY_FLOAT)
+            RETURN_ERROR_MSG("diagonalExclusionTransform needs to be list of NumPy float arrays");
+
+        if (PyArray_NDIM(diagonal_exclusion_transform_array) != 1)
+            RETURN_ERROR_MSG("diagonalExclusionTransform must be list of 1 dimensional NumPy arrays");
+
+        if (PyArray_DIM(diagonal_exclusion_transform_array, 0) != 4)
+            RETURN_ERROR_MSG("diagonalExclusionTransform must be list of size 4 NumPy arrays");
+    }
+
+    return new_peak_exclusions(&picker->exclusions, ndim, excluded_regions_obj, diagonal_exclusion_dims_obj,
+                               diagonal_exclusion_transform_obj, error_msg);
+}
+
+/* data_array has already been checked to be float with picker->ndim dims */
+static CcpnStatus find_peaks(PyArrayObject *data_array, Peak_picker *picker, Peak_grid peak_grid, int numThreads,
+                             char *error_msg) {
+    int i, j, npoints, nneighbours, ndim, ntasks, nthreads;
+    long npeaks = 0;
+    double start = 0;
+    npy_intp point[MAX_NDIM];
+    CcpnStatus status = CCPN_OK;
+    Peak_search search;
+    Peak_candidates *candidates;
+
+    ndim = PyArray_NDIM(data_array);
+
+    if (!picker->have_low && !picker->have_high) return CCPN_OK;
+
+    init_peak_data(&search.data, data_array);
+    search.have_low = picker->have_low;
+    search.have_high = picker->have_high;
+    search.low = picker->low;
+    search.high = picker->high;
+    search.buffer = picker->buffer;
+    search.nonadjacent = picker->nonadjacent;
+    search.drop_factor = picker->drop_factor;
+    search.min_linewidth = picker->min_linewidth;
+    search.check_walks = (picker->drop_factor > 0);
+    for (i = 0; i < ndim; i++) {
+        if (picker->min_linewidth[i] > 0) search.check_walks = CCPN_TRUE;
+    }
+    search.ndim = ndim;
+    search.nneighbours = 0;
+    search.neighbour_offsets = NULL;
+    search.stats = stats_enabled;
+
+    npoints = 1;
+    for (i = 0; i < ndim; i++) {
+        search.cum_points[i] = npoints;
+        search.points[i] = PyArray_DIM(data_array, ndim - 1 - i);
+        npoints *= search.points[i];
+    }
+
+    if (npoints == 0) return CCPN_OK;
+
+    if (picker->nonadjacent) {
+        nneighbours = 1;
+        for (i = 0; i < ndim; i++) nneighbours *= 3;
+
+        sprintf(error_msg, "allocating neighbour memory");
+        MALLOC(search.neighbour_offsets, npy_intp, nneighbours);
+        search.nneighbours = neighbour_offsets(&search.data, search.neighbour_offsets);
+    }
+
+    search.exclusions = &picker->exclusions;
+
+    /* the rows are split into blocks, each searched for candidates on its own */
+    search.nrows = npoints / search.points[0];
+    nthreads = parallel_num_threads(numThreads, search.nrows);
+    ntasks = (nthreads > 1) ? MIN(search.nrows, PEAK_TASKS_PER_THREAD * nthreads) : 1;
+    search.rows_per_task = (search.nrows + ntasks - 1) / ntasks;
+    ntasks = (search.nrows + search.rows_per_task - 1) / search.rows_per_task;
+
+    candidates = (Peak_candidates *)calloc(ntasks, sizeof(Peak_candidates));
+    if (!candidates) {
+        FREE(search.neighbour_offsets, npy_intp);
+        RETURN_ERROR_MSG("allocating candidate memory");
+    }
+
+    search.candidates = candidates;
+
+    for (i = 0; (i < ntasks) && (status == CCPN_OK); i++) {
+        candidates[i].row_mask = (char *)malloc(search.points[0]);
+        if (!candidates[i].row_mask) status = CCPN_ERROR;
+    }
+
+    if (status == CCPN_ERROR) sprintf(error_msg, "allocating candidate memory");
+
+    Py_BEGIN_ALLOW_THREADS
+
+    if (status == CCPN_OK) {
+        status = parallel_for(ntasks, nthreads, candidates_task, &search);
+        if (status == CCPN_ERROR) sprintf(error_msg, "allocating candidate memory");
+    }
+
+    if (search.stats) start = parallel_seconds();
+
+    /* the buffer check depends on the peaks already found, so the candidates are */
+    /* looked at in order of their index, as if the whole array was searched serially */
+    for (i = 0; (i < ntasks) && (status == CCPN_OK); i++) {
+        for (j = 0; j < candidates[i].ncandidates; j++) {
+            ARRAY_OF_INDEX(point, candidates[i].index[j], search.cum_points, ndim);
+
+            if (!check_buffer(data_array, peak_grid, candidates[i].value[j], point)) continue;
+
+            status = new_peak(data_array, peak_grid, candidates[i].value[j], point, error_msg);
+            if (status == CCPN_ERROR) break;
+            npeaks++;
+        }
+    }
+
+    if (search.stats) start = parallel_seconds() - start;
+
+    Py_END_ALLOW_THREADS
+
+    if (search.stats && (status == CCPN_OK)) add_find_stats(candidates, ntasks, npoints, npeaks, start);
+
+    for (i = 0; i < ntasks; i++) {
+        FREE(candidates[i].index, int);
+        FREE(candidates[i].value, float);
+        FREE(candidates[i].row_mask, char);
+    }
+
+    FREE(candidates, Peak_candidates);
+    FREE(search.neighbour_offsets, npy_intp);
+
+    return status;
+}
+
+/* the peak models are separable, y = h * product over dims of f(x - position, linewidth), */
+/* so for each peak and dim f and the derivatives of log(f) with respect to the */
+/* position and linewidth only need working out once for each point of the region */
+
+static float gaussian_1d(float dx, float lw, float fraction, float *dlog_dp, float *dlog_dl, float *dlog_df) {
+    *dlog_df = 0;
+    *dlog_dp = 8 * log(2) * dx / (lw * lw);
+    *dlog_dl = 8 * log(2) * dx * dx / (lw * lw * lw);
+
+    return exp(-4 * log(2) * dx * dx / (lw * lw));
+}
+
+static float lorentzian_1d(float dx, float lw, float fraction, float *dlog_dp, float *dlog_dl, float *dlog_df) {
+    float d = lw * lw + 4 * dx * dx;
+
+    *dlog_df = 0;
+    *dlog_dp = 8 * dx / d;
+    *dlog_dl = 8 * dx * dx / (lw * d);
+
+    return lw * lw / d;
+}
+
+/* fraction of Lorentzian, as lmfit's PseudoVoigtModel (which the 1D picker uses) */
+static float pseudo_voigt_1d(float dx, float lw, float fraction, float *dlog_dp, float *dlog_dl, float *dlog_df) {
+    float g0, g, g_dp, g_dl, l0, l, l_dp, l_dl, f, unused;
+
+    g0 = gaussian_1d(dx, lw, fraction, &g_dp, &g_dl, &unused);
+    l0 = lorentzian_1d(dx, lw, fraction, &l_dp, &l_dl, &unused);
+    g = (1 - fraction) * g0;
+    l = fraction * l0;
+    f = g + l;
+
+    // only all Gaussian can be 0, far from the peak
+    if (f == 0) {
+        *dlog_dp = g_dp;
+        *dlog_dl = g_dl;
+        *dlog_df = 0;
+        return f;
+    }
+
+    *dlog_dp = (g * g_dp + l * l_dp) / f;
+    *dlog_dl = (g * g_dl + l * l_dl) / f;
+    *dlog_df = (l0 - g0) / f;
+
+    return f;
+}
+
+/* nshape is the number of shape params fitted for each peak, and start is their starting value */
+typedef struct _Lineshape {
+    char *name;
+    Lineshape_func func;
+    int nshape;
+    float start;
+} Lineshape;
+
+static Lineshape lineshapes[] = {
+    [GAUSSIAN_METHOD] = {"gaussian", gaussian_1d, 0, 0},
+    [LORENTZIAN_METHOD] = {"lorentzian", lorentzian_1d, 0, 0},
+    [PSEUDO_VOIGT_METHOD] = {"pseudo-voigt", pseudo_voigt_1d, 1, PSEUDO_VOIGT_FRACTION},
+};
+
+#define NLINESHAPES ((int)(sizeof(lineshapes) / sizeof(lineshapes[0])))
+
+static CcpnStatus check_method(int method, char *error_msg) {
+    if ((method < 0) || (method >= NLINESHAPES)) {
+        sprintf(error_msg, "method must be from 0 to %d, the index into Peak.lineshapes", NLINESHAPES - 1);
+        return CCPN_ERROR;
+    }
 
     return CCPN_OK;
 }
 
-static CcpnStatus fit_peaks(PyArrayObject *data_array, PyArrayObject *region_array, PyArrayObject *peak_array, int method,
-                            PyObject *fit_list, char *error_msg) {
-    int i, j, k, ndim, total_region_size, first, last, nparams, npeaks, npts;
-    int region_offset[MAX_NDIM], region_size[MAX_NDIM], cumul_region[MAX_NDIM], points[MAX_NDIM], region_end[MAX_NDIM];
-    npy_intp array[MAX_NDIM], grid_posn[MAX_NDIM], posn;
-    float *x, *y, *params, *params_dev, *w = NULL, *y_fit = NULL;
-    float peak_posn[MAX_NDIM], height, chisq, max_iter = 0, noise = 0;
-    PyObject *fit_obj, *posn_obj, *lw_obj;
-    FitPeak fitPeak;
-    CcpnBool have_maximum;
-    CcpnStatus status;
+/* the number of params of each peak fitted with method, height, position, linewidth and shape */
+static int fit_nparams(int method, int ndim) {
+    return 1 + 2 * ndim + ((method >= 0) ? lineshapes[method].nshape : 0);
+}
 
-    ndim = PyArray_DIM(region_array, 1);
+/* fill the 1D tables for the params a, once for each call of the fitting function over the region */
+static void _fitting_prepare(float *a, void *user_data) {
+    FitPeak *fitPeak = (FitPeak *)user_data;
+    int ndim = fitPeak->ndim;
+    int nparams_per_peak = 1 + 2 * ndim + fitPeak->nshape;
+    int i, j, x, t;
+    float *position, *linewidth, fraction;
+
+    // check whether position is outside the intended fitting region
+    fitPeak->outside = CCPN_FALSE;
     for (i = 0; i < ndim; i++) {
-        first = *((int *)PyArray_GETPTR2(region_array, 0, i));
-        last = *((int *)PyArray_GETPTR2(region_array, 1, i));
-        region_offset[i] = first;
-        region_end[i] = last;
-        region_size[i] = last - first;
+        if ((a[1 + i] < fitPeak->region_offset[i]) || (a[1 + i] >= fitPeak->region_end[i])) {
+            fitPeak->outside = CCPN_TRUE;
+            return;
+        }
     }
 
-    CUMULATIVE(cumul_region, region_size, total_region_size, ndim);
+    // the fraction of a pseudo-voigt is kept from 0 to 1 in the same way
+    for (j = 0; j < fitPeak->npeaks; j++) {
+        if (fitPeak->nshape) {
+            fraction = a[j * nparams_per_peak + 1 + 2 * ndim];
+            if ((fraction < 0) || (fraction > 1)) {
+                fitPeak->outside = CCPN_TRUE;
+                return;
+            }
+        }
+    }
 
-    sprintf(error_msg, "allocating memory for x, y");
-    MALLOC(x, float, total_region_size);
-    MALLOC(y, float, total_region_size);
+    fraction = 0;
+    for (j = 0; j < fitPeak->npeaks; j++) {
+        position = a + j * nparams_per_peak + 1;
+        linewidth = position + ndim;
+        if (fitPeak->nshape) fraction = linewidth[ndim];
+        t = j * fitPeak->table_size;
 
-    // get the block of elements surrounding the peak to test
-    for (j = 0; j < total_region_size; j++) {
-        x[j] = j;  // the real x is multidimensional so have to use index into it
-        ARRAY_OF_INDEX(array, j, cumul_region, ndim);
-        ADD_VECTORS(array, array, region_offset, ndim);
-        y[j] = get_value_at_point(data_array, array);
+        for (i = 0; i < ndim; i++) {
+            for (x = fitPeak->region_offset[i]; x < fitPeak->region_end[i]; x++, t++)
+                fitPeak->factor[t] = (*fitPeak->lineshape)(x - position[i], linewidth[i], fraction, fitPeak->dlog_dp + t,
+                                                           fitPeak->dlog_dl + t, fitPeak->dlog_df + t);
+        }
     }
 
-    npeaks = PyArray_DIM(peak_array, 0);
-    nparams = (1 + 2 * ndim) * npeaks;
+    fitPeak->next_ind = -1;
+}
+
+/* each peak is a block of params, which is not active at samples where the peak is zero */
+PEAK_INLINE void fitting_func_ndim(int ind, float *a, float *y_fit, float *dy_da, CcpnBool *block_active,
+                                   FitPeak *fitPeak, const int ndim) {
+    int npeaks = fitPeak->npeaks, nshape = fitPeak->nshape;
+    int *x = fitPeak->x;
+    int nparams_per_peak = 1 + 2 * ndim + nshape;
+    int i, j, t[MAX_NDIM];
+    float *factor, *dlog_dp, *dlog_dl, *dlog_df, f, y, df;
+
+    if (fitPeak->outside) {
+        *y_fit = LARGE_NUMBER;
+        for (j = 0; j < npeaks; j++) block_active[j] = CCPN_FALSE;  // arbitrary, hopefully ok
+        return;
+    }
+
+    // the samples normally come in order, so step x on rather than work it out from ind
+    if (ind != fitPeak->next_ind) {
+        ARRAY_OF_INDEX(x, ind, fitPeak->cumul_region, ndim);
+    }
+
+    for (i = 0; i < ndim; i++) t[i] = fitPeak->table_start[i] + x[i];
 
-    //    printf(">>> npeaks: %i\n", npeaks);
+    *y_fit = 0;
+    for (j = 0; j < npeaks; j++) {
+        factor = fitPeak->factor + j * fitPeak->table_size;
+        dlog_dp = fitPeak->dlog_dp + j * fitPeak->table_size;
+        dlog_dl = fitPeak->dlog_dl + j * fitPeak->table_size;
+        dlog_df = fitPeak->dlog_df + j * fitPeak->table_size;
 
-    sprintf(error_msg, "allocating memory for params, params_dev");
-    MALLOC(params, float, nparams);
-    MALLOC(params_dev, float, nparams);
+        f = 1;
+        for (i = 0; i < ndim; i++) f *= factor[t[i]];
+
+        y = a[0] * f;
+        dy_da[0] = f;
+        for (i = 0; i < ndim; i++) {
+            dy_da[1 + i] = y * dlog_dp[t[i]];
+            dy_da[1 + ndim + i] = y * dlog_dl[t[i]];
+        }
+
+        // the fraction is the same in every dim
+        if (nshape) {
+            df = 0;
+            for (i = 0; i < ndim; i++) df += dlog_df[t[i]];
+            dy_da[1 + 2 * ndim] = y * df;
+        }
+
+        *y_fit += y;
+        block_active[j] = (y != 0);
+
+        a += nparams_per_peak;
+        dy_da += nparams_per_peak;
+    }
+
+    for (i = 0; (i < ndim - 1) && (++x[i] == fitPeak->region_size[i]); i++) x[i] = 0;
+    if (i == ndim - 1) x[i]++;
+    fitPeak->next_ind = ind + 1;
+}
+
+#define FITTING_FUNC_NDIM(name, ndim)                                                                      \
+    static void name(int ind, float *a, float *y_fit, float *dy_da, CcpnBool *block_active, void *user_data) { \
+        fitting_func_ndim(ind, a, y_fit, dy_da, block_active, (FitPeak *)user_data, ndim);                 \
+    }
+
+FITTING_FUNC_NDIM(_fitting_func1, 1)
+FITTING_FUNC_NDIM(_fitting_func2, 2)
+FITTING_FUNC_NDIM(_fitting_func3, 3)
+FITTING_FUNC_NDIM(_fitting_func4, 4)
+FITTING_FUNC_NDIM(_fitting_func, ((FitPeak *)user_data)->ndim)
+
+/* indexed by ndim, for ndim up to PEAK_NDIM_SPECIALISED */
+static Nonlinear_block_func fitting_funcs[PEAK_NDIM_SPECIALISED + 1] = {_fitting_func, _fitting_func1, _fitting_func2,
+                                                                        _fitting_func3, _fitting_func4};
+
+/* params gets (1 + 2 * ndim) values for each peak, peak_status whether the parabola fitted in every dim */
+static CcpnStatus fit_parabolic(PyArrayObject *data_array, PyArrayObject *region_array, PyArrayObject *peak_array,
+                                float *params, int *peak_status, char *error_msg) {
+    int i, j, k, ndim, npeaks, npts;
+    int points[MAX_NDIM];
+    npy_intp grid_posn[MAX_NDIM], posn;
+    float peak_posn[MAX_NDIM];
+    float peakFit[MAX_NDIM], lineWidths[MAX_NDIM];
+    float peakHeight;
+    CcpnStatus status;
+
+    ndim = PyArray_DIM(region_array, 1);
+    npeaks = PyArray_DIM(peak_array, 0);
 
     for (i = 0; i < ndim; i++) points[i] = PyArray_DIM(data_array, ndim - 1 - i);
 
@@ -823,213 +1485,499 @@ static CcpnStatus fit_peaks(PyArrayObject *data_array, PyArrayObject *region_arr
             posn = MAX(0, posn);
             posn = MIN(npts - 1, posn);
             grid_posn[i] = posn;
+        }
 
-            //            printf(">>> npeak %i, %i -> [%i]\n", j, i, grid_posn[i]);
+        // a dim where the point is on the edge of the data is left at the point, with no linewidth
+        peakHeight = get_value_at_point(data_array, grid_posn);
+        peak_status[j] = FIT_STATUS_OK;
+        for (i = 0; i < ndim; i++) {
+            status = fitParabolicToNDim(data_array, &peakHeight, grid_posn, points, &peakFit[i], &lineWidths[i], i);
+            if (status == CCPN_ERROR) {
+                peakFit[i] = grid_posn[i];
+                lineWidths[i] = 0;
+                peak_status[j] = FIT_STATUS_FAILED;
+            }
         }
 
-        height = get_value_at_point(data_array, grid_posn);
-        have_maximum = height > 0;  // TBD: possibly wrong
+        params[k++] = peakHeight;
+        for (i = 0; i < ndim; i++) params[k++] = peakFit[i];
 
-        //        printf(">>> height %i, %f\n", j, height);
+        for (i = 0; i < ndim; i++) params[k++] = lineWidths[i];
+    }
+
+    return CCPN_OK;
+}
+
+/* fit the npeaks peaks at peak_posns (npeaks x ndim) to the data in region (first then last point in each dim), */
+/* params gets fit_nparams(method, ndim) values for each peak in turn: height, position, linewidth */
+/* and (for pseudo-voigt) fraction, does not use any Python objects so can run without the GIL (with a workspace for each thread) */
+static CcpnStatus fit_peak_group(Peak_data *peak_data, int *region, float *peak_posns, int npeaks, int method,
+                                 float *params, Nonlinear_workspace *workspace, char *error_msg) {
+    int i, j, k, ndim = peak_data->ndim, total_region_size, max_iter = 0;
+    int region_offset[MAX_NDIM], region_size[MAX_NDIM], cumul_region[MAX_NDIM], region_end[MAX_NDIM];
+    npy_intp array[MAX_NDIM], grid_posn[MAX_NDIM], posn;
+    float *y, *w = NULL, *y_fit = NULL;
+    float height, chisq, noise = 0;
+    char *ptr;
+    FitPeak fitPeak;
+    CcpnBool have_maximum;
+    CcpnStatus status;
+
+    for (i = 0; i < ndim; i++) {
+        region_offset[i] = region[i];
+        region_end[i] = region[ndim + i];
+        region_size[i] = region_end[i] - region_offset[i];
+    }
+
+    CUMULATIVE(cumul_region, region_size, total_region_size, ndim);
+
+    sprintf(error_msg, "allocating memory for y");
+    MALLOC(y, float, total_region_size);
+
+    // get the block of elements surrounding the peak to test, the fit uses the index j into it
+    for (j = 0; j < total_region_size; j++) {
+        ARRAY_OF_INDEX(array, j, cumul_region, ndim);
+        ADD_VECTORS(array, array, region_offset, ndim);
+        y[j] = VALUE_AT(point_ptr(peak_data, array), 0);
+    }
+
+    k = 0;
+
+    // iterate over all the peaks passed in
+    for (j = 0; j < npeaks; j++) {
+        // find the index point nearest to the peak position (floats)
+        // relative to the dataArray, clipped to the dataArray bounds
+        for (i = 0; i < ndim; i++) {
+            posn = NEAREST_INTEGER(peak_posns[j * ndim + i]);
+            posn = MAX(0, posn);
+            posn = MIN(peak_data->points[i] - 1, posn);
+            grid_posn[i] = posn;
+        }
+
+        ptr = point_ptr(peak_data, grid_posn);
+        height = VALUE_AT(ptr, 0);
+        have_maximum = height > 0;  // TBD: possibly wrong
 
         params[k++] = height;
         for (i = 0; i < ndim; i++) params[k++] = grid_posn[i];
 
-        for (i = 0; i < ndim; i++) params[k++] = half_max_linewidth(data_array, have_maximum, height, grid_posn, points, i);
+        for (i = 0; i < ndim; i++) params[k++] = half_max_linewidth(peak_data, have_maximum, height, grid_posn, ptr, i);
+
+        for (i = 0; i < lineshapes[method].nshape; i++) params[k++] = lineshapes[method].start;
     }
 
     fitPeak.ndim = ndim;
     fitPeak.npeaks = npeaks;
     fitPeak.region_offset = region_offset;
     fitPeak.region_end = region_end;
+    fitPeak.region_size = region_size;
     fitPeak.cumul_region = cumul_region;
-    fitPeak.method = method;
+    fitPeak.lineshape = lineshapes[method].func;
+    fitPeak.nshape = lineshapes[method].nshape;
 
-    status = nonlinear_fit(total_region_size, x, y, w, y_fit, nparams, params, params_dev, max_iter, noise, &chisq,
-                           _fitting_func, (void *)&fitPeak, error_msg);
+    fitPeak.table_size = 0;
+    for (i = 0; i < ndim; i++) {
+        fitPeak.table_start[i] = fitPeak.table_size;
+        fitPeak.table_size += region_size[i];
+    }
+
+    sprintf(error_msg, "allocating memory for lineshape tables");
+    fitPeak.factor = (float *)malloc(4 * MAX(1, npeaks * fitPeak.table_size) * sizeof(float));
+    if (!fitPeak.factor) {
+        FREE(y, float);
+        return CCPN_ERROR;
+    }
+
+    fitPeak.dlog_dp = fitPeak.factor + npeaks * fitPeak.table_size;
+    fitPeak.dlog_dl = fitPeak.dlog_dp + npeaks * fitPeak.table_size;
+    fitPeak.dlog_df = fitPeak.dlog_dl + npeaks * fitPeak.table_size;
 
-    FREE(x, float);
+    status = nonlinear_fit_blocks(workspace, total_region_size, y, w, y_fit, npeaks, fit_nparams(method, ndim), params, NULL,
+                                  max_iter, noise, &chisq, _fitting_prepare,
+                                  (ndim <= PEAK_NDIM_SPECIALISED) ? fitting_funcs[ndim] : _fitting_func, (void *)&fitPeak,
+                                  error_msg);
+
+    FREE(fitPeak.factor, float);
     FREE(y, float);
 
-    if (status == CCPN_ERROR) {
-        FREE(params, float);
-        FREE(params_dev, float);
-        return CCPN_ERROR;
+    return status;
+}
+
+/* params gets fit_nparams(method, ndim) values for each peak, as fit_peak_group */
+static CcpnStatus fit_peaks(PyArrayObject *data_array, PyArrayObject *region_array, PyArrayObject *peak_array, int method,
+                            float *params, char *error_msg) {
+    int i, j, ndim, npeaks, region[2 * MAX_NDIM];
+    float *peak_posns;
+    Peak_data peak_data;
+    Nonlinear_workspace workspace;
+    CcpnStatus status;
+
+    ndim = PyArray_DIM(region_array, 1);
+    for (i = 0; i < ndim; i++) {
+        region[i] = *((int *)PyArray_GETPTR2(region_array, 0, i));
+        region[ndim + i] = *((int *)PyArray_GETPTR2(region_array, 1, i));
     }
 
-    k = 0;
+    npeaks = PyArray_DIM(peak_array, 0);
+
+    sprintf(error_msg, "allocating memory for peak positions");
+    MALLOC(peak_posns, float, MAX(1, ndim * npeaks));
+
     for (j = 0; j < npeaks; j++) {
-        fit_obj = PyTuple_New(3);  // height, position, linewidth
-        if (!fit_obj) RETURN_ERROR_MSG("allocating fit data");
+        for (i = 0; i < ndim; i++) peak_posns[j * ndim + i] = *((float *)PyArray_GETPTR2(peak_array, j, i));
+    }
 
-        posn_obj = PyTuple_New(ndim);
-        if (!posn_obj) RETURN_ERROR_MSG("allocating position");
+    init_peak_data(&peak_data, data_array);
+    init_nonlinear_workspace(&workspace, NONLINEAR_FLOAT);
+    status = fit_peak_group(&peak_data, region, peak_posns, npeaks, method, params, &workspace, error_msg);
 
-        lw_obj = PyTuple_New(ndim);
-        if (!lw_obj) RETURN_ERROR_MSG("allocating linewidth");
+    if (stats_enabled) add_fit_counts(&workspace.counts);
+
+    clear_nonlinear_workspace(&workspace);
+    FREE(peak_posns, float);
+
+    return status;
+}
+
+/* the groups of peaks for fitPeaksBatch, the tasks only write the fits and status of their own group */
+typedef struct _Fit_batch {
+    Peak_data data;
+    int method;
+    int precision;       /* NONLINEAR_FLOAT or NONLINEAR_DOUBLE */
+    int ngroups;
+    int groups_per_task;
+    int *regions;      /* ngroups x 2 x ndim, first then last point in each dim */
+    int *peak_starts;  /* ngroups + 1, index of the first peak of each group */
+    float *peak_posns; /* npeaks x ndim */
+    float *fits;       /* npeaks x fit_nparams(method, ndim), height, position, linewidth and fraction */
+    int *status;       /* ngroups, FIT_STATUS_OK etc. */
+    Nonlinear_counts *counts; /* one for each task, NULL without the statistics */
+} Fit_batch;
+
+static void delete_fit_batch(Fit_batch *batch) {
+    FREE(batch->regions, int);
+    FREE(batch->peak_starts, int);
+    FREE(batch->peak_posns, float);
+    FREE(batch->fits, float);
+    FREE(batch->status, int);
+    FREE(batch->counts, Nonlinear_counts);
+}
 
-        height = params[k++];
-        PyTuple_SetItem(fit_obj, 0, PyFloat_FromDouble((double)height));
-        PyTuple_SetItem(fit_obj, 1, posn_obj);
-        PyTuple_SetItem(fit_obj, 2, lw_obj);
+/* the arguments have already been checked by fitPeaksBatch, apart from peak_counts */
+static CcpnStatus new_fit_batch(Fit_batch *batch, PyArrayObject *regions_array, PyArrayObject *peak_array,
+                                PyArrayObject *counts_array, char *error_msg) {
+    int i, j, k, count, ndim = batch->data.ndim, npeaks = PyArray_DIM(peak_array, 0);
+
+    batch->ngroups = PyArray_DIM(regions_array, 0);
+    batch->regions = NULL;
+    batch->peak_starts = NULL;
+    batch->peak_posns = NULL;
+    batch->fits = NULL;
+    batch->status = NULL;
+    batch->counts = NULL;
+
+    sprintf(error_msg, "allocating batch memory");
+
+    MALLOC(batch->regions, int, MAX(1, 2 * ndim * batch->ngroups));
+    MALLOC(batch->peak_starts, int, batch->ngroups + 1);
+    MALLOC(batch->peak_posns, float, MAX(1, ndim * npeaks));
+    MALLOC(batch->fits, float, MAX(1, fit_nparams(batch->method, ndim) * npeaks));
+    MALLOC(batch->status, int, MAX(1, batch->ngroups));
+
+    for (i = 0; i < batch->ngroups; i++) {
+        for (j = 0; j < 2; j++) {
+            for (k = 0; k < ndim; k++)
+                batch->regions[(2 * i + j) * ndim + k] = *((int *)PyArray_GETPTR3(regions_array, i, j, k));
+        }
+    }
 
-        for (i = 0; i < ndim; i++) PyTuple_SetItem(posn_obj, i, PyFloat_FromDouble((double)params[k++]));
+    batch->peak_starts[0] = 0;
+    for (i = 0; i < batch->ngroups; i++) {
+        count = *((int *)PyArray_GETPTR1(counts_array, i));
+        if (count < 0) RETURN_ERROR_MSG("peakCounts must be >= 0");
 
-        for (i = 0; i < ndim; i++) PyTuple_SetItem(lw_obj, i, PyFloat_FromDouble((double)params[k++]));
+        batch->peak_starts[i + 1] = batch->peak_starts[i] + count;
+    }
 
-        if (PyList_Append(fit_list, fit_obj)) RETURN_ERROR_MSG("appending fit data to fit list");
+    if (batch->peak_starts[batch->ngroups] != npeaks) RETURN_ERROR_MSG("peakCounts must add up to the number of peaks");
 
-        Py_DECREF(fit_obj);
+    for (i = 0; i < npeaks; i++) {
+        for (k = 0; k < ndim; k++) batch->peak_posns[i * ndim + k] = *((float *)PyArray_GETPTR2(peak_array, i, k));
     }
 
-    FREE(params, float);
-    FREE(params_dev, float);
+    return CCPN_OK;
+}
+
+/* fit one group, a failed fit only sets the status of the group (and its fits to NaN) */
+static CcpnStatus fit_group(Fit_batch *batch, int group, Nonlinear_workspace *workspace) {
+    int i, ndim = batch->data.ndim, nparams_per_peak = fit_nparams(batch->method, ndim);
+    int *region = batch->regions + 2 * ndim * group;
+    int start = batch->peak_starts[group], npeaks = batch->peak_starts[group + 1] - start;
+    float *fits = batch->fits + start * nparams_per_peak;
+    char error_msg[1000];
+
+    batch->status[group] = FIT_STATUS_OK;
+
+    for (i = 0; i < ndim; i++) {
+        if ((region[i] < 0) || (region[i] >= region[ndim + i]) || (region[ndim + i] > batch->data.points[i])) {
+            batch->status[group] = FIT_STATUS_BAD_REGION;
+            break;
+        }
+    }
+
+    if ((batch->status[group] == FIT_STATUS_OK) && (npeaks > 0) &&
+        (fit_peak_group(&batch->data, region, batch->peak_posns + start * ndim, npeaks, batch->method, fits, workspace,
+                        error_msg) == CCPN_ERROR))
+        batch->status[group] = FIT_STATUS_FAILED;
+
+    if (batch->status[group] != FIT_STATUS_OK) {
+        for (i = 0; i < npeaks * nparams_per_peak; i++) fits[i] = NAN;
+    }
 
     return CCPN_OK;
 }
 
+/* fit a range of groups, with one workspace for all of them */
+static CcpnStatus fit_groups_task(int task, void *user_data) {
+    Fit_batch *batch = (Fit_batch *)user_data;
+    int group, group_start = task * batch->groups_per_task;
+    int group_end = MIN(group_start + batch->groups_per_task, batch->ngroups);
+    Nonlinear_workspace workspace;
+
+    init_nonlinear_workspace(&workspace, batch->precision);
+
+    for (group = group_start; group < group_end; group++) fit_group(batch, group, &workspace);
+
+    if (batch->counts) batch->counts[task] = workspace.counts;
+
+    clear_nonlinear_workspace(&workspace);
+
+    return CCPN_OK;
+}
+
+/* the peaks of data_array (already checked) found with picker, as a list or with as_array as a record array */
+static PyObject *pick_peaks(Peak_picker *picker, PyArrayObject *data_array, int numThreads, int as_array) {
+    PyObject *peak_list;
+    Peak_grid peak_grid;
+    CcpnStatus status;
+    char error_msg[1000];
+
+    peak_grid = new_peak_grid(picker->ndim, picker->buffer);
+    if (!peak_grid) RETURN_OBJ_ERROR("allocating memory for peak list");
+
+    status = find_peaks(data_array, picker, peak_grid, numThreads, error_msg);
+
+    if (stats_enabled && (status == CCPN_OK)) peak_stats.nfind_calls++;
+
+    /* the Python list (or array) is only made once all the peaks are found */
+    if (status == CCPN_OK)
+        peak_list = as_array ? peak_array_from_grid(peak_grid) : peak_list_from_grid(peak_grid);
+    else
+        peak_list = NULL;
+
+    delete_peak_grid(peak_grid);
+
+    if (status == CCPN_ERROR) RETURN_OBJ_ERROR(error_msg);
+
+    return peak_list;
+}
+
 static PyObject *findPeaks(PyObject *self, PyObject *args) {
-    long i, ndim, buffer[MAX_NDIM];
+    int numThreads = 1, asArray = 0;
     CcpnBool nonadjacent, have_low, have_high;
-    float low, high, drop_factor, min_linewidth[MAX_NDIM];
-    PyObject *min_linewidth_obj, *buffer_obj, *z, *peak_list;
+    float low, high, drop_factor;
+    PyObject *min_linewidth_obj, *buffer_obj, *peak_list;
     PyObject *excluded_regions_obj, *diagonal_exclusion_dims_obj, *diagonal_exclusion_transform_obj;
-    PyArrayObject *data_array, *excluded_regions_array, *diagonal_exclusion_dims_array, *diagonal_exclusion_transform_array;
+    PyArrayObject *data_array;
+    Peak_picker picker;
+    CcpnStatus status;
     char error_msg[1000];
 
-    if (!PyArg_ParseTuple(args, "O!iiffO!ifO!O!O!O!", &PyArray_Type, &data_array, &have_low, &have_high, &low, &high,
+    if (!PyArg_ParseTuple(args, "O!iiffO!ifO!O!O!O!|ii", &PyArray_Type, &data_array, &have_low, &have_high, &low, &high,
                           &PyList_Type, &buffer_obj, &nonadjacent, &drop_factor, &PyList_Type, &min_linewidth_obj, &PyList_Type,
                           &excluded_regions_obj, &PyList_Type, &diagonal_exclusion_dims_obj, &PyList_Type,
-                          &diagonal_exclusion_transform_obj))
+                          &diagonal_exclusion_transform_obj, &numThreads, &asArray))
         RETURN_OBJ_ERROR(
             "need arguments: dataArray, haveLow, haveHigh, low, high, buffer, nonadjacent, dropFactor, minLinewidth, "
-            "excludedRegions, diagonalExclusionDims, diagonalExclusionTransform");
+            "excludedRegions, diagonalExclusionDims, diagonalExclusionTransform, optional numThreads, optional asArray");
+
+    if (numThreads < 0) RETURN_OBJ_ERROR("numThreads must be >= 0 (0 = use all cpus)");
 
     if (PyArray_TYPE(data_array) != NPY_FLOAT) RETURN_OBJ_ERROR("dataArray needs to be array of floats");
 
-    ndim = PyArray_NDIM(data_array);
+    status = new_peak_picker(&picker, PyArray_NDIM(data_array), have_low, have_high, low, high, buffer_obj, nonadjacent,
+                             drop_factor, min_linewidth_obj, excluded_regions_obj, diagonal_exclusion_dims_obj,
+                             diagonal_exclusion_transform_obj, error_msg);
 
-    if (ndim > MAX_NDIM) {
-        sprintf(error_msg, "maximum ndim is %d", MAX_NDIM);
+    if (status == CCPN_ERROR) {
+        delete_peak_picker(&picker);
         RETURN_OBJ_ERROR(error_msg);
     }
 
-    if (PyList_Size(buffer_obj) != ndim) {
-        sprintf(error_msg, "buffer is a list of size %ld, should be %ld", (long)PyList_Size(buffer_obj), ndim);
-        RETURN_OBJ_ERROR(error_msg);
-    }
+    peak_list = pick_peaks(&picker, data_array, numThreads, asArray);
 
-    for (i = 0; i < ndim; i++) {
-        z = PyList_GetItem(buffer_obj, i);
-        if (!PyLong_Check(z)) {
-            sprintf(error_msg, "buffer element %ld is not an int", i);
-            RETURN_OBJ_ERROR(error_msg);
-        }
+    delete_peak_picker(&picker);
 
-        buffer[i] = (long)PyLong_AsLong(z);
-    }
+    return peak_list;
+}
 
-    if (PyList_Size(min_linewidth_obj) != ndim) {
-        sprintf(error_msg, "minLinewidth is a list of size %ld, should be %ld\n", (long)PyList_Size(buffer_obj), ndim);
+static void delete_peak_picker_capsule(PyObject *capsule) {
+    Peak_picker *picker = (Peak_picker *)PyCapsule_GetPointer(capsule, PEAK_PICKER_CAPSULE);
+
+    if (!picker) return;
+
+    delete_peak_picker(picker);
+    free(picker);
+}
+
+static PyObject *newPeakPicker(PyObject *self, PyObject *args) {
+    CcpnBool nonadjacent, have_low, have_high;
+    float low, high, drop_factor;
+    PyObject *min_linewidth_obj, *buffer_obj, *capsule;
+    PyObject *excluded_regions_obj, *diagonal_exclusion_dims_obj, *diagonal_exclusion_transform_obj;
+    Peak_picker *picker;
+    CcpnStatus status;
+    char error_msg[1000];
+
+    if (!PyArg_ParseTuple(args, "iiffO!ifO!O!O!O!", &have_low, &have_high, &low, &high, &PyList_Type, &buffer_obj,
+                          &nonadjacent, &drop_factor, &PyList_Type, &min_linewidth_obj, &PyList_Type, &excluded_regions_obj,
+                          &PyList_Type, &diagonal_exclusion_dims_obj, &PyList_Type, &diagonal_exclusion_transform_obj))
+        RETURN_OBJ_ERROR("need arguments: haveLow, haveHigh, low, high, buffer, nonadjacent, dropFactor, minLinewidth, "
+                         "excludedRegions, diagonalExclusionDims, diagonalExclusionTransform");
+
+    picker = (Peak_picker *)malloc(sizeof(Peak_picker));
+    if (!picker) RETURN_OBJ_ERROR("allocating memory for peak picker");
+
+    /* the dims are those of buffer, the data of peakPickerPick must have as many */
+    status = new_peak_picker(picker, (int)PyList_Size(buffer_obj), have_low, have_high, low, high, buffer_obj, nonadjacent,
+                             drop_factor, min_linewidth_obj, excluded_regions_obj, diagonal_exclusion_dims_obj,
+                             diagonal_exclusion_transform_obj, error_msg);
+
+    if (status == CCPN_ERROR) {
+        delete_peak_picker(picker);
+        free(picker);
         RETURN_OBJ_ERROR(error_msg);
     }
 
-    for (i = 0; i < ndim; i++) {
-        z = PyList_GetItem(min_linewidth_obj, i);
-        if (!PyFloat_Check(z)) {
-            sprintf(error_msg, "minLinewidth element %ld is not a float", i);
-            RETURN_OBJ_ERROR(error_msg);
-        }
-
-        min_linewidth[i] = (float)PyFloat_AsDouble(z);
+    capsule = PyCapsule_New(picker, PEAK_PICKER_CAPSULE, delete_peak_picker_capsule);
+    if (!capsule) {
+        delete_peak_picker(picker);
+        free(picker);
+        return NULL;
     }
 
-    for (i = 0; i < PyList_Size(excluded_regions_obj); i++) {
-        excluded_regions_array = (PyArrayObject *)PyList_GetItem(excluded_regions_obj, i);
+    return capsule;
+}
 
-        if (!PyArray_Check(excluded_regions_array)) RETURN_OBJ_ERROR("excludedRegions needs to be list of NumPy arrays");
+static PyObject *peakPickerPick(PyObject *self, PyObject *args) {
+    int numThreads = 1, asArray = 0;
+    PyObject *capsule;
+    PyArrayObject *data_array;
+    Peak_picker *picker;
+    char error_msg[1000];
 
-        if (PyArray_TYPE(excluded_regions_array) != NPY_FLOAT)
-            RETURN_OBJ_ERROR("excludedRegions needs to be list of NumPy float arrays");
+    if (!PyArg_ParseTuple(args, "OO!|ii", &capsule, &PyArray_Type, &data_array, &numThreads, &asArray))
+        RETURN_OBJ_ERROR("need arguments: picker, dataArray, optional numThreads, optional asArray");
 
-        if (PyArray_NDIM(excluded_regions_array) != 2) {
-            sprintf(error_msg, "excludedRegions must be list of 2 dimensional NumPy arrays");
-            RETURN_OBJ_ERROR(error_msg);
-        }
+    picker = (Peak_picker *)PyCapsule_GetPointer(capsule, PEAK_PICKER_CAPSULE);
+    if (!picker) return NULL;
 
-        if ((PyArray_DIM(excluded_regions_array, 0) != 2) || (PyArray_DIM(excluded_regions_array, 1) != ndim)) {
-            sprintf(error_msg, "excludedRegions must be list of 2 x %ld NumPy arrays", ndim);
-            RETURN_OBJ_ERROR(error_msg);
-        }
-    }
+    if (numThreads < 0) RETURN_OBJ_ERROR("numThreads must be >= 0 (0 = use all cpus)");
 
-    if (PyList_Size(diagonal_exclusion_dims_obj) != PyList_Size(diagonal_exclusion_transform_obj)) {
-        sprintf(error_msg,
-                "diagonalExclusionDims is a list of size %ld, diagonalExclusionTransform is of size %ld, should be the same",
-                (long)PyList_Size(diagonal_exclusion_dims_obj), (long)PyList_Size(diagonal_exclusion_transform_obj));
+    if (PyArray_TYPE(data_array) != NPY_FLOAT) RETURN_OBJ_ERROR("dataArray needs to be array of floats");
+
+    if (PyArray_NDIM(data_array) != picker->ndim) {
+        sprintf(error_msg, "dataArray has %d dims, the picker is for %d", PyArray_NDIM(data_array), picker->ndim);
         RETURN_OBJ_ERROR(error_msg);
     }
 
-    for (i = 0; i < PyList_Size(diagonal_exclusion_dims_obj); i++) {
-        diagonal_exclusion_dims_array = (PyArrayObject *)PyList_GetItem(diagonal_exclusion_dims_obj, i);
+    return pick_peaks(picker, data_array, numThreads, asArray);
+}
 
-        if (!PyArray_Check(diagonal_exclusion_dims_array))
-            RETURN_OBJ_ERROR("diagonalExclusionDims needs to be list of NumPy arrays");
+static PyObject *fitPeaks(PyObject *self, PyObject *args) {
+    int j, ndim, npeaks, nparams, method, asArray = 0, fit_status;
+    double start = stats_enabled ? parallel_seconds() : 0;
+    float *params;
+    PyObject *fit_list;
+    PyArrayObject *data_array, *region_array, *peak_array;
+    char error_msg[1000];
 
-        if (PyArray_TYPE(diagonal_exclusion_dims_array) != NPY_INT)
-            RETURN_OBJ_ERROR("diagonalExclusionDims needs to be list of NumPy int arrays");
+    if (!PyArg_ParseTuple(args, "O!O!O!i|i", &PyArray_Type, &data_array, &PyArray_Type, &region_array, &PyArray_Type,
+                          &peak_array, &method, &asArray))
+        RETURN_OBJ_ERROR("need arguments: dataArray, regionArray, peakArray, method, optional asArray");
 
-        if (PyArray_NDIM(diagonal_exclusion_dims_array) != 1) {
-            sprintf(error_msg, "diagonalExclusionDims must be list of 1 dimensional NumPy arrays");
-            RETURN_OBJ_ERROR(error_msg);
-        }
+    if (PyArray_TYPE(data_array) != NPY_FLOAT) RETURN_OBJ_ERROR("dataArray needs to be array of floats");
 
-        if (PyArray_DIM(diagonal_exclusion_dims_array, 0) != 2) {
-            sprintf(error_msg, "diagonalExclusionDims must be list of size 2 NumPy arrays");
-            RETURN_OBJ_ERROR(error_msg);
-        }
+    ndim = PyArray_NDIM(data_array);
+
+    if (ndim > MAX_NDIM) {
+        sprintf(error_msg, "maximum ndim is %d", MAX_NDIM);
+        RETURN_OBJ_ERROR(error_msg);
     }
 
-    for (i = 0; i < PyList_Size(diagonal_exclusion_transform_obj); i++) {
-        diagonal_exclusion_transform_array = (PyArrayObject *)PyList_GetItem(diagonal_exclusion_transform_obj, i);
+    if (PyArray_TYPE(region_array) != NPY_INT32) RETURN_OBJ_ERROR("regionArray needs to be array of ints");
 
-        if (!PyArray_Check(diagonal_exclusion_transform_array))
-            RETURN_OBJ_ERROR("diagonalExclusionTransform needs to be list of NumPy arrays");
+    if (PyArray_NDIM(region_array) != 2) RETURN_OBJ_ERROR("regionArray must be 2 dimensional");
 
-        if (PyArray_TYPE(diagonal_exclusion_transform_array) != NPY_FLOAT)
-            RETURN_OBJ_ERROR("diagonalExclusionTransform needs to be list of NumPy float arrays");
+    if ((PyArray_DIM(region_array, 0) != 2) || (PyArray_DIM(region_array, 1) != ndim)) {
+        sprintf(error_msg, "regionArray must be 2 x %d", ndim);
+        RETURN_OBJ_ERROR(error_msg);
+    }
 
-        if (PyArray_NDIM(diagonal_exclusion_transform_array) != 1) {
-            sprintf(error_msg, "diagonalExclusionTransform must be list of 1 dimensional NumPy arrays");
-            RETURN_OBJ_ERROR(error_msg);
-        }
+    if (PyArray_TYPE(peak_array) != NPY_FLOAT) RETURN_OBJ_ERROR("peakArray needs to be array of floats");
+
+    if (check_method(method, error_msg) == CCPN_ERROR) RETURN_OBJ_ERROR(error_msg);
 
-        if (PyArray_DIM(diagonal_exclusion_transform_array, 0) != 4) {
-            sprintf(error_msg, "diagonalExclusionTransform must be list of size 4 NumPy arrays");
+    npeaks = PyArray_DIM(peak_array, 0);
+    nparams = fit_nparams(method, ndim);
+
+    params = (float *)malloc(MAX(1, nparams * npeaks) * sizeof(float));
+    if (!params) RETURN_OBJ_ERROR("allocating memory for params");
+
+    fit_status = FIT_STATUS_OK;
+    if (fit_peaks(data_array, region_array, peak_array, method, params, error_msg) == CCPN_ERROR) {
+        if (stats_enabled) peak_stats.nfailed++;
+
+        if (!asArray) {
+            FREE(params, float);
             RETURN_OBJ_ERROR(error_msg);
         }
+
+        /* as fitPeaksBatch, the array has the failure in the status rather than raising an error */
+        fit_status = FIT_STATUS_FAILED;
+        for (j = 0; j < nparams * npeaks; j++) params[j] = NAN;
     }
 
-    peak_list = PyList_New(0);
-    if (!peak_list) RETURN_OBJ_ERROR("allocating memory for peak list");
+    if (asArray)
+        fit_list = fit_array_from_params(params, NULL, fit_status, npeaks, ndim, lineshapes[method].nshape);
+    else
+        fit_list = fit_list_from_params(params, npeaks, ndim, lineshapes[method].nshape);
 
-    if (find_peaks(data_array, have_low, have_high, low, high, buffer, nonadjacent, drop_factor, min_linewidth, peak_list,
-                   excluded_regions_obj, diagonal_exclusion_dims_obj, diagonal_exclusion_transform_obj,
-                   error_msg) == CCPN_ERROR)
-        RETURN_OBJ_ERROR(error_msg);
+    FREE(params, float);
 
-    return peak_list;
+    if (stats_enabled) {
+        peak_stats.nfit_calls++;
+        peak_stats.ngroups++;
+        peak_stats.fit_seconds += parallel_seconds() - start;
+    }
+
+    return fit_list;
 }
 
-static PyObject *fitPeaks(PyObject *self, PyObject *args) {
-    int i, ndim, method;
-    PyObject *peak_list, *fit_list;
-    PyArrayObject *data_array, *region_array, *peak_array;
+static PyObject *fitPeaksBatch(PyObject *self, PyObject *args) {
+    int i, j, ndim, npeaks, ngroups, method, ntasks, nthreads, numThreads = 1, doublePrecision = 0;
+    int *peak_status;
+    double start = stats_enabled ? parallel_seconds() : 0;
+    PyObject *fit_array = NULL;
+    PyArrayObject *data_array, *regions_array, *peak_array, *counts_array;
+    Fit_batch batch;
+    CcpnStatus status = CCPN_OK;
     char error_msg[1000];
 
-    if (!PyArg_ParseTuple(args, "O!O!O!i", &PyArray_Type, &data_array, &PyArray_Type, &region_array, &PyArray_Type, &peak_array,
-                          &method))
-        RETURN_OBJ_ERROR("need arguments: dataArray, regionArray, peakArray, method");
+    if (!PyArg_ParseTuple(args, "O!O!O!O!i|ii", &PyArray_Type, &data_array, &PyArray_Type, &regions_array, &PyArray_Type,
+                          &peak_array, &PyArray_Type, &counts_array, &method, &numThreads, &doublePrecision))
+        RETURN_OBJ_ERROR(
+            "need arguments: dataArray, regionArrays, peakArray, peakCounts, method, [ numThreads, [ doublePrecision ] ]");
 
     if (PyArray_TYPE(data_array) != NPY_FLOAT) RETURN_OBJ_ERROR("dataArray needs to be array of floats");
 
@@ -1040,38 +1988,108 @@ static PyObject *fitPeaks(PyObject *self, PyObject *args) {
         RETURN_OBJ_ERROR(error_msg);
     }
 
-    if (PyArray_TYPE(region_array) != NPY_INT32) RETURN_OBJ_ERROR("regionArray needs to be array of ints");
-
-    if (PyArray_NDIM(region_array) != 2) RETURN_OBJ_ERROR("regionArray must be 2 dimensional");
+    if (PyArray_TYPE(regions_array) != NPY_INT32) RETURN_OBJ_ERROR("regionArrays needs to be array of ints");
 
-    if ((PyArray_DIM(region_array, 0) != 2) || (PyArray_DIM(region_array, 1) != ndim)) {
-        sprintf(error_msg, "regionArray must be 2 x %d", ndim);
+    if ((PyArray_NDIM(regions_array) != 3) || (PyArray_DIM(regions_array, 1) != 2) ||
+        (PyArray_DIM(regions_array, 2) != ndim)) {
+        sprintf(error_msg, "regionArrays must be ngroups x 2 x %d", ndim);
         RETURN_OBJ_ERROR(error_msg);
     }
 
+    ngroups = PyArray_DIM(regions_array, 0);
+
     if (PyArray_TYPE(peak_array) != NPY_FLOAT) RETURN_OBJ_ERROR("peakArray needs to be array of floats");
 
-    if (method != GAUSSIAN_METHOD && method != LORENTZIAN_METHOD) {
-        sprintf(error_msg, "method must be %d (Gaussian) or %d (Lorentzian)", GAUSSIAN_METHOD, LORENTZIAN_METHOD);
+    if ((PyArray_NDIM(peak_array) != 2) || (PyArray_DIM(peak_array, 1) != ndim)) {
+        sprintf(error_msg, "peakArray must be npeaks x %d", ndim);
         RETURN_OBJ_ERROR(error_msg);
     }
 
-    fit_list = PyList_New(0);
-    if (!fit_list) RETURN_OBJ_ERROR("allocating memory for fit list");
+    if (PyArray_TYPE(counts_array) != NPY_INT32) RETURN_OBJ_ERROR("peakCounts needs to be array of ints");
 
-    if (fit_peaks(data_array, region_array, peak_array, method, fit_list, error_msg) == CCPN_ERROR) RETURN_OBJ_ERROR(error_msg);
+    if ((PyArray_NDIM(counts_array) != 1) || (PyArray_DIM(counts_array, 0) != ngroups))
+        RETURN_OBJ_ERROR("peakCounts must have one count for each region");
 
-    return fit_list;
+    if (check_method(method, error_msg) == CCPN_ERROR) RETURN_OBJ_ERROR(error_msg);
+
+    if (numThreads < 0) RETURN_OBJ_ERROR("numThreads must be >= 0");
+
+    init_peak_data(&batch.data, data_array);
+    batch.method = method;
+    batch.precision = doublePrecision ? NONLINEAR_DOUBLE : NONLINEAR_FLOAT;
+
+    if (new_fit_batch(&batch, regions_array, peak_array, counts_array, error_msg) == CCPN_ERROR) {
+        delete_fit_batch(&batch);
+        RETURN_OBJ_ERROR(error_msg);
+    }
+
+    npeaks = PyArray_DIM(peak_array, 0);
+    peak_status = (int *)malloc(MAX(1, npeaks) * sizeof(int));
+    if (!peak_status) {
+        delete_fit_batch(&batch);
+        RETURN_OBJ_ERROR("allocating memory for peak status");
+    }
+
+    /* blocks of groups, so that a workspace is used for more than one fit */
+    nthreads = parallel_num_threads(numThreads, ngroups);
+    ntasks = (nthreads > 1) ? MIN(ngroups, PEAK_TASKS_PER_THREAD * nthreads) : 1;
+    batch.groups_per_task = (ngroups + ntasks - 1) / MAX(ntasks, 1);
+    ntasks = (batch.groups_per_task > 0) ? (ngroups + batch.groups_per_task - 1) / batch.groups_per_task : 0;
+
+    if (stats_enabled && (ntasks > 0)) {
+        batch.counts = (Nonlinear_counts *)calloc(ntasks, sizeof(Nonlinear_counts));
+        if (!batch.counts) status = CCPN_ERROR;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+
+    if ((ntasks > 0) && (status == CCPN_OK)) status = parallel_for(ntasks, nthreads, fit_groups_task, &batch);
+
+    Py_END_ALLOW_THREADS
+
+    if (stats_enabled && (status == CCPN_OK)) {
+        peak_stats.nfit_calls++;
+        peak_stats.ngroups += ngroups;
+
+        for (i = 0; i < ngroups; i++) {
+            if (batch.status[i] == FIT_STATUS_FAILED)
+                peak_stats.nfailed++;
+            else if (batch.status[i] == FIT_STATUS_BAD_REGION)
+                peak_stats.nbad_region++;
+        }
+
+        for (i = 0; i < ntasks; i++) add_fit_counts(batch.counts + i);
+
+        peak_stats.fit_seconds += parallel_seconds() - start;
+    }
+
+    /* as fitPeaks with asArray, each peak has the status of its group */
+    if (status == CCPN_OK) {
+        for (i = 0; i < ngroups; i++) {
+            for (j = batch.peak_starts[i]; j < batch.peak_starts[i + 1]; j++) peak_status[j] = batch.status[i];
+        }
+
+        fit_array = fit_array_from_params(batch.fits, peak_status, FIT_STATUS_OK, npeaks, ndim, lineshapes[method].nshape);
+    }
+
+    delete_fit_batch(&batch);
+    FREE(peak_status, int);
+
+    if (status == CCPN_ERROR) RETURN_OBJ_ERROR("running the fits");
+
+    return fit_array;
 }
 
 static PyObject *fitParabolicPeaks(PyObject *self, PyObject *args) {
-    int i, ndim;
-    PyObject *peak_list, *fit_list;
+    int ndim, npeaks, asArray = 0, *peak_status;
+    float *params;
+    PyObject *fit_list;
     PyArrayObject *data_array, *region_array, *peak_array;
     char error_msg[1000];
 
-    if (!PyArg_ParseTuple(args, "O!O!O!", &PyArray_Type, &data_array, &PyArray_Type, &region_array, &PyArray_Type, &peak_array))
-        RETURN_OBJ_ERROR("need arguments: dataArray, regionArray, peakArray");
+    if (!PyArg_ParseTuple(args, "O!O!O!|i", &PyArray_Type, &data_array, &PyArray_Type, &region_array, &PyArray_Type,
+                          &peak_array, &asArray))
+        RETURN_OBJ_ERROR("need arguments: dataArray, regionArray, peakArray, optional asArray");
 
     if (PyArray_TYPE(data_array) != NPY_FLOAT) RETURN_OBJ_ERROR("dataArray needs to be array of floats");
 
@@ -1093,23 +2111,136 @@ static PyObject *fitParabolicPeaks(PyObject *self, PyObject *args) {
 
     if (PyArray_TYPE(peak_array) != NPY_FLOAT) RETURN_OBJ_ERROR("peakArray needs to be array of floats");
 
-    fit_list = PyList_New(0);
-    if (!fit_list) RETURN_OBJ_ERROR("allocating memory for fit list");
+    npeaks = PyArray_DIM(peak_array, 0);
+
+    params = (float *)malloc(MAX(1, (1 + 2 * ndim) * npeaks) * sizeof(float));
+    peak_status = (int *)malloc(MAX(1, npeaks) * sizeof(int));
+    if (!params || !peak_status) {
+        FREE(params, float);
+        FREE(peak_status, int);
+        RETURN_OBJ_ERROR("allocating memory for params");
+    }
 
     // iterate over all the maximum presented and return the parabolic closest elements and height
-    if (fit_parabolic(data_array, region_array, peak_array, fit_list, error_msg) == CCPN_ERROR) RETURN_OBJ_ERROR(error_msg);
+    fit_parabolic(data_array, region_array, peak_array, params, peak_status, error_msg);
+
+    if (asArray)
+        fit_list = fit_array_from_params(params, peak_status, FIT_STATUS_OK, npeaks, ndim, 0);
+    else
+        fit_list = fit_list_from_params(params, npeaks, ndim, 0);
+
+    FREE(params, float);
+    FREE(peak_status, int);
 
     return fit_list;
 }
 
-static char findPeaks_doc[] = "Find peaks in ND data";
-static char fitPeaks_doc[] = "Fit peaks in ND data";
-static char fitParabolicPeaks_doc[] = "Fit parabolic peaks in ND data";
+static PyObject *setStatsEnabled(PyObject *self, PyObject *args) {
+    int enabled = 1;
+
+    if (!PyArg_ParseTuple(args, "|p", &enabled)) RETURN_OBJ_ERROR("need arguments: optional enabled = True/False");
+
+    stats_enabled = enabled ? CCPN_TRUE : CCPN_FALSE;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *getStats(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, "")) RETURN_OBJ_ERROR("no arguments expected");
+
+    return Py_BuildValue(
+        "{s:O,s:l,s:l,s:l,s:l,s:l,s:l,s:l,s:l,s:l,s:l,s:d,s:d,s:l,s:l,s:l,s:l,s:l,s:l,s:l,s:d}", "enabled",
+        stats_enabled ? Py_True : Py_False, "findCalls", peak_stats.nfind_calls, "points", peak_stats.npoints, "excluded",
+        peak_stats.nexcluded, "threshold", peak_stats.nthreshold, "rejectedExtreme", peak_stats.nrejected_extreme,
+        "rejectedDrop", peak_stats.nrejected_drop, "rejectedLinewidth", peak_stats.nrejected_linewidth, "candidates",
+        peak_stats.ncandidates, "rejectedBuffer", peak_stats.nrejected_buffer, "peaks", peak_stats.npeaks,
+        "searchSeconds", peak_stats.search_seconds, "bufferSeconds", peak_stats.buffer_seconds, "fitCalls",
+        peak_stats.nfit_calls, "groups", peak_stats.ngroups, "failed", peak_stats.nfailed, "badRegion",
+        peak_stats.nbad_region, "fits", peak_stats.fit_counts.nfits, "iterations", peak_stats.fit_counts.niterations,
+        "notConverged", peak_stats.fit_counts.nnot_converged, "fitSeconds", peak_stats.fit_seconds);
+}
+
+static PyObject *resetStats(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, "")) RETURN_OBJ_ERROR("no arguments expected");
+
+    memset(&peak_stats, 0, sizeof(Peak_stats));
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *buildInfo(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, "")) RETURN_OBJ_ERROR("no arguments expected");
+
+    return Py_BuildValue("{s:O,s:s,s:O}", "multiversion", CCPN_HAVE_MULTIVERSION ? Py_True : Py_False, "cpuTarget",
+                         dispatch_cpu_target(), "openmp", CCPN_HAVE_OPENMP ? Py_True : Py_False);
+}
+
+static char findPeaks_doc[] =
+    "Find peaks in ND data\n"
+    "findPeaks(dataArray, haveLow, haveHigh, low, high, buffer, nonadjacent, dropFactor, minLinewidth,\n"
+    "          excludedRegions, diagonalExclusionDims, diagonalExclusionTransform, numThreads=1, asArray=False)\n"
+    "numThreads != 1 searches blocks of rows on numThreads threads (0 = all the cpus) with the GIL released,\n"
+    "the peaks found are the same as with numThreads = 1, returns a list of (point, height) or with asArray\n"
+    "a structured array with fields position (int32 x ndim) and height (float32)";
+static char newPeakPicker_doc[] =
+    "Check and keep the findPeaks settings, for findPeaks on many data arrays without doing that each time\n"
+    "newPeakPicker(haveLow, haveHigh, low, high, buffer, nonadjacent, dropFactor, minLinewidth,\n"
+    "              excludedRegions, diagonalExclusionDims, diagonalExclusionTransform)\n"
+    "the arguments are as for findPeaks, the data has len(buffer) dims, returns the picker for peakPickerPick";
+static char peakPickerPick_doc[] =
+    "Find peaks in ND data with the settings of a picker from newPeakPicker\n"
+    "peakPickerPick(picker, dataArray, numThreads=1, asArray=False)\n"
+    "returns as findPeaks with the same settings";
+static char fitPeaks_doc[] =
+    "Fit peaks in ND data\n"
+    "fitPeaks(dataArray, regionArray, peakArray, method, asArray=False)\n"
+    "method is the index into Peak.lineshapes: 0 gaussian, 1 lorentzian, 2 pseudo-voigt (the fraction of\n"
+    "Lorentzian, from 0 to 1, is fitted for each peak, starting at 0.5),\n"
+    "returns a list of (height, position, linewidth) or with asArray a structured array with fields height,\n"
+    "position, linewidth, fraction for pseudo-voigt (float32) and status (int32), if the fit fails the array\n"
+    "has status 1 and NaN fits rather than an error being raised";
+static char fitPeaksBatch_doc[] =
+    "Fit groups of peaks in ND data in one call\n"
+    "fitPeaksBatch(dataArray, regionArrays, peakArray, peakCounts, method, numThreads=1, doublePrecision=False)\n"
+    "regionArrays is ngroups x 2 x ndim (as regionArray for fitPeaks), the peaks of each group are the next\n"
+    "peakCounts[group] rows of peakArray, the groups are fitted on numThreads threads (0 = all the cpus)\n"
+    "with the GIL released, returns a structured array as fitPeaks with asArray, where the status of each\n"
+    "peak is that of its group: 0 if fitted, 1 if the fit failed and 2 if the region is not inside the data\n"
+    "(the fits of the group are then NaN),\n"
+    "doublePrecision does the sums over the region samples in double (they are in float for fitPeaks)";
+static char fitParabolicPeaks_doc[] =
+    "Fit parabolic peaks in ND data\n"
+    "fitParabolicPeaks(dataArray, regionArray, peakArray, asArray=False)\n"
+    "returns as fitPeaks, the status is 1 if a peak is on the edge of the data in some dim";
+static char setStatsEnabled_doc[] =
+    "Count the work of findPeaks, fitPeaks and fitPeaksBatch (see getStats), off unless enabled\n"
+    "setStatsEnabled(enabled=True)";
+static char getStats_doc[] =
+    "Return what findPeaks and the fits have done since resetStats (while setStatsEnabled)\n"
+    "getStats()\n"
+    "returns a dict with, for findPeaks, findCalls, points, excluded, threshold (the points beyond low or high),\n"
+    "rejectedExtreme, rejectedDrop and rejectedLinewidth (those failing each check in turn), candidates,\n"
+    "rejectedBuffer, peaks, searchSeconds (summed over the threads) and bufferSeconds, and for the fits,\n"
+    "fitCalls, groups, failed, badRegion, fits, iterations and notConverged (of the Levenberg-Marquardt loop)\n"
+    "and fitSeconds";
+static char resetStats_doc[] = "Reset the getStats counts to zero";
+
+static char buildInfo_doc[] =
+    "Return how the module was built and what it uses on this cpu:\n"
+    "multiversion = whether the fitting sums have versions for AVX2 and AVX-512 chosen at run time,\n"
+    "cpuTarget = the version used here, openmp = whether numThreads uses OpenMP rather than threads of its own";
 
 static struct PyMethodDef Peak_type_methods[] = {
     {"findPeaks", (PyCFunction)findPeaks, METH_VARARGS, findPeaks_doc},
+    {"newPeakPicker", (PyCFunction)newPeakPicker, METH_VARARGS, newPeakPicker_doc},
+    {"peakPickerPick", (PyCFunction)peakPickerPick, METH_VARARGS, peakPickerPick_doc},
     {"fitPeaks", (PyCFunction)fitPeaks, METH_VARARGS, fitPeaks_doc},
+    {"fitPeaksBatch", (PyCFunction)fitPeaksBatch, METH_VARARGS, fitPeaksBatch_doc},
     {"fitParabolicPeaks", (PyCFunction)fitParabolicPeaks, METH_VARARGS, fitParabolicPeaks_doc},
+    {"setStatsEnabled", (PyCFunction)setStatsEnabled, METH_VARARGS, setStatsEnabled_doc},
+    {"getStats", (PyCFunction)getStats, METH_VARARGS, getStats_doc},
+    {"resetStats", (PyCFunction)resetStats, METH_VARARGS, resetStats_doc},
+    {"buildInfo", (PyCFunction)buildInfo, METH_VARARGS, buildInfo_doc},
     {NULL, NULL, 0, NULL}};
 
 struct module_state {
@@ -1120,7 +2251,8 @@ static struct PyModuleDef moduledef = {
     PyModuleDef_HEAD_INIT, "Peak", NULL, sizeof(struct module_state), Peak_type_methods, NULL, NULL, NULL, NULL};
 
 PyMODINIT_FUNC PyInit_Peak(void) {
-    PyObject *module;
+    int i;
+    PyObject *module, *lineshape_names;
 
 #ifdef WIN32
     Peak.ob_type = &PyType_Type;
@@ -1138,6 +2270,17 @@ PyMODINIT_FUNC PyInit_Peak(void) {
 
     if (module == NULL) return NULL;
 
+    /* the names of the fitPeaks methods, in method order */
+    lineshape_names = PyTuple_New(NLINESHAPES);
+    if (lineshape_names == NULL) {
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    for (i = 0; i < NLINESHAPES; i++) PyTuple_SET_ITEM(lineshape_names, i, PyUnicode_FromString(lineshapes[i].name));
+
+    PyModule_AddObject(module, "lineshapes", lineshape_names);
+
     struct module_state *st = (struct module_state *)PyModule_GetState(module);
 
     st->error = PyErr_NewException("Peak.error", NULL, NULL);
@@ -0,0 +1,221 @@
+/*
+======================COPYRIGHT/LICENSE START==========================
+
+peak_grid.c: Part of the CcpNmr Analysis program
+
+Copyright (C) 2011 Wayne Boucher and Tim Stevens (University of Cambridge)
+
+=======================================================================
+
+The CCPN license can be found in ../../../license/CCPN.license.
+
+======================COPYRIGHT/LICENSE END============================
+
+for further information, please contact :
+
+- CCPN website (http://www.ccpn.ac.uk/)
+
+- email: ccpn@bioc.cam.ac.uk
+
+- contact the authors: wb104@bioc.cam.ac.uk, tjs23@cam.ac.uk
+=======================================================================
+
+If you are using this software for academic purposes, we suggest
+quoting the following references:
+
+===========================REFERENCE START=============================
+R. Fogh, J. Ionides, E. Ulrich, W. Boucher, W. Vranken, J.P. Linge, M.
+Habeck, W. Rieping, T.N. Bhat, J. Westbrook, K. Henrick, G. Gilliland,
+H. Berman, J. Thornton, M. Nilges, J. Markley and E. Laue (2002). The
+CCPN project: An interim report on a data model for the NMR community
+(Progress report). Nature Struct. Biol. 9, 416-418.
+
+Wim F. Vranken, Wayne Boucher, Tim J. Stevens, Rasmus
+H. Fogh, Anne Pajon, Miguel Llinas, Eldon L. Ulrich, John L. Markley, John
+Ionides and Ernest D. Laue (2005). The CCPN Data Model for NMR Spectroscopy:
+Development of a Software Pipeline. Proteins 59, 687 - 696.
+
+===========================REFERENCE END===============================
+
+*/
+#include "peak_grid.h"
+
+#define  PEAK_GRID_NALLOC  64
+
+static unsigned int cell_bucket(Peak_grid grid, long *cell)
+{
+    int i;
+    unsigned int h = 0;
+
+    for (i = 0; i < grid->ngrid_dims; i++)
+        h = 31 * (h ^ (h >> 15)) + (unsigned int) cell[i] * 2654435761u;
+
+    return h & (grid->nbuckets - 1);
+}
+
+static void cell_of_point(Peak_grid grid, long *point, long *cell)
+{
+    int i;
+
+    for (i = 0; i < grid->ngrid_dims; i++)
+        cell[i] = point[i] / grid->cell_size[i];
+}
+
+static void add_to_bucket(Peak_grid grid, int peak)
+{
+    unsigned int b;
+    long cell[PEAK_GRID_NDIM];
+
+    cell_of_point(grid, grid->points + peak * grid->ndim, cell);
+    b = cell_bucket(grid, cell);
+
+    grid->next[peak] = grid->buckets[b];
+    grid->buckets[b] = peak;
+}
+
+static CcpnStatus rehash_peak_grid(Peak_grid grid, int nbuckets)
+{
+    int i;
+
+    FREE(grid->buckets, int);
+    MALLOC(grid->buckets, int, nbuckets);
+    grid->nbuckets = nbuckets;
+
+    for (i = 0; i < nbuckets; i++)
+        grid->buckets[i] = -1;
+
+    for (i = 0; i < grid->npeaks; i++)
+        add_to_bucket(grid, i);
+
+    return CCPN_OK;
+}
+
+Peak_grid new_peak_grid(int ndim, long *buffer)
+{
+    int i;
+    Peak_grid grid;
+
+    MALLOC_NEW(grid, struct _Peak_grid, 1);
+
+    grid->ndim = ndim;
+    grid->ngrid_dims = MIN(ndim, PEAK_GRID_NDIM);
+
+    MALLOC_NEW(grid->buffer, long, MAX(ndim, 1));
+    for (i = 0; i < ndim; i++)
+        grid->buffer[i] = buffer[i];
+
+    /* a peak within buffer of a point is in the same or a neighbouring cell */
+    for (i = 0; i < grid->ngrid_dims; i++)
+        grid->cell_size[i] = MAX(buffer[i], 0) + 1;
+
+    grid->npeaks = 0;
+    grid->npeaks_alloc = 0;
+    grid->points = NULL;
+    grid->values = NULL;
+    grid->next = NULL;
+    grid->buckets = NULL;
+
+    if (rehash_peak_grid(grid, PEAK_GRID_NALLOC) == CCPN_ERROR)
+    {
+        delete_peak_grid(grid);
+        return NULL;
+    }
+
+    return grid;
+}
+
+void delete_peak_grid(Peak_grid grid)
+{
+    if (!grid)
+        return;
+
+    FREE(grid->buffer, long);
+    FREE(grid->points, long);
+    FREE(grid->values, float);
+    FREE(grid->next, int);
+    FREE(grid->buckets, int);
+    FREE(grid, struct _Peak_grid);
+}
+
+static CcpnBool point_near_peak(Peak_grid grid, long *point, int peak)
+{
+    int i;
+    long *p = grid->points + peak * grid->ndim;
+
+    for (i = 0; i < grid->ndim; i++)
+    {
+        if (ABS(point[i] - p[i]) > grid->buffer[i])
+            return CCPN_FALSE;
+    }
+
+    return CCPN_TRUE;
+}
+
+CcpnBool point_near_peak_grid(Peak_grid grid, long *point)
+{
+    int i, peak, ncells;
+    long cell0[PEAK_GRID_NDIM], cell[PEAK_GRID_NDIM];
+
+    if (grid->npeaks == 0)
+        return CCPN_FALSE;
+
+    cell_of_point(grid, point, cell0);
+
+    /* loop over the 3^ngrid_dims cells around (and including) cell0 */
+    ncells = 1;
+    for (i = 0; i < grid->ngrid_dims; i++)
+    {
+        cell[i] = cell0[i] - 1;
+        ncells *= 3;
+    }
+
+    while (ncells-- > 0)
+    {
+        for (peak = grid->buckets[cell_bucket(grid, cell)]; peak >= 0; peak = grid->next[peak])
+        {
+            if (point_near_peak(grid, point, peak))
+                return CCPN_TRUE;
+        }
+
+        for (i = 0; i < grid->ngrid_dims; i++)
+        {
+            if (++cell[i] <= cell0[i] + 1)
+                break;
+
+            cell[i] = cell0[i] - 1;
+        }
+    }
+
+    return CCPN_FALSE;
+}
+
+CcpnStatus add_peak_grid(Peak_grid grid, long *point, float value)
+{
+    int i, n = grid->npeaks;
+
+    if (n >= grid->npeaks_alloc)
+    {
+        grid->npeaks_alloc = MAX(2 * grid->npeaks_alloc, PEAK_GRID_NALLOC);
+        REALLOC(grid->points, long, grid->npeaks_alloc * MAX(grid->ndim, 1));
+        REALLOC(grid->values, float, grid->npeaks_alloc);
+        REALLOC(grid->next, int, grid->npeaks_alloc);
+    }
+
+    for (i = 0; i < grid->ndim; i++)
+        grid->points[n * grid->ndim + i] = point[i];
+
+    grid->values[n] = value;
+    grid->npeaks++;
+
+    /* keep the buckets no more than one peak each on average */
+    if (grid->npeaks > grid->nbuckets)
+    {
+        CHECK_STATUS(rehash_peak_grid(grid, 2 * grid->nbuckets));
+    }
+    else
+    {
+        add_to_bucket(grid, n);
+    }
+
+    return CCPN_OK;
+}
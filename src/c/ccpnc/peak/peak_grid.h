@@ -0,0 +1,79 @@
+/*
+======================COPYRIGHT/LICENSE START==========================
+
+peak_grid.h: Part of the CcpNmr Analysis program
+
+Copyright (C) 2011 Wayne Boucher and Tim Stevens (University of Cambridge)
+
+=======================================================================
+
+The CCPN license can be found in ../../../license/CCPN.license.
+
+======================COPYRIGHT/LICENSE END============================
+
+for further information, please contact :
+
+- CCPN website (http://www.ccpn.ac.uk/)
+
+- email: ccpn@bioc.cam.ac.uk
+
+- contact the authors: wb104@bioc.cam.ac.uk, tjs23@cam.ac.uk
+=======================================================================
+
+If you are using this software for academic purposes, we suggest
+quoting the following references:
+
+===========================REFERENCE START=============================
+R. Fogh, J. Ionides, E. Ulrich, W. Boucher, W. Vranken, J.P. Linge, M.
+Habeck, W. Rieping, T.N. Bhat, J. Westbrook, K. Henrick, G. Gilliland,
+H. Berman, J. Thornton, M. Nilges, J. Markley and E. Laue (2002). The
+CCPN project: An interim report on a data model for the NMR community
+(Progress report). Nature Struct. Biol. 9, 416-418.
+
+Wim F. Vranken, Wayne Boucher, Tim J. Stevens, Rasmus
+H. Fogh, Anne Pajon, Miguel Llinas, Eldon L. Ulrich, John L. Markley, John
+Ionides and Ernest D. Laue (2005). The CCPN Data Model for NMR Spectroscopy:
+Development of a Software Pipeline. Proteins 59, 687 - 696.
+
+===========================REFERENCE END===============================
+
+*/
+#ifndef _incl_peak_grid
+#define _incl_peak_grid
+
+#include "defns.h"
+
+/* Store of the peaks found so far, hashed on cells of (buffer+1) points */
+/* in (up to) the first PEAK_GRID_NDIM dimensions, so that checking if a */
+/* point is within the buffer of an existing peak only needs to look at */
+/* the peaks in the neighbouring cells rather than all of them. */
+
+#define  PEAK_GRID_NDIM  3
+
+typedef struct _Peak_grid
+{
+    int ndim;
+    int ngrid_dims;             /* dimensions used for the cells */
+    long *buffer;               /* ndim */
+    long cell_size[PEAK_GRID_NDIM];
+
+    int npeaks;
+    int npeaks_alloc;
+    long *points;               /* npeaks x ndim */
+    float *values;              /* npeaks */
+
+    int nbuckets;               /* power of 2 */
+    int *buckets;               /* first peak in each bucket, -1 if empty */
+    int *next;                  /* next peak in the same bucket, -1 at end */
+} *Peak_grid;
+
+extern Peak_grid new_peak_grid(int ndim, long *buffer);
+
+extern void delete_peak_grid(Peak_grid grid);
+
+/* CCPN_TRUE if within buffer (in all dimensions) of some peak in grid */
+extern CcpnBool point_near_peak_grid(Peak_grid grid, long *point);
+
+extern CcpnStatus add_peak_grid(Peak_grid grid, long *point, float value);
+
+#endif /* _incl_peak_grid */
@@ -4,12 +4,16 @@ Build script for CCPN C contour extension.
 
 Usage:
     python setup_contour.py build_ext --inplace
+
+(see setup_options.py for the SIMD and OpenMP options)
 """
 
 from setuptools import setup, Extension
 import numpy as np
 import os
 
+from setup_options import buildOptions
+
 # Get numpy include dirs (both locations)
 numpy_includes = [
     np.get_include(),
@@ -19,10 +23,11 @@ numpy_includes = [
 # Define the contour extension
 contour_extension = Extension(
     'ccpnc.contour.Contourer2d',
-    sources=['ccpnc/contour/npy_contourer2d.c'],
-    include_dirs=numpy_includes + ['ccpnc/contour'],
-    extra_compile_args=['-O3', '-ffast-math'],  # Aggressive optimization
-    define_macros=[('NPY_NO_DEPRECATED_API', 'NPY_1_7_API_VERSION')],
+    sources=['ccpnc/contour/npy_contourer2d.c', 'ccpnc/common/parallel.c', 'ccpnc/contour/crossing.c',
+             'ccpnc/contour/pool.c'],
+    include_dirs=numpy_includes + ['ccpnc/contour', 'ccpnc/common'],  # common is shared with Peak
+    libraries=[] if os.name == 'nt' else ['pthread'],  # worker threads for numThreads != 1
+    **buildOptions(),  # SIMD and OpenMP, see setup_options.py
 )
 
 setup(
@@ -0,0 +1,63 @@
+"""
+Build options shared by setup_contour.py and setup_peak.py.
+
+The options are chosen with environment variables when building, e.g.
+
+    CCPN_OPENMP=1 python setup_contour.py build_ext --inplace
+
+CCPN_SIMD
+    dispatch (default): the baseline for the architecture (SSE2 on x86-64), plus
+        AVX2 and AVX-512 versions of the hot loops chosen at run time on x86-64
+        Linux with gcc or clang (see ccpnc/common/dispatch.h), so one build runs, at
+        its best, on any cpu of the architecture
+    native: everything compiled for the cpu doing the build (-march=native), only
+        for a build that stays on that machine
+    none: plain C, no SIMD kernels and no run time versions
+
+CCPN_OPENMP
+    1: numThreads runs its tasks on the OpenMP runtime's threads, which are kept
+        between calls, rather than starting threads on each call
+
+The extensions report what they were built with in buildInfo().
+"""
+
+import os
+import sys
+
+
+SIMD_CHOICES = ('dispatch', 'native', 'none')
+
+
+def buildOptions():
+    """Return the extra_compile_args, extra_link_args and define_macros for the Extension"""
+    simd = os.environ.get('CCPN_SIMD', 'dispatch').lower()
+    openmp = os.environ.get('CCPN_OPENMP', '0') == '1'
+    msvc = sys.platform == 'win32'
+
+    if simd not in SIMD_CHOICES:
+        raise ValueError(f'CCPN_SIMD must be one of {", ".join(SIMD_CHOICES)}, not {simd!r}')
+
+    compileArgs = ['-O3', '-ffast-math']  # Aggressive optimization
+    linkArgs = []
+    macros = [('NPY_NO_DEPRECATED_API', 'NPY_1_7_API_VERSION')]
+
+    if simd == 'native':
+        # everything is for this cpu already, so no run time versions
+        compileArgs.append('-march=native')
+        macros.append(('CCPN_NO_MULTIVERSION', None))
+    elif simd == 'none':
+        macros.append(('CCPN_NO_SIMD', None))
+
+    if openmp:
+        macros.append(('CCPN_OPENMP', None))
+        if msvc:
+            compileArgs.append('/openmp')
+        elif sys.platform == 'darwin':
+            # Apple clang needs the libomp runtime (e.g. from Homebrew) on the include and library paths
+            compileArgs += ['-Xpreprocessor', '-fopenmp']
+            linkArgs.append('-lomp')
+        else:
+            compileArgs.append('-fopenmp')
+            linkArgs.append('-fopenmp')
+
+    return {'extra_compile_args': compileArgs, 'extra_link_args': linkArgs, 'define_macros': macros}
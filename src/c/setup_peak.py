@@ -4,12 +4,16 @@ Build script for CCPN C peak extension.
 
 Usage:
     python setup_peak.py build_ext --inplace
+
+(see setup_options.py for the SIMD and OpenMP options)
 """
 
 from setuptools import setup, Extension
 import numpy as np
 import os
 
+from setup_options import buildOptions
+
 # Get numpy include dirs (both locations)
 numpy_includes = [
     np.get_include(),
@@ -22,11 +26,13 @@ peak_extension = Extension(
     sources=[
         'ccpnc/peak/npy_peak.c',
         'ccpnc/peak/nonlinear_model.c',
-        'ccpnc/peak/gauss_jordan.c'
+        'ccpnc/peak/gauss_jordan.c',
+        'ccpnc/peak/peak_grid.c',
+        'ccpnc/common/parallel.c'
     ],
-    include_dirs=numpy_includes + ['ccpnc/peak'],
-    extra_compile_args=['-O3', '-ffast-math'],  # Aggressive optimization
-    define_macros=[('NPY_NO_DEPRECATED_API', 'NPY_1_7_API_VERSION')],
+    include_dirs=numpy_includes + ['ccpnc/peak', 'ccpnc/common'],  # common is shared with Contourer2d
+    libraries=[] if os.name == 'nt' else ['pthread'],  # worker threads for numThreads != 1
+    **buildOptions(),  # SIMD and OpenMP, see setup_options.py
 )
 
 setup(
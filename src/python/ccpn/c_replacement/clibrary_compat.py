@@ -0,0 +1,161 @@
+"""
+Compatibility wrapper for the Clibrary C extension (nmrResidue indexing).
+
+Usage:
+    from ccpn.c_replacement.clibrary_compat import getNmrResidueIndex, invalidateNmrResidueIndices
+
+    index = getNmrResidueIndex(nmrResidue)  # position of nmrResidue in its nmrChain, -1 if not there
+    indices = getNmrResidueIndices(nmrChain)  # integer array, the same for each of nmrChain.nmrResidues
+    invalidateNmrResidueIndices()           # after nmrResidues are created, deleted, renamed or moved
+
+The indices of all the nmrResidues of an nmrChain are worked out together, with one sort,
+and cached until invalidated (or until the number of nmrResidues changes), so that a
+table of nmrResidues only sorts each nmrChain once rather than once per row, and
+getNmrResidueIndices fills a whole column in one call.  If the C extension is not
+available the same ordering is done in Python.
+"""
+
+import threading
+
+import numpy as np
+
+try:
+    from ccpnc.clibrary import Clibrary as _c_implementation
+except ImportError:
+    _c_implementation = None
+
+if _c_implementation is not None and not hasattr(_c_implementation, 'getNmrResidueIndices'):
+    # built before the indices were cached
+    _c_implementation = None
+
+_using_c = _c_implementation is not None
+
+_UNASSIGNED_INDEX_OFFSET = 1000000000
+_MAIN_RELATIVE_OFFSET = -0.1  # sorts the main nmrResidue between its -1 and +1 offset nmrResidues
+
+_chainIndices = {}  # id(apiNmrChain) -> (apiNmrChain, numMain, numGroups, isConnected, {id(apiResonanceGroup): index})
+_chainIndicesLock = threading.Lock()
+
+
+def _groupKey(resonanceGroup, index, isConnected, isMain):
+    apiDict = resonanceGroup.__dict__
+    seqInsertCode = ''
+
+    if not isConnected:
+        if isMain:
+            seqCode = apiDict.get('seqCode')
+            index = seqCode if seqCode is not None else (apiDict.get('serial') or 0) + _UNASSIGNED_INDEX_OFFSET
+        seqInsertCode = apiDict.get('seqInsertCode')
+        if not isinstance(seqInsertCode, str):
+            seqInsertCode = ''
+
+    relativeOffset = apiDict.get('relativeOffset')
+    if relativeOffset is None:
+        relativeOffset = _MAIN_RELATIVE_OFFSET
+
+    return index, seqInsertCode, relativeOffset
+
+
+def _newChainIndices(apiNmrChain, resonanceGroups, isConnected) -> dict:
+    """{id(apiResonanceGroup): index} for all the resonanceGroups of apiNmrChain, as the C extension"""
+    mains = apiNmrChain.mainResonanceGroups
+    mainPositions = {id(main): ii for ii, main in enumerate(mains)}
+
+    offsets = [[] for _ in mains]
+    for resonanceGroup in resonanceGroups.values():
+        mainRes = getattr(resonanceGroup, 'mainResonanceGroup', None)
+        if mainRes is not resonanceGroup and id(mainRes) in mainPositions:
+            offsets[mainPositions[id(mainRes)]].append(resonanceGroup)
+
+    # each main resonanceGroup followed by its offset resonanceGroups, equal keys keep this order
+    keys = []
+    for ii, main in enumerate(mains):
+        mainKey = _groupKey(main, ii, isConnected, True)
+        keys.append((mainKey, main))
+        keys.extend((_groupKey(offset, mainKey[0], isConnected, False), offset) for offset in offsets[ii])
+
+    keys.sort(key=lambda item: item[0])
+
+    return {id(resonanceGroup): index for index, (_, resonanceGroup) in enumerate(keys)}
+
+
+def _pyChainIndices(apiNmrChain, apiNmrProject) -> dict:
+    chainDict = apiNmrChain.__dict__
+    isConnected = bool(chainDict['isConnected'])
+    mains = chainDict.get('mainResonanceGroups')
+    numMain = len(mains) if mains is not None else -1
+    resonanceGroups = apiNmrProject.__dict__['resonanceGroups']
+    numGroups = len(resonanceGroups)
+
+    with _chainIndicesLock:
+        entry = _chainIndices.get(id(apiNmrChain))
+        if entry and numMain >= 0 and entry[0] is apiNmrChain and entry[1:4] == (numMain, numGroups, isConnected):
+            return entry[4]
+
+    indices = _newChainIndices(apiNmrChain, resonanceGroups, isConnected)
+    with _chainIndicesLock:
+        _chainIndices[id(apiNmrChain)] = (apiNmrChain, numMain, numGroups, isConnected, indices)
+
+    return indices
+
+
+def _pyGetNmrResidueIndex(nmrResidue) -> int:
+    apiNmrResidue = nmrResidue._wrappedData
+    indices = _pyChainIndices(apiNmrResidue.nmrChain, apiNmrResidue.nmrProject)
+
+    return indices.get(id(apiNmrResidue), -1)
+
+
+def getNmrResidueIndex(nmrResidue) -> int:
+    """Return the index of nmrResidue in its nmrChain, or -1 if it is not there"""
+    if _using_c:
+        return _c_implementation.getNmrResidueIndex(nmrResidue)
+
+    return _pyGetNmrResidueIndex(nmrResidue)
+
+
+def _pyGetNmrResidueIndices(nmrResidues) -> np.ndarray:
+    indices = np.full(len(nmrResidues), -1, dtype=np.int_)
+    lastChain = chainIndices = None
+    for ii, nmrResidue in enumerate(nmrResidues):
+        apiNmrResidue = nmrResidue._wrappedData
+        apiNmrChain = apiNmrResidue.nmrChain
+        if apiNmrChain is None:
+            continue
+        if apiNmrChain is not lastChain:
+            chainIndices = _pyChainIndices(apiNmrChain, apiNmrResidue.nmrProject)
+            lastChain = apiNmrChain
+        indices[ii] = chainIndices.get(id(apiNmrResidue), -1)
+
+    return indices
+
+
+def getNmrResidueIndices(nmrResidues) -> np.ndarray:
+    """Return an integer array of the index of each nmrResidue in its nmrChain (or -1),
+    nmrResidues is a sequence of nmrResidues, or an nmrChain for all its nmrResidues
+    """
+    if not isinstance(nmrResidues, (list, tuple)) and hasattr(nmrResidues, 'nmrResidues'):
+        nmrResidues = nmrResidues.nmrResidues
+    if _using_c:
+        return _c_implementation.getNmrResidueIndices(list(nmrResidues))
+
+    return _pyGetNmrResidueIndices(list(nmrResidues))
+
+
+def invalidateNmrResidueIndices(apiNmrChain=None):
+    """Forget the cached indices of apiNmrChain, or of all the nmrChains if None"""
+    if _c_implementation is not None:
+        _c_implementation.invalidateNmrResidueIndices(apiNmrChain)
+
+    with _chainIndicesLock:
+        if apiNmrChain is None:
+            _chainIndices.clear()
+        else:
+            _chainIndices.pop(id(apiNmrChain), None)
+
+
+__all__ = [
+    'getNmrResidueIndex',
+    'getNmrResidueIndices',
+    'invalidateNmrResidueIndices',
+]
@@ -0,0 +1,252 @@
+"""
+Incremental contour cache for contourerGLList.
+
+Contours are kept for each level, keyed by a fingerprint of the plane plus the
+level value, so that adding or removing a contour level, or going back to a
+plane that has already been contoured, only costs the levels that are new.
+
+The fingerprint is best given by the caller, as any hashable key that changes
+whenever the data of the plane does (e.g. the spectrum, the plane position and
+the spectrum data version), otherwise each plane is hashed on every call.
+
+Usage:
+    from ccpn.c_replacement.contour_cache import getContourCache
+
+    # Same arguments and result as Contourer2d.contourerGLList
+    contours = getContourCache().contourerGLList(dataArrays, posLevels, ..., fingerprints=planeKeys)
+
+The per-level contours come from the C extension (Contourer2d.contourerLevelChains).
+If that is not available the cache just passes the call on to contour_compat.
+"""
+
+import hashlib
+import threading
+from collections import OrderedDict
+
+import numpy as np
+
+from . import contour_compat
+
+
+DEFAULT_MAX_BYTES = 256 * 1024 * 1024
+_ENTRY_OVERHEAD = 200  # rough size of the key and tuple for each cached level
+
+
+def planeFingerprint(dataArray) -> bytes:
+    """Return a fingerprint of the values (and shape) of a 2D plane, for when the caller has no key for it"""
+    data = np.ascontiguousarray(dataArray, dtype=np.float32)
+    digest = hashlib.blake2b(data.data, digest_size=16)
+    digest.update(repr(data.shape).encode())
+
+    return digest.digest()
+
+
+def flattenPlanes(dataArrays, numThreads: int = 1) -> np.ndarray:
+    """Overlay the planes as contourerGLList(flatten=True) does, into a new array.
+
+    Keeps the largest positive and the most negative value at each point
+    (planes with a different shape to the first are ignored, as in the C code).
+    Uses Contourer2d.projectPlanes (one pass over all the planes) if available.
+    """
+    if contour_compat._using_c and hasattr(contour_compat._implementation, 'projectPlanes'):
+        planes = tuple(np.asarray(dataArray, dtype=np.float32) for dataArray in dataArrays)
+        if all(plane.ndim == 2 for plane in planes):
+            return contour_compat._implementation.projectPlanes(planes, numThreads)
+
+    flat = np.array(dataArrays[0], dtype=np.float32)
+    zero = np.float32(0)
+
+    for dataArray in dataArrays[1:]:
+        if dataArray.shape != flat.shape:
+            continue
+        flat = (np.maximum(np.maximum(flat, zero), np.maximum(dataArray, zero)) +
+                np.minimum(np.minimum(flat, zero), np.minimum(dataArray, zero)))
+
+    return flat
+
+
+def glListFromChains(levelChains, levelColours) -> list:
+    """Build the contourerGLList result from (vertices, chainLengths) and an RGBA colour for each level"""
+    if not levelChains:
+        return [0, 0, np.empty(0, dtype=np.uint32), np.empty(0, dtype=np.float32), np.empty(0, dtype=np.float32)]
+
+    vertices = np.concatenate([vertices for vertices, _ in levelChains])
+    chainLengths = np.concatenate([chainLengths for _, chainLengths in levelChains])
+    numVertices = len(vertices) // 2
+
+    # each vertex is joined to the next one, and the last vertex of a chain back to its first
+    chainEnds = np.cumsum(chainLengths) - 1
+    chainStarts = chainEnds - chainLengths + 1
+    first = np.arange(numVertices, dtype=np.uint32)
+    second = first + 1
+    second[chainEnds] = chainStarts
+
+    indexing = np.empty(2 * numVertices, dtype=np.uint32)
+    indexing[0::2] = first
+    indexing[1::2] = second
+
+    counts = [len(vertices) // 2 for vertices, _ in levelChains]
+    colours = np.repeat(np.array(levelColours, dtype=np.float32).reshape(-1, 4), counts, axis=0).ravel()
+
+    return [2 * numVertices, numVertices, indexing, vertices, colours]
+
+
+class ContourCache:
+    """Least-recently-used cache of contours for each (plane, level).
+
+    Safe to use from several threads, the contouring itself is done outside the lock.
+    """
+
+    def __init__(self, maxBytes: int = DEFAULT_MAX_BYTES):
+        self._maxBytes = maxBytes
+        self._nbytes = 0
+        self._levels = OrderedDict()  # (fingerprint, level) -> (vertices, chainLengths)
+        self._lock = threading.Lock()
+        self.hits = 0
+        self.misses = 0
+
+    @staticmethod
+    def isAvailable() -> bool:
+        """True if the C extension can contour individual levels"""
+        return contour_compat._using_c and hasattr(contour_compat._implementation, 'contourerLevelChains')
+
+    @property
+    def nbytes(self) -> int:
+        return self._nbytes
+
+    def __len__(self):
+        return len(self._levels)
+
+    def clear(self):
+        with self._lock:
+            self._levels.clear()
+            self._nbytes = 0
+            self.hits = self.misses = 0
+
+    def _add(self, key, chains):
+        if key in self._levels:
+            return
+
+        self._levels[key] = chains
+        self._nbytes += chains[0].nbytes + chains[1].nbytes + _ENTRY_OVERHEAD
+
+        while self._nbytes > self._maxBytes and self._levels:
+            _, (vertices, chainLengths) = self._levels.popitem(last=False)
+            self._nbytes -= vertices.nbytes + chainLengths.nbytes + _ENTRY_OVERHEAD
+
+    def cachedLevelChains(self, fingerprint, levels):
+        """Return (vertices, chainLengths) for each level if they are all cached for fingerprint, otherwise None,
+        so that a caller can skip making the plane when nothing needs contouring
+        """
+        keys = [(fingerprint, float(level)) for level in np.asarray(levels, dtype=np.float32)]
+
+        with self._lock:
+            chains = [self._levels.get(key) for key in keys]
+            if any(levelChains is None for levelChains in chains):
+                return None
+
+            for key in keys:
+                self._levels.move_to_end(key)
+            self.hits += len(keys)
+
+        return chains
+
+    def levelChains(self, dataArray, levels, numThreads: int = 1, fingerprint=None, contourLevels=None) -> list:
+        """Return (vertices, chainLengths) for each level, only contouring the levels not already cached.
+
+        levels must be all increasing or all decreasing, as for contourerGLList.
+        fingerprint is the key of the plane (any hashable), planeFingerprint(dataArray) if None.
+        contourLevels(dataArray, levels, numThreads) contours the missing levels, a pair of arrays for
+        each, Contourer2d.contourerLevelChains if None; a different contourLevels needs its own
+        fingerprints (e.g. with a tag), as the keys do not say what made them.
+        """
+        levels = np.asarray(levels, dtype=np.float32)
+        if fingerprint is None:
+            fingerprint = planeFingerprint(dataArray)
+
+        keys = [(fingerprint, float(level)) for level in levels]
+
+        with self._lock:
+            chains = [self._levels.get(key) for key in keys]
+            for key, levelChains in zip(keys, chains):
+                if levelChains is not None:
+                    self._levels.move_to_end(key)
+
+        missing = [ii for ii, levelChains in enumerate(chains) if levelChains is None]
+
+        if missing:
+            # a subset of monotonic levels is still monotonic
+            if contourLevels is None:
+                contourLevels = contour_compat._implementation.contourerLevelChains
+            newChains = contourLevels(dataArray, levels[missing], numThreads)
+
+            with self._lock:
+                for ii, levelChains in zip(missing, newChains):
+                    chains[ii] = levelChains
+                    self._add(keys[ii], levelChains)
+
+        with self._lock:
+            self.hits += len(levels) - len(missing)
+            self.misses += len(missing)
+
+        return chains
+
+    def contourerGLList(self, dataArrays, posLevels, negLevels, posColour, negColour, flatten=0, numThreads=1,
+                        fingerprints=None):
+        """Same as Contourer2d.contourerGLList, but using (and filling) the cache.
+
+        fingerprints is a key (any hashable) for each of dataArrays that changes whenever its data does,
+        each plane is hashed with planeFingerprint if None.  With flatten the overlaid plane is cached
+        as a single plane, keyed by the keys of all the planes.
+        """
+        if not self.isAvailable():
+            return contour_compat.Contourer2d.contourerGLList(dataArrays, posLevels, negLevels,
+                                                              posColour, negColour, flatten, numThreads)
+
+        if fingerprints is not None and len(fingerprints) != len(dataArrays):
+            raise ValueError(f'{len(fingerprints)} fingerprints for {len(dataArrays)} dataArrays')
+
+        if flatten and len(dataArrays) > 1:
+            dataArrays = (flattenPlanes(dataArrays, numThreads),)
+            if fingerprints is not None:
+                fingerprints = (('flatten',) + tuple(fingerprints),)
+
+        levelChains = []
+        levelColours = []
+        for ii, dataArray in enumerate(dataArrays):
+            fingerprint = fingerprints[ii] if fingerprints is not None else planeFingerprint(dataArray)
+
+            for levels, colour in ((posLevels, posColour), (negLevels, negColour)):
+                for ll, chains in enumerate(self.levelChains(dataArray, levels, numThreads, fingerprint)):
+                    if len(chains[1]) == 0:
+                        # as contourerGLList, stop at the first level without contours
+                        break
+
+                    levelChains.append(chains)
+                    levelColours.append(colour[4 * ll:4 * ll + 4])
+
+        return glListFromChains(levelChains, levelColours)
+
+
+_contourCache = None
+_contourCacheLock = threading.Lock()
+
+
+def getContourCache() -> ContourCache:
+    """Return the contour cache shared by all the spectrum views"""
+    global _contourCache
+
+    with _contourCacheLock:
+        if _contourCache is None:
+            _contourCache = ContourCache()
+
+    return _contourCache
+
+
+__all__ = [
+    'ContourCache',
+    'getContourCache',
+    'planeFingerprint',
+    'flattenPlanes',
+    'glListFromChains',
+]
@@ -162,7 +162,7 @@ class Contourer2d:
     """
 
     @staticmethod
-    def contourerGLList(dataArrays, posLevels, negLevels, posColour, negColour, flatten=0):
+    def contourerGLList(dataArrays, posLevels, negLevels, posColour, negColour, flatten=0, numThreads=1):
         """Generate contours in OpenGL format.
 
         Args:
@@ -171,7 +171,9 @@ class Contourer2d:
             negLevels: 1D array of negative contour levels (float32)
             posColour: RGBA color for positive contours (4 floats)
             negColour: RGBA color for negative contours (4 floats)
-            flatten: Whether to flatten multiple arrays (0 or 1)
+            flatten: Whether to overlay multiple arrays into one (0 or 1), dataArrays are not changed
+            numThreads: Number of threads for the C extension, 1 is serial, 0 uses all cpus
+                (ignored by the Python implementation)
 
         Returns:
             List containing [numIndices, numVertices, indexing, vertices, colours]
@@ -179,7 +181,7 @@ class Contourer2d:
         if _using_c:
             # C implementation is the Contourer2d class itself
             return _implementation.contourerGLList(
-                dataArrays, posLevels, negLevels, posColour, negColour, flatten
+                dataArrays, posLevels, negLevels, posColour, negColour, flatten, numThreads
             )
         else:
             # Python implementation is the module
@@ -0,0 +1,292 @@
+"""
+GPU marching-squares backend for contourerGLList.
+
+Every cell of every level is done by its own CUDA thread (through numba.cuda, numba
+being needed for the Python implementations anyway), writing its line segments
+straight into a vertex buffer on the device.  This is done in two passes, the first
+only counts the segments of each level so that the second can write each level into
+its own, exactly sized, part of the buffer.
+
+The segments of each (plane, level) go through the ContourCache shared with the CPU
+contours (under their own keys), so only the levels not already cached are done on
+the GPU, and the result is put together on the host.
+
+Usage:
+    from ccpn.c_replacement.contour_gpu import getContourer
+
+    # Same arguments and result as Contourer2d.contourerGLList, the GPU is used if
+    # CCPN_GPU_CONTOURS=1 and CUDA is available, otherwise the contour cache
+    contours = getContourer().contourerGLList(dataArrays, posLevels, ..., fingerprints=planeKeys)
+
+The spectrum views do not use it: the result is not left on the device for the GL
+upload, and it has about twice the vertices of the CPU chains, see below.
+
+The result has the same layout as Contourer2d.contourerGLList, but each contour is
+a set of separate segments (two vertices each, indexed in order) rather than
+chains, which draws the same with GL_LINES.  The segments of a level are in no
+particular order.  Saddle cells are split as the C code does, by comparing the
+average of the four corners with the level, and as in the C code the positive
+(negative) levels stop at the first level without contours.
+"""
+
+import math
+import os
+
+import numpy as np
+
+from . import contour_compat
+from .contour_cache import ContourCache, flattenPlanes, getContourCache, planeFingerprint
+
+
+try:
+    from numba import cuda
+except ImportError:
+    cuda = None
+
+
+_BLOCK = (16, 16, 1)  # threads per block, over (columns, rows, levels)
+
+_GPU_CONTOURS = os.environ.get('CCPN_GPU_CONTOURS', '0') == '1'
+
+
+if cuda is not None:
+
+    @cuda.jit(device=True)
+    def _edgePoint(edge, i0, i1, level, d00, d01, d10, d11):
+        # edges are 0 = bottom (row i1), 1 = right (column i0 + 1), 2 = top (row i1 + 1), 3 = left (column i0)
+        if edge == 0:
+            return i0 + (level - d00) / (d01 - d00), i1
+        elif edge == 1:
+            return i0 + 1, i1 + (level - d01) / (d11 - d01)
+        elif edge == 2:
+            return i0 + (level - d10) / (d11 - d10), i1 + 1
+        else:
+            return i0, i1 + (level - d00) / (d10 - d00)
+
+    @cuda.jit(device=True)
+    def _writeSegment(k, edgeA, edgeB, i0, i1, level, d00, d01, d10, d11, vertices):
+        xa, ya = _edgePoint(edgeA, i0, i1, level, d00, d01, d10, d11)
+        xb, yb = _edgePoint(edgeB, i0, i1, level, d00, d01, d10, d11)
+
+        vertices[4 * k] = xa
+        vertices[4 * k + 1] = ya
+        vertices[4 * k + 2] = xb
+        vertices[4 * k + 3] = yb
+
+    @cuda.jit
+    def _marchingSquaresKernel(data, levels, offsets, cursors, vertices, write):
+        """Count (write = 0) or write (write = 1) the segments of the cell at (i0, i1) for level ll.
+
+        When writing, offsets are where each level starts (in segments), and the cursors count the
+        segments of each level written so far.
+        """
+        i0, i1, ll = cuda.grid(3)
+        npoints1, npoints0 = data.shape
+
+        if (i0 >= npoints0 - 1) or (i1 >= npoints1 - 1) or (ll >= levels.shape[0]):
+            return
+
+        level = levels[ll]
+        d00 = data[i1, i0]
+        d01 = data[i1, i0 + 1]
+        d10 = data[i1 + 1, i0]
+        d11 = data[i1 + 1, i0 + 1]
+
+        b00 = d00 > level
+        b01 = d01 > level
+        b10 = d10 > level
+        b11 = d11 > level
+
+        crossBottom = b00 != b01
+        crossRight = b01 != b11
+        crossTop = b10 != b11
+        crossLeft = b00 != b10
+        ncrossings = int(crossBottom) + int(crossRight) + int(crossTop) + int(crossLeft)
+
+        if ncrossings == 0:
+            return
+
+        nsegments = 2 if ncrossings == 4 else 1
+
+        if not write:
+            cuda.atomic.add(cursors, ll, nsegments)
+            return
+
+        k = offsets[ll] + cuda.atomic.add(cursors, ll, nsegments)
+
+        if ncrossings == 4:
+            # saddle, cut off the corners that are not on the same side as the centre
+            centreAbove = (d00 + d01 + d10 + d11) / 4 > level
+            if b00 != centreAbove:
+                _writeSegment(k, 0, 3, i0, i1, level, d00, d01, d10, d11, vertices)
+                _writeSegment(k + 1, 2, 1, i0, i1, level, d00, d01, d10, d11, vertices)
+            else:
+                _writeSegment(k, 0, 1, i0, i1, level, d00, d01, d10, d11, vertices)
+                _writeSegment(k + 1, 2, 3, i0, i1, level, d00, d01, d10, d11, vertices)
+            return
+
+        # the edges crossed are the first and last of bottom, right, top, left
+        if crossBottom:
+            edgeA = 0
+        elif crossRight:
+            edgeA = 1
+        else:
+            edgeA = 2
+
+        if crossLeft:
+            edgeB = 3
+        elif crossTop:
+            edgeB = 2
+        else:
+            edgeB = 1
+
+        _writeSegment(k, edgeA, edgeB, i0, i1, level, d00, d01, d10, d11, vertices)
+
+
+def _levelOffsets(counts):
+    """Return where the segments of each level start in the vertex buffer (in segments), and the total"""
+    counts = np.asarray(counts, dtype=np.int64)
+    offsets = np.zeros(len(counts), dtype=np.int64)
+    offsets[1:] = np.cumsum(counts)[:-1]
+
+    return offsets, int(counts.sum())
+
+
+def glListFromSegments(levelSegments, levelColours) -> list:
+    """Build the contourerGLList result from the segment vertices (x0, y0, x1, y1 for each segment)
+    and an RGBA colour for each level, with the indices 0, 1, 2, ... for GL_LINES
+    """
+    if not levelSegments:
+        return [0, 0, np.empty(0, dtype=np.uint32), np.empty(0, dtype=np.float32), np.empty(0, dtype=np.float32)]
+
+    vertices = np.concatenate(levelSegments)
+    numVertices = len(vertices) // 2
+
+    counts = [len(segments) // 2 for segments in levelSegments]
+    colours = np.repeat(np.array(levelColours, dtype=np.float32).reshape(-1, 4), counts, axis=0).ravel()
+
+    return [numVertices, numVertices, np.arange(numVertices, dtype=np.uint32), vertices, colours]
+
+
+class GpuContourer:
+    """contourerGLList on a CUDA device, falling back to the CPU (through the contour cache) without one"""
+
+    def __init__(self, enabled: bool = True, cache: ContourCache = None):
+        self.enabled = enabled
+        self._cache = cache if cache is not None else getContourCache()
+
+    @staticmethod
+    def isAvailable() -> bool:
+        """True if there is a CUDA device to contour on"""
+        if cuda is None:
+            return False
+
+        try:
+            return cuda.is_available()
+        except Exception:
+            return False
+
+    def contourerGLList(self, dataArrays, posLevels, negLevels, posColour, negColour, flatten=0, numThreads=1,
+                        fingerprints=None):
+        """Same as Contourer2d.contourerGLList, but on the GPU.
+
+        The contours are not joined into chains: each line segment has its own two vertices, and the
+        indices are 0, 1, 2, ... numVertices - 1, i.e. pairs (2k, 2k + 1), for GL_LINES.  So numIndices
+        == numVertices, rather than twice numVertices as for the chains of contourerGLList, and there
+        are about twice as many vertices.  The CPU fallback returns the chains of contourerGLList.
+        fingerprints are the keys of the planes, as for ContourCache.contourerGLList, each plane is
+        hashed if None.  numThreads is only used by the CPU fallback and the flattening.
+        """
+        if not (self.enabled and self.isAvailable()):
+            return self._cache.contourerGLList(dataArrays, posLevels, negLevels, posColour, negColour,
+                                               flatten, numThreads, fingerprints=fingerprints)
+
+        if fingerprints is not None and len(fingerprints) != len(dataArrays):
+            raise ValueError(f'{len(fingerprints)} fingerprints for {len(dataArrays)} dataArrays')
+
+        if flatten and len(dataArrays) > 1:
+            dataArrays = (flattenPlanes(dataArrays, numThreads),)
+            if fingerprints is not None:
+                fingerprints = (('flatten',) + tuple(fingerprints),)
+
+        levelSegments = []
+        levelColours = []
+        for ii, dataArray in enumerate(dataArrays):
+            plane = np.ascontiguousarray(dataArray, dtype=np.float32)
+            if plane.ndim != 2 or min(plane.shape) < 2:
+                continue
+
+            # the segments are kept apart from the chains of the same plane
+            fingerprint = ('gpu', fingerprints[ii] if fingerprints is not None else planeFingerprint(plane))
+
+            for levels, colour in ((posLevels, posColour), (negLevels, negColour)):
+                if len(levels) == 0:
+                    continue
+
+                segments = self._cache.levelChains(plane, levels, numThreads, fingerprint, self._levelSegments)
+                for ll, (vertices, segmentLengths) in enumerate(segments):
+                    if len(segmentLengths) == 0:
+                        # as contourerGLList, stop at the first level without contours
+                        break
+
+                    levelSegments.append(vertices)
+                    levelColours.append(colour[4 * ll:4 * ll + 4])
+
+        return glListFromSegments(levelSegments, levelColours)
+
+    def _levelSegments(self, plane, levels, numThreads=1):
+        """Return (vertices, segmentLengths) for each level, as the cache keeps them, where segmentLengths
+        has a 2 for each segment (so is empty for a level without contours)
+        """
+        levels = np.asarray(levels, dtype=np.float32)
+        nlevels = len(levels)
+        grid = self._grid(plane.shape, nlevels)
+
+        devicePlane = cuda.to_device(plane)
+        deviceLevels = cuda.to_device(levels)
+
+        # first pass, count the segments of each level
+        cursors = cuda.to_device(np.zeros(nlevels, dtype=np.int64))
+        _marchingSquaresKernel[grid, _BLOCK](devicePlane, deviceLevels, cursors, cursors,
+                                             cuda.device_array(1, dtype=np.float32), 0)
+        counts = cursors.copy_to_host()
+
+        offsets, nsegments = _levelOffsets(counts)
+        vertices = np.empty(0, dtype=np.float32)
+
+        if nsegments > 0:
+            # second pass, write each level into its own part of the buffer
+            deviceVertices = cuda.device_array(4 * nsegments, dtype=np.float32)
+            _marchingSquaresKernel[grid, _BLOCK](devicePlane, deviceLevels, cuda.to_device(offsets),
+                                                 cuda.to_device(np.zeros(nlevels, dtype=np.int64)), deviceVertices, 1)
+            vertices = deviceVertices.copy_to_host()
+
+        return [(vertices[4 * offset:4 * (offset + count)], np.full(count, 2, dtype=np.int32))
+                for offset, count in zip(offsets, counts)]
+
+    @staticmethod
+    def _grid(shape, nlevels):
+        npoints1, npoints0 = shape
+        return (math.ceil((npoints0 - 1) / _BLOCK[0]), math.ceil((npoints1 - 1) / _BLOCK[1]), nlevels)
+
+
+_gpuContourer = None
+
+
+def getContourer():
+    """Return the GPU contourer if CCPN_GPU_CONTOURS=1 and CUDA is available, otherwise the contour cache"""
+    global _gpuContourer
+
+    if _GPU_CONTOURS and GpuContourer.isAvailable():
+        if _gpuContourer is None:
+            _gpuContourer = GpuContourer()
+        return _gpuContourer
+
+    return getContourCache()
+
+
+__all__ = [
+    'GpuContourer',
+    'getContourer',
+    'glListFromSegments',
+]
@@ -0,0 +1,165 @@
+"""
+Tiled, viewport-aware level-of-detail contouring.
+
+The plane is downsampled by a power of 2 decimation (chosen from the size of the
+viewport on the screen) and divided into square tiles of decimated points.  Only
+the tiles inside the viewport are contoured, positive levels from the maximum of
+each decimation block and negative levels from the minimum, so that peaks are
+kept at every resolution.  Tiles go through a ContourCache, so when the user zooms
+in only the tiles at the new, finer, decimation need contouring.  With a planeKey
+the tiles are cached by (planeKey, decimation, tile), and going back out again
+only puts the cached contours together, without decimating or hashing any tiles;
+without one each visible tile is decimated and hashed on every call.
+
+Usage:
+    from ccpn.c_replacement.contour_tiles import TiledContourer
+
+    # viewport is (x0, x1, y0, y1) in points of dataArray, pixels is (width, height) on the screen
+    contours = TiledContourer().contourerGLList(dataArray, posLevels, negLevels, posColour, negColour,
+                                                viewport=viewport, pixels=pixels, planeKey=planeKey)
+
+The result has the same layout as Contourer2d.contourerGLList, with the vertices
+in (full resolution) points of dataArray.
+"""
+
+import numpy as np
+
+from . import contour_compat
+from .contour_cache import ContourCache, getContourCache, glListFromChains
+
+
+DEFAULT_TILE_SIZE = 128  # decimated points along each side of a tile
+
+
+def decimationForViewport(viewport, pixels, pointsPerPixel: float = 1.0) -> int:
+    """Return the largest power of 2 decimation that still gives at least pointsPerPixel
+    decimated points for each screen pixel (along both axes)
+    """
+    x0, x1, y0, y1 = viewport
+    width, height = pixels
+
+    ratio = min(abs(x1 - x0) / max(width, 1), abs(y1 - y0) / max(height, 1)) / pointsPerPixel
+
+    decimation = 1
+    while 2 * decimation <= ratio:
+        decimation *= 2
+
+    return decimation
+
+
+class TiledContourer:
+    """Contour the visible tiles of a plane at a resolution to suit the viewport"""
+
+    def __init__(self, tileSize: int = DEFAULT_TILE_SIZE, cache: ContourCache = None):
+        if tileSize < 1:
+            raise ValueError('tileSize must be >= 1')
+
+        self.tileSize = tileSize
+        self._cache = cache if cache is not None else getContourCache()
+
+    @staticmethod
+    def isAvailable() -> bool:
+        """True if the C extension supports tiled contouring"""
+        return ContourCache.isAvailable() and hasattr(contour_compat._implementation, 'decimatePlane')
+
+    def _tileCounts(self, shape, decimation):
+        # neighbouring tiles share a row/column of decimated points, so that their contours join up
+        nrows, ncols = [(npoints + decimation - 1) // decimation for npoints in shape]
+
+        return (max(1, -(-(nrows - 1) // self.tileSize)),
+                max(1, -(-(ncols - 1) // self.tileSize)))
+
+    def visibleTiles(self, shape, decimation: int, viewport=None) -> list:
+        """Return the (tileRow, tileCol) of the tiles that overlap viewport (or all of them if None)"""
+        ntileRows, ntileCols = self._tileCounts(shape, decimation)
+
+        if viewport is None:
+            return [(tileRow, tileCol) for tileRow in range(ntileRows) for tileCol in range(ntileCols)]
+
+        x0, x1, y0, y1 = viewport
+        offset = (decimation - 1) / 2.0
+        size = self.tileSize * decimation
+
+        def _tileRange(p0, p1, ntiles):
+            p0, p1 = min(p0, p1), max(p0, p1)
+            first = int(np.floor((p0 - offset) / size))
+            last = int(np.floor((p1 - offset) / size))
+            return range(max(first, 0), min(last, ntiles - 1) + 1)
+
+        return [(tileRow, tileCol) for tileRow in _tileRange(y0, y1, ntileRows)
+                for tileCol in _tileRange(x0, x1, ntileCols)]
+
+    def tileRegion(self, shape, decimation: int, tile) -> tuple:
+        """Return (rowStart, rowEnd, colStart, colEnd), the points of the plane covered by tile"""
+        tileRow, tileCol = tile
+        size = self.tileSize * decimation
+
+        return (tileRow * size, min((tileRow + 1) * size + decimation, shape[0]),
+                tileCol * size, min((tileCol + 1) * size + decimation, shape[1]))
+
+    def contourerGLList(self, dataArray, posLevels, negLevels, posColour, negColour,
+                        viewport=None, pixels=None, decimation: int = None, numThreads: int = 1,
+                        planeKey=None) -> list:
+        """Contour the tiles of dataArray inside viewport.
+
+        decimation is chosen from viewport and pixels if not given (1 if neither is given).
+        planeKey is a key (any hashable) that changes whenever the data of dataArray does, as the
+        fingerprints of ContourCache.contourerGLList; tiles with all their levels cached are then
+        not decimated again.
+        Unlike contourerGLList an empty level does not stop the later levels, as a tile can
+        be completely above a level and still have contours at higher ones.
+        """
+        if not self.isAvailable():
+            return contour_compat.Contourer2d.contourerGLList((dataArray,), posLevels, negLevels,
+                                                              posColour, negColour, 0, numThreads)
+
+        if decimation is None:
+            decimation = decimationForViewport(viewport, pixels) if (viewport and pixels) else 1
+        if decimation < 1:
+            raise ValueError('decimation must be >= 1')
+
+        offset = (decimation - 1) / 2.0  # decimated points are at the centre of their block
+        levelChains = []
+        levelColours = []
+
+        if dataArray.size == 0:
+            return glListFromChains(levelChains, levelColours)
+
+        for tile in self.visibleTiles(dataArray.shape, decimation, viewport):
+            rowStart, rowEnd, colStart, colEnd = self.tileRegion(dataArray.shape, decimation, tile)
+            origin = np.array([colStart + offset, rowStart + offset], dtype=np.float32)
+            decimated = None  # (maxData, minData), only made if a level is not cached
+
+            for sign, (levels, colour) in enumerate(((posLevels, posColour), (negLevels, negColour))):
+                if len(levels) == 0:
+                    continue
+
+                key = (planeKey, decimation, tile, sign) if planeKey is not None else None
+                chains = self._cache.cachedLevelChains(key, levels) if key is not None else None
+
+                if chains is None:
+                    if decimated is None:
+                        decimated = contour_compat._implementation.decimatePlane(dataArray, decimation,
+                                                                                 rowStart, rowEnd, colStart, colEnd)
+                    chains = self._cache.levelChains(decimated[sign], levels, numThreads, key)
+
+                for ll, (vertices, chainLengths) in enumerate(chains):
+                    if len(chainLengths) == 0:
+                        continue
+
+                    if decimation > 1:
+                        vertices = vertices.reshape(-1, 2) * np.float32(decimation) + origin
+                    else:
+                        vertices = vertices.reshape(-1, 2) + origin
+
+                    levelChains.append((vertices.ravel(), chainLengths))
+                    levelColours.append(colour[4 * ll:4 * ll + 4])
+
+        return glListFromChains(levelChains, levelColours)
+
+
+__all__ = [
+    'TiledContourer',
+    'decimationForViewport',
+    'DEFAULT_TILE_SIZE',
+]
@@ -10,6 +10,10 @@ Usage:
     peaks = Peak.findPeaks(dataArray, haveLow, haveHigh, low, high, ...)
     results = Peak.fitParabolicPeaks(dataArray, regionArray, peakArray)
 
+    # or check the findPeaks settings once, for many data arrays
+    picker = PeakPicker(haveLow, haveHigh, low, high, ...)
+    peaks = picker.pick(dataArray)
+
 Configuration:
     You can force a specific implementation using environment variables:
 
@@ -154,10 +158,14 @@ def get_implementation_info() -> dict:
     available_funcs = []
     if hasattr(_implementation, 'findPeaks'):
         available_funcs.append('findPeaks')
+    if hasattr(_implementation, 'newPeakPicker'):
+        available_funcs.append('newPeakPicker')
     if hasattr(_implementation, 'fitParabolicPeaks'):
         available_funcs.append('fitParabolicPeaks')
     if hasattr(_implementation, 'fitPeaks'):
         available_funcs.append('fitPeaks')
+    if hasattr(_implementation, 'fitPeaksBatch'):
+        available_funcs.append('fitPeaksBatch')
 
     return {
         'implementation': _impl_name,
@@ -170,6 +178,41 @@ def get_implementation_info() -> dict:
     }
 
 
+def peakDtype(ndim: int) -> np.dtype:
+    """Return the dtype of the records of findPeaks(..., asArray=True)"""
+    return np.dtype([('position', '<i4', (ndim,)), ('height', '<f4')])
+
+
+def fitDtype(ndim: int, fraction: bool = False) -> np.dtype:
+    """Return the dtype of the records of fitPeaks/fitParabolicPeaks(..., asArray=True),
+    with fraction for fitPeaks with the pseudo-Voigt method
+    """
+    fields = [('height', '<f4'), ('position', '<f4', (ndim,)), ('linewidth', '<f4', (ndim,))]
+    if fraction:
+        fields.append(('fraction', '<f4'))
+
+    return np.dtype(fields + [('status', '<i4')])
+
+
+def _peakRecords(peaks, ndim: int) -> np.ndarray:
+    records = np.zeros(len(peaks), dtype=peakDtype(ndim))
+    for record, (position, height) in zip(records, peaks):
+        record['position'] = position
+        record['height'] = height
+
+    return records
+
+
+def _fitRecords(fits, ndim: int) -> np.ndarray:
+    records = np.zeros(len(fits), dtype=fitDtype(ndim))
+    for record, (height, position, linewidth) in zip(records, fits):
+        record['height'] = height
+        record['position'] = position
+        record['linewidth'] = linewidth
+
+    return records
+
+
 class Peak:
     """Peak finding and fitting for N-dimensional NMR data.
 
@@ -192,7 +235,9 @@ class Peak:
         minLinewidth: List[float],
         excludedRegions: Optional[List[np.ndarray]] = None,
         diagonalExclusionDims: Optional[List[np.ndarray]] = None,
-        diagonalExclusionTransform: Optional[List[np.ndarray]] = None
+        diagonalExclusionTransform: Optional[List[np.ndarray]] = None,
+        numThreads: int = 1,
+        asArray: bool = False
     ) -> List[Tuple[Tuple[int, ...], float]]:
         """Find peaks in N-dimensional data.
 
@@ -209,10 +254,14 @@ class Peak:
             excludedRegions: List of exclusion boxes (optional)
             diagonalExclusionDims: Diagonal exclusion dimensions (optional)
             diagonalExclusionTransform: Diagonal exclusion transforms (optional)
+            numThreads: Number of threads for the C extension, 1 is serial, 0 uses all cpus
+                (ignored by the Python implementation, the peaks found are the same)
+            asArray: Return a structured array (dtype peakDtype(ndim)) instead of a list
 
         Returns:
             List of (position_tuple, height) for each peak found
-            where position_tuple is (x, y, ...) integer coordinates
+            where position_tuple is (x, y, ...) integer coordinates,
+            or with asArray a structured array with fields position and height
 
         Example:
             >>> data = np.random.randn(50, 50).astype(np.float32)
@@ -235,20 +284,22 @@ class Peak:
             return _implementation.findPeaks(
                 dataArray, haveLow, haveHigh, low, high,
                 buffer, nonadjacent, dropFactor, minLinewidth,
-                excludedRegions, diagonalExclusionDims, diagonalExclusionTransform
+                excludedRegions, diagonalExclusionDims, diagonalExclusionTransform, numThreads, int(asArray)
             )
         else:
-            return _implementation.find_peaks(
+            peaks = _implementation.find_peaks(
                 dataArray, haveLow, haveHigh, low, high,
                 buffer, nonadjacent, dropFactor, minLinewidth,
                 excludedRegions, diagonalExclusionDims, diagonalExclusionTransform
             )
+            return _peakRecords(peaks, dataArray.ndim) if asArray else peaks
 
     @staticmethod
     def fitParabolicPeaks(
         dataArray: np.ndarray,
         regionArray: np.ndarray,
-        peakArray: np.ndarray
+        peakArray: np.ndarray,
+        asArray: bool = False
     ) -> List[Tuple[float, Tuple[float, ...], Tuple[float, ...]]]:
         """Fit parabolic peaks (fast, non-iterative).
 
@@ -261,6 +312,7 @@ class Peak:
             regionArray: int32 array (2 x ndim) with [[first_x, ...], [last_x, ...]]
                         defining the fitting region
             peakArray: float32 array (npeaks x ndim) with initial peak positions
+            asArray: Return a structured array (dtype fitDtype(ndim)) instead of a list
 
         Returns:
             List of (height, position_tuple, linewidth_tuple) for each peak
@@ -268,6 +320,9 @@ class Peak:
             - height: float, peak intensity
             - position_tuple: (x, y, ...) refined positions (float)
             - linewidth_tuple: (lw_x, lw_y, ...) FWHM linewidths (float)
+            or with asArray a structured array with fields height, position, linewidth and
+            status, which the C extension sets to 1 if the peak is on the edge of dataArray
+            in some dim (that dim is then left at the initial position, with linewidth 0)
 
         Example:
             >>> data = generate_gaussian_peak((30, 30), (15, 15), 100.0, (2.5, 2.5))
@@ -279,21 +334,23 @@ class Peak:
         """
         if _using_c:
             return _implementation.fitParabolicPeaks(
-                dataArray, regionArray, peakArray
+                dataArray, regionArray, peakArray, int(asArray)
             )
         else:
-            return _implementation.fit_parabolic_peaks(
+            fits = _implementation.fit_parabolic_peaks(
                 dataArray, regionArray, peakArray
             )
+            return _fitRecords(fits, dataArray.ndim) if asArray else fits
 
     @staticmethod
     def fitPeaks(
         dataArray: np.ndarray,
         regionArray: np.ndarray,
         peakArray: np.ndarray,
-        method: int
+        method: int,
+        asArray: bool = False
     ) -> List[Tuple[float, Tuple[float, ...], Tuple[float, ...]]]:
-        """Fit Gaussian or Lorentzian peaks using Levenberg-Marquardt.
+        """Fit Gaussian, Lorentzian or pseudo-Voigt peaks using Levenberg-Marquardt.
 
         This is the most accurate fitting method but also the slowest.
         Uses iterative nonlinear least-squares fitting.
@@ -302,10 +359,17 @@ class Peak:
             dataArray: N-dimensional float32 array
             regionArray: int32 array (2 x ndim) defining fitting region
             peakArray: float32 array (npeaks x ndim) with initial positions
-            method: 0 for Gaussian, 1 for Lorentzian
+            method: 0 for Gaussian, 1 for Lorentzian, 2 for pseudo-Voigt (a fraction of
+                Lorentzian, the rest Gaussian with the same linewidth, as lmfit's PseudoVoigtModel,
+                the fraction is fitted for each peak from 0 to 1), the index into the C
+                extension's Peak.lineshapes
+            asArray: Return a structured array (dtype fitDtype(ndim, method == 2)) instead of a list
 
         Returns:
-            List of (height, position_tuple, linewidth_tuple) for each peak
+            List of (height, position_tuple, linewidth_tuple) for each peak,
+            or with asArray a structured array with fields height, position, linewidth,
+            fraction (pseudo-Voigt only) and status; a fit that fails then gives status 1
+            (and NaN values) rather than raising
 
         Note:
             Phase 3 (Levenberg-Marquardt fitting) is not yet implemented
@@ -321,7 +385,7 @@ class Peak:
         """
         if _using_c:
             return _implementation.fitPeaks(
-                dataArray, regionArray, peakArray, method
+                dataArray, regionArray, peakArray, method, int(asArray)
             )
         else:
             # Pure Python implementation - Phase 3 not yet complete
@@ -332,6 +396,107 @@ class Peak:
                 "Phase 3 implementation is planned for future release."
             )
 
+    @staticmethod
+    def fitPeaksBatch(
+        dataArray: np.ndarray,
+        regionArrays: np.ndarray,
+        peakArray: np.ndarray,
+        peakCounts: np.ndarray,
+        method: int,
+        numThreads: int = 1,
+        doublePrecision: bool = False
+    ) -> np.ndarray:
+        """Fit groups of Gaussian, Lorentzian or pseudo-Voigt peaks in one call.
+
+        Args:
+            dataArray: N-dimensional float32 array
+            regionArrays: int32 array (ngroups x 2 x ndim), the fitting region of each group
+            peakArray: float32 array (npeaks x ndim), the peaks of all the groups, a group at a time
+            peakCounts: int32 array (ngroups), the number of peaks in each group
+            method: as for fitPeaks
+            numThreads: Number of threads for the C extension, 1 is serial, 0 uses all cpus
+            doublePrecision: Do the sums over the region samples in double rather than float
+                (C extension only, more accurate for large regions)
+
+        Returns:
+            Structured array (dtype fitDtype(ndim, method == 2)) of the fits, as fitPeaks with
+            asArray, where the status of each peak is that of its group: 0 if the group was fitted,
+            1 if the fit failed and 2 if the region is empty or not inside dataArray (the fits of
+            the group are then NaN)
+        """
+        if _using_c and hasattr(_implementation, 'fitPeaksBatch'):
+            return _implementation.fitPeaksBatch(
+                dataArray, regionArrays, peakArray, peakCounts, method, numThreads, int(doublePrecision)
+            )
+
+        # a group at a time, through fitPeaks
+        ndim = dataArray.ndim
+        fitArray = np.zeros(len(peakArray), dtype=fitDtype(ndim, method == 2))
+        shape = np.array(dataArray.shape[::-1])
+
+        start = 0
+        for regionArray, count in zip(regionArrays, peakCounts):
+            end = start + count
+            if np.any(regionArray[0] < 0) or np.any(regionArray[0] >= regionArray[1]) or np.any(regionArray[1] > shape):
+                for field in fitArray.dtype.names[:-1]:
+                    fitArray[field][start:end] = np.nan
+                fitArray['status'][start:end] = 2
+            elif count > 0:
+                # a failed fit has status 1 and NaN fits
+                fitArray[start:end] = Peak.fitPeaks(dataArray, regionArray, peakArray[start:end], method, asArray=True)
+            start = end
+
+        return fitArray
+
+
+class PeakPicker:
+    """The findPeaks arguments other than the data, checked once, to pick many data arrays with.
+
+    With the C extension the settings are checked and read into a native picker by
+    Peak.newPeakPicker, so that pick (Peak.peakPickerPick) only checks the data array,
+    otherwise pick is findPeaks with the same settings.  The excluded regions and
+    diagonals are in points of the data arrays picked, so a picker is only for data
+    arrays starting at the same point.
+
+    Example:
+        >>> picker = PeakPicker(False, True, 0.0, 2.0, [3, 3], True, 0.5, [2.0, 2.0])
+        >>> peaks = [picker.pick(plane, asArray=True) for plane in planes]
+    """
+
+    def __init__(
+        self,
+        haveLow: bool,
+        haveHigh: bool,
+        low: float,
+        high: float,
+        buffer: List[int],
+        nonadjacent: bool,
+        dropFactor: float,
+        minLinewidth: List[float],
+        excludedRegions: Optional[List[np.ndarray]] = None,
+        diagonalExclusionDims: Optional[List[np.ndarray]] = None,
+        diagonalExclusionTransform: Optional[List[np.ndarray]] = None
+    ):
+        """Arguments as for Peak.findPeaks, the data arrays picked have len(buffer) dims"""
+        self.ndim = len(buffer)
+        self._settings = (haveLow, haveHigh, low, high, list(buffer), nonadjacent, dropFactor, list(minLinewidth),
+                          list(excludedRegions or []), list(diagonalExclusionDims or []),
+                          list(diagonalExclusionTransform or []))
+
+        # the implementation is kept, as the native picker is only for the C extension
+        self._implementation = _implementation
+        if _using_c and hasattr(_implementation, 'newPeakPicker'):
+            self._picker = _implementation.newPeakPicker(*self._settings)
+        else:
+            self._picker = None
+
+    def pick(self, dataArray: np.ndarray, numThreads: int = 1, asArray: bool = False):
+        """Return the peaks of dataArray, as Peak.findPeaks(dataArray, <settings>, numThreads, asArray)"""
+        if self._picker is not None:
+            return self._implementation.peakPickerPick(self._picker, dataArray, numThreads, int(asArray))
+
+        return Peak.findPeaks(dataArray, *self._settings, numThreads=numThreads, asArray=asArray)
+
 
 # Module-level convenience functions (alternative to class interface)
 
@@ -353,6 +518,7 @@ def fit_peaks(*args, **kwargs) -> List[Tuple[float, Tuple[float, ...], Tuple[flo
 # Export public API
 __all__ = [
     'Peak',
+    'PeakPicker',
     'find_peaks',
     'fit_parabolic_peaks',
     'fit_peaks',
@@ -360,6 +526,8 @@ __all__ = [
     'get_available_implementations',
     'use_python_implementation',
     'use_c_implementation',
+    'peakDtype',
+    'fitDtype',
 ]
 
 
@@ -0,0 +1,385 @@
+"""
+Streaming (out-of-core) peak finding over the blocks of a large spectrum.
+
+findPeaks needs the whole nD array in memory.  Here the data are read a tile at a
+time, each with a halo of extra points around it, from anything that can be sliced
+like a numpy array (an np.memmap, or an h5py dataset such as the spectrumData of the
+.hdf5 files written by bin/pipe2hdf5), from a SpectrumDataSource (so any format it
+can read, NmrPipe included) or from a function that reads a block.  The memory used
+grows with the size of a tile rather than the size of the spectrum, and the next
+tile is read (on another thread) while the current one is searched.
+
+Usage:
+    from ccpn.c_replacement.peak_stream import StreamingPeakFinder
+
+    # tileShape and halo are in the order of the data array (z, y, x)
+    finder = StreamingPeakFinder(tileShape=(4, None, None, None), halo=8)
+    for peaks in finder.iterPeaks(dataset, haveLow, haveHigh, low, high, buffer,
+                                  nonadjacent, dropFactor, minLinewidth):
+        ...  # structured array with fields position and height, as findPeaks(..., asArray=True)
+
+Each tile is searched by findPeaks without the buffer, and only the peaks in the tile
+itself (not its halo) are kept.  The buffer is then applied in order of the point
+index, as findPeaks does, so the peaks are the same (and in the same order) as
+findPeaks on the whole array.
+
+With a dropFactor or minLinewidth, findPeaks walks out from each peak along each axis
+until the values rise again (or have dropped far enough, or below half the height).
+The candidates whose walk gets to the edge of the tile and its halo (but not the edge
+of the data) are checked again, on a block read out far enough for every walk to stop
+inside it, so a small halo only costs the extra reads.
+"""
+
+import itertools
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+from . import peak_compat
+from .peak_compat import Peak, PeakPicker, peakDtype
+
+
+DEFAULT_TILE_BYTES = 64 * 1024 * 1024  # the default tile is a slab along the first axis of about this size
+DEFAULT_HALO = 8
+
+
+def _walkLength(line, centre, findMaximum, checkDrop, dropV, checkHalf, dirn):
+    """Return how many points the drop and half-height walk of findPeaks (walk_in_direction in
+    npy_peak.c) reads from line[centre] in direction dirn, or None if it gets to the end of line
+    without knowing both
+    """
+    v = line[centre]
+    vHalf = np.float32(0.5) * v
+    vPrev = v
+    ii = centre + dirn
+    while 0 <= ii < len(line) and (checkDrop or checkHalf):
+        vThis = line[ii]
+        if checkDrop:
+            if (vThis > vPrev) if findMaximum else (vThis < vPrev):
+                return abs(ii - centre)
+
+            if ((v - vThis) if findMaximum else (vThis - v)) >= dropV:
+                checkDrop = False
+
+        if checkHalf and ((vThis < vHalf) if findMaximum else (vThis > vHalf)):
+            checkHalf = False
+
+        vPrev = vThis
+        ii += dirn
+
+    if checkDrop or checkHalf:
+        return None
+
+    return abs(ii - dirn - centre)
+
+
+def blockReader(source, shape=None):
+    """Return (shape, read) for source, where read(starts, stops) returns the float32 block
+    of the points from starts up to (not including) stops, all in the order of the data array.
+
+    source is a SpectrumDataSource, something that can be sliced like a numpy array, or a
+    function read(starts, stops), in which case shape (of the whole data array) must be given.
+    Each block read is a new array, so that a memory-mapped file is read when the block is.
+    """
+    if hasattr(source, 'getRegionData') and hasattr(source, 'pointCounts'):
+        def read(starts, stops):
+            # sliceTuples are x first, 1-based and inclusive
+            sliceTuples = [(int(start) + 1, int(stop)) for start, stop in zip(starts[::-1], stops[::-1])]
+            return np.array(source.getRegionData(sliceTuples), dtype=np.float32)
+
+        return tuple(source.pointCounts[::-1]), read
+
+    if callable(source):
+        if shape is None:
+            raise ValueError('shape must be given to read blocks with a function')
+
+        return tuple(shape), lambda starts, stops: np.array(source(starts, stops), dtype=np.float32)
+
+    def read(starts, stops):
+        return np.array(source[tuple(slice(start, stop) for start, stop in zip(starts, stops))], dtype=np.float32)
+
+    return tuple(source.shape), read
+
+
+class _BufferGrid:
+    """The peaks found so far, in cells of the buffer size, to check new peaks against"""
+
+    def __init__(self, buffer):
+        self.buffer = np.asarray(buffer, dtype=np.int64)
+        self.cellSize = self.buffer + 1
+        self.cells = {}
+        self.neighbours = list(itertools.product((-1, 0, 1), repeat=len(self.buffer)))
+
+    def isNear(self, position) -> bool:
+        cell = position // self.cellSize
+        for neighbour in self.neighbours:
+            for peak in self.cells.get(tuple(cell + neighbour), ()):
+                if np.all(np.abs(position - peak) <= self.buffer):
+                    return True
+
+        return False
+
+    def add(self, position):
+        self.cells.setdefault(tuple(position // self.cellSize), []).append(position)
+
+    def prune(self, lastStart):
+        """Remove the peaks that can not be near any point with last coordinate at least lastStart"""
+        lastCell = (lastStart - self.buffer[-1]) // self.cellSize[-1]
+        self.cells = {cell: peaks for cell, peaks in self.cells.items() if cell[-1] >= lastCell}
+
+
+class _SerialExecutor:
+    """Reads each tile when it is asked for, in place of the prefetching ThreadPoolExecutor"""
+
+    class _Done:
+        def __init__(self, value):
+            self._value = value
+
+        def result(self):
+            return self._value
+
+    def submit(self, func, *args):
+        return self._Done(func(*args))
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        return False
+
+
+class StreamingPeakFinder:
+    """Find the peaks of a large spectrum a tile at a time"""
+
+    def __init__(self, tileShape=None, halo=DEFAULT_HALO, prefetch: bool = True, maxTileBytes: int = DEFAULT_TILE_BYTES):
+        """tileShape is the number of points of a tile along each axis of the data array (None for
+        the whole axis), if not given a tile is a slab along the first axis of about maxTileBytes.
+        halo is the number of extra points read on each side of a tile (one value or one for each axis),
+        with prefetch the next tile is read while the current one is searched.  With a dropFactor or
+        minLinewidth a halo at least as long as most of the walks saves checking the peaks again.
+        """
+        self.tileShape = tileShape
+        self.halo = halo
+        self.prefetch = prefetch
+        self.maxTileBytes = maxTileBytes
+        self.nrechecked = 0  # candidates checked again on a larger block, as their walks left the tile and halo
+
+    def tiles(self, shape) -> list:
+        """Return (starts, stops) of the tiles of a data array of shape, in the order they are searched"""
+        ndim = len(shape)
+        if self.tileShape is None:
+            planeBytes = 4 * int(np.prod(shape[1:], dtype=np.int64))
+            tileShape = (max(1, self.maxTileBytes // max(planeBytes, 1)),) + tuple(shape[1:])
+        else:
+            if len(self.tileShape) != ndim:
+                raise ValueError(f'tileShape must have {ndim} values')
+            tileShape = tuple(npoints if size is None else size for size, npoints in zip(self.tileShape, shape))
+
+        if any(size < 1 for size in tileShape):
+            raise ValueError('tileShape must be >= 1')
+
+        ranges = [[(start, min(start + size, npoints)) for start in range(0, npoints, size)]
+                  for size, npoints in zip(tileShape, shape)]
+
+        return [tuple(zip(*tile)) for tile in itertools.product(*ranges)]
+
+    def _haloShape(self, ndim) -> np.ndarray:
+        halo = np.broadcast_to(np.asarray(self.halo, dtype=np.int64), (ndim,))
+        if np.any(halo < 1):
+            raise ValueError('halo must be >= 1')
+
+        return halo
+
+    def iterPeaks(self, source, haveLow, haveHigh, low, high, buffer, nonadjacent, dropFactor, minLinewidth,
+                  excludedRegions=None, diagonalExclusionDims=None, diagonalExclusionTransform=None,
+                  numThreads: int = 1, shape=None):
+        """Yield the peaks a slab of tiles (along the first axis) at a time, as structured arrays with
+        the fields of findPeaks(..., asArray=True), positions are in points of the whole data array.
+
+        The arguments after source are as for findPeaks, shape is only needed if source is a function.
+        """
+        shape, read = blockReader(source, shape)
+        ndim = len(shape)
+        halo = self._haloShape(ndim)
+        shapeArray = np.array(shape, dtype=np.int64)
+        excludedRegions = excludedRegions or []
+        diagonalExclusionDims = diagonalExclusionDims or []
+        diagonalExclusionTransform = diagonalExclusionTransform or []
+
+        # point index of a position (x first), to order the peaks as findPeaks does
+        cumPoints = np.cumprod((1,) + tuple(shape[::-1][:-1]), dtype=np.int64)
+        grid = _BufferGrid(buffer) if np.any(np.asarray(buffer) > 0) else None
+
+        # minLinewidth is x first, the walks are along the axes of the data array
+        axisLinewidths = [float(linewidth) for linewidth in minLinewidth][::-1]
+        checkDrop = dropFactor > 0
+        checkWalks = checkDrop or any(linewidth > 0 for linewidth in axisLinewidths)
+        # a peak that only fails the linewidth check in a tile may pass it on a longer walk
+        walkLinewidth = [0.0] * ndim if any(linewidth > 0 for linewidth in axisLinewidths) else minLinewidth
+
+        # the exclusions move with the tile, otherwise the settings are the same for every tile
+        if excludedRegions or diagonalExclusionDims:
+            pickers = None
+        else:
+            linewidths = (minLinewidth,) if walkLinewidth is minLinewidth else (minLinewidth, walkLinewidth)
+            pickers = [PeakPicker(haveLow, haveHigh, low, high, [0] * ndim, nonadjacent, dropFactor, linewidth)
+                       for linewidth in linewidths]
+
+        def readTile(tile):
+            starts, stops = tile
+            readStarts = np.maximum(np.array(starts) - halo, 0)
+            readStops = np.minimum(np.array(stops) + halo, shapeArray)
+            return readStarts, read(readStarts, readStops)
+
+        def tilePeaks(tile, readStarts, data):
+            # findPeaks positions and exclusions are x first
+            offset = readStarts[::-1].astype(np.int32)
+            regions = [np.asarray(region, dtype=np.float32) - offset.astype(np.float32) for region in excludedRegions]
+            transforms = []
+            for dims, transform in zip(diagonalExclusionDims, diagonalExclusionTransform):
+                transform = np.array(transform, dtype=np.float32)
+                transform[2] += transform[0] * offset[dims[0]] - transform[1] * offset[dims[1]]
+                transforms.append(transform)
+
+            def pick(linewidth, ii):
+                if pickers is not None:
+                    peaks = pickers[ii].pick(data, numThreads=numThreads, asArray=True)
+                else:
+                    peaks = Peak.findPeaks(data, haveLow, haveHigh, low, high, [0] * ndim, nonadjacent, dropFactor,
+                                           linewidth, regions, list(diagonalExclusionDims), transforms,
+                                           numThreads=numThreads, asArray=True)
+                peaks['position'] += offset
+
+                starts, stops = tile
+                inTile = np.all((peaks['position'] >= starts[::-1]) & (peaks['position'] < stops[::-1]), axis=1)
+                return peaks[inTile]
+
+            peaks = pick(minLinewidth, 0)
+            if not checkWalks:
+                return peaks
+
+            # the candidates are the peaks without the linewidth check (if any), those with all their
+            # walks inside the data read are right as they are, the others are checked again
+            candidates = pick(walkLinewidth, 1) if walkLinewidth is not minLinewidth else peaks
+            found = {tuple(position) for position in peaks['position'].tolist()}
+            keep = np.zeros(len(candidates), dtype=bool)
+            for ii, candidate in enumerate(candidates):
+                box = walkBox(candidate, readStarts, data)
+                if box is None:
+                    keep[ii] = tuple(candidate['position'].tolist()) in found
+                else:
+                    keep[ii] = recheck(candidate, *box)
+
+            return candidates[keep]
+
+        def walkBox(candidate, readStarts, data):
+            """Return (starts, stops) of a block that every walk of candidate stops inside, or None
+            if they all stop inside data (read from readStarts)
+            """
+            point = candidate['position'][::-1].astype(np.int64)
+            local = point - readStarts
+            value = data[tuple(local)]
+            findMaximum = bool(haveHigh and value >= high)
+            dropV = np.float32(dropFactor) * np.abs(value)
+
+            boxStarts = np.maximum(point - 1, 0)
+            boxStops = np.minimum(point + 2, shapeArray)
+            outside = False
+            for axis in range(ndim):
+                checkHalf = axisLinewidths[axis] > 0
+                if not (checkDrop or checkHalf):
+                    continue
+
+                index = tuple(local[:axis]) + (slice(None),) + tuple(local[axis + 1:])
+                line, lineStart = data[index], readStarts[axis]
+                for dirn in (1, -1):
+                    length = _walkLength(line, point[axis] - lineStart, findMaximum, checkDrop, dropV, checkHalf, dirn)
+                    extent = len(line)
+                    while length is None and ((lineStart + len(line) < shape[axis]) if dirn == 1 else (lineStart > 0)):
+                        # read a line twice as far out, through the point
+                        outside = True
+                        extent *= 2
+                        starts, stops = point.copy(), point + 1
+                        starts[axis] = max(point[axis] - extent, 0)
+                        stops[axis] = min(point[axis] + extent + 1, shape[axis])
+                        line, lineStart = read(starts, stops).reshape(-1), starts[axis]
+                        length = _walkLength(line, point[axis] - lineStart, findMaximum, checkDrop, dropV,
+                                             checkHalf, dirn)
+
+                    if length is None:
+                        # the walk stops at the edge of the data
+                        length = (shape[axis] - 1 - point[axis]) if dirn == 1 else point[axis]
+
+                    if dirn == 1:
+                        boxStops[axis] = max(boxStops[axis], min(point[axis] + length + 1, shape[axis]))
+                    else:
+                        boxStarts[axis] = min(boxStarts[axis], max(point[axis] - length, 0))
+
+            return (boxStarts, boxStops) if outside else None
+
+        def recheck(candidate, boxStarts, boxStops):
+            """True if candidate is a peak of findPeaks on the block from boxStarts to boxStops"""
+            peaks = Peak.findPeaks(read(boxStarts, boxStops), haveLow, haveHigh, low, high, [0] * ndim, nonadjacent,
+                                   dropFactor, minLinewidth, [], [], [], asArray=True)
+            self.nrechecked += 1
+
+            position = candidate['position'] - boxStarts[::-1]
+            return bool(np.any(np.all(peaks['position'] == position, axis=1)))
+
+        def slabPeaks(candidates):
+            peaks = np.concatenate(candidates) if candidates else np.zeros(0, dtype=peakDtype(ndim))
+            peaks = peaks[np.argsort(peaks['position'].astype(np.int64) @ cumPoints, kind='stable')]
+            if grid is None:
+                return peaks
+
+            keep = np.zeros(len(peaks), dtype=bool)
+            for ii, position in enumerate(peaks['position'].astype(np.int64)):
+                if not grid.isNear(position):
+                    grid.add(position)
+                    keep[ii] = True
+
+            return peaks[keep]
+
+        tiles = self.tiles(shape)
+        with ThreadPoolExecutor(max_workers=1) if self.prefetch else _SerialExecutor() as executor:
+            pending = executor.submit(readTile, tiles[0]) if tiles else None
+            candidates = []
+            for ii, tile in enumerate(tiles):
+                readStarts, data = pending.result()
+                if ii + 1 < len(tiles):
+                    pending = executor.submit(readTile, tiles[ii + 1])
+
+                candidates.append(tilePeaks(tile, readStarts, data))
+                del data
+
+                # the peaks of a slab all have a lower point index than those of the next one
+                if ii + 1 == len(tiles) or tiles[ii + 1][0][0] != tile[0][0]:
+                    peaks = slabPeaks(candidates)
+                    candidates = []
+                    if grid is not None and ii + 1 < len(tiles):
+                        grid.prune(tiles[ii + 1][0][0])
+                    if len(peaks):
+                        yield peaks
+
+    def findPeaks(self, source, *args, **kwds) -> np.ndarray:
+        """Return all the peaks of iterPeaks (same arguments) in one structured array"""
+        peaks = list(self.iterPeaks(source, *args, **kwds))
+        if peaks:
+            return np.concatenate(peaks)
+
+        ndim = len(blockReader(source, kwds.get('shape'))[0])
+        return np.zeros(0, dtype=peakDtype(ndim))
+
+
+def isAvailable() -> bool:
+    """True if findPeaks is from the C extension (the tiles then give exactly the peaks of the whole array)"""
+    return peak_compat._using_c
+
+
+__all__ = [
+    'StreamingPeakFinder',
+    'blockReader',
+    'isAvailable',
+    'DEFAULT_HALO',
+    'DEFAULT_TILE_BYTES',
+]
@@ -0,0 +1 @@
+"""Shared test data and helpers for the C replacement tests."""
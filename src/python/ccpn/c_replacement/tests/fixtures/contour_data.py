@@ -0,0 +1,60 @@
+"""Test data generators and checks for the contouring tests.
+
+Planes are (rows, columns) float32 arrays, as passed to contourerGLList, and
+the contour lists have the contourerGLList layout
+[numIndices, numVertices, indices, vertices, colours].
+"""
+
+import numpy as np
+from typing import Sequence, Tuple
+
+
+def gaussianPlane(
+    shape: Tuple[int, int],
+    peaks: Sequence[Tuple[float, float, float, float]],
+    noise: float = 0.0,
+    seed: int = None
+) -> np.ndarray:
+    """Generate a plane with a Gaussian for each peak.
+
+    Args:
+        shape: (rows, columns) of the plane
+        peaks: (x, y, height, width) of each peak, height * exp(-((X - x)^2 + (Y - y)^2) / width),
+            height is negative for a negative peak
+        noise: Standard deviation of the Gaussian noise added (none if 0)
+        seed: Seed for np.random, set before the noise is drawn
+
+    Returns:
+        float32 array of shape
+    """
+    if seed is not None:
+        np.random.seed(seed)
+
+    Y, X = np.mgrid[0:shape[0], 0:shape[1]]
+    data = sum(height * np.exp(-((X - x)**2 + (Y - y)**2) / width) for x, y, height, width in peaks)
+    if noise:
+        data = data + np.random.normal(0, noise, X.shape)
+
+    return data.astype(np.float32)
+
+
+def contourLevels(values, colour=(1, 0, 0, 1)) -> Tuple[np.ndarray, np.ndarray]:
+    """Return the float32 levels and their RGBA colours (all colour), as for contourerGLList"""
+    return np.array(values, dtype=np.float32), np.array(list(colour) * len(values), dtype=np.float32)
+
+
+def allNear(points, reference, tol=1e-3) -> bool:
+    """True if every (x, y) of points is within tol of one of the reference points"""
+    reference = reference[np.argsort(reference[:, 0])]
+    lows = np.searchsorted(reference[:, 0], points[:, 0] - tol)
+    highs = np.searchsorted(reference[:, 0], points[:, 0] + tol, side='right')
+
+    return all(np.any(np.abs(reference[low:high, 1] - y) <= tol) for (x, y), low, high in zip(points, lows, highs))
+
+
+def assertSameGLList(result, expected):
+    """Assert that two contour lists are the same, down to the dtypes of the arrays"""
+    assert result[:2] == expected[:2]
+    for array, expectedArray in zip(result[2:], expected[2:]):
+        assert array.dtype == expectedArray.dtype
+        np.testing.assert_array_equal(array, expectedArray)
@@ -13,6 +13,7 @@ Purpose:
 When these tests pass with Python implementation, we know it's correct!
 """
 
+import os
 import pytest
 import numpy as np
 from operator import itemgetter
@@ -129,6 +130,193 @@ class TestPeakFindingBaseline:
             'data': data
         }
 
+    def test_dense_peaks_respect_buffer(self):
+        """Test that no two peaks are found within buffer of each other in dense 3D data"""
+        np.random.seed(2)
+        data = np.random.normal(0, 1, (20, 30, 40)).astype(np.float32)
+        buffer = [3, 1, 2]
+
+        peaks = Peak.findPeaks(data, 1, 1, -1.0, 1.0, buffer, 0, 0.0, [0.0, 0.0, 0.0], [], [], [])
+        assert len(peaks) > 100
+
+        positions = np.array([position for position, _ in peaks])
+        assert all(isinstance(p, int) for p in peaks[0][0]) and isinstance(peaks[0][1], float)
+        for i in range(1, len(positions)):
+            within = np.all(np.abs(positions[:i] - positions[i]) <= buffer, axis=1)
+            assert not within.any(), f"peak {i} at {positions[i]} is within buffer of an earlier peak"
+
+    def test_threaded_find_peaks_matches_serial(self):
+        """Test that searching blocks of rows on several threads finds exactly the serial peaks"""
+        np.random.seed(6)
+        data = np.random.normal(0, 1, (10, 40, 50)).astype(np.float32)
+        region = np.array([[5.0, 5.0, 2.0], [20.0, 30.0, 6.0]], dtype=np.float32)
+
+        for buffer, nonadjacent in (([1, 1, 1], 0), ([2, 0, 3], 1)):
+            args = (data, 1, 1, -1.0, 1.0, buffer, nonadjacent, 0.1, [0.0, 0.0, 0.0], [region], [], [])
+            serial = Peak.findPeaks(*args)
+            assert len(serial) > 0
+            for numThreads in (0, 2, 5):
+                assert Peak.findPeaks(*args, numThreads) == serial
+
+        with pytest.raises(Exception):
+            Peak.findPeaks(data, 1, 1, -1.0, 1.0, [1, 1, 1], 0, 0.0, [0.0, 0.0, 0.0], [], [], [], -1)
+
+    def test_strided_data_matches_contiguous(self):
+        """Test that a strided view finds the same peaks as a contiguous copy of it"""
+        np.random.seed(8)
+        data = np.random.normal(0, 1, (6, 7, 8, 18)).astype(np.float32)[:, 1:, :, ::2]
+        assert not data.flags['C_CONTIGUOUS']
+
+        for nonadjacent in (0, 1):
+            args = (1, 1, -1.0, 1.0, [1, 1, 1, 1], nonadjacent, 0.1, [1.0, 0.0, 1.0, 0.0], [], [], [])
+            peaks = Peak.findPeaks(data, *args)
+            assert len(peaks) > 0
+            assert Peak.findPeaks(np.ascontiguousarray(data), *args) == peaks
+
+    def test_excluded_regions_and_diagonals(self):
+        """Test that no peaks are found in excluded regions or near excluded diagonals"""
+        np.random.seed(4)
+        data = np.random.normal(0, 1, (12, 50, 60)).astype(np.float32)
+        args = (1, 1, -1.0, 1.0, [1, 1, 1], 0, 0.0, [0.0, 0.0, 0.0])
+
+        # region is (low, high) for dims (x, y, z), diagonal is |x - y| < 3
+        region = np.array([[10.5, 5.0, 2.0], [30.0, 20.0, 8.0]], dtype=np.float32)
+        diagonalDims = np.array([0, 1], dtype=np.int32)
+        diagonalTransform = np.array([1.0, 1.0, 0.0, 3.0], dtype=np.float32)
+
+        allPeaks = Peak.findPeaks(data, *args, [], [], [])
+        peaks = Peak.findPeaks(data, *args, [region], [diagonalDims], [diagonalTransform])
+
+        def excluded(position):
+            inRegion = all(region[0, k] <= position[k] <= region[1, k] for k in range(3))
+            return inRegion or abs(position[0] - position[1]) < 3
+
+        assert peaks and any(excluded(position) for position, _ in allPeaks)
+        assert not any(excluded(position) for position, _ in peaks)
+
+        with pytest.raises(Exception):
+            Peak.findPeaks(data, *args, [], [np.array([0, 3], dtype=np.int32)], [diagonalTransform])
+
+    def test_peak_picker_matches_find_peaks(self):
+        """Test that a picker from newPeakPicker finds the findPeaks peaks, with its settings only checked once"""
+        np.random.seed(14)
+        region = np.array([[10.5, 5.0, 2.0], [30.0, 20.0, 8.0]], dtype=np.float32)
+        diagonalDims = np.array([0, 1], dtype=np.int32)
+        diagonalTransform = np.array([1.0, 1.0, 0.0, 3.0], dtype=np.float32)
+        settings = (1, 1, -1.0, 1.0, [1, 2, 1], 1, 0.1, [0.5, 0.0, 0.0], [region], [diagonalDims], [diagonalTransform])
+
+        picker = Peak.newPeakPicker(*settings)
+        for _ in range(3):
+            data = np.random.normal(0, 1, (12, 50, 60)).astype(np.float32)
+            peaks = Peak.findPeaks(data, *settings)
+            assert len(peaks) > 0
+            assert Peak.peakPickerPick(picker, data) == peaks
+            assert Peak.peakPickerPick(picker, data, 3) == peaks
+            records = Peak.peakPickerPick(picker, data, 1, 1)
+            assert [tuple(position) for position in records['position'].tolist()] == [position for position, _ in peaks]
+
+        with pytest.raises(Exception):
+            Peak.peakPickerPick(picker, np.zeros((50, 60), dtype=np.float32))
+        with pytest.raises(Exception):
+            Peak.peakPickerPick(picker, np.zeros((12, 50, 60)))
+        with pytest.raises(Exception):
+            Peak.newPeakPicker(1, 1, -1.0, 1.0, [1, 1], 0, 0.0, [0.0, 0.0], [region], [], [])
+        with pytest.raises(Exception):
+            Peak.newPeakPicker(1, 1, -1.0, 1.0, [1, 1, 1], 0, 0.0, [0.0, 0.0, 0.0], [],
+                               [np.array([0, 3], dtype=np.int32)], [diagonalTransform])
+
+    def test_find_peaks_stats(self):
+        """Test that getStats accounts for every point beyond the thresholds, on any number of threads"""
+        np.random.seed(12)
+        data = np.random.normal(0, 1, (40, 50)).astype(np.float32)
+        region = np.array([[10.0, 5.0], [20.0, 30.0]], dtype=np.float32)
+        args = (data, 1, 1, -1.0, 1.0, [2, 2], 1, 0.2, [0.5, 0.5], [region], [], [])
+
+        try:
+            Peak.setStatsEnabled(True)
+            results = []
+            for numThreads in (1, 3):
+                Peak.resetStats()
+                peaks = Peak.findPeaks(*args, numThreads)
+                stats = Peak.getStats()
+                results.append({key: value for key, value in stats.items() if not key.endswith('Seconds')})
+
+                assert stats['findCalls'] == 1 and stats['points'] == data.size and stats['peaks'] == len(peaks)
+                assert stats['excluded'] == 11 * 26
+                assert stats['threshold'] == (stats['rejectedExtreme'] + stats['rejectedDrop'] +
+                                              stats['rejectedLinewidth'] + stats['candidates'])
+                assert stats['candidates'] == stats['peaks'] + stats['rejectedBuffer']
+            assert results[0] == results[1]
+
+            Peak.setStatsEnabled(False)
+            Peak.resetStats()
+            Peak.findPeaks(*args)
+            assert Peak.getStats()['findCalls'] == 0
+        finally:
+            Peak.setStatsEnabled(False)
+            Peak.resetStats()
+
+    def test_drop_and_linewidth_checks_only_remove_peaks(self):
+        """Test that the drop and linewidth checks only remove peaks, and a nonadjacent search only removes more"""
+        np.random.seed(23)
+        data = np.random.normal(0, 1, (30, 40)).astype(np.float32)
+
+        def findPeaks(nonadjacent, dropFactor, minLinewidth):
+            peaks = Peak.findPeaks(data, 1, 1, -1.0, 1.0, [0, 0], nonadjacent, dropFactor, minLinewidth, [], [], [])
+            return {tuple(position) for position, _ in peaks}
+
+        for nonadjacent in (0, 1):
+            allPeaks = findPeaks(nonadjacent, 0.0, [0.0, 0.0])
+            dropPeaks = findPeaks(nonadjacent, 0.3, [0.0, 0.0])
+            linewidthPeaks = findPeaks(nonadjacent, 0.0, [1.5, 1.0])
+            bothPeaks = findPeaks(nonadjacent, 0.3, [1.5, 1.0])
+
+            assert dropPeaks < allPeaks and linewidthPeaks < allPeaks
+            assert bothPeaks == dropPeaks & linewidthPeaks
+
+        assert findPeaks(1, 0.3, [1.5, 1.0]) <= findPeaks(0, 0.3, [1.5, 1.0])
+
+    def test_find_peaks_for_each_ndim(self):
+        """Test the searches specialised for 1 to 4 dims, and the general one for 5, against numpy"""
+        from itertools import product
+
+        np.random.seed(24)
+        for shape in ((50,), (12, 15), (6, 7, 8), (4, 5, 6, 7), (3, 4, 4, 5, 6)):
+            data = np.random.normal(0, 1, shape).astype(np.float32)
+            ndim = data.ndim
+            padded = np.pad(data, 1, constant_values=-np.inf)
+            centre = (slice(1, -1),) * ndim
+
+            for nonadjacent in (0, 1):
+                isPeak = data >= 1.0
+                for offset in product((-1, 0, 1), repeat=ndim):
+                    if not any(offset) or (not nonadjacent and sum(map(abs, offset)) != 1):
+                        continue
+                    shifted = tuple(slice(1 + k, padded.shape[i] - 1 + k) for i, k in enumerate(offset))
+                    isPeak &= padded[shifted] <= padded[centre]
+                if nonadjacent:  # border points are never nonadjacent peaks
+                    border = np.ones(shape, dtype=bool)
+                    border[tuple(slice(1, -1) for _ in range(ndim))] = False
+                    isPeak &= ~border
+
+                expected = {tuple(reversed(index)) for index in zip(*np.nonzero(isPeak))}
+                peaks = Peak.findPeaks(data, 0, 1, 0.0, 1.0, [0] * ndim, nonadjacent, 0.0, [0.0] * ndim, [], [], [])
+                assert {tuple(position) for position, _ in peaks} == expected, (shape, nonadjacent)
+
+    def test_drop_check_rejects_rise_before_drop(self):
+        """Test that a peak is rejected when the data rises again before dropping by dropFactor"""
+        data = np.zeros((5, 9), dtype=np.float32)
+        data[2, :] = [0.0, 2.0, 9.0, 8.0, 10.0, 8.0, 8.5, 3.0, 0.0]
+
+        def findPeaks(dropFactor):
+            peaks = Peak.findPeaks(data, 0, 1, 0.0, 5.0, [0, 0], 0, dropFactor, [0.0, 0.0], [], [], [])
+            return sorted(tuple(position) for position, _ in peaks)
+
+        # the peak at x = 4 drops by 2 before rising either way, the others by at most 1
+        assert findPeaks(0.0) == [(2, 2), (4, 2), (6, 2)]
+        assert findPeaks(0.15) == [(4, 2)]
+        assert findPeaks(0.25) == []
+
 
 @pytest.mark.skipif(not HAS_C_EXTENSIONS, reason="C extensions not available")
 class TestPeakFittingBaseline:
@@ -222,6 +410,160 @@ class TestPeakFittingBaseline:
             'result': result[0]
         }
 
+    def test_separable_fit_recovers_3d_peaks(self):
+        """Test that two overlapping 3D peaks are recovered exactly, from a region away from the origin"""
+        positions = np.array([[11.3, 8.6, 6.2], [14.8, 9.4, 7.1]])  # (x, y, z)
+        linewidths = np.array([[3.0, 2.5, 2.2], [2.6, 3.2, 2.0]])
+        heights = np.array([800.0, 500.0])
+        Z, Y, X = np.meshgrid(np.arange(14), np.arange(18), np.arange(22), indexing='ij')
+        region = np.array([[6, 4, 3], [20, 15, 11]], dtype=np.int32)
+        peaks = np.array([[11, 9, 6], [15, 9, 7]], dtype=np.float32)
+
+        def gaussian(dx, lw):
+            return np.exp(-4 * np.log(2) * dx**2 / lw**2)
+
+        def lorentzian(dx, lw):
+            return lw**2 / (lw**2 + 4 * dx**2)
+
+        def pseudoVoigt(dx, lw):
+            return (1 - fraction) * gaussian(dx, lw) + fraction * lorentzian(dx, lw)
+
+        fraction = 0.3
+
+        assert Peak.lineshapes == ('gaussian', 'lorentzian', 'pseudo-voigt')
+
+        for method, lineshape in enumerate((gaussian, lorentzian, pseudoVoigt)):
+            data = np.zeros(X.shape)
+            for position, linewidth, height in zip(positions, linewidths, heights):
+                peak = height
+                for point, p, lw in zip((X, Y, Z), position, linewidth):
+                    peak = peak * lineshape(point - p, lw)
+                data += peak
+
+            result = Peak.fitPeaks(data.astype(np.float32), region, peaks, method)
+            assert len(result) == 2
+
+            fittedHeights, fittedPositions, fittedLinewidths = zip(*result)
+            np.testing.assert_allclose(fittedHeights, heights, rtol=1e-4)
+            np.testing.assert_allclose(fittedPositions, positions, atol=1e-3)
+            np.testing.assert_allclose(fittedLinewidths, linewidths, atol=1e-3)
+
+        # the pseudo-voigt fraction is fitted for each peak, from the 0.5 it starts at
+        fits = Peak.fitPeaks(data.astype(np.float32), region, peaks, 2, asArray=True)
+        assert fits.dtype.names == ('height', 'position', 'linewidth', 'fraction', 'status')
+        np.testing.assert_allclose(fits['fraction'], fraction, atol=1e-3)
+        assert np.all(fits['status'] == 0)
+
+        batchFits = Peak.fitPeaksBatch(data.astype(np.float32), region[None], peaks, np.array([2], dtype=np.int32), 2)
+        assert batchFits.dtype == fits.dtype
+        np.testing.assert_array_equal(batchFits['fraction'], fits['fraction'])
+
+        with pytest.raises(Exception):
+            Peak.fitPeaks(data.astype(np.float32), region, peaks, len(Peak.lineshapes))
+
+    def test_batch_fit_matches_single_fits(self):
+        """Test that fitPeaksBatch gives the fitPeaks result for each group, on any number of threads"""
+        np.random.seed(5)
+        Y, X = np.mgrid[0:40, 0:60]
+        centres = [(12.0, 10.0), (16.0, 12.0), (40.0, 25.0), (45.0, 30.0), (30.0, 8.0)]
+        data = sum(100 * np.exp(-4 * np.log(2) * ((X - x)**2 / 9 + (Y - y)**2 / 12)) for x, y in centres)
+        data = (data + np.random.normal(0, 0.5, data.shape)).astype(np.float32)
+
+        # the last group is not inside the data
+        regions = np.array([[[6, 4], [22, 18]], [[34, 19], [51, 36]], [[25, 3], [36, 14]], [[50, 30], [70, 45]]],
+                           dtype=np.int32)
+        peaks = np.array(centres + [(55.0, 35.0)], dtype=np.float32)
+        counts = np.array([2, 2, 1, 1], dtype=np.int32)
+
+        for method in (0, 1):
+            fits = Peak.fitPeaksBatch(data, regions, peaks, counts, method)
+            assert len(fits) == len(peaks)
+            assert fits.dtype.names == ('height', 'position', 'linewidth', 'status')
+            assert fits['status'][5] == 2 and np.isnan(fits['height'][5])
+
+            start = 0
+            for region, count in zip(regions[:3], counts):
+                groupFits = fits[start:start + count]
+                # every peak of a group has the status of the group
+                assert len(set(groupFits['status'])) == 1
+                if groupFits['status'][0] == 0:
+                    expected = Peak.fitPeaks(data, region, peaks[start:start + count], method, asArray=True)
+                    np.testing.assert_array_equal(groupFits, expected)
+                start += count
+
+            for numThreads in (0, 3):
+                threadedFits = Peak.fitPeaksBatch(data, regions, peaks, counts, method, numThreads)
+                np.testing.assert_array_equal(threadedFits, fits)
+
+            # sums in double only change the fits by rounding
+            doubleFits = Peak.fitPeaksBatch(data, regions, peaks, counts, method, 1, True)
+            np.testing.assert_array_equal(doubleFits['status'], fits['status'])
+            fitted = fits['status'] == 0
+            for field in ('height', 'position', 'linewidth'):
+                np.testing.assert_allclose(doubleFits[field][fitted], fits[field][fitted], rtol=1e-3, atol=1e-3)
+
+        with pytest.raises(Exception):
+            Peak.fitPeaksBatch(data, regions, peaks, np.array([2, 2, 1, 2], dtype=np.int32), 0)
+
+    def test_fit_stats(self):
+        """Test that getStats counts the fits, their iterations and the groups not fitted"""
+        Y, X = np.mgrid[0:40, 0:50]
+        data = (100 * np.exp(-4 * np.log(2) * ((X - 20)**2 / 9 + (Y - 15)**2 / 12))).astype(np.float32)
+        regions = np.array([[[14, 10], [27, 21]], [[0, 0], [0, 3]], [[40, 30], [60, 45]]], dtype=np.int32)
+        peaks = np.array([[20.0, 15.0], [1.0, 1.0], [45.0, 35.0]], dtype=np.float32)
+        counts = np.array([1, 1, 1], dtype=np.int32)
+
+        try:
+            Peak.setStatsEnabled(True)
+            Peak.resetStats()
+            Peak.fitPeaks(data, regions[0], peaks[:1], 0)
+            stats = Peak.getStats()
+            assert stats['fitCalls'] == 1 and stats['fits'] == 1 and stats['iterations'] > 0
+
+            status = Peak.fitPeaksBatch(data, regions, peaks, counts, 0, 2)['status']
+            stats = Peak.getStats()
+            assert stats['fitCalls'] == 2 and stats['groups'] == 4 and stats['fits'] == 2
+            assert stats['badRegion'] == np.count_nonzero(status == 2) == 2
+            assert stats['notConverged'] <= stats['failed'] == 0
+        finally:
+            Peak.setStatsEnabled(False)
+            Peak.resetStats()
+
+    def test_array_outputs_match_lists(self):
+        """Test that the structured array outputs hold the same peaks and fits as the lists"""
+        np.random.seed(6)
+        Y, X = np.mgrid[0:30, 0:40]
+        data = sum(100 * np.exp(-4 * np.log(2) * ((X - x)**2 / 9 + (Y - y)**2 / 8)) for x, y in ((12, 10), (30, 20)))
+        data = (data + np.random.normal(0, 0.5, data.shape)).astype(np.float32)
+
+        args = (data, 0, 1, 0.0, 10.0, [2, 2], 1, 0.0, [0.0, 0.0], [], [], [], 1)
+        peakList = Peak.findPeaks(*args)
+        peakRecords = Peak.findPeaks(*args, 1)
+        assert peakRecords.dtype.names == ('position', 'height') and len(peakRecords) == len(peakList) > 0
+        assert [(tuple(position), height) for position, height in peakRecords.tolist()] == peakList
+
+        region = np.array([[0, 0], [40, 30]], dtype=np.int32)
+        peaks = peakRecords['position'].astype(np.float32)
+
+        def fitList(records):
+            return [(height, tuple(position), tuple(linewidth)) for height, position, linewidth, _ in records.tolist()]
+
+        fitRecords = Peak.fitPeaks(data, region, peaks, 0, 1)
+        assert fitRecords.dtype.names == ('height', 'position', 'linewidth', 'status')
+        assert np.all(fitRecords['status'] == 0)
+        assert fitList(fitRecords) == Peak.fitPeaks(data, region, peaks, 0)
+
+        # a peak on the edge of the data has status 1 for a parabolic fit, and a fit that fails is not raised
+        edgePeaks = np.append(peaks, [[0.0, 15.0]], axis=0).astype(np.float32)
+        parabolicRecords = Peak.fitParabolicPeaks(data, region, edgePeaks, 1)
+        assert parabolicRecords['status'].tolist() == [0] * len(peaks) + [1]
+        assert fitList(parabolicRecords) == Peak.fitParabolicPeaks(data, region, edgePeaks)
+
+        failed = Peak.fitPeaks(np.zeros_like(data), region, peaks, 0, 1)
+        assert np.all(failed['status'] == 1) and np.all(np.isnan(failed['height']))
+        with pytest.raises(Exception):
+            Peak.fitPeaks(np.zeros_like(data), region, peaks, 0)
+
 
 @pytest.mark.skipif(not HAS_C_EXTENSIONS, reason="C extensions not available")
 class TestContourBaseline:
@@ -265,6 +607,365 @@ class TestContourBaseline:
         except (AttributeError, ImportError) as e:
             pytest.skip(f"Contour C extension not fully available: {e}")
 
+    def test_threaded_gl_list_matches_serial(self):
+        """Test that contourerGLList with numThreads gives the same contours as the serial version"""
+        np.random.seed(7)
+        Y, X = np.mgrid[0:400, 0:120]
+        data = (100 * np.exp(-((X - 40)**2 + (Y - 100)**2) / 200) +
+                80 * np.exp(-((X - 80)**2 + (Y - 250)**2) / 2000) -
+                60 * np.exp(-((X - 60)**2 + (Y - 350)**2) / 100) +
+                np.random.normal(0, 2, X.shape)).astype(np.float32)
+
+        posLevels = np.array([5, 10, 20, 40, 80], dtype=np.float32)
+        negLevels = np.array([-5, -20], dtype=np.float32)
+        posColour = np.array([1, 0, 0, 1] * len(posLevels), dtype=np.float32)
+        negColour = np.array([0, 0, 1, 1] * len(negLevels), dtype=np.float32)
+
+        def contourPoints(result):
+            # chains may be split differently, so compare the (colour, vertex) multisets
+            numIndices, numVertices, indexing, vertices, colours = result
+            assert len(indexing) == numIndices == 2 * numVertices
+            points = np.concatenate([colours.reshape(-1, 4), vertices.reshape(-1, 2)], axis=1)
+            return points[np.lexsort(points.T[::-1])]
+
+        serial = Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour, negColour, 0)
+        for numThreads in (0, 2, 4):
+            threaded = Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour, negColour, 0, numThreads)
+
+            assert threaded[0] == serial[0] and threaded[1] == serial[1]
+            np.testing.assert_allclose(contourPoints(threaded), contourPoints(serial), atol=1e-4)
+
+        with pytest.raises(Exception):
+            Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour, negColour, 0, -1)
+
+    def test_native_gl_list_matches_lists(self):
+        """Test that the native buffer contourerGLList gives exactly the output of the list version"""
+        np.random.seed(11)
+        data = np.random.normal(0, 1, (150, 130)).astype(np.float32)
+        posLevels = np.array([0.5, 1.0, 2.0], dtype=np.float32)
+        negLevels = np.array([-0.5, -1.5], dtype=np.float32)
+        posColour = np.array([1, 0, 0, 1] * len(posLevels), dtype=np.float32)
+        negColour = np.array([0, 0, 1, 1] * len(negLevels), dtype=np.float32)
+
+        native = Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour, negColour, 0)
+        lists = Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour, negColour, 0, 1, 1)
+
+        assert native[:2] == lists[:2]
+        for array, listArray in zip(native[2:], lists[2:]):
+            assert array.dtype == listArray.dtype
+            np.testing.assert_array_equal(array, listArray)
+
+    def test_plane_summary_skips_give_same_contours(self):
+        """Test that jumping blocks of cells from the plane summaries (native only) loses no contours"""
+        np.random.seed(12)
+        Y, X = np.mgrid[0:161, 0:97]
+        slab = []
+        for i in range(3):
+            plane = (100 * np.exp(-((X - 30 - 10 * i)**2 + (Y - 80)**2) / 500) -
+                     60 * np.exp(-((X - 70)**2 + (Y - 30 - 20 * i)**2) / 80) +
+                     np.random.normal(0, 1, X.shape)).astype(np.float32)
+            plane[40:90, 60:75] = 500  # a plateau above every level
+            slab.append(plane)
+        slab.append(np.asfortranarray(slab[0]))
+        # enough levels for a summary of each plane both in one band and split into bands
+        posLevels = np.array([3, 10, 30, 50, 80, 1000], dtype=np.float32)
+        negLevels = np.array([-3, -10, -20], dtype=np.float32)
+        posColour = np.array([1, 0, 0, 1] * len(posLevels), dtype=np.float32)
+        negColour = np.array([0, 0, 1, 1] * len(negLevels), dtype=np.float32)
+
+        def contourPoints(result):
+            # the bands split the chains differently, so compare the (colour, vertex) multisets
+            points = np.concatenate([result[4].reshape(-1, 4), result[3].reshape(-1, 2)], axis=1)
+            return points[np.lexsort(points.T[::-1])]
+
+        for planes in ((slab[0],), tuple(slab)):
+            native = Contourer2d.contourerGLList(planes, posLevels, negLevels, posColour, negColour, 0)
+            lists = Contourer2d.contourerGLList(planes, posLevels, negLevels, posColour, negColour, 0, 1, 1)
+
+            assert native[:2] == lists[:2]
+            for array, listArray in zip(native[2:], lists[2:]):
+                np.testing.assert_array_equal(array, listArray)
+
+            banded = Contourer2d.contourerGLList(planes, posLevels, negLevels, posColour, negColour, 0, 4)
+            assert banded[:2] == lists[:2]
+            np.testing.assert_allclose(contourPoints(banded), contourPoints(lists), atol=1e-4)
+
+    def test_compact_gl_list(self):
+        """Test that contourerGLListCompact holds the same contours as contourerGLList"""
+        np.random.seed(13)
+        Y, X = np.mgrid[0:180, 0:260]
+        planes = ((100 * np.exp(-((X - 90)**2 + (Y - 80)**2) / 900) - 40 * np.exp(-((X - 200)**2 + (Y - 50)**2) / 60) +
+                   np.random.normal(0, 1, X.shape)).astype(np.float32),)
+        posLevels = np.array([3, 20, 60, 5000], dtype=np.float32)
+        negLevels = np.array([-3, -15], dtype=np.float32)
+        posColour = np.arange(4 * len(posLevels), dtype=np.float32) / 16
+        negColour = 1 - np.arange(4 * len(negLevels), dtype=np.float32) / 8
+
+        numIndices, numVertices, indices, vertices, colours = Contourer2d.contourerGLList(planes, posLevels, negLevels,
+                                                                                         posColour, negColour)
+
+        for fixedPoint in (0, 1):
+            compact = Contourer2d.contourerGLListCompact(planes, posLevels, negLevels, posColour, negColour, 0, 1,
+                                                         fixedPoint)
+            cNumIndices, cNumVertices, cIndices, cVertices, scale, levelRanges, levelColours = compact
+
+            assert (cNumIndices, cNumVertices) == (numIndices, numVertices)
+            assert cIndices.dtype == np.uint16
+            np.testing.assert_array_equal(cIndices, indices)
+
+            if fixedPoint:
+                assert cVertices.dtype == np.int16 and scale == 64.0  # 259 * 64 <= 32767 < 259 * 128
+                np.testing.assert_allclose(cVertices / scale, vertices, atol=0.5 / scale)
+            else:
+                assert cVertices.dtype == np.float32 and scale == 1.0
+                np.testing.assert_array_equal(cVertices, vertices)
+
+            # each level is a run of indices in one colour, the level at 5000 has no contours so no range
+            levelRanges = levelRanges.reshape(-1, 2)
+            assert len(levelRanges) == 5 and levelRanges[0, 0] == 0 and levelRanges[:, 1].sum() == numIndices
+            np.testing.assert_array_equal(levelRanges[1:, 0], np.cumsum(levelRanges[:-1, 1]))
+            expanded = np.repeat(levelColours.reshape(-1, 4), levelRanges[:, 1] // 2, axis=0)
+            np.testing.assert_array_equal(expanded.ravel(), colours)
+
+    def test_compact_gl_list_wide_plane(self):
+        """Test that planes too wide for int16 vertices at scale 1 fall back to float32"""
+        X = np.arange(40000, dtype=np.float32)
+        planes = (np.vstack([100 * np.exp(-(X - 39000)**2 / 2000)] * 4).astype(np.float32),)
+        posLevels = np.array([10], dtype=np.float32)
+        negLevels = np.array([], dtype=np.float32)
+        colour = np.ones(4, dtype=np.float32)
+
+        vertices = Contourer2d.contourerGLList(planes, posLevels, negLevels, colour, colour)[3]
+        compact = Contourer2d.contourerGLListCompact(planes, posLevels, negLevels, colour, colour, 0, 1, 1)
+
+        cVertices, scale = compact[3:5]
+        assert cVertices.dtype == np.float32 and scale == 1.0
+        assert cVertices.max() > 32768
+        np.testing.assert_array_equal(cVertices, vertices)
+
+    def test_build_info(self):
+        """Test that both extensions report the options they were built with"""
+        for info in (Contourer2d.buildInfo(), Peak.buildInfo()):
+            assert info['cpuTarget'] in ('avx512f', 'avx2', 'default')
+            assert isinstance(info['multiversion'], bool) and isinstance(info['openmp'], bool)
+            if not info['multiversion']:
+                assert info['cpuTarget'] == 'default'
+
+        assert isinstance(Contourer2d.buildInfo()['simd'], str)
+
+    def test_flatten_projects_without_changing_data(self):
+        """Test that flatten overlays the planes into a new array, as folding them in turn with numpy"""
+        np.random.seed(8)
+        planes = tuple(np.random.normal(0, 1, (60, 3000)).astype(np.float32) for _ in range(6))
+        originals = [plane.copy() for plane in planes]
+
+        expected = planes[0].copy()
+        for plane in planes[1:]:
+            expected = (np.maximum(np.maximum(expected, 0), np.maximum(plane, 0)) +
+                        np.minimum(np.minimum(expected, 0), np.minimum(plane, 0)))
+
+        for numThreads in (1, 4):
+            np.testing.assert_array_equal(Contourer2d.projectPlanes(planes, numThreads), expected)
+        np.testing.assert_array_equal(Contourer2d.projectPlanes(tuple(np.asfortranarray(p) for p in planes)), expected)
+
+        posLevels = np.array([1.0, 2.0], dtype=np.float32)
+        negLevels = np.array([-1.0], dtype=np.float32)
+        posColour = np.array([1, 0, 0, 1] * len(posLevels), dtype=np.float32)
+        negColour = np.array([0, 0, 1, 1] * len(negLevels), dtype=np.float32)
+
+        flat = Contourer2d.contourerGLList(planes, posLevels, negLevels, posColour, negColour, 1)
+        single = Contourer2d.contourerGLList((expected,), posLevels, negLevels, posColour, negColour, 0)
+        for plane, original in zip(planes, originals):
+            np.testing.assert_array_equal(plane, original)
+
+        assert flat[:2] == single[:2]
+        for array, singleArray in zip(flat[2:], single[2:]):
+            np.testing.assert_array_equal(array, singleArray)
+
+    def test_strided_data_matches_contiguous(self):
+        """Test that contiguous rows (vectorised cell skipping) and strided rows give the same contours"""
+        np.random.seed(5)
+        Y, X = np.mgrid[0:90, 0:110]
+        data = (50 * np.exp(-((X - 50)**2 + (Y - 40)**2) / 100) + np.random.normal(0, 1, X.shape)).astype(np.float32)
+        posLevels = np.array([3, 10, 30], dtype=np.float32)
+        negLevels = np.array([-3], dtype=np.float32)
+        posColour = np.array([1, 0, 0, 1] * len(posLevels), dtype=np.float32)
+        negColour = np.array([0, 0, 1, 1] * len(negLevels), dtype=np.float32)
+
+        contiguous = Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour, negColour, 0)
+        strided = Contourer2d.contourerGLList((np.asfortranarray(data),), posLevels, negLevels, posColour, negColour, 0)
+
+        assert contiguous[:2] == strided[:2]
+        for array, stridedArray in zip(contiguous[2:], strided[2:]):
+            np.testing.assert_array_equal(array, stridedArray)
+
+    def test_repeat_contour_reuses_memory(self):
+        """Test that contouring a plane of the same size again takes all its memory from the pool"""
+        np.random.seed(3)
+        posLevels = np.array([0.5, 1.0, 2.0], dtype=np.float32)
+        negLevels = np.array([-0.5, -1.5], dtype=np.float32)
+        posColour = np.array([1, 0, 0, 1] * len(posLevels), dtype=np.float32)
+        negColour = np.array([0, 0, 1, 1] * len(negLevels), dtype=np.float32)
+
+        Contourer2d.clearPool()
+        data = np.random.normal(0, 1, (140, 120)).astype(np.float32)
+        first = Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour, negColour, 0)
+        heapAllocs = Contourer2d.poolStats()['heapAllocs']
+        assert heapAllocs > 0
+
+        second = Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour, negColour, 0)
+        stats = Contourer2d.poolStats()
+        assert stats['heapAllocs'] == heapAllocs and stats['reuses'] > 0
+        for array, secondArray in zip(first[2:], second[2:]):
+            np.testing.assert_array_equal(array, secondArray)
+
+        Contourer2d.clearPool()
+        assert Contourer2d.poolStats() == {'heapAllocs': 0, 'reuses': 0, 'cachedBytes': 0}
+
+    def test_concurrent_gl_list_calls(self):
+        """Test that contourerGLList can be called from several threads at once"""
+        from concurrent.futures import ThreadPoolExecutor
+
+        Y, X = np.mgrid[0:200, 0:150]
+        planes = [(100 * np.exp(-((X - 20 - 10 * i)**2 + (Y - 100)**2) / 300)).astype(np.float32) for i in range(8)]
+        posLevels = np.array([10, 30, 60], dtype=np.float32)
+        negLevels = np.array([], dtype=np.float32)
+        posColour = np.array([1, 0, 0, 1] * len(posLevels), dtype=np.float32)
+        negColour = np.array([], dtype=np.float32)
+
+        def contour(plane):
+            return Contourer2d.contourerGLList((plane,), posLevels, negLevels, posColour, negColour, 0)
+
+        expected = [contour(plane) for plane in planes]
+        with ThreadPoolExecutor(max_workers=4) as executor:
+            results = list(executor.map(contour, planes * 4))
+
+        for i, result in enumerate(results):
+            assert result[:2] == expected[i % len(planes)][:2]
+            for array, expectedArray in zip(result[2:], expected[i % len(planes)][2:]):
+                np.testing.assert_array_equal(array, expectedArray)
+
+    def test_contour_stats(self):
+        """Test that getStats counts the vertices and chains of each level, the same on any number of threads"""
+        np.random.seed(9)
+        Y, X = np.mgrid[0:120, 0:150]
+        data = (100 * np.exp(-((X - 40)**2 + (Y - 30)**2) / 60) - 50 * np.exp(-((X - 100)**2 + (Y - 80)**2) / 40) +
+                np.random.normal(0, 2, X.shape)).astype(np.float32)
+        posLevels = np.array([5, 20, 60], dtype=np.float32)
+        negLevels = np.array([-5, -20], dtype=np.float32)
+        posColour = np.array([1, 0, 0, 1] * len(posLevels), dtype=np.float32)
+        negColour = np.array([0, 0, 1, 1] * len(negLevels), dtype=np.float32)
+
+        try:
+            Contourer2d.setStatsEnabled(True)
+            results = []
+            for numThreads in (1, 4):
+                Contourer2d.resetStats()
+                numIndices, numVertices, _, _, _ = Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour,
+                                                                              negColour, 0, numThreads)
+                stats = Contourer2d.getStats()
+                results.append({key: value for key, value in stats.items() if not key.endswith('Seconds')})
+
+                assert stats['calls'] == stats['planes'] == 1 and stats['levels'] == 5
+                assert stats['vertices'] == numVertices == sum(stats['levelVertices'])
+                assert stats['chains'] == sum(stats['levelChains']) > 0 and len(stats['levelVertices']) == 3
+            assert results[0] == results[1]
+
+            Contourer2d.resetStats()
+            contours = Contourer2d.contourer2d(data, posLevels)
+            assert Contourer2d.getStats()['chains'] == sum(len(levelChains) for levelChains in contours)
+
+            Contourer2d.setStatsEnabled(False)
+            Contourer2d.resetStats()
+            Contourer2d.contourer2d(data, posLevels)
+            assert Contourer2d.getStats()['calls'] == 0
+        finally:
+            Contourer2d.setStatsEnabled(False)
+            Contourer2d.resetStats()
+
+    def test_contour_job(self):
+        """Test that a background contour job gives the contourerGLList result, in order while it runs"""
+        Y, X = np.mgrid[0:300, 0:250]
+        planes = tuple((100 * np.exp(-((X - 60 - 40 * i)**2 + (Y - 150)**2) / 800) -
+                        40 * np.exp(-((X - 200)**2 + (Y - 60 - 30 * i)**2) / 300)).astype(np.float32) for i in range(3))
+        posLevels = np.array([5, 10, 20, 40, 80], dtype=np.float32)
+        negLevels = np.array([-5, -20], dtype=np.float32)
+        posColour = np.array([1, 0, 0, 1] * len(posLevels), dtype=np.float32)
+        negColour = np.array([0, 0, 1, 1] * len(negLevels), dtype=np.float32)
+
+        def assertSameList(result, expected):
+            assert result[:2] == expected[:2]
+            for array, expectedArray in zip(result[2:], expected[2:]):
+                np.testing.assert_array_equal(array, expectedArray)
+
+        for flatten, numThreads in ((0, 1), (0, 4), (1, 2)):
+            expected = Contourer2d.contourerGLList(planes, posLevels, negLevels, posColour, negColour, flatten)
+
+            job = Contourer2d.startContourJob(planes, posLevels, negLevels, posColour, negColour, flatten, numThreads)
+            numIndices, numVertices, indices, vertices, colours = Contourer2d.contourJobPartial(job)
+            assert numIndices == len(indices) and 2 * numVertices == len(vertices) == len(colours) // 2
+            assert numVertices <= expected[1]
+
+            assertSameList(Contourer2d.contourJobWait(job), expected)
+            assert Contourer2d.contourJobDone(job)
+            assertSameList(Contourer2d.contourJobWait(job), expected)
+            assertSameList(Contourer2d.contourJobPartial(job), expected)
+
+        # a job dropped without waiting is stopped and freed
+        Contourer2d.startContourJob(planes, posLevels, negLevels, posColour, negColour)
+
+        # paused, so the job is cancelled before it can finish however fast the machine
+        Contourer2d.pauseContourJobs(True)
+        try:
+            job = Contourer2d.startContourJob(planes, posLevels, negLevels, posColour, negColour)
+            assert not Contourer2d.contourJobDone(job)
+            Contourer2d.contourJobCancel(job)
+        finally:
+            Contourer2d.pauseContourJobs(False)
+        with pytest.raises(Contourer2d.error, match='cancelled'):
+            Contourer2d.contourJobWait(job)
+        assert Contourer2d.contourJobDone(job)
+
+        # a job cancelled while it runs stops, or has finished already
+        bigPlanes = tuple(np.tile(plane, (4, 4)) for plane in planes)
+        manyLevels = np.linspace(1, 99, 60).astype(np.float32)
+        job = Contourer2d.startContourJob(bigPlanes, manyLevels, negLevels, np.tile(posColour[:4], 60), negColour)
+        Contourer2d.contourJobCancel(job)
+        try:
+            Contourer2d.contourJobWait(job)
+        except Contourer2d.error as es:
+            assert 'cancelled' in str(es)
+        assert Contourer2d.contourJobDone(job)
+
+        with pytest.raises(Contourer2d.error):
+            Contourer2d.startContourJob(planes, posLevels.astype(np.float64), negLevels, posColour, negColour)
+
+    @pytest.mark.skipif(not os.path.isdir('/proc/self/task'), reason="needs /proc to count the threads")
+    def test_contour_jobs_share_a_fixed_pool(self):
+        """Test that queueing many background contour jobs (e.g. scrolling through planes) starts no more threads"""
+        Y, X = np.mgrid[0:100, 0:90]
+        plane = (100 * np.exp(-((X - 40)**2 + (Y - 50)**2) / 300)).astype(np.float32)
+        levels = np.array([10, 50], dtype=np.float32)
+        colour = np.array([1, 0, 0, 1] * len(levels), dtype=np.float32)
+        noLevels = np.array([], dtype=np.float32)
+        noColour = np.array([], dtype=np.float32)
+        expected = Contourer2d.contourerGLList((plane,), levels, noLevels, colour, noColour)
+
+        # the pool is started by the first job
+        Contourer2d.contourJobWait(Contourer2d.startContourJob((plane,), levels, noLevels, colour, noColour))
+        nthreads = len(os.listdir('/proc/self/task'))
+
+        Contourer2d.pauseContourJobs(True)
+        try:
+            jobs = [Contourer2d.startContourJob((plane,), levels, noLevels, colour, noColour) for _ in range(50)]
+            assert len(os.listdir('/proc/self/task')) == nthreads
+        finally:
+            Contourer2d.pauseContourJobs(False)
+
+        for job in jobs:
+            result = Contourer2d.contourJobWait(job)
+            assert result[:2] == expected[:2]
+
 
 class TestGenerateValidationDatasets:
     """Generate comprehensive test datasets for Python implementation"""
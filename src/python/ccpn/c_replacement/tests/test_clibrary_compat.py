@@ -0,0 +1,269 @@
+"""
+Tests for the cached nmrResidue indices of clibrary_compat.
+
+This test suite validates:
+1. The order of main and offset nmrResidues in connected and unconnected nmrChains
+2. The indices are cached, and worked out again when invalidated or the nmrChain changes
+3. The C extension and the Python fallback give the same indices
+4. getNmrResidueIndices gives the indices of a whole nmrChain or list of nmrResidues in one call
+5. The C extension counts its lookups and sorts when its statistics are enabled
+6. Invalidating the indices lets go of the nmrChains
+"""
+
+import gc
+import random
+import weakref
+
+import numpy as np
+import pytest
+
+from ccpn.c_replacement import clibrary_compat
+
+
+class _ApiNmrProject:
+    def __init__(self):
+        self.__dict__['resonanceGroups'] = {}
+
+
+class _ApiNmrChain:
+    def __init__(self, nmrProject, isConnected):
+        self.__dict__.update(isConnected=isConnected, serial=1, mainResonanceGroups=[])
+        self.nmrProject = nmrProject
+
+    @property
+    def mainResonanceGroups(self):
+        return tuple(self.__dict__['mainResonanceGroups'])
+
+
+class _ApiResonanceGroup:
+    def __init__(self, nmrChain, serial, seqCode=None, seqInsertCode=None, relativeOffset=None, mainResonanceGroup=None):
+        self.__dict__.update(serial=serial, seqCode=seqCode, seqInsertCode=seqInsertCode, relativeOffset=relativeOffset)
+        self.nmrChain = nmrChain
+        self.nmrProject = nmrChain.nmrProject
+        self._mainResonanceGroup = mainResonanceGroup or self
+
+    @property
+    def mainResonanceGroup(self):
+        return self._mainResonanceGroup
+
+
+class _NmrResidue:
+    def __init__(self, apiResonanceGroup):
+        self._wrappedData = apiResonanceGroup
+
+
+class _NmrChain:
+    def __init__(self, nmrResidues):
+        self.nmrResidues = nmrResidues
+
+
+def _addGroup(nmrChain, *args, **kwds):
+    groups = nmrChain.nmrProject.__dict__['resonanceGroups']
+    group = _ApiResonanceGroup(nmrChain, len(groups) + 1, *args, **kwds)
+    groups[group.serial] = group
+    if group.mainResonanceGroup is group:
+        nmrChain.__dict__['mainResonanceGroups'].append(group)
+
+    return _NmrResidue(group)
+
+
+def _randomChains(seed, isConnected):
+    rng = random.Random(seed)
+    nmrProject = _ApiNmrProject()
+    nmrChains = [_ApiNmrChain(nmrProject, isConnected), _ApiNmrChain(nmrProject, not isConnected)]
+    nmrResidues = []
+    for nmrChain in nmrChains:
+        for _ in range(30):
+            main = _addGroup(nmrChain, rng.choice([None, rng.randint(1, 12)]), rng.choice([None, None, 'A', 'B']))
+            nmrResidues.append(main)
+            for offset in rng.sample([-1, 1, -2], rng.randint(0, 2)):
+                nmrResidues.append(_addGroup(nmrChain, None, rng.choice([None, 'A']), offset, main._wrappedData))
+
+    groups = list(nmrProject.__dict__['resonanceGroups'].items())
+    rng.shuffle(groups)
+    nmrProject.__dict__['resonanceGroups'] = dict(groups)
+
+    return nmrResidues, nmrChains
+
+
+def _implementations():
+    implementations = [clibrary_compat._pyGetNmrResidueIndex]
+    if clibrary_compat._c_implementation is not None:
+        implementations.append(clibrary_compat._c_implementation.getNmrResidueIndex)
+
+    return implementations
+
+
+def _bulkImplementations():
+    implementations = [clibrary_compat._pyGetNmrResidueIndices]
+    if clibrary_compat._c_implementation is not None:
+        implementations.append(clibrary_compat._c_implementation.getNmrResidueIndices)
+
+    return implementations
+
+
+@pytest.fixture(autouse=True)
+def _clearIndices():
+    clibrary_compat.invalidateNmrResidueIndices()
+    yield
+    clibrary_compat.invalidateNmrResidueIndices()
+
+
+class TestNmrResidueIndex:
+
+    @pytest.mark.parametrize('getIndex', _implementations())
+    def test_unconnected_order(self, getIndex):
+        nmrChain = _ApiNmrChain(_ApiNmrProject(), False)
+        res5 = _addGroup(nmrChain, 5)
+        res2 = _addGroup(nmrChain, 2)
+        res2B = _addGroup(nmrChain, 2, 'B')
+        res2A = _addGroup(nmrChain, 2, 'A')
+        unassigned = _addGroup(nmrChain)
+        res5m1 = _addGroup(nmrChain, None, None, -1, res5._wrappedData)
+        res5p1 = _addGroup(nmrChain, None, None, 1, res5._wrappedData)
+
+        order = [res2, res2A, res2B, res5m1, res5, res5p1, unassigned]
+        assert [getIndex(nmrRes) for nmrRes in order] == list(range(len(order)))
+
+    @pytest.mark.parametrize('getIndex', _implementations())
+    def test_connected_order(self, getIndex):
+        nmrChain = _ApiNmrChain(_ApiNmrProject(), True)
+        first = _addGroup(nmrChain, 9)
+        second = _addGroup(nmrChain, 3)
+        secondM1 = _addGroup(nmrChain, None, None, -1, second._wrappedData)
+        firstP1 = _addGroup(nmrChain, None, None, 1, first._wrappedData)
+
+        # connected nmrChains keep the order of the stretch, not of the sequenceCodes
+        order = [first, firstP1, secondM1, second]
+        assert [getIndex(nmrRes) for nmrRes in order] == list(range(len(order)))
+
+    @pytest.mark.parametrize('getIndex', _implementations())
+    def test_not_in_chain(self, getIndex):
+        nmrChain = _ApiNmrChain(_ApiNmrProject(), False)
+        _addGroup(nmrChain, 1)
+        other = _ApiNmrChain(nmrChain.nmrProject, False)
+        orphan = _NmrResidue(_ApiResonanceGroup(nmrChain, 99, 4))
+
+        assert getIndex(orphan) == -1
+        assert getIndex(_addGroup(other, 1)) == 0
+
+    @pytest.mark.parametrize('getIndex', _implementations())
+    def test_cached_until_invalidated(self, getIndex):
+        nmrChain = _ApiNmrChain(_ApiNmrProject(), True)
+        nmrResidues = [_addGroup(nmrChain, ii) for ii in range(5)]
+        assert [getIndex(nmrRes) for nmrRes in nmrResidues] == [0, 1, 2, 3, 4]
+
+        # reordering the stretch is not seen until the indices are invalidated
+        nmrChain.__dict__['mainResonanceGroups'].reverse()
+        assert [getIndex(nmrRes) for nmrRes in nmrResidues] == [0, 1, 2, 3, 4]
+        clibrary_compat.invalidateNmrResidueIndices(nmrChain)
+        assert [getIndex(nmrRes) for nmrRes in nmrResidues] == [4, 3, 2, 1, 0]
+
+        # adding a nmrResidue is seen without invalidating
+        added = _addGroup(nmrChain, 10)
+        assert getIndex(added) == 5
+        assert getIndex(nmrResidues[0]) == 4
+
+    @pytest.mark.parametrize('getIndex', _implementations())
+    def test_invalidating_releases_chains(self, getIndex):
+        # the cache holds on to the api-nmrChains, as a closed project must not
+        nmrChains = [_ApiNmrChain(_ApiNmrProject(), False) for _ in range(2)]
+        for nmrChain in nmrChains:
+            getIndex(_addGroup(nmrChain, 1))
+        refs = [weakref.ref(nmrChain) for nmrChain in nmrChains]
+        del nmrChains, nmrChain
+
+        clibrary_compat.invalidateNmrResidueIndices(refs[0]())
+        gc.collect()
+        assert refs[0]() is None and refs[1]() is not None
+
+        clibrary_compat.invalidateNmrResidueIndices()
+        gc.collect()
+        assert refs[1]() is None
+
+    def test_implementations_agree(self):
+        implementations = _implementations()
+        if len(implementations) < 2:
+            pytest.skip("C extension not available")
+
+        for seed in range(6):
+            nmrResidues, _ = _randomChains(seed, seed % 2 == 0)
+            indices = [[getIndex(nmrRes) for nmrRes in nmrResidues] for getIndex in implementations]
+            assert indices[0] == indices[1]
+
+    def test_each_chain_is_a_permutation(self):
+        for seed in range(4):
+            nmrResidues, nmrChains = _randomChains(seed, seed % 2 == 0)
+            for nmrChain in nmrChains:
+                indices = sorted(clibrary_compat.getNmrResidueIndex(nmrRes) for nmrRes in nmrResidues
+                                 if nmrRes._wrappedData.nmrChain is nmrChain)
+                assert indices == list(range(len(indices)))
+
+
+class TestNmrResidueIndices:
+
+    @pytest.mark.parametrize('getIndices', _bulkImplementations())
+    def test_matches_single_lookups(self, getIndices):
+        for seed in range(4):
+            nmrResidues, _ = _randomChains(seed, seed % 2 == 0)
+            random.Random(seed).shuffle(nmrResidues)
+
+            indices = getIndices(nmrResidues)
+            assert indices.dtype.kind == 'i' and indices.shape == (len(nmrResidues),)
+            assert list(indices) == [clibrary_compat._pyGetNmrResidueIndex(nmrRes) for nmrRes in nmrResidues]
+
+    @pytest.mark.parametrize('getIndices', _bulkImplementations())
+    def test_not_in_chain(self, getIndices):
+        nmrChain = _ApiNmrChain(_ApiNmrProject(), False)
+        res3 = _addGroup(nmrChain, 3)
+        res1 = _addGroup(nmrChain, 1)
+        orphan = _NmrResidue(_ApiResonanceGroup(nmrChain, 99, 4))
+        deleted = _NmrResidue(_ApiResonanceGroup(nmrChain, 98, 2))
+        deleted._wrappedData.nmrChain = None
+
+        assert list(getIndices([res3, orphan, deleted, res1])) == [1, -1, -1, 0]
+        assert len(getIndices([])) == 0
+
+    def test_nmrChain_argument(self):
+        nmrResidues, nmrChains = _randomChains(3, False)
+        chainResidues = [nmrRes for nmrRes in nmrResidues if nmrRes._wrappedData.nmrChain is nmrChains[0]]
+
+        indices = clibrary_compat.getNmrResidueIndices(_NmrChain(chainResidues))
+        np.testing.assert_array_equal(indices, clibrary_compat.getNmrResidueIndices(tuple(chainResidues)))
+        assert sorted(indices) == list(range(len(chainResidues)))
+
+    def test_bad_arguments(self):
+        with pytest.raises(Exception):
+            clibrary_compat.getNmrResidueIndices([object()])
+
+
+class TestIndexStats:
+
+    def test_counts_lookups_and_sorts(self):
+        if clibrary_compat._c_implementation is None:
+            pytest.skip("C extension not available")
+
+        clib = clibrary_compat._c_implementation
+        nmrResidues, nmrChains = _randomChains(1, True)
+        orphan = _NmrResidue(_ApiResonanceGroup(nmrChains[0], 999, 4))
+        try:
+            clib.setStatsEnabled(True)
+            clib.resetStats()
+            clib.getNmrResidueIndices(nmrResidues)
+            stats = clib.getStats()
+            assert stats['indicesCalls'] == 1 and stats['residues'] == len(nmrResidues) and stats['notFound'] == 0
+            assert stats['sorts'] == 2 and stats['sorted'] == len(nmrResidues)
+
+            clib.getNmrResidueIndex(nmrResidues[0])
+            clib.getNmrResidueIndex(orphan)
+            stats = clib.getStats()
+            assert stats['indexCalls'] == 2 and stats['notFound'] == 1 and stats['sorts'] == 2
+            assert stats['cacheHits'] == 2
+
+            clib.setStatsEnabled(False)
+            clib.resetStats()
+            clib.getNmrResidueIndex(nmrResidues[0])
+            assert clib.getStats()['indexCalls'] == 0
+        finally:
+            clib.setStatsEnabled(False)
+            clib.resetStats()
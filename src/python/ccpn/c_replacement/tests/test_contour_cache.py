@@ -0,0 +1,116 @@
+"""
+Tests for the incremental contour cache.
+
+This test suite validates:
+1. The cached contourerGLList gives the same result as Contourer2d.contourerGLList
+2. Only levels/planes not already in the cache are contoured
+3. The cache stays within its size limit
+"""
+
+import pytest
+import numpy as np
+
+from ccpn.c_replacement.contour_cache import ContourCache, flattenPlanes, planeFingerprint
+from ccpn.c_replacement.tests.fixtures.contour_data import gaussianPlane, contourLevels, assertSameGLList
+
+
+pytestmark = pytest.mark.skipif(not ContourCache.isAvailable(),
+                                reason="C extension with contourerLevelChains not available")
+
+
+def _plane(shift=0.0, seed=1):
+    return gaussianPlane((120, 100), [(30 + shift, 40, 100, 150), (70, 90, 70, 400), (20, 100, -50, 80)],
+                         noise=1.0, seed=seed)
+
+
+class TestContourCache:
+    """Test the cached contourerGLList"""
+
+    def test_matches_contourerGLList(self):
+        from ccpnc.contour import Contourer2d
+
+        data = _plane()
+        posLevels, posColour = contourLevels([5, 10, 20, 40, 80])
+        negLevels, negColour = contourLevels([-5, -20])
+
+        cache = ContourCache()
+        expected = Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour, negColour, 0)
+
+        assertSameGLList(cache.contourerGLList((data,), posLevels, negLevels, posColour, negColour), expected)
+        # and again, now all from the cache
+        assertSameGLList(cache.contourerGLList((data,), posLevels, negLevels, posColour, negColour), expected)
+        assert cache.hits == 7 and cache.misses == 7
+
+    def test_only_new_levels_contoured(self):
+        data = _plane()
+        negLevels, negColour = contourLevels([])
+
+        cache = ContourCache()
+        posLevels, posColour = contourLevels([5, 10, 20])
+        cache.contourerGLList((data,), posLevels, negLevels, posColour, negColour)
+        assert cache.misses == 3
+
+        posLevels, posColour = contourLevels([5, 10, 15, 20])
+        cache.contourerGLList((data,), posLevels, negLevels, posColour, negColour)
+        assert cache.misses == 4 and cache.hits == 3
+
+        # a different plane needs all its levels
+        cache.contourerGLList((_plane(shift=5.0),), posLevels, negLevels, posColour, negColour)
+        assert cache.misses == 8
+
+    def test_flatten_matches_and_leaves_data(self):
+        from ccpnc.contour import Contourer2d
+
+        planes = (_plane(seed=1), _plane(shift=20.0, seed=2))
+        original = planes[0].copy()
+        posLevels, posColour = contourLevels([5, 20, 40])
+        negLevels, negColour = contourLevels([-5, -20])
+
+        result = ContourCache().contourerGLList(planes, posLevels, negLevels, posColour, negColour, 1)
+        assert np.array_equal(planes[0], original)
+
+        expected = Contourer2d.contourerGLList((planes[0].copy(), planes[1]), posLevels, negLevels,
+                                               posColour, negColour, 1)
+        assertSameGLList(result, expected)
+        assert planeFingerprint(flattenPlanes(planes)) != planeFingerprint(planes[0])
+
+    def test_fingerprints_given_by_caller(self, monkeypatch):
+        from ccpn.c_replacement import contour_cache
+
+        planes = (_plane(seed=1), _plane(shift=20.0, seed=2))
+        posLevels, posColour = contourLevels([5, 20, 40])
+        negLevels, negColour = contourLevels([-5])
+        expected = ContourCache().contourerGLList(planes, posLevels, negLevels, posColour, negColour)
+        flatExpected = ContourCache().contourerGLList(planes, posLevels, negLevels, posColour, negColour, 1)
+
+        # the planes are not hashed when the caller has keys for them
+        def _noHashing(dataArray):
+            raise AssertionError('plane hashed')
+
+        monkeypatch.setattr(contour_cache, 'planeFingerprint', _noHashing)
+
+        cache = ContourCache()
+        for _ in range(2):
+            assertSameGLList(cache.contourerGLList(planes, posLevels, negLevels, posColour, negColour,
+                                                    fingerprints=(('spectrum', 1), ('spectrum', 2))), expected)
+        assert cache.hits == 8 and cache.misses == 8
+
+        # the overlaid plane is keyed by all the plane keys, so is not mistaken for either plane
+        assertSameGLList(cache.contourerGLList(planes, posLevels, negLevels, posColour, negColour, 1,
+                                                fingerprints=(('spectrum', 1), ('spectrum', 2))), flatExpected)
+        assert cache.misses == 12
+
+        with pytest.raises(ValueError):
+            cache.contourerGLList(planes, posLevels, negLevels, posColour, negColour, fingerprints=(('spectrum', 1),))
+
+    def test_size_limit(self):
+        posLevels, posColour = contourLevels([5, 10, 20, 40])
+        negLevels, negColour = contourLevels([])
+
+        cache = ContourCache(maxBytes=20000)
+        for shift in range(5):
+            cache.contourerGLList((_plane(shift=shift),), posLevels, negLevels, posColour, negColour)
+            assert cache.nbytes <= 20000
+
+        cache.clear()
+        assert len(cache) == 0 and cache.nbytes == 0
@@ -0,0 +1,115 @@
+"""
+Tests for the GPU marching-squares backend.
+
+This test suite validates:
+1. Without a GPU (or disabled) the result is that of Contourer2d.contourerGLList
+2. Where each level goes in the segment buffer, and the GL list built from the
+   segments (both on the host)
+3. The GPU segments are the same as the segments of the C chains
+4. The segments go through the contour cache
+"""
+
+import pytest
+import numpy as np
+
+from ccpn.c_replacement import contour_compat
+from ccpn.c_replacement.contour_cache import ContourCache
+from ccpn.c_replacement.contour_gpu import GpuContourer, _levelOffsets, glListFromSegments
+from ccpn.c_replacement.tests.fixtures.contour_data import gaussianPlane, contourLevels, allNear, assertSameGLList
+
+
+requiresGpu = pytest.mark.skipif(not (GpuContourer.isAvailable() and contour_compat._using_c),
+                                 reason="CUDA device and C extension not available")
+
+
+def _plane():
+    # smooth and zero at the edges, so that all the contours are closed, with a saddle between the two positive peaks
+    return gaussianPlane((120, 140), [(50, 60, 100, 150), (80, 60, 90, 150), (100, 25, -70, 60)])
+
+
+def _segmentMidpoints(contourList):
+    _, numVertices, indexing, vertices, _ = contourList
+    vertices = np.asarray(vertices).reshape(-1, 2)
+    pairs = np.asarray(indexing).reshape(-1, 2)
+
+    return (vertices[pairs[:, 0]] + vertices[pairs[:, 1]]) / 2
+
+
+class TestGpuContourer:
+
+    def test_disabled_matches_cpu(self):
+        data = _plane()
+        posLevels, posColour = contourLevels([20.0, 40.0, 80.0], (1, 0, 0, 1))
+        negLevels, negColour = contourLevels([-20.0, -40.0], (0, 0, 1, 1))
+
+        for planes, flatten in (((data,), 0), ((data, data[:, ::-1].copy()), 1)):
+            result = GpuContourer(enabled=False).contourerGLList(planes, posLevels, negLevels, posColour, negColour,
+                                                                 flatten)
+            expected = contour_compat.Contourer2d.contourerGLList(planes, posLevels, negLevels, posColour, negColour,
+                                                                  flatten)
+            assertSameGLList(result, expected)
+
+    def test_level_offsets(self):
+        offsets, nsegments = _levelOffsets([4, 0, 7, 2])
+        np.testing.assert_array_equal(offsets, [0, 4, 4, 11])
+        assert nsegments == 13
+
+        offsets, nsegments = _levelOffsets(np.zeros(0, dtype=int))
+        assert len(offsets) == 0 and nsegments == 0
+
+    def test_gl_list_from_segments(self):
+        levelSegments = [np.arange(8, dtype=np.float32), np.arange(4, dtype=np.float32)]
+        levelColours = [(1, 0, 0, 1), (0, 0, 1, 1)]
+        numIndices, numVertices, indices, vertices, colours = glListFromSegments(levelSegments, levelColours)
+
+        assert numIndices == numVertices == 6
+        np.testing.assert_array_equal(indices, np.arange(6, dtype=np.uint32))
+        np.testing.assert_array_equal(vertices, np.concatenate(levelSegments))
+        np.testing.assert_array_equal(np.asarray(colours).reshape(-1, 4), [levelColours[0]] * 4 + [levelColours[1]] * 2)
+
+        result = glListFromSegments([], [])
+        assert result[:2] == [0, 0]
+        assert [array.dtype for array in result[2:]] == [np.uint32, np.float32, np.float32]
+
+    @requiresGpu
+    def test_segments_match_c(self):
+        from ccpnc.contour import Contourer2d
+
+        data = _plane()
+        posLevels, posColour = contourLevels([10.0, 30.0, 60.0, 95.0, 500.0, 600.0], (1, 0, 0, 1))
+        negLevels, negColour = contourLevels([-10.0, -50.0], (0, 0, 1, 1))
+
+        for planes, flatten in (((data,), 0), ((data, 0.5 * data[::-1].copy()), 0), ((data, data[:, ::-1].copy()), 1)):
+            expected = Contourer2d.contourerGLList(planes, posLevels, negLevels, posColour, negColour, flatten)
+            result = GpuContourer().contourerGLList(planes, posLevels, negLevels, posColour, negColour, flatten)
+
+            numIndices, numVertices, indices, vertices, colours = result
+            assert numIndices == numVertices == len(indices) == len(vertices) // 2 == len(colours) // 4
+            np.testing.assert_array_equal(indices, np.arange(numVertices, dtype=np.uint32))
+
+            # the C chains are closed, so have as many segments as vertices
+            midpoints, expectedMidpoints = _segmentMidpoints(result), _segmentMidpoints(expected)
+            assert len(midpoints) == expected[1]
+            assert allNear(midpoints, expectedMidpoints) and allNear(expectedMidpoints, midpoints)
+
+            # levels 500 and 600 have no contours and are dropped
+            assert set(map(tuple, np.asarray(colours).reshape(-1, 4))) == {(1, 0, 0, 1), (0, 0, 1, 1)}
+
+    @requiresGpu
+    def test_segments_are_cached(self):
+        data = _plane()
+        posLevels, posColour = contourLevels([20.0, 40.0], (1, 0, 0, 1))
+        negLevels, negColour = contourLevels([-20.0], (0, 0, 1, 1))
+
+        cache = ContourCache()
+        contourer = GpuContourer(cache=cache)
+        first = contourer.contourerGLList((data,), posLevels, negLevels, posColour, negColour, fingerprints=('plane',))
+        hits = cache.hits
+
+        second = contourer.contourerGLList((data,), posLevels, negLevels, posColour, negColour, fingerprints=('plane',))
+        assert cache.hits == hits + 3
+        assertSameGLList(second, first)
+
+        # the chains of the same plane are kept apart from its segments
+        chains = cache.contourerGLList((data,), posLevels, negLevels, posColour, negColour, fingerprints=('plane',))
+        assert chains[0] == 2 * chains[1]
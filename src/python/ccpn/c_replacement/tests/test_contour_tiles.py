@@ -0,0 +1,144 @@
+"""
+Tests for tiled, level-of-detail contouring.
+
+This test suite validates:
+1. decimatePlane keeps the maximum/minimum of each block
+2. The decimation chosen for a viewport
+3. Tiled contours at full resolution agree with contourerGLList
+4. Only the tiles in the viewport are contoured
+5. With a planeKey cached tiles are not decimated or hashed again
+"""
+
+import pytest
+import numpy as np
+
+from ccpn.c_replacement.contour_cache import ContourCache
+from ccpn.c_replacement.contour_tiles import TiledContourer, decimationForViewport
+from ccpn.c_replacement.tests.fixtures.contour_data import gaussianPlane, contourLevels, allNear, assertSameGLList
+
+
+pytestmark = pytest.mark.skipif(not TiledContourer.isAvailable(),
+                                reason="C extension with decimatePlane not available")
+
+
+def _plane():
+    return gaussianPlane((300, 260), [(60, 70, 100, 300), (200, 220, 80, 800), (130, 150, -60, 200)],
+                         noise=1.0, seed=3)
+
+
+class TestDecimation:
+
+    def test_decimate_plane(self):
+        from ccpnc.contour import Contourer2d
+
+        data = _plane()
+        maxData, minData = Contourer2d.decimatePlane(data, 4, 10, 250, 0, 258)
+
+        region = np.pad(data[10:250, 0:258], ((0, 0), (0, 2)), mode='edge')
+        blocks = region.reshape(60, 4, 65, 4)
+        np.testing.assert_array_equal(maxData, blocks.max(axis=(1, 3)))
+        np.testing.assert_array_equal(minData, blocks.min(axis=(1, 3)))
+
+    def test_decimation_for_viewport(self):
+        assert decimationForViewport((0, 1000, 0, 1000), (1000, 1000)) == 1
+        assert decimationForViewport((0, 4000, 0, 5000), (1000, 1000)) == 4
+        assert decimationForViewport((0, 4000, 0, 800), (1000, 1000)) == 1
+        assert decimationForViewport((0, 16000, 0, 16000), (1000, 1000), pointsPerPixel=2) == 8
+
+
+class TestTiledContours:
+
+    def test_full_resolution_matches_contourerGLList(self):
+        from ccpnc.contour import Contourer2d
+
+        data = _plane()
+        posLevels, posColour = contourLevels([10, 30, 60])
+        negLevels, negColour = contourLevels([-10, -30])
+
+        expected = Contourer2d.contourerGLList((data,), posLevels, negLevels, posColour, negColour, 0)
+        result = TiledContourer(tileSize=64, cache=ContourCache()).contourerGLList(data, posLevels, negLevels,
+                                                                                   posColour, negColour)
+
+        # chains are cut at the tile edges, but the points are the same
+        assert result[0] == 2 * result[1] == len(result[2])
+        points, expectedPoints = result[3].reshape(-1, 2), expected[3].reshape(-1, 2)
+        assert allNear(points, expectedPoints) and allNear(expectedPoints, points)
+
+    def test_viewport_tiles(self):
+        data = _plane()
+        posLevels, posColour = contourLevels([10, 30, 60])
+        negLevels, negColour = contourLevels([])
+
+        tiler = TiledContourer(tileSize=32, cache=ContourCache())
+        assert len(tiler.visibleTiles(data.shape, 1)) == 10 * 9
+        assert tiler.visibleTiles(data.shape, 1, (0, 31, 0, 31)) == [(0, 0)]
+        assert tiler.visibleTiles(data.shape, 4, (0, 260, 0, 300)) == [(0, 0), (0, 1), (1, 0), (1, 1), (2, 0), (2, 1)]
+
+        result = tiler.contourerGLList(data, posLevels, negLevels, posColour, negColour,
+                                       viewport=(30, 90, 40, 100), decimation=1)
+        vertices = result[3].reshape(-1, 2)
+        assert result[1] > 0
+        assert vertices[:, 0].min() >= 0 and vertices[:, 0].max() <= 128
+        assert vertices[:, 1].min() >= 32 and vertices[:, 1].max() <= 128
+
+    def test_decimated_keeps_peaks(self):
+        data = _plane()
+        posLevels, posColour = contourLevels([95])
+        negLevels, negColour = contourLevels([-55])
+
+        result = TiledContourer(cache=ContourCache()).contourerGLList(data, posLevels, negLevels,
+                                                                      posColour, negColour,
+                                                                      viewport=(0, 260, 0, 300), pixels=(32, 32))
+        vertices = result[3].reshape(-1, 2)
+        assert result[1] > 0
+
+        # contours around both the positive and the negative peak survive the downsampling
+        assert np.any(np.hypot(vertices[:, 0] - 60, vertices[:, 1] - 70) < 15)
+        assert np.any(np.hypot(vertices[:, 0] - 130, vertices[:, 1] - 150) < 15)
+
+    def test_plane_key_skips_cached_tiles(self, monkeypatch):
+        from ccpn.c_replacement import contour_cache, contour_compat, contour_tiles
+
+        data = _plane()
+        posLevels, posColour = contourLevels([10, 30, 60])
+        negLevels, negColour = contourLevels([-10, -30])
+        tiler = TiledContourer(tileSize=64, cache=ContourCache())
+
+        cImplementation = contour_compat._implementation
+        calls = []
+
+        class _Implementation:
+            def __getattr__(self, name):
+                return getattr(cImplementation, name)
+
+        def _decimatePlane(*args):
+            calls.append(args[1:])
+            return cImplementation.decimatePlane(*args)
+
+        def _noFingerprint(dataArray):
+            raise AssertionError('tile hashed although it has a planeKey')
+
+        implementation = _Implementation()
+        implementation.decimatePlane = _decimatePlane
+        monkeypatch.setattr(contour_tiles.contour_compat, '_implementation', implementation)
+        monkeypatch.setattr(contour_cache, 'planeFingerprint', _noFingerprint)
+
+        def _contour(decimation):
+            return tiler.contourerGLList(data, posLevels, negLevels, posColour, negColour,
+                                         decimation=decimation, planeKey=('plane', 1))
+
+        coarse = _contour(4)
+        ncoarse = len(calls)
+        fine = _contour(1)
+        assert ncoarse > 0 and len(calls) > ncoarse
+
+        # zooming back out only puts the cached contours together
+        nfine = len(calls)
+        assertSameGLList(_contour(4), coarse)
+        assertSameGLList(_contour(1), fine)
+        assert len(calls) == nfine
+
+        # a new level only decimates the tiles again, each once for both signs
+        posLevels, posColour = contourLevels([10, 30, 60, 90])
+        _contour(4)
+        assert len(calls) == nfine + ncoarse
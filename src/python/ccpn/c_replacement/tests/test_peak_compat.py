@@ -160,6 +160,27 @@ class TestCompatibilityWrapper:
         results = fit_parabolic_peaks(data, region, peak_array)
         assert len(results) == 1
 
+    def test_peak_picker(self):
+        """Test that PeakPicker.pick finds the same peaks as findPeaks with its settings."""
+        from ccpn.c_replacement.peak_compat import Peak, PeakPicker
+
+        shape = (40, 40)
+        peaks_spec = [
+            {'center': (10, 10), 'height': 100, 'linewidth': (2, 2), 'model': 'gaussian'},
+            {'center': (30, 10), 'height': 120, 'linewidth': (2.5, 2.5), 'model': 'gaussian'},
+        ]
+
+        picker = PeakPicker(False, True, 0.0, 40.0, [3, 3], True, 0.0, [0.0, 0.0])
+        assert picker.ndim == 2
+
+        for noise_level in (0.5, 1.0):
+            data = generate_multi_peak_spectrum(shape, peaks_spec, noise_level=noise_level)
+            expected = Peak.findPeaks(data, False, True, 0.0, 40.0, [3, 3], True, 0.0, [0.0, 0.0], [], [], [])
+
+            assert len(expected) == 2
+            assert picker.pick(data) == expected
+            assert picker.pick(data, asArray=True)['height'].tolist() == [height for _, height in expected]
+
     def test_multiple_peaks_workflow(self):
         """Test complete workflow: find peaks, then fit them."""
         from ccpn.c_replacement.peak_compat import Peak
@@ -0,0 +1,117 @@
+"""
+Tests for streaming peak finding.
+
+This test suite validates:
+1. The peaks found a tile at a time are those of findPeaks on the whole array
+2. Excluded regions and diagonals are moved to the points of each tile
+3. Memory-mapped arrays and block reading functions can be streamed
+4. Peaks whose drop or linewidth walks leave the halo are checked again
+"""
+
+import pytest
+import numpy as np
+
+from ccpn.c_replacement.peak_compat import Peak
+from ccpn.c_replacement.peak_stream import StreamingPeakFinder, isAvailable
+
+
+pytestmark = pytest.mark.skipif(not isAvailable(), reason="C extension not available")
+
+
+def _data():
+    np.random.seed(11)
+    return np.random.normal(0, 1, (9, 23, 31)).astype(np.float32)
+
+
+def _assertSamePeaks(streamed, whole):
+    assert len(whole) > 0
+    np.testing.assert_array_equal(streamed['position'], whole['position'])
+    np.testing.assert_array_equal(streamed['height'], whole['height'])
+
+
+class TestStreamingPeakFinder:
+
+    def test_tiles_match_whole_array(self):
+        data = _data()
+
+        for tileShape, halo, buffer, nonadjacent in (((2, 7, 9), 1, [0, 0, 0], 0),
+                                                     ((3, 10, None), 1, [1, 2, 1], 1),
+                                                     ((1, 5, 6), 2, [2, 1, 1], 0),
+                                                     (None, 1, [1, 1, 2], 1)):
+            args = (1, 1, -1.0, 1.0, buffer, nonadjacent, 0.0, [0.0, 0.0, 0.0])
+            whole = Peak.findPeaks(data, *args, asArray=True)
+            streamed = StreamingPeakFinder(tileShape, halo, maxTileBytes=4 * 23 * 31 * 2).findPeaks(data, *args)
+            _assertSamePeaks(streamed, whole)
+
+    def test_drop_factor_within_halo(self):
+        data = _data()
+        args = (1, 1, -1.0, 1.0, [1, 1, 1], 1, 0.3, [0.0, 0.0, 0.0])
+
+        whole = Peak.findPeaks(data, *args, asArray=True)
+        _assertSamePeaks(StreamingPeakFinder((2, 8, 8), halo=12).findPeaks(data, *args), whole)
+
+    def test_walks_beyond_halo(self):
+        # broad peaks, so that the walks are much longer than the halo
+        np.random.seed(3)
+        Z, Y, X = np.mgrid[0:9, 0:40, 0:48]
+        data = np.random.normal(0, 0.05, X.shape)
+        for x, y, z, height in ((10, 12, 4, 10), (30, 25, 2, 8), (40, 8, 6, -9), (22, 33, 5, 3)):
+            data += height * np.exp(-((X - x)**2 / 60 + (Y - y)**2 / 40 + (Z - z)**2 / 4))
+        data = data.astype(np.float32)
+
+        for dropFactor, minLinewidth in ((0.5, [0.0, 0.0, 0.0]), (0.0, [9.0, 8.0, 2.0]), (0.3, [12.0, 0.0, 1.0])):
+            args = (1, 1, -1.0, 1.0, [1, 1, 1], 0, dropFactor, minLinewidth)
+            whole = Peak.findPeaks(data, *args, asArray=True)
+
+            finder = StreamingPeakFinder((3, 10, 12), halo=1)
+            _assertSamePeaks(finder.findPeaks(data, *args), whole)
+            assert finder.nrechecked > 0
+
+    def test_exclusions(self):
+        data = _data()
+        args = (1, 1, -1.0, 1.0, [1, 1, 1], 0, 0.0, [0.0, 0.0, 0.0])
+
+        # region is (low, high) for dims (x, y, z), diagonal is |x - y - 2| < 2.5
+        exclusions = ([np.array([[5.0, 3.0, 1.0], [14.0, 12.0, 4.0]], dtype=np.float32)],
+                      [np.array([0, 1], dtype=np.int32)],
+                      [np.array([1.0, 1.0, -2.0, 2.5], dtype=np.float32)])
+
+        whole = Peak.findPeaks(data, *args, *exclusions, asArray=True)
+        assert len(whole) < len(Peak.findPeaks(data, *args, asArray=True))
+        _assertSamePeaks(StreamingPeakFinder((2, 7, 9), halo=1).findPeaks(data, *args, *exclusions), whole)
+
+    def test_memmap_and_block_reader(self, tmp_path):
+        data = _data()
+        args = (1, 1, -1.0, 1.0, [1, 1, 1], 1, 0.0, [0.0, 0.0, 0.0])
+        whole = Peak.findPeaks(data, *args, asArray=True)
+
+        mapped = np.memmap(tmp_path / 'spectrum.dat', dtype=np.float32, mode='w+', shape=data.shape)
+        mapped[:] = data
+        mapped.flush()
+        mapped = np.memmap(tmp_path / 'spectrum.dat', dtype=np.float32, mode='r', shape=data.shape)
+
+        finder = StreamingPeakFinder((2, None, None), halo=1)
+        slabs = list(finder.iterPeaks(mapped, *args))
+        assert len(slabs) > 1
+        _assertSamePeaks(np.concatenate(slabs), whole)
+
+        blocks = []
+
+        def readBlock(starts, stops):
+            blocks.append(tuple(stop - start for start, stop in zip(starts, stops)))
+            return data[tuple(slice(start, stop) for start, stop in zip(starts, stops))]
+
+        serial = StreamingPeakFinder((3, 12, None), halo=1, prefetch=False)
+        _assertSamePeaks(serial.findPeaks(readBlock, *args, shape=data.shape), whole)
+        assert len(blocks) == 6 and max(np.prod(block) for block in blocks) < data.size
+
+    def test_bad_arguments(self):
+        data = _data()
+        args = (1, 1, -1.0, 1.0, [1, 1, 1], 0, 0.0, [0.0, 0.0, 0.0])
+
+        with pytest.raises(ValueError):
+            StreamingPeakFinder((2, 7, 9), halo=0).findPeaks(data, *args)
+        with pytest.raises(ValueError):
+            StreamingPeakFinder((2, 7)).findPeaks(data, *args)
+        with pytest.raises(ValueError):
+            StreamingPeakFinder().findPeaks(lambda starts, stops: data, *args)
@@ -37,6 +37,7 @@ from ccpn.core.Project import Project
 from ccpn.core.Residue import Residue
 from ccpn.core._implementation.AbstractWrapperObject import AbstractWrapperObject
 from ccpn.core.lib import Pid
+from ccpn.c_replacement.clibrary_compat import invalidateNmrResidueIndices
 from ccpn.core.lib.ContextManagers import newObject, undoStackBlocking, renameObject, \
     undoBlock, ccpNmrV3CoreUndoBlock
 from ccpn.util.decorators import logCommand
@@ -406,6 +407,8 @@ class NmrChain(AbstractWrapperObject):
             if self._wrappedData.implCode == '@-' and self._wrappedData.nmrProject:
                 raise TypeError("NmrChain '@-' cannot be deleted")
 
+        invalidateNmrResidueIndices(self._wrappedData)
+
         if not super()._finaliseAction(action, **actionKwds):
             return
 
@@ -37,6 +37,7 @@ from ccpn.core.Residue import Residue
 from ccpn.core._implementation.AbstractWrapperObject import AbstractWrapperObject
 from ccpn.core._implementation.AbsorbResonance import absorbResonance
 from ccpn.core.lib import Pid
+from ccpn.c_replacement.clibrary_compat import invalidateNmrResidueIndices
 from ccpn.core.lib.ContextManagers import newObject, ccpNmrV3CoreSetter, \
     renameObject, undoBlock
 from ccpn.util.Common import makeIterableList
@@ -1349,6 +1350,11 @@ class NmrResidue(AbstractWrapperObject):
                 nmrAt._oldNmrResidue = None
                 nmrAt._oldAssignedPeaks = ()
 
+        if action in ['create', 'delete', 'rename']:
+            # the order of the nmrResidues in the nmrChain may have changed, a 'change' leaves it alone;
+            # an nmrChain the nmrResidue was moved out of has one fewer nmrResidue, which the cache checks
+            invalidateNmrResidueIndices(self._wrappedData.nmrChain)
+
         if not super()._finaliseAction(action):
             return
 
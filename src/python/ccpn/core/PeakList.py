@@ -43,7 +43,8 @@ from ccpn.util.Logging import getLogger
 GAUSSIANMETHOD = 'gaussian'
 LORENTZIANMETHOD = 'lorentzian'
 PARABOLICMETHOD = 'parabolic'
-PICKINGMETHODS = (GAUSSIANMETHOD, LORENTZIANMETHOD, PARABOLICMETHOD)
+PSEUDOVOIGTMETHOD = 'pseudo-voigt'
+PICKINGMETHODS = (GAUSSIANMETHOD, LORENTZIANMETHOD, PARABOLICMETHOD, PSEUDOVOIGTMETHOD)
 
 
 class PeakList(PMIListABC):
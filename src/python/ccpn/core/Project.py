@@ -55,6 +55,8 @@ from ccpn.core.lib.ContextManagers import (notificationBlanking, undoBlock, undo
                                            inactivity, logCommandManager, ccpNmrV3CoreUndoBlock, undoStackBlocking)
 from ccpn.core.lib.XmlLoader import XmlLoader
 
+from ccpn.c_replacement.clibrary_compat import invalidateNmrResidueIndices
+
 from ccpn.util import Logging
 from ccpn.util.ExcelReader import ExcelReader
 from ccpn.util.Path import aPath, Path
@@ -1173,6 +1175,9 @@ class Project(AbstractWrapperObject):
         # local import to avoid cycles
         from ccpn.core.NmrChain import DEFAULT_NMRCHAINCODE
 
+        # nothing cached from a previous project
+        invalidateNmrResidueIndices()
+
         self._logger = createLogger(self, now=self.application._created)
         Logging.setLevel(self._logger, application._loggingLevel)
 
@@ -1438,6 +1443,8 @@ class Project(AbstractWrapperObject):
         # clear the lookup dicts
         self._data2Obj.clear()
         self._pid2Obj.clear()
+        # the cached nmrResidue indices hold on to the api-nmrChains
+        invalidateNmrResidueIndices()
 
     @contextmanager
     def _loggerBlocking(self):
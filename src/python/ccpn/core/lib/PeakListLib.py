@@ -90,7 +90,7 @@ def _pickPeaksRegion(peakList, regionToPick: dict = {},
     :return: list of peaks.
     """
 
-    from ccpn.c_replacement.peak_compat import Peak as CPeak
+    from ccpn.c_replacement.peak_compat import Peak as CPeak, PeakPicker as CPeakPicker
 
     spectrum = peakList.spectrum
     dataSource = spectrum._apiDataSource
@@ -126,9 +126,19 @@ def _pickPeaksRegion(peakList, regionToPick: dict = {},
     if posLevel is None and negLevel is None:
         return peaks
 
+    # the same signs and levels for every region
+    doPos = posLevel is not None
+    doNeg = negLevel is not None
+    posLevel = posLevel or 0.0
+    negLevel = negLevel or 0.0
+
     # find the regions from the spectrum - sometimes returning None which gives an error
     foundRegions = peakList.spectrum.getRegion(**regionToPick)
 
+    # the findPeaks settings are only checked once for all the regions, unless there are exclusions,
+    # which are relative to the start of each region
+    pickers = {}
+
     if not foundRegions:
         return peaks
 
@@ -143,30 +153,29 @@ def _pickPeaksRegion(peakList, regionToPick: dict = {},
             startPointBuffer, endPointBuffer = region
 
         if dataArray is not None and dataArray.size:
-            # find new peaks
-            # exclusion code copied from Nmr/PeakList.py
-            excludedRegionsList = [np.array(excludedRegion, dtype=np.float32) - startPointBuffer
-                                   for excludedRegion in excludedRegions]
-            excludedDiagonalDimsList = []
-            excludedDiagonalTransformList = []
-            for n in range(len(excludedDiagonalDims)):
-                dim1, dim2 = excludedDiagonalDims[n]
-                a1, a2, b12, d = excludedDiagonalTransform[n]
-                b12 += a1 * startPointBuffer[dim1] - a2 * startPointBuffer[dim2]
-                excludedDiagonalDimsList.append(np.array((dim1, dim2), dtype=np.int32))
-                excludedDiagonalTransformList.append(np.array((a1, a2, b12, d), dtype=np.float32))
-
-            doPos = posLevel is not None
-            doNeg = negLevel is not None
-            posLevel = posLevel or 0.0
-            negLevel = negLevel or 0.0
-
-            # print('>>dataArray', dataArray)
-            # NOTE:ED requires an exclusionBuffer of 1 in all axis directions
-            peakPoints = CPeak.findPeaks(dataArray, doNeg, doPos,
-                                         negLevel, posLevel, exclusionBuffer,
-                                         nonAdj, minDropFactor, minLinewidth,
-                                         excludedRegionsList, excludedDiagonalDimsList, excludedDiagonalTransformList)
+            pickerKey = tuple(startPointBuffer) if (excludedRegions or excludedDiagonalDims) else None
+            if pickerKey not in pickers:
+                # find new peaks
+                # exclusion code copied from Nmr/PeakList.py
+                excludedRegionsList = [np.array(excludedRegion, dtype=np.float32) - startPointBuffer
+                                       for excludedRegion in excludedRegions]
+                excludedDiagonalDimsList = []
+                excludedDiagonalTransformList = []
+                for n in range(len(excludedDiagonalDims)):
+                    dim1, dim2 = excludedDiagonalDims[n]
+                    a1, a2, b12, d = excludedDiagonalTransform[n]
+                    b12 += a1 * startPointBuffer[dim1] - a2 * startPointBuffer[dim2]
+                    excludedDiagonalDimsList.append(np.array((dim1, dim2), dtype=np.int32))
+                    excludedDiagonalTransformList.append(np.array((a1, a2, b12, d), dtype=np.float32))
+
+                # NOTE:ED requires an exclusionBuffer of 1 in all axis directions
+                pickers[pickerKey] = CPeakPicker(doNeg, doPos,
+                                                 negLevel, posLevel, exclusionBuffer,
+                                                 nonAdj, minDropFactor, minLinewidth,
+                                                 excludedRegionsList, excludedDiagonalDimsList,
+                                                 excludedDiagonalTransformList)
+
+            peakPoints = pickers[pickerKey].pick(dataArray)
 
             peakPoints = [(np.array(position), height) for position, height in peakPoints]
 
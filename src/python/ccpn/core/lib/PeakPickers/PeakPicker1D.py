@@ -32,7 +32,7 @@ __date__ = "$Date: 2022-02-02 14:08:56 +0000 (Wed, February 02, 2022) $"
 from ccpn.core.lib.PeakPickers.PeakPickerABC import PeakPickerABC, SimplePeak
 import numpy as np
 from scipy.integrate import trapz
-from lmfit.models import LorentzianModel, GaussianModel
+from lmfit.models import LorentzianModel, GaussianModel, PseudoVoigtModel
 from ccpn.util.UnitConverters import  _getSpUnitConversionArguments, _pnt2hz
 from scipy.integrate import quad
 from ccpn.util.Logging import getLogger
@@ -232,11 +232,12 @@ class PeakPicker1D(PeakPickerABC):
         """Refit the current selected peaks.
         Must be called with peaks that belong to this peakList
         """
-        from ccpn.core.PeakList import GAUSSIANMETHOD, LORENTZIANMETHOD, PARABOLICMETHOD # here for bad imports
+        from ccpn.core.PeakList import GAUSSIANMETHOD, LORENTZIANMETHOD, PARABOLICMETHOD, PSEUDOVOIGTMETHOD # here for bad imports
 
         self._models = {
                                 GAUSSIANMETHOD: GaussianModel,
-                                LORENTZIANMETHOD: LorentzianModel
+                                LORENTZIANMETHOD: LorentzianModel,
+                                PSEUDOVOIGTMETHOD: PseudoVoigtModel
                                 }
 
         spectrum = peaks[0].spectrum
@@ -36,17 +36,23 @@ import matplotlib.pyplot as plt
 from ccpn.core.lib.PeakPickers.PeakPickerABC import PeakPickerABC, SimplePeak
 from ccpn.util.traits.CcpNmrTraits import CFloat, CInt, CBool, CList, Dict
 from ccpn.util.Logging import getLogger
-from ccpn.c_replacement.peak_compat import Peak as CPeak
+from ccpn.c_replacement.peak_compat import Peak as CPeak, PeakPicker as CPeakPicker
 
 
 GAUSSIANMETHOD = 'gaussian'
 LORENTZIANMETHOD = 'lorentzian'
 PARABOLICMETHOD = 'parabolic'
-PICKINGMETHODS = (GAUSSIANMETHOD, LORENTZIANMETHOD, PARABOLICMETHOD)
+PSEUDOVOIGTMETHOD = 'pseudo-voigt'
+PICKINGMETHODS = (GAUSSIANMETHOD, LORENTZIANMETHOD, PARABOLICMETHOD, PSEUDOVOIGTMETHOD)
 
 _DEBUG = False
 _DEBUGPLOT = False
 _MAXGROUPING = 5
+# the method for CPeak.fitPeaks of each fitMethod, the index into CPeak.lineshapes
+_FITMETHODS = {GAUSSIANMETHOD: 0, LORENTZIANMETHOD: 1, PSEUDOVOIGTMETHOD: 2}
+# the status of the peaks of each group returned by fitPeaksBatch
+_FITSTATUSMESSAGES = {1: 'fit did not converge or was singular',
+                      2: 'fitting region is empty or outside the data'}
 
 
 # these functions could probably go into a .lib somewhere
@@ -216,6 +222,8 @@ class PeakPickerNd(PeakPickerABC):
         self._hbsWidth = None
         self._hbfWidth = None
         self.findFunc = None
+        self._cPicker = None
+        self._cPickerSettings = None
 
     def findPeaks(self, data) -> list:
         """find the peaks in data (type numpy-array) and return as a list of SimplePeak instances
@@ -258,8 +266,8 @@ class PeakPickerNd(PeakPickerABC):
                     _plotParabolic(data, _logp, _makeParabola, regionArray, result)
             else:
                 result = ()
-                # currently gaussian or lorentzian
-                method = 0 if fitMethod == GAUSSIANMETHOD else 1
+                # gaussian, lorentzian or pseudo-voigt
+                method = _FITMETHODS.get(fitMethod, 1)
                 maxGroup = 1 if singularMode else _MAXGROUPING
                 getLogger().debug(f'{self.__class__.__name__}._fitPeaks: {method} {maxGroup}')
                 _errorMsgs = []
@@ -312,18 +320,31 @@ class PeakPickerNd(PeakPickerABC):
                     xmS, ymS = np.meshgrid(range(data.shape[1]), range(data.shape[0]))
                     ax.plot_wireframe(xmS, ymS, data)
 
-                # now iterate over all the new merged-regions, as group-peak-fits
-                for row, (lRegion, slc) in enumerate(arrays):
-                    peakArray = allPeaksArray[slc, :]
-                    try:
-                        localResult = CPeak.fitPeaks(data, lRegion, peakArray, method)
-                        result += tuple(localResult)
-                    except Exception as es:
+                # now fit all the new merged-regions, as group-peak-fits, in a single call
+                ndim = allPeaksArray.shape[1]
+                regionArrays = np.array([lRegion for lRegion, _ in arrays], dtype=np.int32).reshape((-1, 2, ndim))
+                peakCounts = np.array([len(slc) for _, slc in arrays], dtype=np.int32)
+                peakArrays = [allPeaksArray[slc, :] for _, slc in arrays]
+                fitArray = CPeak.fitPeaksBatch(data, regionArrays, np.concatenate(peakArrays).astype(np.float32),
+                                               peakCounts, method, numThreads=0)
+
+                fitStart = 0
+                for (lRegion, slc), peakArray in zip(arrays, peakArrays):
+                    fits = fitArray[fitStart:fitStart + len(slc)]
+                    fitStart += len(slc)
+                    # every peak of a group has the status of the group
+                    status = fits['status'][0]
+                    if status != 0:
                         # catch all errors as a single report - make sure results stay aligned
                         # by padding with Nones
-                        _errorMsgs.append(f'failed to fit peaks: {peakArray}\n{es}')
+                        _errorMsgs.append(f'failed to fit peaks: {peakArray}\n{_FITSTATUSMESSAGES.get(status)}')
                         result += tuple([None] * len(slc))
                     else:
+                        localResult = [(float(height), tuple(float(val) for val in position),
+                                        tuple(float(val) for val in linewidth))
+                                       for height, position, linewidth in zip(fits['height'], fits['position'],
+                                                                              fits['linewidth'])]
+                        result += tuple(localResult)
                         if _DEBUGPLOT:
                             # debugging - make plots of the centre-line of the picked-region
                             # (not actually very good unless in pick-and-assign module)
@@ -362,52 +383,43 @@ class PeakPickerNd(PeakPickerABC):
         excludedDiagonalTransformList = []
         nonAdj = 1 if self.checkAllAdjacent else 0
         minLinewidth = [0.0] * self.dimensionCount if not self.minimumLineWidth else self.minimumLineWidth
-        pointPeaks = CPeak.findPeaks(data, doNeg, doPos,
-                                     negLevel, posLevel, exclusionBuffer,
-                                     nonAdj,
-                                     self.dropFactor,
-                                     minLinewidth,
-                                     excludedRegionsList, excludedDiagonalDimsList, excludedDiagonalTransformList)
 
-        # get the peak maxima from pointPeaks
-        pointPeaks = [(np.array(position), height) for position, height in pointPeaks]
+        # the settings are checked once, then kept for as long as they are the same (e.g. when picking many planes)
+        settings = (doNeg, doPos, negLevel, posLevel, tuple(exclusionBuffer), nonAdj, self.dropFactor,
+                    tuple(minLinewidth))
+        if settings != self._cPickerSettings:
+            self._cPicker = CPeakPicker(doNeg, doPos,
+                                        negLevel, posLevel, exclusionBuffer,
+                                        nonAdj,
+                                        self.dropFactor,
+                                        minLinewidth,
+                                        excludedRegionsList, excludedDiagonalDimsList, excludedDiagonalTransformList)
+            self._cPickerSettings = settings
+        pointPeaks = self._cPicker.pick(data, numThreads=0, asArray=True)
 
         # ignore exclusion buffer for the minute
-        validPointPeaks = [pk for pk in pointPeaks]
-        allPeaksArray = None
-        allRegionArrays = []
-        regionArray = None
+        positions = pointPeaks['position'].reshape((-1, self.dimensionCount))
+        validPointPeaks = list(zip(positions, pointPeaks['height'].tolist()))
+        if not validPointPeaks:
+            return None, [], None, validPointPeaks
 
         # get the offset of the bottom left of the slice region
         startPoint = np.array([pp[0] for pp in self.sliceTuples])
         endPoint = np.array([pp[1] for pp in self.sliceTuples])
         numPointInt = (endPoint - startPoint) + 1
 
-        for position, height in validPointPeaks:
-
-            # get the region containing this point
-            bLeft = np.maximum(position - self._hbsWidth, 0)
-            tRight = np.minimum(position + self._hbsWidth + 1, numPointInt)
-            localRegionArray = np.array((bLeft, tRight), dtype=np.int32)
-
-            # get the larger regionArray size containing all points so far
-            # the actual picked region may be huge, only need the bounds containing the maxima
-            bLeftAll = np.maximum(position - self._hbsWidth - 1, 0)
-            tRightAll = np.minimum(position + self._hbsWidth + 1, numPointInt)
-            if regionArray is not None:
-                bLeftAll = np.array(np.minimum(bLeftAll, regionArray[0]), dtype=np.int32)
-                tRightAll = np.array(np.maximum(tRightAll, regionArray[1]), dtype=np.int32)
+        # get the region containing each point
+        bLeft = np.maximum(positions - self._hbsWidth, 0)
+        tRight = np.minimum(positions + self._hbsWidth + 1, numPointInt)
+        allRegionArrays = np.stack((bLeft, tRight), axis=1).astype(np.int32)
 
-            # numpy arrays need tweaking to pass to the c code
-            peakArray = position.reshape((1, self.dimensionCount))
-            peakArray = peakArray.astype(np.float32)
-            regionArray = np.array((bLeftAll, tRightAll), dtype=np.int32)
+        # get the larger regionArray size containing all the points
+        # the actual picked region may be huge, only need the bounds containing the maxima
+        bLeftAll = np.maximum(positions - self._hbsWidth - 1, 0)
+        regionArray = np.array((bLeftAll.min(axis=0), tRight.max(axis=0)), dtype=np.int32)
 
-            if allPeaksArray is None:
-                allPeaksArray = peakArray
-            else:
-                allPeaksArray = np.append(allPeaksArray, peakArray, axis=0)
-            allRegionArrays.append(localRegionArray)
+        # numpy arrays need tweaking to pass to the c code
+        allPeaksArray = positions.astype(np.float32)
 
         return allPeaksArray, allRegionArrays, regionArray, validPointPeaks
 
@@ -536,7 +548,7 @@ class PeakPickerNd(PeakPickerABC):
                         result = CPeak.fitParabolicPeaks(data, regionArray, peakArray)
 
                     else:
-                        method = 0 if self.fitMethod == GAUSSIANMETHOD else 1
+                        method = _FITMETHODS.get(self.fitMethod, 1)
 
                         # use the halfBoxFitWidth to give a close fit
                         firstArray = np.maximum(peakArray[0] - self._hbfWidth, regionArray[0])
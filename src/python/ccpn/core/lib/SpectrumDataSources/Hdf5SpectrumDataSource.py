@@ -497,6 +497,7 @@ class Hdf5SpectrumDataSource(SpectrumDataSourceABC):
 
         # copy the data into the dataset
         dataset[slices[::-1]] = data  # dataset and data are z,y,x ordered
+        self._dataChanged()
 
     def getSliceData(self, position: Sequence = None, sliceDim: int = 1) -> SliceData:
         """Get slice defined by sliceDim and position (all 1-based)
@@ -541,6 +542,7 @@ class Hdf5SpectrumDataSource(SpectrumDataSourceABC):
         dataset = self.spectrumData
         slices = self._getSlices(position=position, dims=(sliceDim,))
         dataset[slices[::-1]] = data  # data are z,y,x ordered
+        self._dataChanged()
 
     def getPointData(self, position: Sequence = None) -> float:
         """Get value defined by position (1-based)
@@ -580,6 +582,7 @@ class Hdf5SpectrumDataSource(SpectrumDataSourceABC):
         dataset = self.spectrumData
         slices = self._getSlices(position=position, dims=[])
         dataset[slices[::-1]] = value # data are z,y,x ordered
+        self._dataChanged()
 
     def getRegionData(self, sliceTuples, aliasingFlags=None):
         """Return an numpy array containing the points defined by
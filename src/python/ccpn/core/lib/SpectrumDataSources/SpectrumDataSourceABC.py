@@ -112,6 +112,7 @@ from collections import OrderedDict, defaultdict
 from itertools import product
 
 import tempfile
+import itertools
 import numpy
 import numpy as np
 
@@ -137,6 +138,9 @@ _BLOCK_CACHE = CCPNMR_PREFIX + 'block_cache'
 # _BLOCK_CACHE_MAXITEMS = 128
 MB = 1024 * 1024
 
+# shared by all the dataSources, so that a dataVersion is never used twice (unlike id(), once a dataSource is gone)
+_dataVersions = itertools.count(1)
+
 
 def getDataFormats() -> OrderedDict:
     """Get spectrum datasource formats
@@ -654,6 +658,7 @@ class SpectrumDataSourceABC(CcpNmrJson):
         self._bufferPath = None
 
         self.spectrum = None  # Spectrum instance
+        self._dataVersion = next(_dataVersions)  # see dataVersion
 
         self.setDefaultParameters()
 
@@ -687,6 +692,19 @@ class SpectrumDataSourceABC(CcpNmrJson):
             values = values[0:self.dimensionCount]
             self.setTraitValue(par, values)
 
+    @property
+    def dataVersion(self) -> int:
+        """A number that changes whenever the data may have; i.e. on creating the dataSource, setting
+        its path, opening it for writing and writing data.  No two dataSources share a dataVersion,
+        so it can key e.g. cached contours
+        """
+        return self._dataVersion
+
+    def _dataChanged(self):
+        """Give the data a new dataVersion
+        """
+        self._dataVersion = next(_dataVersions)
+
     @property
     def path(self) -> aPath:
         """Return an absolute path of datapath as a Path instance or None when dataFile is
@@ -722,6 +740,8 @@ class SpectrumDataSourceABC(CcpNmrJson):
 
         :return self or None on error
         """
+        self._dataChanged()
+
         if path is None:
             self.dataFile = None  # A reset essentially
             return self
@@ -1488,6 +1508,9 @@ class SpectrumDataSourceABC(CcpNmrJson):
         else:
             self.disableCache()  # No caching on writing; that creates sync issues
 
+        if newFile or '+' in mode:
+            self._dataChanged()
+
         # getLogger().debug('openFile: %s' % self)
 
         return self.fp
@@ -1698,6 +1721,7 @@ class SpectrumDataSourceABC(CcpNmrJson):
         if self.isBuffered:
             self._checkBuffer()
             self.hdf5buffer.setPlaneData(data=data, position=position, xDim=xDim, yDim=yDim)
+            self._dataChanged()
             return
         else:
             raise RuntimeError('setPlaneData: not buffered and no valid implementation')
@@ -1747,6 +1771,7 @@ class SpectrumDataSourceABC(CcpNmrJson):
         if self.isBuffered:
             self._checkBuffer()
             self.hdf5buffer.setSliceData(data=data, position=position, sliceDim=sliceDim)
+            self._dataChanged()
         else:
             raise RuntimeError('setSliceData, not buffered and no valid implementation')
 
@@ -1801,7 +1826,9 @@ class SpectrumDataSourceABC(CcpNmrJson):
         """
         if self.isBuffered:
             self._checkBuffer()
-            return self.hdf5buffer.setPointData(value=value, position=position)
+            result = self.hdf5buffer.setPointData(value=value, position=position)
+            self._dataChanged()
+            return result
         else:
             raise RuntimeError('setPointData: not buffered or no valid implementation')
 
@@ -27,6 +27,10 @@ __date__ = "$Date: 2017-04-07 10:28:41 +0000 (Fri, April 07, 2017) $"
 # Start of code
 #=========================================================================================
 
+import unittest
+from types import SimpleNamespace
+from unittest import mock
+import numpy as np
 from ccpn.core.testing.WrapperTesting import WrapperTesting
 
 
@@ -147,3 +151,41 @@ class PeakListTest2(WrapperTesting):
 
         for tag in self.singleValueTags:
             self.assertEqual((tag, getattr(peakList, tag)), (tag, getattr(peakList2, tag)))
+
+
+class PickPeaksRegionLevelsTest(unittest.TestCase):
+    """Check that every region is picked with the same signs and levels.
+    """
+
+    class _Picker:
+        calls = []
+
+        def __init__(self, doNeg, doPos, negLevel, posLevel, *args):
+            self.calls.append((doNeg, doPos, negLevel, posLevel))
+
+        def pick(self, dataArray):
+            return []
+
+    def _region(self, start):
+        start = np.array(start, dtype=np.int32)
+        end = start + 8
+        return (np.zeros((8, 8), dtype=np.float32), None,
+                start, end, start, end, start, np.array((8, 8), dtype=np.int32),
+                start, end)
+
+    def test_levels_kept_across_regions(self):
+        from ccpn.core.lib.PeakListLib import _pickPeaksRegion
+
+        spectrum = SimpleNamespace(_apiDataSource=SimpleNamespace(numDim=2),
+                                   positiveContourBase=10.0, negativeContourBase=-10.0,
+                                   getRegion=lambda **kwds: [self._region((0, 0)), self._region((8, 0))])
+        peakList = SimpleNamespace(spectrum=spectrum, peaks=[])
+
+        self._Picker.calls = []
+        with mock.patch('ccpn.c_replacement.peak_compat.PeakPicker', self._Picker):
+            # exclusions give a picker for each region
+            peaks = _pickPeaksRegion(peakList, doPos=True, doNeg=False,
+                                     excludedRegions=[[[100, 100], [101, 101]]])
+
+        self.assertEqual(peaks, [])
+        self.assertEqual(self._Picker.calls, [(False, True, 0.0, 10.0)] * 2)
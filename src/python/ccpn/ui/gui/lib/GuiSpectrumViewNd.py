@@ -27,6 +27,7 @@ __date__ = "$Date: 2017-04-07 10:28:41 +0000 (Fri, April 07, 2017) $"
 # Start of code
 #=========================================================================================
 
+import os
 import numpy as np
 from itertools import product
 from collections import namedtuple
@@ -37,11 +38,15 @@ from ccpn.util import Colour
 from ccpn.util.Logging import getLogger
 from ccpn.core.Spectrum import MAXALIASINGRANGE
 from ccpn.core.lib.ContextManagers import notificationEchoBlocking
-from ccpn.c_replacement.contour_compat import Contourer2d
+from ccpn.c_replacement.contour_cache import getContourCache
+from ccpn.c_replacement.contour_tiles import TiledContourer, decimationForViewport
 
 
 AxisPlaneData = namedtuple('AxisPlaneData', 'startPoint endPoint pointCount')
 
+# single planes of at least this many points are contoured in tiles at a resolution to suit the screen
+TILED_CONTOUR_POINTS = 4096 * 4096
+
 
 def _getLevels(count: int, base: float, factor: float) -> list:
     """return a list with contour levels"""
@@ -89,6 +94,34 @@ class GuiSpectrumViewNd(GuiSpectrumView):
         self.buildContours = True
         self.buildContoursOnly = False
 
+        # the decimation of the last tiled contours, None if the plane was too small to tile
+        self._tiledContourer = TiledContourer()
+        self._contourDecimation = None
+        self._pixelSize = None
+        self.strip.pixelSizeChanged.connect(self._updatePixelSize)
+
+    def _updatePixelSize(self, strip, value: tuple):
+        """Update the pixel size from the strip signal, rebuilding tiled contours if the zoom
+        needs a different decimation.
+        """
+        self._pixelSize = value
+
+        if self._contourDecimation is not None and self._tiledDecimation() != self._contourDecimation:
+            self.buildContours = True
+
+    def _tiledDecimation(self):
+        """Return the decimation for tiled contours, about one point for each pixel of the strip
+        """
+        if not self._pixelSize:
+            return 1
+
+        xDim, yDim = self.dimensionIndices[:2]
+        ppmPerPoints = self.spectrum.ppmPerPoints
+        pointsPerPixel = [abs(pixel / ppmPerPoints[dim]) if ppmPerPoints[dim] else 1.0
+                          for pixel, dim in zip(self._pixelSize, (xDim, yDim))]
+
+        return decimationForViewport((0.0, pointsPerPixel[0], 0.0, pointsPerPixel[1]), (1, 1))
+
     def _turnOnPhasing(self):
         """
         # CCPN INTERNAL - called by turnOnPhasing method of GuiStrip.
@@ -241,10 +274,12 @@ class GuiSpectrumViewNd(GuiSpectrumView):
         try:
             if True:  # numDims < 3 or self._application.preferences.general.generateSinglePlaneContours:
                 dataArrays = tuple()
+                planeKeys = tuple()
 
                 for position, dataArray in self._getPlaneData():
                     # overlay all the planes into a single plane
                     dataArrays += (dataArray,)
+                    planeKeys += (self._planeKey(position),)
                     # break
 
                 # moved to C Code
@@ -254,13 +289,30 @@ class GuiSpectrumViewNd(GuiSpectrumView):
                 #         sum = np.max(sum, dataArrays[ii].clip(0.0, 1e16)) + np.min(sum, dataArrays[ii].clip(-1e16, 0.0))
                 #     dataArrays = (sum,)
 
-                # build the contours
-                contourList = Contourer2d.contourerGLList(dataArrays,
-                                                          posLevelsArray,
-                                                          negLevelsArray,
-                                                          np.array(_posColours, dtype=np.float32),
-                                                          np.array(_negColours, dtype=np.float32),
-                                                          not self._application.preferences.general.generateSinglePlaneContours)
+                self._contourDecimation = None
+                if len(dataArrays) == 1 and dataArrays[0].size >= TILED_CONTOUR_POINTS and \
+                        self._tiledContourer.isAvailable():
+                    self._contourDecimation = self._tiledDecimation()
+
+                if self._contourDecimation and self._contourDecimation > 1:
+                    # zoomed out on a large plane, contour the tiles of the decimated plane
+                    contourList = self._tiledContourer.contourerGLList(dataArrays[0],
+                                                                       posLevelsArray,
+                                                                       negLevelsArray,
+                                                                       np.array(_posColours, dtype=np.float32),
+                                                                       np.array(_negColours, dtype=np.float32),
+                                                                       decimation=self._contourDecimation,
+                                                                       numThreads=self._contourThreads(),
+                                                                       planeKey=planeKeys[0])
+                else:
+                    # build the contours, only the levels/planes not in the cache
+                    contourList = getContourCache().contourerGLList(dataArrays,
+                                                                    posLevelsArray,
+                                                                    negLevelsArray,
+                                                                    np.array(_posColours, dtype=np.float32),
+                                                                    np.array(_negColours, dtype=np.float32),
+                                                                    not self._application.preferences.general.generateSinglePlaneContours,
+                                                                    numThreads=self._contourThreads(), fingerprints=planeKeys)
 
         except Exception as es:
             getLogger().warning(f'Contouring error: {es}')
@@ -309,6 +361,24 @@ class GuiSpectrumViewNd(GuiSpectrumView):
 
         return colours
 
+    def _planeKey(self, position):
+        """Return the key of the plane at position for the contour cache, changing whenever its data can
+        (a new or reloaded data source, a write to it or a new scale), so that the plane need not be hashed
+        """
+        spectrum = self.spectrum
+        xDim, yDim = self.dimensionIndices[:2]
+        dataVersion = spectrum.dataSource.dataVersion if spectrum.dataSource is not None else None
+
+        return (spectrum.pid, dataVersion, spectrum.scale, xDim, yDim, tuple(position))
+
+    def _contourThreads(self):
+        """Return the number of threads to contour on, from the contourThreads preference,
+        all the cpus but one (left for the GUI) if not set
+        """
+        numThreads = self._application.preferences.general.contourThreads
+
+        return numThreads if numThreads > 0 else max(1, (os.cpu_count() or 1) - 1)
+
     def _getPlaneData(self):
 
         spectrum = self.spectrum
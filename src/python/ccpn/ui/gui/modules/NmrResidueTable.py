@@ -374,9 +374,16 @@ class _NewNmrResidueTableWidget(_CoreTableWidgetABC):
                 markNmrAtoms(self.mainWindow, currentNmrResidue.nmrAtoms)
 
     def buildTableDataFrame(self):
-        # create a simple speed-cache for the current nmrResidue indexing
+        # create a simple speed-cache for the current nmrResidue indexing, all the column in one call
         self._caching = True
         self._objCache = None
+        try:
+            from ccpn.c_replacement.clibrary_compat import getNmrResidueIndices
+
+            nmrResidues = self._sourceObjects
+            self._objCache = {id(nmrRes): int(index) for nmrRes, index in zip(nmrResidues, getNmrResidueIndices(nmrResidues))}
+        except Exception as es:
+            getLogger().debug2(f'Error creating nmrResidue indices {es}')
 
         result = super().buildTableDataFrame()
 
@@ -430,15 +437,15 @@ class _NewNmrResidueTableWidget(_CoreTableWidgetABC):
         try:
             if getattr(self, '_caching', False):
                 if self._objCache is None:
-                    self._objCache = [id(pp) for pp in nmrRes.nmrChain.nmrResidues]
-                return self._objCache.index(id(nmrRes))
+                    self._objCache = {id(pp): ii for ii, pp in enumerate(nmrRes.nmrChain.nmrResidues)}
+                index = self._objCache[id(nmrRes)]
+                return index if index >= 0 else None
 
             else:
-                from ccpnc.clibrary import Clibrary
-
-                _getNmrIndex = Clibrary.getNmrResidueIndex
+                # the indices of the whole nmrChain are cached until the nmrResidues change
+                from ccpn.c_replacement.clibrary_compat import getNmrResidueIndex
 
-                return _getNmrIndex(nmrRes)
+                return getNmrResidueIndex(nmrRes)
                 # return nmrRes.nmrChain.nmrResidues.index(nmrRes)  # ED: THIS IS VERY SLOW
         except Exception:
             return None
@@ -27,13 +27,13 @@ __date__ = "$Date: 2017-03-30 11:28:58 +0100 (Thu, March 30, 2017) $"
 # Start of code
 #=========================================================================================
 
-# import os
+import os
 from collections import OrderedDict
 import pandas as pd
 from PyQt5 import QtWidgets, QtCore, QtGui
 from functools import partial
 from copy import deepcopy
-from ccpn.core.PeakList import GAUSSIANMETHOD, PARABOLICMETHOD, LORENTZIANMETHOD
+from ccpn.core.PeakList import GAUSSIANMETHOD, PARABOLICMETHOD, LORENTZIANMETHOD, PSEUDOVOIGTMETHOD
 from ccpn.core.MultipletList import MULTIPLETAVERAGINGTYPES
 from ccpn.core.lib.DataStore import DataStore
 from ccpn.core.lib.ContextManagers import queueStateChange, undoStackBlocking
@@ -80,7 +80,7 @@ from ccpn.framework.lib.pipeline.PipesLoader import _fetchUserPipesPath
 from ccpn.framework.Preferences import getPreferences
 
 
-PEAKFITTINGDEFAULTS = [PARABOLICMETHOD, GAUSSIANMETHOD, LORENTZIANMETHOD]
+PEAKFITTINGDEFAULTS = [PARABOLICMETHOD, GAUSSIANMETHOD, LORENTZIANMETHOD, PSEUDOVOIGTMETHOD]
 
 # FIXME separate pure GUI to project/preferences properties
 # The code sets Gui Parameters assuming that  Preference is not None and has a bunch of attributes.
@@ -1221,6 +1221,7 @@ class PreferencesPopup(CcpnDialogMainWidget):
         # self.aliasShadeData.setEnabled(_enabled)
 
         self.contourThicknessData.setValue(int(self.preferences.general.contourThickness))
+        self.contourThreadsData.setValue(int(self.preferences.general.contourThreads))
         # change from description to dataValue for pulldown
         desc = Theme.getByDataValue(self.preferences.general.colourScheme).description
         self.colourSchemeBox.setCurrentIndex(self.colourSchemeBox.findText(desc))
@@ -1572,6 +1573,13 @@ class PreferencesPopup(CcpnDialogMainWidget):
         self.contourThicknessData.setMinimumWidth(LineEditsMinimumWidth)
         self.contourThicknessData.valueChanged.connect(self._queueSetContourThickness)
 
+        row += 1
+        self.contourThreadsLabel = _makeLabel(parent, text="Contour threads (0 = all cpus but one)", grid=(row, 0))
+        self.contourThreadsData = Spinbox(parent, step=1,
+                                          min=0, max=os.cpu_count() or 1, grid=(row, 1), hAlign='l')
+        self.contourThreadsData.setMinimumWidth(LineEditsMinimumWidth)
+        self.contourThreadsData.valueChanged.connect(self._queueSetContourThreads)
+
         row += 1
         self.colourSchemeLabel = _makeLabel(parent, text="Spectrum display style", grid=(row, 0))
         self.colourSchemeBox = PulldownList(parent, grid=(row, 1), hAlign='l')
@@ -2470,6 +2478,17 @@ class PreferencesPopup(CcpnDialogMainWidget):
         """
         self.preferences.general.contourThickness = value
 
+    @queueStateChange(_verifyPopupApply)
+    def _queueSetContourThreads(self, _value):
+        value = self.contourThreadsData.get()
+        if value != self.preferences.general.contourThreads:
+            return partial(self._setContourThreads, value)
+
+    def _setContourThreads(self, value):
+        """Set the number of threads to contour on, 0 for all the cpus but one
+        """
+        self.preferences.general.contourThreads = value
+
     @queueStateChange(_verifyPopupApply)
     def _queueSetAliasShade(self, _value):
         value = int(self.aliasShadeData.get())